@@ -47,6 +47,11 @@ int main(int argc, const char *argv[]) {
         ("d, hd-image", "Path to hard disk drive image", cxxopts::value<std::string>(), "image_path")
         ("g, xgd-image", "Path to Xbox Game Disc image", cxxopts::value<std::string>(), "image_path")
         ("r, revision", "XBOX revision (retail | debug)", cxxopts::value<std::string>(), "xbox_rev")
+        ("l, log", "Log levels, optionally per category (e.g. warning,nv2a=spew,ata=debug)", cxxopts::value<std::string>(), "levels")
+        ("unthrottled", "Run timed events such as vertical blanks as fast as the guest waits for them")
+        ("video-export", "Export of scanned out frames (none | null | shm | ppm | y4m); shm is Linux only", cxxopts::value<std::string>(), "type")
+        ("video-export-path", "PPM file name prefix or Y4M file path", cxxopts::value<std::string>(), "path")
+        ("video-export-interval", "Export one out of every N frames", cxxopts::value<uint32_t>(), "N")
         ("h, help", "Shows this message");
 
     auto args = options.parse(argc, argv);
@@ -58,6 +63,11 @@ int main(int argc, const char *argv[]) {
     }
 
     // Parse arguments
+    if (args.count("log") && !log_configure(args["log"].as<std::string>().c_str())) {
+        printf("Invalid log levels: %s\n", args["log"].as<std::string>().c_str());
+        return 1;
+    }
+
     const char *mcpx_path = args["mcpx"].as<std::string>().c_str();
     const char *bios_path = args["bios"].as<std::string>().c_str();
     const char *revision = args["revision"].as<std::string>().c_str();
@@ -76,6 +86,15 @@ int main(int argc, const char *argv[]) {
         vdvd_path = args["xgd-image"].as<std::string>().c_str();
     }
 
+    std::string videoExport = "none";
+    if (args.count("video-export")) {
+        videoExport = args["video-export"].as<std::string>();
+    }
+    std::string videoExportPath;
+    if (args.count("video-export-path")) {
+        videoExportPath = args["video-export-path"].as<std::string>();
+    }
+
     // Pick the first hypervisor platform that is available and properly initialized on this system.
     printf("Loading virtualization platforms... ");
 
@@ -151,6 +170,40 @@ int main(int argc, const char *argv[]) {
         settings.vdvd_parameters.image.preserveImage = true;
     }
 
+    settings.emu_unthrottled = args.count("unthrottled") > 0;
+
+    if (videoExport == "none") {
+        settings.video_exportType = VEX_None;
+    }
+    else if (videoExport == "null") {
+        settings.video_exportType = VEX_Null;
+    }
+    else if (videoExport == "shm") {
+#ifdef _WIN32
+        printf("Shared memory video export is only supported on Linux.\n");
+        return 1;
+#else
+        settings.video_exportType = VEX_SharedMemory;
+#endif
+    }
+    else if (videoExport == "ppm") {
+        settings.video_exportType = VEX_PPM;
+    }
+    else if (videoExport == "y4m") {
+        settings.video_exportType = VEX_Y4M;
+    }
+    else {
+        printf("Invalid video export type specified.\n");
+        std::cout << options.help();
+        return 1;
+    }
+    if (!videoExportPath.empty()) {
+        settings.video_exportPath = videoExportPath.c_str();
+    }
+    if (args.count("video-export-interval")) {
+        settings.video_exportInterval = args["video-export-interval"].as<uint32_t>();
+    }
+
     EmulatorStatus status = xbox->Run();
     if (status == EMUS_OK) {
         log_info("Emulator exited successfully\n");
@@ -172,6 +225,7 @@ int main(int argc, const char *argv[]) {
         case EMUS_INIT_HARD_DRIVE_INIT_FAILED: log_fatal("Failed to initialize virtual hard drive"); break;
         case EMUS_INIT_INVALID_DVD_DRIVE_TYPE: log_fatal("Invalid virtual DVD drive type specified"); break;
         case EMUS_INIT_DVD_DRIVE_INIT_FAILED: log_fatal("Failed to initialize virtual DVD drive"); break;
+        case EMUS_INIT_VIDEO_EXPORT_FAILED: log_fatal("Failed to initialize frame export"); break;
         case EMUS_INIT_DEBUGGER_FAILED: log_fatal("Debugger initialization failed"); break;
         default: log_fatal("Unspecified error\n"); break;
         }
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace strikebox {
+
+/*!
+ * Guest physical RAM with per-page dirty tracking.
+ *
+ * Owns the host mapping that backs guest RAM and records which 4 KiB pages
+ * were written. Writes come from two sources:
+ *  - the guest CPU, tracked automatically where the host supports it (Linux
+ *    6.7+ asynchronous userfaultfd write-protection read with PAGEMAP_SCAN,
+ *    which also observes writes made through the hypervisor's view of the
+ *    mapping);
+ *  - device DMA, marked explicitly by the devices with MarkDirty.
+ *
+ * Consumers subscribe to obtain an independent view of the dirty pages. Each
+ * view accumulates writes until its owner collects them, at which point the
+ * view is cleared. Marking is lock-free and may be done from any thread.
+ *
+ * CPU writes are gathered into every view at once by Synchronize, since
+ * reading the host's record of them is costly and clears it.
+ */
+class GuestMemory {
+public:
+    static const uint32_t kPageShift = 12;
+    static const uint32_t kPageSize = 1 << kPageShift;
+    static const uint32_t kMaxSubscribers = 16;
+
+    GuestMemory() = default;
+    ~GuestMemory();
+
+    GuestMemory(const GuestMemory&) = delete;
+    GuestMemory& operator=(const GuestMemory&) = delete;
+
+    /*!
+     * Allocates size bytes of zeroed RAM and starts tracking writes.
+     * Returns false if the memory could not be allocated.
+     */
+    bool Allocate(uint32_t size);
+
+    uint8_t *Data() const { return m_data; }
+    uint32_t Size() const { return m_size; }
+    uint32_t PageCount() const { return m_pageCount; }
+
+    /*!
+     * Determines if writes made by the guest CPU are tracked. If not, views
+     * only report pages marked explicitly by devices.
+     */
+    bool TracksCPUWrites() const { return m_tracker != nullptr; }
+
+    /*!
+     * Marks the pages overlapping the given range as written. Must be called
+     * after the data is written.
+     *
+     * The subscriber making the write may pass its own view as writerView to
+     * leave it out, since it already knows about the write.
+     */
+    void MarkDirty(uint32_t address, uint32_t size, int writerView = -1);
+
+    /*!
+     * Creates a new view of dirty pages in which every page starts dirty.
+     * Returns the view ID, or -1 if there are no free views.
+     */
+    int Subscribe();
+
+    /*!
+     * Releases a view created by Subscribe.
+     */
+    void Unsubscribe(int view);
+
+    /*!
+     * Adds the pages written by the guest CPU since the last synchronization
+     * to every view. Should be called once per synchronization point, before
+     * the views are collected.
+     *
+     * The host reports and clears its record of each page atomically, so the
+     * guest may keep running: a concurrent write is either included now or
+     * reported by the next call.
+     */
+    void Synchronize();
+
+    /*!
+     * Stores in bitmap the pages written since the view was last collected,
+     * one bit per page, and clears the view. CPU writes are only included up
+     * to the last call to Synchronize.
+     */
+    void CollectDirty(int view, std::vector<uint64_t>& bitmap);
+
+    /*!
+     * Determines if any page overlapping the given range is set in a bitmap
+     * filled by CollectDirty.
+     */
+    static bool AnyPageDirty(const std::vector<uint64_t>& bitmap, uint32_t address, uint32_t size);
+
+private:
+    uint8_t *m_data = nullptr;
+    uint32_t m_size = 0;
+    uint32_t m_pageCount = 0;
+    uint32_t m_bitmapWords = 0;
+
+    // ----- Views ------------------------------------------------------------
+
+    std::unique_ptr<std::atomic<uint64_t>[]> m_views[kMaxSubscribers];
+    std::atomic<uint32_t> m_activeViews{ 0 };   // Bit N set if view N is subscribed
+    std::mutex m_viewMutex;                     // Serializes subscription and collection
+    std::vector<uint64_t> m_scanned;
+
+    // ----- Platform-specific ------------------------------------------------
+
+    // Host state used to track CPU writes; null if unsupported
+    struct WriteTracker;
+    WriteTracker *m_tracker = nullptr;
+
+    static uint8_t *AllocatePages(uint32_t size);
+    static void FreePages(uint8_t *data, uint32_t size);
+
+    WriteTracker *CreateWriteTracker();
+    void DestroyWriteTracker();
+
+    // Sets the bits of the pages written by the CPU since the last scan and
+    // atomically clears the host's record of them
+    void ScanCPUWrites(std::vector<uint64_t>& bitmap);
+};
+
+}
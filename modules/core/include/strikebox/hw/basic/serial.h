@@ -3,6 +3,7 @@
 #include <cstdint>
 
 #include "strikebox/io.h"
+#include "strikebox/virtual_clock.h"
 #include "strikebox/util/fifo.h"
 #include "strikebox/util/invoke_later.h"
 #include "char.h"
@@ -22,7 +23,7 @@ namespace strikebox {
 
 class Serial : public IODevice {
 public:
-    Serial(IRQHandler& irqHandler, uint32_t ioBase);
+    Serial(IRQHandler& irqHandler, VirtualClock& clock, uint32_t ioBase);
     virtual ~Serial();
 
     bool Init(CharDriver *chr);
@@ -62,6 +63,7 @@ private:
     static void FifoTimeoutInterruptCB(void *userData);
 
     IRQHandler& m_irqHandler;
+    VirtualClock& m_clock;
     uint32_t m_ioBase;
 
     uint16_t m_divider = 0;
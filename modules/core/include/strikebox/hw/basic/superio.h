@@ -42,7 +42,7 @@ namespace strikebox {
 
 class SuperIO : public IODevice {
 public:
-    SuperIO(IRQHandler& irqHandler, CharDriver *chrs[SUPERIO_SERIAL_PORT_COUNT]);
+    SuperIO(IRQHandler& irqHandler, VirtualClock& clock, CharDriver *chrs[SUPERIO_SERIAL_PORT_COUNT]);
     virtual ~SuperIO();
 
     void Init();
@@ -23,13 +23,16 @@ public:
     bool IORead(uint32_t port, uint32_t *value, uint8_t size) override;
     bool IOWrite(uint32_t port, uint32_t value, uint8_t size) override;
 
-    bool MMIORead(uint32_t addr, uint32_t *value, uint8_t size) override;
-    bool MMIOWrite(uint32_t addr, uint32_t value, uint8_t size) override;
-
     void Reset();
 
     void ConfigureIRQs(IRQMapper *irqMapper, uint8_t numIRQs);
 
+    /*!
+     * Refreshes the I/O and MMIO mappings of the device's BARs.
+     * Must be invoked whenever a BAR is registered or relocated.
+     */
+    void UpdateMappings(PCIDevice *dev);
+
     inline uint8_t MapIRQ(PCIDevice *dev, uint8_t irqNum) { return m_irqMapper->MapIRQ(dev, irqNum); }
     inline bool CanSetIRQ() { return m_irqMapper->CanSetIRQ(); }
     inline void SetIRQ(uint8_t irqNum, int level) { return m_irqMapper->SetIRQ(irqNum, level); }
@@ -41,6 +44,7 @@ private:
     PCIDevice *m_owner; // The bridge that owns this bus
     std::map<uint32_t, PCIDevice*> m_Devices;
     PCIConfigAddressRegister m_configAddressRegister;
+    IOMapper *m_ioMapper;
 
     uint8_t m_numIRQs;
     uint32_t *m_irqCount;
@@ -17,6 +17,15 @@ namespace strikebox::nv2a {
 // [https://envytools.readthedocs.io/en/latest/hw/fifo/intro.html#introduction]
 enum class FIFOEngine : uint8_t { Software, PGRAPH };
 
+// --- MMIO register space ---------
+
+// Size of the MMIO register space mapped by BAR0
+const uint32_t kMMIOSize = 0x1000000;
+
+// Engines are looked up by 4 KiB page of the MMIO register space
+const uint32_t kEnginePageShift = 12;
+const uint32_t kEnginePageCount = kMMIOSize >> kEnginePageShift;
+
 // --- RAMHT -----------------------
 
 union RAMHT {
@@ -51,4 +51,19 @@ protected:
     const uint32_t m_offsetEnd;  // m_offset + m_length, precomputed for speed
 };
 
+// Sentinel engine that handles accesses to unmapped regions of the MMIO
+// register space. Covers the entire space so that addresses are passed
+// through unmodified.
+class UnmappedEngine : public NV2AEngine {
+public:
+    UnmappedEngine(NV2A& nv2a) : NV2AEngine("Unmapped", 0x000000, kMMIOSize, nv2a) {}
+
+    void Reset() override {}
+    uint32_t Read(const uint32_t addr) override;
+    void Write(const uint32_t addr, const uint32_t value) override;
+
+    uint32_t ReadUnaligned(const uint32_t addr, const uint8_t size) override;
+    void WriteUnaligned(const uint32_t addr, const uint32_t value, const uint8_t size) override;
+};
+
 }
@@ -9,10 +9,24 @@
 // brackets optionally followed by a quote from the documentation.
 //
 // PCRTC engine registers occupy the range 0x600000..0x600FFF.
+//
+// At every vertical blank the CRTC hands the frame it just displayed to the
+// scan-out, lets the video overlay switch buffers and raises the vertical
+// blank interrupt.
+//
+// Vertical blanks are events of the system scheduler, spaced by the frame
+// period of the programmed video timing: the pixel clock of the VPLL divided
+// by the total pixels per line and lines per frame. Reading the raster
+// position or polling for a vertical blank tells the scheduler that the guest
+// is waiting, which fast-forwards time in unthrottled mode.
 #pragma once
 
 #include "../engine.h"
 
+#include "strikebox/scheduler.h"
+
+#include <atomic>
+
 namespace strikebox::nv2a {
 
 // PCRTC registers
@@ -20,6 +34,20 @@ namespace strikebox::nv2a {
 const uint32_t Reg_PCRTC_INTR = 0x100;                // [RW] Interrupt status
 const uint32_t Reg_PCRTC_INTR_ENABLE = 0x140;         // [RW] Interrupt enable
 /**/const uint32_t Val_PCRTC_INTR_VBLANK = (1 << 0);  //  bit  0: Vertical blank
+const uint32_t Reg_PCRTC_START = 0x800;               // [RW] Framebuffer start address
+/**/const uint32_t Mask_PCRTC_START = 0x07fffffc;     //  bits 26..2: Address
+const uint32_t Reg_PCRTC_RASTER = 0x808;              // [R-] Raster position
+/**/const uint32_t Mask_PCRTC_RASTER_POSITION = 0x7ff; //  bits 10..0: Current line
+/**/const uint32_t Val_PCRTC_RASTER_VBLANK = (1 << 16); //  bit 16: Vertical blank in progress
+
+// Video timing used until a valid mode is programmed: 525 lines at 60 Hz
+const uint64_t kDefaultFramePeriod = 16666667;
+const uint32_t kDefaultTotalLines = 525;
+const uint32_t kDefaultDisplayLines = 480;
+
+// Programmed timings outside of the 20..240 Hz range are ignored
+const uint64_t kMinFramePeriod = 4166667;
+const uint64_t kMaxFramePeriod = 50000000;
 
 // ----------------------------------------------------------------------------
 
@@ -36,11 +64,35 @@ public:
 
     bool GetInterruptState() { return m_interruptLevels & m_enabledInterrupts; }
 
+    // Scans out the displayed frame and raises the vertical blank interrupt
+    void VerticalBlank();
+
+    uint32_t GetStart() const { return m_start; }
+
+    // Duration of a frame in nanoseconds of virtual time
+    uint64_t GetFramePeriod() const { return m_framePeriod; }
+
 private:
-    bool m_enabled = false;
+    std::atomic<bool> m_enabled{ false };
+
+    // Vertical blanks are signaled outside of the CPU thread
+    std::atomic<uint32_t> m_interruptLevels;
+    std::atomic<uint32_t> m_enabledInterrupts;
+
+    std::atomic<uint32_t> m_start;
+
+    // Video timing; frames are timed on the scheduler's virtual clock
+    Scheduler::EventID m_vblankEvent = Scheduler::kInvalidEvent;
+    std::atomic<uint64_t> m_frameStart{ 0 };    // Time of the last vertical blank
+    std::atomic<uint64_t> m_nextVerticalBlank{ 0 };
+    std::atomic<uint64_t> m_framePeriod{ kDefaultFramePeriod };
+    std::atomic<uint32_t> m_totalLines{ kDefaultTotalLines };
+    std::atomic<uint32_t> m_displayLines{ kDefaultDisplayLines };
 
-    uint32_t m_interruptLevels;
-    uint32_t m_enabledInterrupts;
+    void UpdateFrameTiming();
+    void ScheduleVerticalBlank(uint64_t time);
+    void OnVerticalBlank();
+    uint32_t ReadRaster();
 };
 
 }
@@ -19,6 +19,10 @@
 
 #include "../engine.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 
 namespace strikebox::nv2a {
@@ -257,6 +261,169 @@ static_assert(sizeof(FIFOCommand) == sizeof(uint32_t[2]));
 
 // ----------------------------------------------------------------------------
 
+// A run of method data words decoded from a pushbuffer by the DMA pusher.
+// The data points directly into the pushbuffer.
+struct PFIFOMethodRun {
+    uint32_t subchannel;
+    uint32_t method;
+    MethodType type;
+    uint32_t count;
+    const uint32_t* data;
+};
+
+// ----------------------------------------------------------------------------
+
+// CACHE1 command queue between the DMA pusher and the puller.
+//
+// This is a single-producer, single-consumer ring buffer: the pusher fills
+// slots and publishes them by advancing PUT, the puller consumes them and
+// releases them by advancing GET. The indices count commands and wrap around
+// naturally; the slot of a command is its index modulo the ring size. This
+// allows the ring to hold a full kPFIFO_CommandBufferSize commands and makes
+// the empty and full states unambiguous.
+//
+// The register views of the ring (CACHE1_PUT, CACHE1_GET and the marks in
+// CACHE1_STATUS) are derived from the indices.
+class PFIFOCommandCache {
+public:
+    static const uint32_t kSize = kPFIFO_CommandBufferSize;
+    static_assert((kSize & (kSize - 1)) == 0, "command cache size must be a power of two");
+
+    void Reset() {
+        m_put.store(0, std::memory_order_relaxed);
+        m_get.store(0, std::memory_order_relaxed);
+        std::fill(std::begin(m_commands), std::end(m_commands), FIFOCommand{ 0 });
+    }
+
+    // ----- Producer ---------------------------------------------------------
+
+    // Number of slots that can be filled
+    uint32_t FreeSpace() const {
+        return kSize - (m_put.load(std::memory_order_relaxed) - m_get.load(std::memory_order_acquire));
+    }
+
+    // Slot at the specified offset from PUT
+    FIFOCommand& PutSlot(uint32_t offset) {
+        return m_commands[(m_put.load(std::memory_order_relaxed) + offset) & (kSize - 1)];
+    }
+
+    // Hands over the specified number of slots to the consumer
+    void Publish(uint32_t count) {
+        m_put.store(m_put.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    // ----- Consumer ---------------------------------------------------------
+
+    // Number of slots that can be consumed
+    uint32_t Available() const {
+        return m_put.load(std::memory_order_acquire) - m_get.load(std::memory_order_relaxed);
+    }
+
+    // Slot at the specified offset from GET
+    const FIFOCommand& GetSlot(uint32_t offset) const {
+        return m_commands[(m_get.load(std::memory_order_relaxed) + offset) & (kSize - 1)];
+    }
+
+    // Hands back the specified number of slots to the producer
+    void Release(uint32_t count) {
+        m_get.store(m_get.load(std::memory_order_relaxed) + count, std::memory_order_release);
+    }
+
+    // ----- Register views ---------------------------------------------------
+
+    bool IsEmpty() const { return m_put.load(std::memory_order_acquire) == m_get.load(std::memory_order_acquire); }
+    bool IsFull() const { return m_put.load(std::memory_order_acquire) - m_get.load(std::memory_order_acquire) == kSize; }
+
+    uint32_t GetPutAddress() const { return (m_put.load(std::memory_order_acquire) & (kSize - 1)) << 2; }
+    uint32_t GetGetAddress() const { return (m_get.load(std::memory_order_acquire) & (kSize - 1)) << 2; }
+
+    // These are only meant to be used while the pusher and the puller are
+    // stopped, for instance when the driver restores a channel's state.
+    void SetPutAddress(uint32_t address) {
+        uint32_t get = m_get.load(std::memory_order_relaxed);
+        m_put.store(get + (((address >> 2) - get) & (kSize - 1)), std::memory_order_release);
+    }
+
+    void SetGetAddress(uint32_t address) {
+        uint32_t put = m_put.load(std::memory_order_relaxed);
+        m_get.store(put - ((put - (address >> 2)) & (kSize - 1)), std::memory_order_release);
+    }
+
+    // Applies the low (empty) and high (full) marks written to CACHE1_STATUS.
+    // The marks only matter when PUT and GET point to the same slot.
+    void SetMarks(bool empty, bool full) {
+        uint32_t put = m_put.load(std::memory_order_relaxed);
+        uint32_t get = m_get.load(std::memory_order_relaxed);
+        if (((put - get) & (kSize - 1)) != 0) {
+            return;
+        }
+        if (full) {
+            m_put.store(get + kSize, std::memory_order_release);
+        }
+        else if (empty) {
+            m_put.store(get, std::memory_order_release);
+        }
+    }
+
+    // Direct access to the slots through the CACHE1_METHOD/DATA registers
+    FIFOCommand& operator[](size_t index) { return m_commands[index]; }
+
+private:
+    alignas(64) std::atomic<uint32_t> m_put{ 0 };
+    alignas(64) std::atomic<uint32_t> m_get{ 0 };
+    alignas(64) FIFOCommand m_commands[kSize];
+};
+
+// ----------------------------------------------------------------------------
+
+// Per-channel cache of RAMHT lookups.
+//
+// The puller looks up object handles whenever an object is bound to a
+// subchannel or passed as a method parameter, and the same few handles are
+// used over and over. Each channel has a small direct-mapped table of
+// handle -> RAMHT entry mappings.
+//
+// Entries are tagged with the RAMHT generation from PRAMIN at the time of the
+// lookup. The generation changes whenever the hash table is written to or
+// moved, which invalidates all cached entries at once.
+class RAMHTCache {
+public:
+    static const uint32_t kChannels = 32;
+    static const uint32_t kEntriesPerChannel = 16;
+
+    // Returns the cached entry for the handle, or nullptr if not cached
+    const RAMHT::Entry* Find(uint32_t handle, uint32_t channelID, uint32_t generation) const {
+        const Slot& slot = m_slots[channelID & (kChannels - 1)][Index(handle)];
+        if (slot.generation == generation && slot.handle == handle) {
+            return &slot.entry;
+        }
+        return nullptr;
+    }
+
+    const RAMHT::Entry& Insert(uint32_t handle, uint32_t channelID, uint32_t generation, const RAMHT::Entry& entry) {
+        Slot& slot = m_slots[channelID & (kChannels - 1)][Index(handle)];
+        slot.handle = handle;
+        slot.generation = generation;
+        slot.entry = entry;
+        return slot.entry;
+    }
+
+private:
+    struct Slot {
+        uint32_t handle;
+        uint32_t generation;   // 0 = empty; PRAMIN generations start at 1
+        RAMHT::Entry entry;
+    };
+
+    static uint32_t Index(uint32_t handle) {
+        return (handle ^ (handle >> 4) ^ (handle >> 12)) & (kEntriesPerChannel - 1);
+    }
+
+    Slot m_slots[kChannels][kEntriesPerChannel] = {};
+};
+
+// ----------------------------------------------------------------------------
+
 // NV2A MMIO and DMA FIFO submission to PGRAPH engine (PFIFO)
 class PFIFO : public NV2AEngine {
 public:
@@ -272,11 +439,14 @@ public:
 
     RAMHT::Entry* GetRAMHTEntry(uint32_t handle, uint32_t channelID);
 
+    // Looks up a RAMHT entry through the cache
+    const RAMHT::Entry& LookupRAMHTEntry(uint32_t handle, uint32_t channelID);
+
     inline ChannelMode GetChannelMode(uint8_t channelID) const { return m_channelModes & (1 << channelID) ? ChannelMode::DMA : ChannelMode::PIO; }
     inline uint32_t GetCurrentChannelID() const { return m_dmaPusher.push1.channelID; }
 
 private:
-    bool m_enabled;
+    std::atomic_bool m_enabled{ false };
 
     // Operational parameters
     uint32_t m_delay0;
@@ -294,6 +464,9 @@ private:
     RAMFC m_ramfcParams;
     uint32_t m_caches;
 
+    RAMHTCache m_ramhtCache;
+    void UpdateRAMHTRegion();
+
     // Channel flags
     uint32_t m_channelModes;
     uint32_t m_channelDMA;
@@ -309,8 +482,6 @@ private:
     // FIXME: some of these are actually part of the PFIFO pusher or puller states and shouldn't be here
     // [https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#pusher-state]
     // [https://envytools.readthedocs.io/en/latest/hw/fifo/puller.html#puller-state]
-    uint32_t m_cache1_getAddress;
-    uint32_t m_cache1_putAddress;
     PFIFOCacheDMAFetch m_cache1_dmaFetch;
     uint32_t m_cache1_dmaControl;
     uint32_t m_cache1_referenceCounter;
@@ -319,8 +490,8 @@ private:
     uint32_t m_cache1_acquireTimestamp;
     uint32_t m_cache1_acquireValue;
     uint32_t m_cache1_semaphore;
-    PFIFOCacheStatus m_cache1_status;
-    FIFOCommand m_cache1_commands[kPFIFO_CommandBufferSize];
+    PFIFOCacheStatus m_cache1_status;  // low and high marks are derived from m_cache1
+    PFIFOCommandCache m_cache1;
 
     // DMA pusher state
     struct DMAPusher {
@@ -354,6 +525,25 @@ private:
     std::thread m_pusherThread;
     std::thread m_pullerThread;
 
+    // The threads sleep on these condition variables while they have nothing
+    // to do. Any state change that may allow them to make progress must be
+    // followed by a call to WakePusher or WakePuller.
+    std::mutex m_threadMutex;
+    std::condition_variable m_pusherCond;
+    std::condition_variable m_pullerCond;
+
+    void WakePusher();
+    void WakePuller();
+
+    bool CanRunPusher();
+    bool CanRunPuller();
+
+    void RunPusher();
+    void RunPuller();
+    uint32_t PushMethodRun(const PFIFOMethodRun& run);
+    void PullCommand(const FIFOCommand& cmd);
+    uint32_t PullMethodRun(uint32_t first, uint32_t end);
+
     void PusherThread();
     void PullerThread();
 };
@@ -14,6 +14,7 @@
 #pragma once
 
 #include "../engine.h"
+#include "../pgraph/dispatch.h"
 
 namespace strikebox::nv2a {
 
@@ -51,12 +52,15 @@ const uint32_t Reg_PGRAPH_CHANNEL_CTX_POINTER = 0x784;  // [RW] Channel context
 
 const uint32_t Reg_PGRAPH_TILE_BASE = 0x900;            //      Base address of tiles
 const uint32_t Reg_PGRAPH_TILE = 0x0;                   // [RW]   Tile address
+/**/const uint32_t Reg_PGRAPH_TILE_VALID = (1 << 0);           // bit  0: tile region is valid
 const uint32_t Reg_PGRAPH_TLIMIT = 0x4;                 // [RW]   Tile limit
 const uint32_t Reg_PGRAPH_TSIZE = 0x8;                  // [RW]   Tile size (pitch)
 const uint32_t Reg_PGRAPH_TSTATUS = 0xc;                // [RW]   Tile status
 const size_t kPGRAPH_NumTiles = 8;
 
 const uint32_t Reg_PGRAPH_ZCOMP_BASE = 0x980;           //      Base address of ZCOMP (?)
+/**/const uint32_t Reg_PGRAPH_ZCOMP_Z24S8 = (1 << 26);         // bit 26: 0 = Z16, 1 = Z24S8
+/**/const uint32_t Reg_PGRAPH_ZCOMP_ENABLE = (1u << 31);       // bit 31: Z compression enabled for the tile region
 const size_t kPGRAPH_NumZCOMP = 8;
 
 // ----------------------------------------------------------------------------
@@ -114,7 +118,7 @@ static_assert(sizeof(PGRAPHTile) == sizeof(uint32_t[4]));
 // NV2A 2D/3D graphics engine (PGRAPH)
 class PGRAPH : public NV2AEngine {
 public:
-    PGRAPH(NV2A& nv2a) : NV2AEngine("PGRAPH", 0x400000, 0x2000, nv2a) {}
+    PGRAPH(NV2A& nv2a) : NV2AEngine("PGRAPH", 0x400000, 0x2000, nv2a), m_dispatcher(nv2a) {}
 
     void SetEnabled(bool enabled);
     
@@ -123,6 +127,29 @@ public:
     void Write(const uint32_t addr, const uint32_t value) override;
 
     bool GetInterruptState() { return m_interruptLevels & m_enabledInterrupts; }
+    void RaiseInterrupt(uint32_t interrupts);
+
+    // Methods submitted by the PFIFO puller. method is the method offset / 4.
+    void BindObject(uint32_t subchannel, uint32_t instance) { m_dispatcher.BindObject(subchannel, instance); }
+    void SubmitMethods(uint32_t subchannel, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+        m_dispatcher.SubmitMethods(subchannel, method, data, count, increasing);
+    }
+
+    // Replaces the rendering backend; the software renderer is used by default
+    void SetRenderer(std::unique_ptr<Renderer> renderer) { m_dispatcher.SetRenderer(std::move(renderer)); }
+
+    // Cache of decoded textures; owned by the PFIFO puller thread
+    TextureCache& GetTextureCache() { return m_dispatcher.GetTextureCache(); }
+
+    // Cache of decoded vertex programs; owned by the PFIFO puller thread
+    VertexProgramCache& GetVertexProgramCache() { return m_dispatcher.GetVertexProgramCache(); }
+    CombinerCache& GetCombinerCache() { return m_dispatcher.GetCombinerCache(); }
+    SurfaceCache& GetSurfaceCache() { return m_dispatcher.GetSurfaceCache(); }
+
+    // Tile regions and their Z compression settings. ZCOMP register N applies
+    // to tile region N.
+    const PGRAPHTile& GetTile(uint32_t index) const { return m_tiles[index]; }
+    uint32_t GetZComp(uint32_t index) const { return m_zcomp[index]; }
 
 private:
     bool m_enabled = false;
@@ -145,6 +172,8 @@ private:
     PGRAPHTile m_tiles[kPGRAPH_NumTiles];
     uint32_t m_zcomp[kPGRAPH_NumZCOMP];
 
+    MethodDispatcher m_dispatcher;
+
     uint32_t RDIRead();
     uint32_t RDIWrite(const uint32_t value);
 };
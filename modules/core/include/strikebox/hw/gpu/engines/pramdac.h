@@ -20,6 +20,11 @@ namespace strikebox::nv2a {
 const uint32_t Reg_RAMDAC_NVPLL = 0x500;  // [RW] Core PLL clock
 const uint32_t Reg_RAMDAC_MPLL = 0x504;  // [RW] Memory PLL clock
 const uint32_t Reg_RAMDAC_VPLL = 0x508;  // [RW] Video PLL clocks
+const uint32_t Reg_RAMDAC_GENERAL_CONTROL = 0x600;  // [RW] General control
+/**/const uint32_t Val_RAMDAC_GENERAL_CONTROL_ALT_MODE_SEL = (1 << 12);  //  bit 12: 16-bit pixels are R5G6B5 instead of X1R5G5B5
+const uint32_t Reg_RAMDAC_FP_VDISPLAY_END = 0x800;  // [RW] Last displayed line
+const uint32_t Reg_RAMDAC_FP_VTOTAL = 0x804;  // [RW] Total lines per frame minus one
+const uint32_t Reg_RAMDAC_FP_HTOTAL = 0x824;  // [RW] Total pixels per line minus one
 
 // The NV2A crystal clock frequency in Hz
 const uint32_t kNV2ACrystalClock = 16666667;
@@ -57,10 +62,22 @@ public:
     ClockCoefficients GetMemoryClockCoefficients() const { return m_memoryClockCoeff; }
     ClockCoefficients GetVideoClockCoefficients() const { return m_videoClockCoeff; }
 
+    uint32_t GetGeneralControl() const { return m_generalControl; }
+
+    // Display timings of the flat panel registers, which the Xbox programs for
+    // every output. Values are counts minus one, or zero if not programmed.
+    uint32_t GetFPHorizontalTotal() const { return m_fpHTotal; }
+    uint32_t GetFPVerticalTotal() const { return m_fpVTotal; }
+    uint32_t GetFPVerticalDisplayEnd() const { return m_fpVDisplayEnd; }
+
 private:
     ClockCoefficients m_coreClockCoeff;
     ClockCoefficients m_memoryClockCoeff;
     ClockCoefficients m_videoClockCoeff;
+    uint32_t m_generalControl;
+    uint32_t m_fpHTotal;
+    uint32_t m_fpVTotal;
+    uint32_t m_fpVDisplayEnd;
 
     uint32_t m_mem[0x1000 >> 2]; // for all other reads/writes
 };
@@ -15,6 +15,8 @@
 
 #include "../engine.h"
 
+#include <atomic>
+
 namespace strikebox::nv2a {
 
 // NV2A RAMIN access engine (PRAMIN)
@@ -39,8 +41,25 @@ public:
         return nullptr;
     }
 
+    // Sets the location of the RAMHT. Writes to this region change the RAMHT
+    // generation, which lets PFIFO know when to discard cached lookups.
+    void SetRAMHTRegion(uint32_t address, uint32_t length);
+
+    inline uint32_t GetRAMHTGeneration() const { return m_ramhtGeneration.load(std::memory_order_acquire); }
+
 private:
     uint8_t* m_mem;
+
+    uint32_t m_ramhtAddress = 0;
+    uint32_t m_ramhtLength = 0;
+    std::atomic<uint32_t> m_ramhtGeneration{ 1 };
+
+    inline void InvalidateRAMHT() {
+        // Skip 0 on wraparound; it denotes empty cache entries
+        if (m_ramhtGeneration.fetch_add(1, std::memory_order_release) + 1 == 0) {
+            m_ramhtGeneration.fetch_add(1, std::memory_order_release);
+        }
+    }
 };
 
 }
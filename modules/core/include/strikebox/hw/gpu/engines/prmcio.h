@@ -9,12 +9,45 @@
 // brackets optionally followed by a quote from the documentation.
 //
 // PRMCIO engine registers occupy the range 0x601000..0x601FFF.
+//
+// The CRTC registers are accessed through an index and a data port, as on VGA
+// hardware. Besides the standard VGA registers, the extended registers hold
+// the upper bits of the display size and framebuffer pitch and the pixel
+// depth used by the scan-out.
 #pragma once
 
 #include "../engine.h"
 
+#include <atomic>
+
 namespace strikebox::nv2a {
 
+// PRMCIO registers
+// [https://envytools.readthedocs.io/en/latest/hw/display/nv3/vga.html]
+const uint32_t Reg_PRMCIO_CRX_MONO = 0x3b4;    // [RW] CRTC register index (monochrome address)
+const uint32_t Reg_PRMCIO_CR_MONO = 0x3b5;     // [RW] CRTC register data (monochrome address)
+const uint32_t Reg_PRMCIO_CRX_COLOR = 0x3d4;   // [RW] CRTC register index
+const uint32_t Reg_PRMCIO_CR_COLOR = 0x3d5;    // [RW] CRTC register data
+
+// CRTC registers
+// [https://github.com/torvalds/linux/blob/master/drivers/gpu/drm/nouveau/dispnv04/nvreg.h]
+const uint8_t Reg_CR_HT = 0x00;       // Horizontal total, in characters minus five
+const uint8_t Reg_CR_HDE = 0x01;      // Horizontal display end, in characters minus one
+const uint8_t Reg_CR_VT = 0x06;       // Vertical total, in lines minus two
+const uint8_t Reg_CR_OVL = 0x07;      // Overflow; bit 0: VT bit 8, bit 1: VDE bit 8, bit 5: VT bit 9, bit 6: VDE bit 9
+const uint8_t Reg_CR_VDE = 0x12;      // Vertical display end, in lines minus one
+const uint8_t Reg_CR_OFFSET = 0x13;   // Framebuffer pitch in units of 8 bytes
+const uint8_t Reg_CR_RPC0 = 0x19;     // Repaint control 0; bits 7..5: OFFSET bits 10..8
+const uint8_t Reg_CR_LSR = 0x25;      // Extended vertical bits; bit 0: VT bit 10, bit 1: VDE bit 10, bit 5: OFFSET bit 11
+const uint8_t Reg_CR_PIXEL = 0x28;    // Pixel format; bits 1..0: depth
+const uint8_t Reg_CR_HEB = 0x2d;      // Extended horizontal bits; bit 0: HT bit 8, bit 1: HDE bit 8
+
+// Pixel depths in CR28
+const uint8_t Val_CR_PIXEL_DEPTH_VGA = 0;
+const uint8_t Val_CR_PIXEL_DEPTH_8 = 1;
+const uint8_t Val_CR_PIXEL_DEPTH_16 = 2;
+const uint8_t Val_CR_PIXEL_DEPTH_32 = 3;
+
 // NV2A VGA CRTC and attribute controller registers engine (PRMCIO)
 class PRMCIO : public NV2AEngine {
 public:
@@ -25,6 +58,24 @@ public:
     void Write(const uint32_t addr, const uint32_t value) override;
     uint32_t ReadUnaligned(const uint32_t addr, const uint8_t size) override;
     void WriteUnaligned(const uint32_t addr, const uint32_t value, const uint8_t size) override;
+
+    uint8_t GetCRTCRegister(uint8_t index) const { return m_cr[index].load(std::memory_order_relaxed); }
+
+    // Display mode as programmed in the CRTC registers
+    uint32_t GetDisplayWidth() const;
+    uint32_t GetDisplayHeight() const;
+    uint32_t GetFramebufferPitch() const;   // In bytes
+    uint32_t GetHorizontalTotal() const;    // In pixels
+    uint32_t GetVerticalTotal() const;      // In lines
+    uint8_t GetPixelDepth() const { return GetCRTCRegister(Reg_CR_PIXEL) & 3; }
+
+private:
+    // Read by the scan-out while the CPU programs them
+    std::atomic<uint8_t> m_crIndex;
+    std::atomic<uint8_t> m_cr[256];
+
+    bool ReadPort(const uint32_t addr, uint8_t& value);
+    bool WritePort(const uint32_t addr, const uint8_t value);
 };
 
 }
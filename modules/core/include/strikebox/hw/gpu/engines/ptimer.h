@@ -20,7 +20,10 @@
 
 #include "../engine.h"
 
-#include <chrono>
+#include "strikebox/virtual_clock.h"
+
+#include <atomic>
+#include <mutex>
 
 namespace strikebox::nv2a {
 
@@ -50,6 +53,14 @@ public:
 
     bool GetInterruptState() { return m_interruptLevels & m_enabledInterrupts; }
 
+    // Returns the time as read from TIME_HIGH:TIME_LOW, which is the format
+    // of the timestamps written by the GPU. May be called from any thread.
+    uint64_t GetTime() const { return GetTickCount() << 5ull; }
+
+    // Keeps the counter running at the right rate when the core clock (NVPLL)
+    // is reprogrammed; called by PRAMDAC after the change
+    void CoreClockChanged();
+
 private:
     bool m_enabled = false;
 
@@ -60,9 +71,28 @@ private:
     uint32_t m_clockDiv;
     uint32_t m_alarm;
 
-    uint64_t GetTickCount();
-    uint64_t m_tickCount;
-    std::chrono::high_resolution_clock::time_point m_lastTickCountRead;
+    // The counter is m_baseTickCount plus the ticks elapsed since m_baseTime
+    // at m_tickFactor ticks per nanosecond (32.32 fixed-point). The rate only
+    // changes when the clock source or ratio is reprogrammed, so reads cost
+    // one clock read and one multiplication.
+    //
+    // PGRAPH timestamps notifications while the CPU may be reprogramming the
+    // counter, so the three values are published together under a sequence
+    // lock, like VirtualClock's timeline. Reads never modify them.
+    uint64_t GetTickCount() const;
+
+    // Changes to the counter are bracketed by these; both require m_mutex.
+    // BeginUpdate returns the current count and the virtual time it was read
+    // at; EndUpdate restarts the counter from the given count and time, at
+    // the rate given by the current clock source and ratio.
+    uint64_t BeginUpdate(uint64_t& now);
+    void EndUpdate(uint64_t tickCount, uint64_t now);
+
+    std::mutex m_mutex;   // Serializes changes to the counter
+    std::atomic<uint32_t> m_sequence{ 0 };
+    std::atomic<uint64_t> m_baseTickCount{ 0 };
+    std::atomic<uint64_t> m_baseTime{ 0 };
+    std::atomic<uint64_t> m_tickFactor{ 0 };
 };
 
 }
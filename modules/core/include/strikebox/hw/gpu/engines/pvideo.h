@@ -9,16 +9,68 @@
 // brackets optionally followed by a quote from the documentation.
 //
 // PVIDEO engine registers occupy the range 0x008000..0x008FFF.
+//
+// The overlay scales a YUV 4:2:2 image from system memory onto a rectangle of
+// the scanned out framebuffer, optionally only over pixels matching a color
+// key. There are two sets of buffer registers. The driver fills in a buffer,
+// then sets its USE bit in the BUFFER register. At the next vertical blank the
+// overlay switches to the most recently submitted buffer, and clears the USE
+// bit and raises the interrupt of the buffer it stops displaying, which the
+// driver may then reuse.
 #pragma once
 
 #include "../engine.h"
 
+#include <mutex>
+
 namespace strikebox::nv2a {
 
 // PVIDEO registers
 // [https://envytools.readthedocs.io/en/latest/hw/display/nv3/pvideo.html#mmio-registers]
-const uint32_t Reg_PVIDEO_INTR = 0x100;        // [RW] Interrupt status
-const uint32_t Reg_PVIDEO_INTR_ENABLE = 0x140; // [RW] Interrupt enable
+const uint32_t Reg_PVIDEO_INTR = 0x100;                        // [RW] Interrupt status
+const uint32_t Reg_PVIDEO_INTR_ENABLE = 0x140;                 // [RW] Interrupt enable
+/**/const uint32_t Val_PVIDEO_INTR_BUFFER_0 = (1 << 0);        //  bit  0: Buffer 0 released
+/**/const uint32_t Val_PVIDEO_INTR_BUFFER_1 = (1 << 4);        //  bit  4: Buffer 1 released
+const uint32_t Reg_PVIDEO_BUFFER = 0x700;                      // [RW] Buffers submitted for display
+/**/const uint32_t Val_PVIDEO_BUFFER_0_USE = (1 << 0);         //  bit  0: Buffer 0 in use
+/**/const uint32_t Val_PVIDEO_BUFFER_1_USE = (1 << 4);         //  bit  4: Buffer 1 in use
+const uint32_t Reg_PVIDEO_STOP = 0x704;                        // [RW] Stop the overlay
+/**/const uint32_t Val_PVIDEO_STOP_ACTIVE = (1 << 0);          //  bit  0: Stop at the next vertical blank
+const uint32_t Reg_PVIDEO_BASE = 0x900;                        // [RW] Buffer base address (x2)
+const uint32_t Reg_PVIDEO_LIMIT = 0x908;                       // [RW] Buffer limit address (x2)
+const uint32_t Reg_PVIDEO_LUMINANCE = 0x910;                   // [RW] Brightness and contrast (x2)
+const uint32_t Reg_PVIDEO_CHROMINANCE = 0x918;                 // [RW] Saturation and hue (x2)
+const uint32_t Reg_PVIDEO_OFFSET = 0x920;                      // [RW] Image offset from the base (x2)
+const uint32_t Reg_PVIDEO_SIZE_IN = 0x928;                     // [RW] Image size (x2)
+const uint32_t Reg_PVIDEO_POINT_IN = 0x930;                    // [RW] Image origin (x2)
+const uint32_t Reg_PVIDEO_DS_DX = 0x938;                       // [RW] Horizontal image step per output pixel (x2)
+const uint32_t Reg_PVIDEO_DT_DY = 0x940;                       // [RW] Vertical image step per output line (x2)
+const uint32_t Reg_PVIDEO_POINT_OUT = 0x948;                   // [RW] Output rectangle origin (x2)
+const uint32_t Reg_PVIDEO_SIZE_OUT = 0x950;                    // [RW] Output rectangle size (x2)
+const uint32_t Reg_PVIDEO_FORMAT = 0x958;                      // [RW] Image format (x2)
+/**/const uint32_t Val_PVIDEO_FORMAT_COLOR_YB8CR8YA8CB8 = 0;   //  bits 17..16: U, Y0, V, Y1 byte order (UYVY)
+/**/const uint32_t Val_PVIDEO_FORMAT_COLOR_CR8YB8CB8YA8 = 1;   //  bits 17..16: Y0, U, Y1, V byte order (YUY2)
+/**/const uint32_t Val_PVIDEO_FORMAT_DISPLAY = (1 << 20);      //  bit  20: Display only over pixels matching the color key
+const uint32_t Reg_PVIDEO_COLOR_KEY = 0xb00;                   // [RW] Color key in the framebuffer format
+
+// Scale factors of DS_DX and DT_DY are fixed point numbers with 20 fractional bits
+const uint32_t kPVIDEOScaleUnity = 1 << 20;
+
+// Registers of one overlay buffer
+struct PVIDEOBuffer {
+    uint32_t base;
+    uint32_t limit;
+    uint32_t luminance;   // Not applied
+    uint32_t chrominance; // Not applied
+    uint32_t offset;
+    uint32_t sizeIn;      // bits 10..0 = width, bits 26..16 = height
+    uint32_t pointIn;     // bits 14..0 = S, bits 31..17 = T, in 1/16 texels (T in 1/8)
+    uint32_t dsdx;
+    uint32_t dtdy;
+    uint32_t pointOut;    // bits 11..0 = X, bits 27..16 = Y
+    uint32_t sizeOut;     // bits 11..0 = width, bits 27..16 = height
+    uint32_t format;      // bits 12..0 = pitch, bits 17..16 = color, bit 20 = color key enable
+};
 
 // ----------------------------------------------------------------------------
 
@@ -35,11 +87,38 @@ public:
 
     bool GetInterruptState() { return m_interruptLevels & m_enabledInterrupts; }
 
+    // Switches buffers as the hardware does at the start of a vertical blank
+    void VerticalBlank();
+
+    // Determines if the overlay is displaying a buffer
+    bool IsDisplaying();
+
+    // Returns the color key in the framebuffer format
+    uint32_t GetColorKey() const { return m_colorKey; }
+
+    // Draws the displayed buffer over a frame of X8R8G8B8 pixels. pitch is
+    // the distance between rows in pixels. colorKey is the color key
+    // converted to X8R8G8B8 by the caller, which knows the framebuffer
+    // format.
+    void Compose(uint32_t* frame, uint32_t pitch, uint32_t width, uint32_t height, uint32_t colorKey);
+
 private:
     bool m_enabled = false;
 
     uint32_t m_interruptLevels;
     uint32_t m_enabledInterrupts;
+
+    // Guards the buffer state, which is written by the CPU and read at
+    // vertical blanks
+    std::mutex m_mutex;
+    PVIDEOBuffer m_buffers[2];
+    uint32_t m_bufferUse;
+    uint32_t m_stop;
+    uint32_t m_colorKey;
+    int32_t m_displayedBuffer;    // -1 if the overlay is off
+    uint32_t m_submitOrder;       // Index of the most recently submitted buffer
+
+    uint32_t* BufferRegister(uint32_t addr);
 };
 
 }
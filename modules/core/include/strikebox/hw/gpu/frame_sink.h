@@ -0,0 +1,202 @@
+// StrikeBox NV2A frame export sinks
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Frames scanned out at each vertical blank are published to a sink. Pixels
+// are 8-bit RGBA, stored as the bytes R, G, B, A, with alpha always 255.
+//
+// The scan-out writes frames directly into memory provided by the sink:
+// BeginFrame returns a buffer for the frame, or nullptr to skip it, and
+// EndFrame publishes the frame written to that buffer. A sink is only used by
+// one thread at a time.
+//
+// The available sinks are:
+// - NullFrameSink discards frames. The scan-out still runs in full.
+// - FileFrameSink writes numbered PPM images or a Y4M video stream from a
+//   writer thread. Frames are dropped while the writer is behind.
+// - SharedMemoryFrameSink publishes frames to a ring of slots in a shared
+//   memory object that other processes map and read in place. Linux only.
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace strikebox::nv2a {
+
+// Receives scanned out frames
+class FrameSink {
+public:
+    virtual ~FrameSink() = default;
+
+    // Receives the display's frame period in nanoseconds before the first
+    // frame and whenever the display timing changes
+    virtual void SetFramePeriod(uint64_t) {}
+
+    // Returns a buffer for a frame of the given size, or nullptr to skip the
+    // frame. pitch receives the distance between rows in bytes, which is at
+    // least width * 4.
+    virtual uint8_t* BeginFrame(uint32_t width, uint32_t height, uint32_t& pitch) = 0;
+
+    // Publishes the frame written to the buffer returned by BeginFrame
+    virtual void EndFrame() = 0;
+};
+
+// ----------------------------------------------------------------------------
+
+// Discards frames
+class NullFrameSink : public FrameSink {
+public:
+    uint8_t* BeginFrame(uint32_t width, uint32_t height, uint32_t& pitch) override;
+    void EndFrame() override {}
+
+private:
+    std::vector<uint8_t> m_buffer;
+};
+
+// ----------------------------------------------------------------------------
+
+enum class FrameFileFormat {
+    PPM,   // One binary RGB image per frame, named <path>_<frame number>.ppm
+    Y4M,   // A single 4:4:4 YCbCr video stream at path, at the display's rate
+};
+
+// Writes frames to files from a writer thread
+class FileFrameSink : public FrameSink {
+public:
+    // Writes one out of every interval frames. Frames are numbered from zero,
+    // including the skipped ones.
+    FileFrameSink(FrameFileFormat format, const std::string& path, uint32_t interval = 1);
+    ~FileFrameSink();
+
+    // Opens the output and starts the writer thread. Returns false if the
+    // output could not be opened.
+    bool Start();
+
+    void SetFramePeriod(uint64_t period) override { m_framePeriod = period; }
+    uint8_t* BeginFrame(uint32_t width, uint32_t height, uint32_t& pitch) override;
+    void EndFrame() override;
+
+private:
+    // Number of frame buffers; frames are dropped while all of them are
+    // waiting to be written
+    static const size_t kBufferCount = 4;
+
+    struct Frame {
+        std::vector<uint8_t> pixels;
+        uint32_t width;
+        uint32_t height;
+        uint64_t number;
+        uint64_t period;   // Frame period of the display, in nanoseconds
+    };
+
+    const FrameFileFormat m_format;
+    const std::string m_path;
+    const uint32_t m_interval;
+
+    uint64_t m_frameNumber = 0;
+    uint64_t m_framePeriod = 0;
+    uint64_t m_droppedFrames = 0;
+    std::unique_ptr<Frame> m_current;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<std::unique_ptr<Frame>> m_free;
+    std::deque<std::unique_ptr<Frame>> m_queue;
+    bool m_running = false;
+    std::thread m_thread;
+
+    // Y4M stream and its frame size and rate, fixed by the first frame
+    FILE* m_file = nullptr;
+    uint32_t m_streamWidth = 0;
+    uint32_t m_streamHeight = 0;
+    std::vector<uint8_t> m_planes;
+
+    void WriterThread();
+    void WritePPM(const Frame& frame);
+    void WriteY4M(const Frame& frame);
+};
+
+// ----------------------------------------------------------------------------
+
+// Shared memory layout of SharedMemoryFrameSink:
+//
+//   Offset                              Contents
+//   0                                   FrameRingHeader
+//   headerSize + n * slotSize           FrameSlotHeader of slot n
+//   headerSize + n * slotSize + dataOffset   Pixels of slot n
+//
+// Frame f is written to slot f % slotCount. Each slot is guarded by a sequence
+// counter that is odd while the slot is written. To read the latest frame, a
+// viewer loads frameCount, picks slot (frameCount - 1) % slotCount, loads the
+// slot sequence, reads the frame if the sequence is even and loads the
+// sequence again; the frame is intact if both loads match. The writer only
+// reuses a slot after publishing slotCount - 1 newer frames.
+
+const uint32_t kFrameRingMagic = 0x52464253;   // "SBFR"
+const uint32_t kFrameRingVersion = 1;
+const uint32_t kFrameRingSlotCount = 3;
+const uint32_t kFrameRingMaxWidth = 1920;
+const uint32_t kFrameRingMaxHeight = 1080;
+
+struct FrameRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;                  // Offset of the first slot
+    uint32_t slotCount;
+    uint32_t slotSize;                    // Distance between slots in bytes
+    uint32_t dataOffset;                  // Offset of the pixels in a slot
+    std::atomic<uint64_t> frameCount;     // Number of frames published
+};
+
+struct FrameSlotHeader {
+    std::atomic<uint32_t> sequence;       // Odd while the slot is being written
+    uint32_t width;
+    uint32_t height;
+    uint32_t pitch;                       // In bytes
+    uint64_t frameNumber;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "frame ring counters must be usable across processes");
+
+// Publishes frames to a ring in shared memory that viewers map without copies.
+// Only implemented on Linux, where the ring is a memfd; Create always
+// fails on other platforms.
+class SharedMemoryFrameSink : public FrameSink {
+public:
+    SharedMemoryFrameSink() = default;
+    ~SharedMemoryFrameSink();
+
+    SharedMemoryFrameSink(const SharedMemoryFrameSink&) = delete;
+    SharedMemoryFrameSink& operator=(const SharedMemoryFrameSink&) = delete;
+
+    // Creates and maps the shared memory object. Returns false if shared
+    // memory is not supported or could not be allocated.
+    bool Create();
+
+    uint8_t* BeginFrame(uint32_t width, uint32_t height, uint32_t& pitch) override;
+    void EndFrame() override;
+
+private:
+    uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    FrameRingHeader* m_header = nullptr;
+    FrameSlotHeader* m_slot = nullptr;    // Slot being written
+    bool m_warnedSize = false;
+
+    // ----- Platform-specific ------------------------------------------------
+
+    // Host handle of the shared memory object
+    intptr_t m_handle = -1;
+
+    bool MapSharedMemory(size_t size);
+    void UnmapSharedMemory();
+};
+
+}
@@ -0,0 +1,156 @@
+// StrikeBox NV2A PGRAPH register combiners and texture shaders
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+//
+// The pixel pipeline of the NV2A computes texture colors with one texture
+// shader program per stage, then combines them with the interpolated colors
+// through up to eight general combiner stages and a final combiner.
+//
+// The state of the pipeline is split in two parts: the key holds everything
+// that selects code paths (stage count, input registers and mappings, output
+// operations, texture shader modes, sampler modes), while the constants hold
+// values such as constant colors and matrices. Each unique key is compiled
+// into a kernel assembled from functions specialized at compile time: the
+// shading loop is instantiated for each stage count, and every operand,
+// combiner operation, texture shader mode and fog mode is bound to an
+// instance specialized for its configuration. Kernels are cached by key, so
+// changing constants between draws does not rebuild them.
+//
+// Kernels shade 2x2 quads of pixels, one pixel per SIMD lane.
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "kelvin.h"
+#include "simd.h"
+#include "texture.h"
+
+namespace strikebox::nv2a {
+
+const uint32_t kCombinerStageCount = 8;
+
+// Kelvin state that selects the code paths of a kernel
+struct CombinerKey {
+    uint32_t colorICW[kCombinerStageCount];
+    uint32_t colorOCW[kCombinerStageCount];
+    uint32_t alphaICW[kCombinerStageCount];
+    uint32_t alphaOCW[kCombinerStageCount];
+    uint32_t finalCW0;
+    uint32_t finalCW1;
+    uint32_t control;
+    uint32_t shaderProgram;
+    uint32_t dotMapping;
+    uint32_t otherStageInput;
+    uint32_t clipPlaneMode;
+    uint32_t fogMode;
+    uint32_t textureAddress[kKelvinTextureCount];
+    uint32_t textureFilter[kKelvinTextureCount];
+    uint32_t normalizedCoords;   // Bit N set if stage N uses normalized texture coordinates
+
+    bool operator==(const CombinerKey& other) const {
+        return std::memcmp(this, &other, sizeof(CombinerKey)) == 0;
+    }
+};
+
+// Constant values used by kernels. Colors are in RGBA order.
+struct CombinerConstants {
+    float factor0[kCombinerStageCount][4];
+    float factor1[kCombinerStageCount][4];
+    float specularFog[2][4];   // Constant colors of the final combiner
+    float fogColor[4];
+    float fogParams[3];
+    float bumpEnvMatrix[kKelvinTextureCount][4];
+    float bumpEnvScale[kKelvinTextureCount];
+    float bumpEnvOffset[kKelvinTextureCount];
+};
+
+// Decodes the pixel pipeline state from the Kelvin state
+void DecodeCombinerState(const KelvinState& state, CombinerKey& key, CombinerConstants& constants);
+
+// Interpolated inputs of a 2x2 quad of pixels, one pixel per lane
+struct PixelQuad {
+    simd::F4 diffuse[4];
+    simd::F4 specular[4];
+    simd::F4 fog;
+    simd::F4 texCoords[kKelvinTextureCount][4];
+};
+
+// Interpolated inputs read by a kernel
+enum CombinerInput : uint32_t {
+    CombinerInput_Diffuse = (1 << 0),
+    CombinerInput_Specular = (1 << 1),
+    CombinerInput_Fog = (1 << 2),
+    CombinerInput_TexCoord0 = (1 << 3),   // Stage N uses bit (CombinerInput_TexCoord0 << N)
+};
+
+class CombinerKernel {
+public:
+    explicit CombinerKernel(const CombinerKey& key);
+    ~CombinerKernel();
+
+    // CombinerInput bits of the inputs used by the kernel
+    uint32_t GetInputMask() const { return m_inputMask; }
+
+    // Determines if the kernel may discard pixels
+    bool CanDiscard() const { return m_canDiscard; }
+
+    // Shades a quad of pixels into RGBA colors. textures holds the texture
+    // bound to each stage, or null if none. Returns a mask of the lanes that
+    // were not discarded, lane 0 in bit 0.
+    uint32_t Shade(const CombinerConstants& constants, const Texture* const* textures, const PixelQuad& in, simd::F4 out[4]) const;
+
+    struct Program;
+
+private:
+    std::unique_ptr<Program> m_program;
+    uint32_t m_inputMask = 0;
+    bool m_canDiscard = false;
+};
+
+// ----------------------------------------------------------------------------
+
+const size_t kDefaultCombinerCacheSize = 256;
+
+struct CombinerCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t entries = 0;
+};
+
+class CombinerCache {
+public:
+    CombinerCache(size_t capacity = kDefaultCombinerCacheSize) : m_capacity(capacity) {}
+
+    // Returns the kernel for the given state, building it if needed
+    std::shared_ptr<const CombinerKernel> Lookup(const CombinerKey& key);
+
+    // Drops all entries
+    void Clear();
+
+    const CombinerCacheStats& GetStats() const { return m_stats; }
+
+private:
+    struct Entry {
+        uint64_t hash;
+        CombinerKey key;
+        std::shared_ptr<const CombinerKernel> kernel;
+    };
+    typedef std::list<Entry> EntryList;
+
+    size_t m_capacity;
+    EntryList m_lru;   // Most recently used first
+    std::unordered_multimap<uint64_t, EntryList::iterator> m_entries;
+    CombinerCacheStats m_stats;
+};
+
+}
@@ -0,0 +1,277 @@
+// StrikeBox NV2A PGRAPH method dispatcher
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+//
+// The dispatcher executes methods submitted by the PFIFO puller to the
+// objects bound to each subchannel. Methods are looked up in per-class tables
+// built at compile time, indexed by method offset / 4. Each entry points to
+// the handler of the method and tells how many of the following methods share
+// the same handler, so that runs of methods are processed with a single call.
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "combiner.h"
+#include "fixed_function.h"
+#include "kelvin.h"
+#include "renderer.h"
+#include "surface_cache.h"
+#include "texture_cache.h"
+#include "vertex_fetch.h"
+#include "vertex_program.h"
+
+namespace strikebox::nv2a {
+
+class NV2A;
+class MethodDispatcher;
+struct MethodEntry;
+
+// Number of subchannels of a FIFO channel
+const uint32_t kNumSubchannels = 8;
+
+// Executes a run of methods starting at the given method (offset / 4).
+// Increasing runs target consecutive methods; non-increasing runs target the
+// same method repeatedly. Returns the number of data words consumed, which
+// must be at least one. The dispatcher invokes the handler of the next method
+// with the remaining words.
+typedef uint32_t (*MethodHandler)(MethodDispatcher& dispatcher, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing);
+
+struct MethodEntry {
+    MethodHandler handler;
+    uint32_t dirty;       // KelvinDirty bits set by the method
+    uint16_t runLength;   // Number of methods starting at this one with the same handler and dirty bits
+};
+
+typedef std::array<MethodEntry, kMethodCount> MethodTable;
+
+// Method tables of the supported object classes
+const MethodTable& GetKelvinMethodTable();
+const MethodTable& GetUnknownClassMethodTable();
+
+// Vertex data collected between SET_BEGIN_END calls
+struct PrimitiveBatch {
+    KelvinPrimitive primitive = KelvinPrimitive::End;
+
+    std::vector<uint32_t> inlineArray;                        // Raw vertex data from INLINE_ARRAY
+    std::vector<uint32_t> elements;                           // Indices from ARRAY_ELEMENT16/32
+    std::vector<std::pair<uint32_t, uint32_t>> drawArrays;    // Ranges (first, count) from DRAW_ARRAYS
+    std::vector<float> immediate;                             // Vertices built from attribute methods, kKelvinAttributeCount * 4 floats each
+
+    void Clear() {
+        inlineArray.clear();
+        elements.clear();
+        drawArrays.clear();
+        immediate.clear();
+    }
+};
+
+class MethodDispatcher {
+public:
+    MethodDispatcher(NV2A& nv2a);
+    ~MethodDispatcher();
+
+    void Reset();
+
+    // Binds the object at the given instance address to the subchannel
+    void BindObject(uint32_t subchannel, uint32_t instance);
+
+    // Executes a run of methods on the object bound to the subchannel.
+    // method is the method offset / 4.
+    inline void SubmitMethods(uint32_t subchannel, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+        const MethodTable& table = *m_tables[subchannel & (kNumSubchannels - 1)];
+        method &= kMethodCount - 1;
+        while (count > 0) {
+            const MethodEntry& entry = table[method];
+            uint32_t consumed = entry.handler(*this, entry, method, data, count, increasing);
+            data += consumed;
+            count -= consumed;
+            if (increasing) {
+                method = (method + consumed) & (kMethodCount - 1);
+            }
+        }
+    }
+
+    KelvinState& State() { return m_state; }
+    PrimitiveBatch& Batch() { return m_batch; }
+    NV2A& GetNV2A() { return m_nv2a; }
+
+    uint32_t GetObjectClass(uint32_t subchannel) const { return m_classes[subchannel & (kNumSubchannels - 1)]; }
+
+    // Returns a pointer to size bytes at the given offset into the memory
+    // described by the DMA object at the given instance address, or nullptr
+    // if the range is out of bounds
+    uint8_t* GetDMAPointer(uint32_t instance, uint32_t offset, uint32_t size);
+
+    // Translates an offset into the memory described by the DMA object at
+    // the given instance address into a system RAM address. Returns false if
+    // the range of size bytes is out of bounds.
+    bool GetDMAAddress(uint32_t instance, uint32_t offset, uint32_t size, uint32_t& address);
+
+    // Records a write to system RAM made through a pointer from GetDMAPointer
+    void MarkGuestWrite(const uint8_t* pointer, uint32_t size);
+
+    // Appends a vertex made from the current attributes to the batch
+    void EmitVertex();
+
+    // Starts or ends a primitive
+    void BeginEnd(KelvinPrimitive primitive);
+
+    // Clears the current surfaces
+    void ClearSurface(uint32_t flags);
+
+    // Completes all pending rendering and writes surfaces back into guest
+    // memory. Bound textures and surfaces are revalidated afterwards, since
+    // the CPU may modify them once the GPU is idle.
+    void FlushRenderer();
+
+    TextureCache& GetTextureCache() { return m_textureCache; }
+    VertexProgramCache& GetVertexProgramCache() { return m_programCache; }
+    CombinerCache& GetCombinerCache() { return m_combinerCache; }
+    SurfaceCache& GetSurfaceCache() { return m_surfaceCache; }
+
+    // Replaces the rendering backend
+    void SetRenderer(std::unique_ptr<Renderer> renderer);
+
+private:
+    NV2A& m_nv2a;
+    std::unique_ptr<Renderer> m_renderer;
+
+    const MethodTable* m_tables[kNumSubchannels];
+    uint32_t m_classes[kNumSubchannels];
+
+    KelvinState m_state;
+    PrimitiveBatch m_batch;
+
+    // Render state decoded from the Kelvin state
+    RasterState m_rasterState;
+    std::vector<RasterVertex> m_vertices;
+    std::vector<uint32_t> m_indices;
+
+    // Vertex arrays and the vertices fetched from them
+    VertexArrayLayout m_arrayLayout;
+    std::vector<float> m_fetched;
+    std::vector<uint32_t> m_uniqueIndices;   // Array elements read by an indexed draw, relative to the lowest index
+    std::vector<uint32_t> m_indexSlots;      // Transformed vertex of each element index, relative to the lowest index
+    std::vector<uint32_t> m_elementSlots;    // Transformed vertex of each element of an indexed draw
+
+    TextureCache m_textureCache;
+
+    // Vertex program in use; null if the fixed-function pipeline is enabled
+    VertexProgramCache m_programCache;
+    std::shared_ptr<const VertexProgram> m_vertexProgram;
+
+    // Fixed-function pipeline state, used when no vertex program is in use
+    FixedFunctionState m_fixedFunction;
+
+    // Pixel kernels by register combiner and texture shader state
+    CombinerCache m_combinerCache;
+
+    // Render targets and their working copies
+    SurfaceCache m_surfaceCache;
+    CachedSurface* m_colorSurface = nullptr;
+    CachedSurface* m_zetaSurface = nullptr;
+    bool m_surfacesWritten = false;   // The renderer has work for the surfaces since the last flush
+
+    // Writes made to surfaces by the guest CPU and other devices, which
+    // invalidate working copies and the hierarchical depth data of the
+    // renderer. Writes are collected before the first draw or clear after
+    // each flush.
+    GuestMemory* m_memory = nullptr;   // Null if guest writes are not tracked
+    int m_memoryView = -1;
+    bool m_collectPending = false;
+    std::vector<uint64_t> m_dirtyPages;
+
+    // Flushes the renderer and records the surface writes
+    void CompleteRendering();
+
+    // Reloads surfaces written by the guest CPU and notifies the renderer of
+    // writes to the zeta buffer
+    void CollectGuestWrites();
+
+    // Makes rendering to surfaces overlapping the range of guest memory
+    // visible to texture lookups
+    void ResolveSurfaceWrites(uint32_t address, uint32_t size);
+
+    // Returns the PGRAPH tile region holding the range of guest memory, or
+    // -1 if none does
+    int32_t FindTileRegion(uint32_t address, uint32_t size) const;
+
+    // Determines if the tile region has Z compression enabled for the format
+    bool IsZetaCompressed(int32_t tile, SurfaceZetaFormat format) const;
+
+    void UpdateRenderState();
+    void UpdateSurfaces();
+    void UpdateRasterState();
+    void UpdateTexture(uint32_t stage);
+    void UpdateVertexProgram();
+    void UpdateCombiners();
+    void FlushBatch();
+
+    // Points each attribute to its array, covering count elements starting
+    // at first, or to its current value if it has no array. Returns false if
+    // an array is out of bounds.
+    bool ResolveVertexArrays(uint32_t first, uint32_t count, VertexAttributeSource* sources);
+
+    // Runs the vertex program or fixed-function pipeline into m_vertices
+    void TransformVertices(const float* inputs, uint32_t count);
+
+    // Draws the triangles in m_indices
+    void DrawVertices();
+
+    void DrawInlineArray();
+    void DrawArrays();
+    void DrawElements();
+};
+
+// ----------------------------------------------------------------------------
+
+// Builds a method table at compile time. All methods start with the given
+// default handler; ranges of methods are then assigned with Set, and Finish
+// computes the run lengths.
+class MethodTableBuilder {
+public:
+    constexpr MethodTableBuilder(MethodHandler defaultHandler)
+        : m_table()
+    {
+        for (uint32_t i = 0; i < kMethodCount; i++) {
+            m_table[i] = MethodEntry{ defaultHandler, 0, 1 };
+        }
+    }
+
+    // Assigns the handler to count methods starting at the given method offset
+    constexpr MethodTableBuilder& Set(uint32_t offset, uint32_t count, MethodHandler handler, uint32_t dirty = 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            m_table[(offset >> 2) + i] = MethodEntry{ handler, dirty, 1 };
+        }
+        return *this;
+    }
+
+    constexpr MethodTable Finish() {
+        uint16_t runLength = 0;
+        for (uint32_t i = kMethodCount; i-- > 0; ) {
+            if (i + 1 < kMethodCount && m_table[i].handler == m_table[i + 1].handler && m_table[i].dirty == m_table[i + 1].dirty) {
+                runLength++;
+            }
+            else {
+                runLength = 1;
+            }
+            m_table[i].runLength = runLength;
+        }
+        return m_table;
+    }
+
+private:
+    MethodTable m_table;
+};
+
+}
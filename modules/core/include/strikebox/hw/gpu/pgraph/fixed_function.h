@@ -0,0 +1,111 @@
+// StrikeBox NV2A PGRAPH fixed-function transform and lighting
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+//
+// The fixed-function pipeline transforms vertices with the matrices loaded
+// through the Kelvin object, optionally blending up to four model-view
+// matrices by the vertex weights, then computes lighting from up to eight
+// lights, generates texture coordinates and computes the fog coordinate.
+//
+// The state is decoded from the Kelvin registers only when it changes. The
+// features in use form a bitmask that selects one of a set of variants of the
+// pipeline instantiated at compile time, so disabled features cost nothing
+// per vertex; each enabled light is likewise processed by a variant
+// specialized for its type. Vertices are processed in batches, one vertex
+// per SIMD lane, with every component of an attribute held in a vector.
+#pragma once
+
+#include <cstdint>
+
+#include "kelvin.h"
+#include "renderer.h"
+
+namespace strikebox::nv2a {
+
+// Features of the fixed-function pipeline; each combination has its own
+// variant of the pipeline
+enum FixedFunctionFeature : uint32_t {
+    FixedFunction_Skinning = (1 << 0),   // Blend model-view matrices by vertex weights
+    FixedFunction_Lighting = (1 << 1),
+    FixedFunction_Specular = (1 << 2),   // Specular lighting; only set along with lighting
+    FixedFunction_Texgen = (1 << 3),     // Texture coordinate generation or texture matrices
+    FixedFunction_Fog = (1 << 4),
+
+    FixedFunction_All = (1 << 5) - 1,
+};
+
+enum class LightType : uint8_t {
+    Off, Infinite, Local, Spot,
+};
+
+// Source of material colors selected by SET_COLOR_MATERIAL
+enum class MaterialSource : uint8_t {
+    Material, Diffuse, Specular,
+};
+
+// Parameters of a light, in eye space. Light colors are premultiplied by the
+// material colors.
+struct FixedFunctionLight {
+    LightType type;
+    float ambient[3];
+    float diffuse[3];
+    float specular[3];
+    float range;             // Local and spot lights have no effect beyond this distance
+    float halfVector[3];     // Infinite lights
+    float direction[3];      // Infinite lights; points towards the light
+    float spotFalloff[3];
+    float spotDirection[4];
+    float position[3];       // Local and spot lights
+    float attenuation[3];    // Constant, linear and quadratic
+};
+
+struct FixedFunctionState {
+    uint32_t features;
+
+    // Transform. Matrices are stored as four rows of four floats; each
+    // component of the result is the dot product of the vertex and a row.
+    uint32_t skinMatrices;    // Number of blended matrices
+    bool skinImplicitWeight;  // The weight of the last matrix is one minus the sum of the others
+    bool normalize;
+    float modelView[4][16];
+    float inverseModelView[4][16];
+    float composite[16];
+
+    // Lighting. Only enabled lights are listed.
+    uint32_t lightCount;
+    FixedFunctionLight lights[kKelvinLightCount];
+    MaterialSource emissionSource;
+    MaterialSource ambientSource;
+    MaterialSource diffuseSource;
+    MaterialSource specularSource;
+    float sceneAmbient[3];
+    float materialEmission[3];
+    float materialAlpha;
+    float specularParams[6];
+
+    // Texture coordinate generation, per stage and coordinate (S, T, R, Q)
+    uint32_t texgen[kKelvinTextureCount][4];
+    float texgenPlanes[kKelvinTextureCount][4][4];
+    bool textureMatrixEnable[kKelvinTextureCount];
+    float textureMatrix[kKelvinTextureCount][16];
+
+    // Fog
+    uint32_t fogGenMode;
+    float fogPlane[4];
+};
+
+// Decodes the fixed-function pipeline state from the Kelvin state
+void DecodeFixedFunctionState(const KelvinState& state, FixedFunctionState& ff);
+
+// Transforms and lights count vertices. Each input vertex has
+// kKelvinAttributeCount attributes of four floats. Positions are output in
+// window coordinates.
+void RunFixedFunction(const FixedFunctionState& ff, const float* inputs, uint32_t count, RasterVertex* outputs);
+
+}
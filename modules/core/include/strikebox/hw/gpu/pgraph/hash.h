@@ -0,0 +1,90 @@
+// StrikeBox NV2A PGRAPH content hashing
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Fast non-cryptographic hash used to detect changes to guest memory ranges
+// backing cached resources. The mixing follows the structure of XXH64: four
+// independent accumulators consume 32 bytes per iteration, which keeps the
+// hash close to memory bandwidth.
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace strikebox::nv2a {
+
+namespace hash_detail {
+
+const uint64_t kPrime1 = 0x9e3779b185ebca87ull;
+const uint64_t kPrime2 = 0xc2b2ae3d27d4eb4full;
+const uint64_t kPrime3 = 0x165667b19e3779f9ull;
+const uint64_t kPrime4 = 0x85ebca77c2b2ae63ull;
+const uint64_t kPrime5 = 0x27d4eb2f165667c5ull;
+
+inline uint64_t Rotl(uint64_t value, uint32_t shift) {
+    return (value << shift) | (value >> (64 - shift));
+}
+
+inline uint64_t Read64(const uint8_t* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint64_t Round(uint64_t acc, uint64_t input) {
+    return Rotl(acc + input * kPrime2, 31) * kPrime1;
+}
+
+inline uint64_t Merge(uint64_t acc, uint64_t value) {
+    return (acc ^ Round(0, value)) * kPrime1 + kPrime4;
+}
+
+}
+
+// Hashes size bytes starting at data
+inline uint64_t HashMemory(const void* data, size_t size, uint64_t seed = 0) {
+    using namespace hash_detail;
+
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + kPrime1 + kPrime2;
+        uint64_t v2 = seed + kPrime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kPrime1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+        }
+        h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+        h = Merge(h, v1);
+        h = Merge(h, v2);
+        h = Merge(h, v3);
+        h = Merge(h, v4);
+    }
+    else {
+        h = seed + kPrime5;
+    }
+
+    h += static_cast<uint64_t>(size);
+    for (; p + 8 <= end; p += 8) {
+        h ^= Round(0, Read64(p));
+        h = Rotl(h, 27) * kPrime1 + kPrime4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * kPrime5;
+        h = Rotl(h, 11) * kPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+}
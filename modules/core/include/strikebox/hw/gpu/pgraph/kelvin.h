@@ -0,0 +1,387 @@
+// StrikeBox NV2A PGRAPH Kelvin (NV20-class 3D) object definitions
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+//
+// [https://envytools.readthedocs.io/en/latest/hw/graph/kelvin/intro.html]
+// Kelvin is the 3D object class of NV20-family GPUs. The NV2A exposes it as
+// class 0x97. Methods are identified by their byte offset in the object's
+// method space, which spans 0x0000..0x1FFF.
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace strikebox::nv2a {
+
+// Object class of the Kelvin 3D primitive object
+const uint32_t kKelvinClass = 0x97;
+
+// Number of methods in an object's method space
+const uint32_t kMethodCount = 0x800;
+
+// Kelvin methods
+// [https://github.com/torvalds/linux/blob/master/drivers/gpu/drm/nouveau/nv20_3d.xml.h]
+const uint32_t Mthd_KELVIN_NO_OPERATION = 0x0100;
+const uint32_t Mthd_KELVIN_NOTIFY = 0x0104;
+const uint32_t Mthd_KELVIN_WAIT_FOR_IDLE = 0x0110;
+const uint32_t Mthd_KELVIN_SET_FLIP_READ = 0x0120;
+const uint32_t Mthd_KELVIN_SET_FLIP_WRITE = 0x0124;
+const uint32_t Mthd_KELVIN_SET_FLIP_MODULO = 0x0128;
+const uint32_t Mthd_KELVIN_FLIP_INCREMENT_WRITE = 0x012c;
+const uint32_t Mthd_KELVIN_FLIP_STALL = 0x0130;
+
+const uint32_t Mthd_KELVIN_SET_CONTEXT_DMA_NOTIFIES = 0x0180;
+const uint32_t Mthd_KELVIN_SET_CONTEXT_DMA_A = 0x0184;
+const uint32_t Mthd_KELVIN_SET_CONTEXT_DMA_B = 0x0188;
+const uint32_t Mthd_KELVIN_SET_CONTEXT_DMA_STATE = 0x0190;
+const uint32_t Mthd_KELVIN_SET_CONTEXT_DMA_COLOR = 0x0194;
+const uint32_t Mthd_KELVIN_SET_CONTEXT_DMA_ZETA = 0x0198;
+const uint32_t Mthd_KELVIN_SET_CONTEXT_DMA_VERTEX_A = 0x019c;
+const uint32_t Mthd_KELVIN_SET_CONTEXT_DMA_VERTEX_B = 0x01a0;
+const uint32_t Mthd_KELVIN_SET_CONTEXT_DMA_SEMAPHORE = 0x01a4;
+const uint32_t Mthd_KELVIN_SET_CONTEXT_DMA_REPORT = 0x01a8;
+
+const uint32_t Mthd_KELVIN_SET_SURFACE_CLIP_HORIZONTAL = 0x0200;
+const uint32_t Mthd_KELVIN_SET_SURFACE_CLIP_VERTICAL = 0x0204;
+const uint32_t Mthd_KELVIN_SET_SURFACE_FORMAT = 0x0208;
+const uint32_t Mthd_KELVIN_SET_SURFACE_PITCH = 0x020c;
+const uint32_t Mthd_KELVIN_SET_SURFACE_COLOR_OFFSET = 0x0210;
+const uint32_t Mthd_KELVIN_SET_SURFACE_ZETA_OFFSET = 0x0214;
+
+const uint32_t Mthd_KELVIN_SET_COMBINER_ALPHA_ICW = 0x0260;          // 8 stages
+const uint32_t Mthd_KELVIN_SET_COMBINER_SPECULAR_FOG_CW0 = 0x0288;
+const uint32_t Mthd_KELVIN_SET_COMBINER_SPECULAR_FOG_CW1 = 0x028c;
+const uint32_t Mthd_KELVIN_SET_CONTROL0 = 0x0290;
+const uint32_t Mthd_KELVIN_SET_LIGHT_CONTROL = 0x0294;
+const uint32_t Mthd_KELVIN_SET_COLOR_MATERIAL = 0x0298;
+const uint32_t Mthd_KELVIN_SET_FOG_MODE = 0x029c;
+const uint32_t Mthd_KELVIN_SET_FOG_GEN_MODE = 0x02a0;
+const uint32_t Mthd_KELVIN_SET_FOG_ENABLE = 0x02a4;
+const uint32_t Mthd_KELVIN_SET_FOG_COLOR = 0x02a8;
+const uint32_t Mthd_KELVIN_SET_WINDOW_CLIP_TYPE = 0x02b4;
+const uint32_t Mthd_KELVIN_SET_WINDOW_CLIP_HORIZONTAL = 0x02c0;      // 8 rectangles
+const uint32_t Mthd_KELVIN_SET_WINDOW_CLIP_VERTICAL = 0x02e0;        // 8 rectangles
+
+const uint32_t Mthd_KELVIN_SET_ALPHA_TEST_ENABLE = 0x0300;
+const uint32_t Mthd_KELVIN_SET_BLEND_ENABLE = 0x0304;
+const uint32_t Mthd_KELVIN_SET_CULL_FACE_ENABLE = 0x0308;
+const uint32_t Mthd_KELVIN_SET_DEPTH_TEST_ENABLE = 0x030c;
+const uint32_t Mthd_KELVIN_SET_DITHER_ENABLE = 0x0310;
+const uint32_t Mthd_KELVIN_SET_LIGHTING_ENABLE = 0x0314;
+const uint32_t Mthd_KELVIN_SET_POINT_PARAMS_ENABLE = 0x0318;
+const uint32_t Mthd_KELVIN_SET_POINT_SMOOTH_ENABLE = 0x031c;
+const uint32_t Mthd_KELVIN_SET_LINE_SMOOTH_ENABLE = 0x0320;
+const uint32_t Mthd_KELVIN_SET_POLY_SMOOTH_ENABLE = 0x0324;
+const uint32_t Mthd_KELVIN_SET_SKIN_MODE = 0x0328;
+const uint32_t Mthd_KELVIN_SET_STENCIL_TEST_ENABLE = 0x032c;
+const uint32_t Mthd_KELVIN_SET_POLY_OFFSET_POINT_ENABLE = 0x0330;
+const uint32_t Mthd_KELVIN_SET_POLY_OFFSET_LINE_ENABLE = 0x0334;
+const uint32_t Mthd_KELVIN_SET_POLY_OFFSET_FILL_ENABLE = 0x0338;
+const uint32_t Mthd_KELVIN_SET_ALPHA_FUNC = 0x033c;
+const uint32_t Mthd_KELVIN_SET_ALPHA_REF = 0x0340;
+const uint32_t Mthd_KELVIN_SET_BLEND_FUNC_SFACTOR = 0x0344;
+const uint32_t Mthd_KELVIN_SET_BLEND_FUNC_DFACTOR = 0x0348;
+const uint32_t Mthd_KELVIN_SET_BLEND_COLOR = 0x034c;
+const uint32_t Mthd_KELVIN_SET_BLEND_EQUATION = 0x0350;
+const uint32_t Mthd_KELVIN_SET_DEPTH_FUNC = 0x0354;
+const uint32_t Mthd_KELVIN_SET_COLOR_MASK = 0x0358;
+const uint32_t Mthd_KELVIN_SET_DEPTH_MASK = 0x035c;
+const uint32_t Mthd_KELVIN_SET_STENCIL_MASK = 0x0360;
+const uint32_t Mthd_KELVIN_SET_STENCIL_FUNC = 0x0364;
+const uint32_t Mthd_KELVIN_SET_STENCIL_FUNC_REF = 0x0368;
+const uint32_t Mthd_KELVIN_SET_STENCIL_FUNC_MASK = 0x036c;
+const uint32_t Mthd_KELVIN_SET_STENCIL_OP_FAIL = 0x0370;
+const uint32_t Mthd_KELVIN_SET_STENCIL_OP_ZFAIL = 0x0374;
+const uint32_t Mthd_KELVIN_SET_STENCIL_OP_ZPASS = 0x0378;
+const uint32_t Mthd_KELVIN_SET_SHADE_MODE = 0x037c;
+const uint32_t Mthd_KELVIN_SET_LINE_WIDTH = 0x0380;
+const uint32_t Mthd_KELVIN_SET_POLYGON_OFFSET_SCALE_FACTOR = 0x0384;
+const uint32_t Mthd_KELVIN_SET_POLYGON_OFFSET_BIAS = 0x0388;
+const uint32_t Mthd_KELVIN_SET_FRONT_POLYGON_MODE = 0x038c;
+const uint32_t Mthd_KELVIN_SET_BACK_POLYGON_MODE = 0x0390;
+const uint32_t Mthd_KELVIN_SET_CLIP_MIN = 0x0394;
+const uint32_t Mthd_KELVIN_SET_CLIP_MAX = 0x0398;
+const uint32_t Mthd_KELVIN_SET_CULL_FACE = 0x039c;
+const uint32_t Mthd_KELVIN_SET_FRONT_FACE = 0x03a0;
+const uint32_t Mthd_KELVIN_SET_NORMALIZATION_ENABLE = 0x03a4;
+const uint32_t Mthd_KELVIN_SET_MATERIAL_EMISSION = 0x03a8;           // 3 floats
+const uint32_t Mthd_KELVIN_SET_MATERIAL_ALPHA = 0x03b4;
+const uint32_t Mthd_KELVIN_SET_SPECULAR_ENABLE = 0x03b8;
+const uint32_t Mthd_KELVIN_SET_LIGHT_ENABLE_MASK = 0x03bc;
+const uint32_t Mthd_KELVIN_SET_TEXGEN_S = 0x03c0;                    // 4 stages, stride 0x10 (S, T, R, Q)
+const uint32_t Mthd_KELVIN_SET_TEXTURE_MATRIX_ENABLE = 0x0420;       // 4 stages
+const uint32_t Mthd_KELVIN_SET_POINT_SIZE = 0x043c;
+
+const uint32_t Mthd_KELVIN_SET_PROJECTION_MATRIX = 0x0440;           // 16 floats
+const uint32_t Mthd_KELVIN_SET_MODEL_VIEW_MATRIX = 0x0480;           // 4 matrices of 16 floats
+const uint32_t Mthd_KELVIN_SET_INVERSE_MODEL_VIEW_MATRIX = 0x0580;   // 4 matrices of 16 floats
+const uint32_t Mthd_KELVIN_SET_COMPOSITE_MATRIX = 0x0680;            // 16 floats
+const uint32_t Mthd_KELVIN_SET_TEXTURE_MATRIX = 0x06c0;              // 4 matrices of 16 floats
+const uint32_t Mthd_KELVIN_SET_TEXGEN_PLANE_S = 0x0840;              // 4 stages, stride 0x40 (S, T, R, Q planes)
+const uint32_t Mthd_KELVIN_SET_FOG_PARAMS = 0x09c0;                  // 3 floats
+const uint32_t Mthd_KELVIN_SET_TEXGEN_VIEW_MODEL = 0x09cc;
+const uint32_t Mthd_KELVIN_SET_FOG_PLANE = 0x09d0;                   // 4 floats
+const uint32_t Mthd_KELVIN_SET_SPECULAR_PARAMS = 0x09e0;             // 6 floats
+const uint32_t Mthd_KELVIN_SET_SWATH_WIDTH = 0x09f8;
+const uint32_t Mthd_KELVIN_SET_FLAT_SHADE_OP = 0x09fc;
+const uint32_t Mthd_KELVIN_SET_SCENE_AMBIENT_COLOR = 0x0a10;         // 3 floats
+const uint32_t Mthd_KELVIN_SET_VIEWPORT_OFFSET = 0x0a20;             // 4 floats
+const uint32_t Mthd_KELVIN_SET_POINT_PARAMS = 0x0a30;                // 8 floats
+const uint32_t Mthd_KELVIN_SET_EYE_POSITION = 0x0a50;                // 4 floats
+const uint32_t Mthd_KELVIN_SET_COMBINER_FACTOR0 = 0x0a60;            // 8 stages
+const uint32_t Mthd_KELVIN_SET_COMBINER_FACTOR1 = 0x0a80;            // 8 stages
+const uint32_t Mthd_KELVIN_SET_COMBINER_ALPHA_OCW = 0x0aa0;          // 8 stages
+const uint32_t Mthd_KELVIN_SET_COMBINER_COLOR_ICW = 0x0ac0;          // 8 stages
+const uint32_t Mthd_KELVIN_SET_COLOR_KEY_COLOR = 0x0ae0;             // 4 stages
+const uint32_t Mthd_KELVIN_SET_VIEWPORT_SCALE = 0x0af0;              // 4 floats
+const uint32_t Mthd_KELVIN_SET_TRANSFORM_PROGRAM = 0x0b00;           // 32 words, streamed into program memory
+const uint32_t Mthd_KELVIN_SET_TRANSFORM_CONSTANT = 0x0b80;          // 32 words, streamed into constant memory
+const uint32_t Mthd_KELVIN_SET_BACK_LIGHT = 0x0c00;                  // 8 lights, stride 0x40
+const uint32_t Mthd_KELVIN_SET_LIGHT = 0x1000;                       // 8 lights, stride 0x80
+const uint32_t Mthd_KELVIN_SET_STIPPLE_CONTROL = 0x147c;
+const uint32_t Mthd_KELVIN_SET_STIPPLE_PATTERN = 0x1480;             // 32 words
+
+// Immediate mode vertex attributes (legacy fixed-function forms)
+const uint32_t Mthd_KELVIN_SET_VERTEX3F = 0x1500;
+const uint32_t Mthd_KELVIN_SET_VERTEX4F = 0x1518;
+const uint32_t Mthd_KELVIN_SET_NORMAL3F = 0x1530;
+const uint32_t Mthd_KELVIN_SET_DIFFUSE_COLOR4F = 0x1550;
+const uint32_t Mthd_KELVIN_SET_DIFFUSE_COLOR3F = 0x1560;
+const uint32_t Mthd_KELVIN_SET_DIFFUSE_COLOR4UB = 0x156c;
+const uint32_t Mthd_KELVIN_SET_SPECULAR_COLOR4F = 0x1570;
+const uint32_t Mthd_KELVIN_SET_SPECULAR_COLOR3F = 0x1580;
+const uint32_t Mthd_KELVIN_SET_SPECULAR_COLOR4UB = 0x158c;
+const uint32_t Mthd_KELVIN_SET_TEXCOORD0_2F = 0x1590;                // texture coordinate blocks have a stride of 0x28
+const uint32_t Mthd_KELVIN_SET_TEXCOORD0_4F = 0x15a0;
+const uint32_t Mthd_KELVIN_SET_FOG1F = 0x1698;
+const uint32_t Mthd_KELVIN_SET_WEIGHT1F = 0x169c;
+const uint32_t Mthd_KELVIN_SET_EDGE_FLAG = 0x16bc;
+
+const uint32_t Mthd_KELVIN_SET_VERTEX_DATA_ARRAY_OFFSET = 0x1720;    // 16 attributes
+const uint32_t Mthd_KELVIN_SET_VERTEX_DATA_ARRAY_FORMAT = 0x1760;    // 16 attributes
+const uint32_t Mthd_KELVIN_SET_BACK_SCENE_AMBIENT_COLOR = 0x17a0;    // 3 floats
+const uint32_t Mthd_KELVIN_SET_BACK_MATERIAL_ALPHA = 0x17ac;
+const uint32_t Mthd_KELVIN_SET_BACK_MATERIAL_EMISSION = 0x17b0;      // 3 floats
+const uint32_t Mthd_KELVIN_SET_LOGIC_OP_ENABLE = 0x17bc;
+const uint32_t Mthd_KELVIN_SET_LOGIC_OP = 0x17c0;
+const uint32_t Mthd_KELVIN_SET_TWO_SIDE_LIGHT_EN = 0x17c4;
+const uint32_t Mthd_KELVIN_CLEAR_REPORT_VALUE = 0x17c8;
+const uint32_t Mthd_KELVIN_SET_ZPASS_PIXEL_COUNT_ENABLE = 0x17cc;
+const uint32_t Mthd_KELVIN_GET_REPORT = 0x17d0;
+const uint32_t Mthd_KELVIN_SET_TL_CONST_ZERO = 0x17d4;               // 3 floats
+const uint32_t Mthd_KELVIN_SET_EYE_DIRECTION = 0x17e0;               // 3 floats
+const uint32_t Mthd_KELVIN_SET_LINEAR_FOG_CONST = 0x17ec;            // 3 floats
+const uint32_t Mthd_KELVIN_SET_SHADER_CLIP_PLANE_MODE = 0x17f8;
+const uint32_t Mthd_KELVIN_SET_BEGIN_END = 0x17fc;
+const uint32_t Mthd_KELVIN_ARRAY_ELEMENT16 = 0x1800;
+const uint32_t Mthd_KELVIN_ARRAY_ELEMENT32 = 0x1808;
+const uint32_t Mthd_KELVIN_DRAW_ARRAYS = 0x1810;
+const uint32_t Mthd_KELVIN_INLINE_ARRAY = 0x1818;
+const uint32_t Mthd_KELVIN_SET_EYE_VECTOR = 0x181c;                  // 3 floats
+
+// Immediate mode vertex attributes (generic forms)
+const uint32_t Mthd_KELVIN_SET_VERTEX_DATA2F_M = 0x1880;             // 16 attributes of 2 floats
+const uint32_t Mthd_KELVIN_SET_VERTEX_DATA2S = 0x1900;               // 16 attributes of 2 packed shorts
+const uint32_t Mthd_KELVIN_SET_VERTEX_DATA4UB = 0x1940;              // 16 attributes of 4 packed unsigned bytes
+const uint32_t Mthd_KELVIN_SET_VERTEX_DATA4S_M = 0x1980;             // 16 attributes of 4 shorts in 2 words
+const uint32_t Mthd_KELVIN_SET_VERTEX_DATA4F_M = 0x1a00;             // 16 attributes of 4 floats
+
+const uint32_t Mthd_KELVIN_SET_TEXTURE_OFFSET = 0x1b00;              // 4 stages, stride 0x40
+const uint32_t Mthd_KELVIN_SET_TEXTURE_FORMAT = 0x1b04;
+const uint32_t Mthd_KELVIN_SET_TEXTURE_ADDRESS = 0x1b08;
+const uint32_t Mthd_KELVIN_SET_TEXTURE_CONTROL0 = 0x1b0c;
+const uint32_t Mthd_KELVIN_SET_TEXTURE_CONTROL1 = 0x1b10;
+const uint32_t Mthd_KELVIN_SET_TEXTURE_FILTER = 0x1b14;
+const uint32_t Mthd_KELVIN_SET_TEXTURE_IMAGE_RECT = 0x1b1c;
+const uint32_t Mthd_KELVIN_SET_TEXTURE_PALETTE = 0x1b20;
+const uint32_t Mthd_KELVIN_SET_TEXTURE_BORDER_COLOR = 0x1b24;
+const uint32_t Mthd_KELVIN_SET_TEXTURE_SET_BUMP_ENV_MAT = 0x1b28;    // 4 floats
+const uint32_t Mthd_KELVIN_SET_TEXTURE_SET_BUMP_ENV_SCALE = 0x1b38;
+const uint32_t Mthd_KELVIN_SET_TEXTURE_SET_BUMP_ENV_OFFSET = 0x1b3c;
+const uint32_t kKelvinTextureStride = 0x40;
+
+const uint32_t Mthd_KELVIN_SET_SEMAPHORE_OFFSET = 0x1d6c;
+const uint32_t Mthd_KELVIN_BACK_END_WRITE_SEMAPHORE_RELEASE = 0x1d70;
+const uint32_t Mthd_KELVIN_SET_ZMIN_MAX_CONTROL = 0x1d78;
+const uint32_t Mthd_KELVIN_SET_ANTI_ALIASING_CONTROL = 0x1d7c;
+const uint32_t Mthd_KELVIN_SET_COMPRESS_ZBUFFER_EN = 0x1d80;
+const uint32_t Mthd_KELVIN_SET_OCCLUDE_ZSTENCIL_EN = 0x1d84;
+const uint32_t Mthd_KELVIN_SET_ZSTENCIL_CLEAR_VALUE = 0x1d8c;
+const uint32_t Mthd_KELVIN_SET_COLOR_CLEAR_VALUE = 0x1d90;
+const uint32_t Mthd_KELVIN_CLEAR_SURFACE = 0x1d94;
+const uint32_t Mthd_KELVIN_SET_CLEAR_RECT_HORIZONTAL = 0x1d98;
+const uint32_t Mthd_KELVIN_SET_CLEAR_RECT_VERTICAL = 0x1d9c;
+const uint32_t Mthd_KELVIN_SET_SPECULAR_FOG_FACTOR = 0x1e20;         // 2 words
+const uint32_t Mthd_KELVIN_SET_BACK_SPECULAR_PARAMS = 0x1e28;        // 6 floats
+const uint32_t Mthd_KELVIN_SET_COMBINER_COLOR_OCW = 0x1e40;          // 8 stages
+const uint32_t Mthd_KELVIN_SET_COMBINER_CONTROL = 0x1e60;
+const uint32_t Mthd_KELVIN_SET_SHADOW_ZSLOPE_THRESHOLD = 0x1e68;
+const uint32_t Mthd_KELVIN_SET_SHADOW_DEPTH_FUNC = 0x1e6c;
+const uint32_t Mthd_KELVIN_SET_SHADER_STAGE_PROGRAM = 0x1e70;
+const uint32_t Mthd_KELVIN_SET_DOT_RGBMAPPING = 0x1e74;
+const uint32_t Mthd_KELVIN_SET_SHADER_OTHER_STAGE_INPUT = 0x1e78;
+const uint32_t Mthd_KELVIN_SET_TRANSFORM_DATA = 0x1e80;              // 4 words
+const uint32_t Mthd_KELVIN_LAUNCH_TRANSFORM_PROGRAM = 0x1e90;
+const uint32_t Mthd_KELVIN_SET_TRANSFORM_EXECUTION_MODE = 0x1e94;
+const uint32_t Mthd_KELVIN_SET_TRANSFORM_PROGRAM_CXT_WRITE_EN = 0x1e98;
+const uint32_t Mthd_KELVIN_SET_TRANSFORM_PROGRAM_LOAD = 0x1e9c;
+const uint32_t Mthd_KELVIN_SET_TRANSFORM_PROGRAM_START = 0x1ea0;
+const uint32_t Mthd_KELVIN_SET_TRANSFORM_CONSTANT_LOAD = 0x1ea4;
+
+// Values of SET_BEGIN_END
+enum class KelvinPrimitive : uint32_t {
+    End,
+    Points,
+    Lines,
+    LineLoop,
+    LineStrip,
+    Triangles,
+    TriangleStrip,
+    TriangleFan,
+    Quads,
+    QuadStrip,
+    Polygon,
+};
+
+// CLEAR_SURFACE flags
+const uint32_t Val_KELVIN_CLEAR_SURFACE_Z = (1 << 0);
+const uint32_t Val_KELVIN_CLEAR_SURFACE_STENCIL = (1 << 1);
+const uint32_t Val_KELVIN_CLEAR_SURFACE_COLOR = (0xf << 4);
+
+// SET_TEXTURE_FORMAT fields
+const uint32_t Val_KELVIN_TEXTURE_FORMAT_CONTEXT_DMA_B = 2;       // bits 1..0: 1 = context DMA A, 2 = context DMA B
+const uint32_t Val_KELVIN_TEXTURE_FORMAT_CUBEMAP = (1 << 2);
+const uint32_t Val_KELVIN_TEXTURE_FORMAT_DIMENSIONALITY_3D = 3;   // bits 7..4
+// bits 15..8 = color format, bits 19..16 = mipmap levels, bits 23..20, 27..24, 31..28 = log2 width, height, depth
+
+// SET_TEXTURE_CONTROL0 fields
+const uint32_t Val_KELVIN_TEXTURE_CONTROL0_ENABLE = (1u << 30);
+
+// SET_TEXTURE_PALETTE fields
+const uint32_t Val_KELVIN_TEXTURE_PALETTE_CONTEXT_DMA_B = (1 << 0);
+// bits 3..2 = length (0 = 256, 1 = 128, 2 = 64, 3 = 32 entries), bits 31..6 = offset
+
+// SET_TRANSFORM_EXECUTION_MODE fields
+const uint32_t Val_KELVIN_TRANSFORM_EXECUTION_MODE_PROGRAM = 2;   // bits 1..0: 0 = fixed function, 2 = program
+
+// SET_SKIN_MODE values: 0 = off; 1, 3, 5 = 2, 3, 4 matrices with the last weight implied;
+//   2, 4, 6 = 2, 3, 4 matrices with explicit weights
+
+// SET_COLOR_MATERIAL fields: bits 1..0 = emission, 3..2 = ambient, 5..4 = diffuse, 7..6 = specular source
+//   (0 = material, 1 = diffuse color, 2 = specular color)
+
+// SET_LIGHT_ENABLE_MASK fields: two bits per light (0 = off, 1 = infinite, 2 = local, 3 = spot)
+
+// SET_LIGHT fields, as offsets from the method of each light
+const uint32_t Mthd_KELVIN_LIGHT_AMBIENT_COLOR = 0x00;          // 3 floats
+const uint32_t Mthd_KELVIN_LIGHT_DIFFUSE_COLOR = 0x0c;          // 3 floats
+const uint32_t Mthd_KELVIN_LIGHT_SPECULAR_COLOR = 0x18;         // 3 floats
+const uint32_t Mthd_KELVIN_LIGHT_LOCAL_RANGE = 0x24;
+const uint32_t Mthd_KELVIN_LIGHT_INFINITE_HALF_VECTOR = 0x28;   // 3 floats
+const uint32_t Mthd_KELVIN_LIGHT_INFINITE_DIRECTION = 0x34;     // 3 floats
+const uint32_t Mthd_KELVIN_LIGHT_SPOT_FALLOFF = 0x40;           // 3 floats
+const uint32_t Mthd_KELVIN_LIGHT_SPOT_DIRECTION = 0x4c;         // 4 floats
+const uint32_t Mthd_KELVIN_LIGHT_LOCAL_POSITION = 0x5c;         // 3 floats
+const uint32_t Mthd_KELVIN_LIGHT_LOCAL_ATTENUATION = 0x68;      // 3 floats
+const uint32_t kKelvinLightStride = 0x80;
+
+// SET_TEXGEN_* values
+const uint32_t Val_KELVIN_TEXGEN_DISABLE = 0;
+const uint32_t Val_KELVIN_TEXGEN_EYE_LINEAR = 0x2400;
+const uint32_t Val_KELVIN_TEXGEN_OBJECT_LINEAR = 0x2401;
+const uint32_t Val_KELVIN_TEXGEN_SPHERE_MAP = 0x2402;
+const uint32_t Val_KELVIN_TEXGEN_NORMAL_MAP = 0x8511;
+const uint32_t Val_KELVIN_TEXGEN_REFLECTION_MAP = 0x8512;
+
+// SET_FOG_GEN_MODE values
+const uint32_t Val_KELVIN_FOG_GEN_SPEC_ALPHA = 0;
+const uint32_t Val_KELVIN_FOG_GEN_RADIAL = 1;
+const uint32_t Val_KELVIN_FOG_GEN_PLANAR = 2;
+const uint32_t Val_KELVIN_FOG_GEN_ABS_PLANAR = 3;
+const uint32_t Val_KELVIN_FOG_GEN_FOG_X = 6;
+
+// Sizes of the transform engine memories
+const uint32_t kKelvinProgramSize = 136;     // instructions of 4 words
+const uint32_t kKelvinConstantCount = 192;   // vectors of 4 floats
+const uint32_t kKelvinAttributeCount = 16;
+const uint32_t kKelvinTextureCount = 4;
+const uint32_t kKelvinLightCount = 8;
+
+// Vertex attribute slots
+const uint32_t kKelvinAttr_Position = 0;
+const uint32_t kKelvinAttr_Weight = 1;
+const uint32_t kKelvinAttr_Normal = 2;
+const uint32_t kKelvinAttr_Diffuse = 3;
+const uint32_t kKelvinAttr_Specular = 4;
+const uint32_t kKelvinAttr_Fog = 5;
+const uint32_t kKelvinAttr_PointSize = 6;
+const uint32_t kKelvinAttr_BackDiffuse = 7;
+const uint32_t kKelvinAttr_BackSpecular = 8;
+const uint32_t kKelvinAttr_TexCoord0 = 9;
+
+// ----------------------------------------------------------------------------
+
+// Groups of Kelvin state that can be marked as modified. Consumers of the
+// state check these bits to find out what needs to be recomputed.
+enum KelvinDirty : uint32_t {
+    KelvinDirty_Surface = (1 << 0),          // Surface format, pitch, offsets, clip, context DMAs
+    KelvinDirty_Viewport = (1 << 1),         // Viewport, clip range, window clip
+    KelvinDirty_Rasterizer = (1 << 2),       // Culling, polygon modes, shading, offsets, stipple
+    KelvinDirty_Blend = (1 << 3),            // Blending, logic op, color mask, dither
+    KelvinDirty_DepthStencil = (1 << 4),     // Depth, stencil and alpha tests
+    KelvinDirty_Combiners = (1 << 5),        // Register combiners and shader stages
+    KelvinDirty_Transform = (1 << 6),        // Matrices, texgen, skinning, fixed-function control
+    KelvinDirty_Lighting = (1 << 7),         // Lights and materials
+    KelvinDirty_Fog = (1 << 8),              // Fog parameters
+    KelvinDirty_VertexArrays = (1 << 9),     // Vertex array offsets and formats
+    KelvinDirty_VertexProgram = (1 << 10),   // Transform program memory and execution mode
+    KelvinDirty_VertexConstants = (1 << 11), // Transform constant memory
+    KelvinDirty_Control = (1 << 12),         // Z range control, anti-aliasing, compression, occlusion
+    KelvinDirty_Texture0 = (1 << 13),        // Texture stage state; stage N uses bit (KelvinDirty_Texture0 << N)
+    KelvinDirty_Textures = (0xf << 13),      // All texture stages
+
+    KelvinDirty_All = 0xffffffff,
+};
+
+// ----------------------------------------------------------------------------
+
+// Shadow copy of the Kelvin object state.
+//
+// Every method writes to its slot in the flat register array, indexed by
+// method offset / 4, so that most state can be read back directly from there.
+// Methods that stream data into internal memories (transform program and
+// constants) or build vertices also update the dedicated arrays below.
+struct KelvinState {
+    // Last value written to each method
+    uint32_t regs[kMethodCount];
+
+    // KelvinDirty bits of state modified since last cleared by the consumer
+    uint32_t dirty;
+
+    // Transform program memory and its load cursor
+    uint32_t program[kKelvinProgramSize][4];
+    uint32_t programLoad;
+
+    // Transform constant memory and its load cursor
+    float constants[kKelvinConstantCount][4];
+    uint32_t constantLoad;
+
+    // Current values of the vertex attributes used in immediate mode
+    float attributes[kKelvinAttributeCount][4];
+
+    inline uint32_t Reg(uint32_t method) const { return regs[method >> 2]; }
+
+    inline float RegFloat(uint32_t method) const {
+        float value;
+        std::memcpy(&value, &regs[method >> 2], sizeof(float));
+        return value;
+    }
+};
+
+}
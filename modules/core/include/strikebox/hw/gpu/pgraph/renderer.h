@@ -0,0 +1,180 @@
+// StrikeBox NV2A PGRAPH renderer interface
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+//
+// The method dispatcher decodes Kelvin state into the backend-neutral
+// structures below and hands primitives to a Renderer. Renderers may defer
+// work, but must complete it into guest memory when Flush is invoked.
+//
+// Only triangle-based primitives are rendered. Points, lines, line loops and
+// line strips are dropped by AssembleTriangles, which logs them.
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "combiner.h"
+#include "kelvin.h"
+#include "texture.h"
+
+namespace strikebox::nv2a {
+
+// Values of the SET_SURFACE_FORMAT color field
+enum class SurfaceColorFormat : uint32_t {
+    Unknown = 0x0,
+    X1R5G5B5_Z1R5G5B5 = 0x1,
+    X1R5G5B5_O1R5G5B5 = 0x2,
+    R5G6B5 = 0x3,
+    X8R8G8B8_Z8R8G8B8 = 0x4,
+    X8R8G8B8_O8R8G8B8 = 0x5,
+    X1A7R8G8B8_Z1A7R8G8B8 = 0x6,
+    X1A7R8G8B8_O1A7R8G8B8 = 0x7,
+    A8R8G8B8 = 0x8,
+    B8 = 0x9,
+    G8B8 = 0xa,
+};
+
+// Values of the SET_SURFACE_FORMAT zeta field
+enum class SurfaceZetaFormat : uint32_t {
+    None = 0x0,
+    Z16 = 0x1,
+    Z24S8 = 0x2,
+};
+
+// Values of the SET_SURFACE_FORMAT type field
+enum class SurfaceType : uint32_t {
+    Pitch = 0x1,
+    Swizzle = 0x2,
+};
+
+// Returns the number of bytes per pixel of a color format, or 0 if unsupported
+inline uint32_t GetColorFormatSize(SurfaceColorFormat format) {
+    switch (format) {
+    case SurfaceColorFormat::X1R5G5B5_Z1R5G5B5:
+    case SurfaceColorFormat::X1R5G5B5_O1R5G5B5:
+    case SurfaceColorFormat::R5G6B5:
+    case SurfaceColorFormat::G8B8:
+        return 2;
+    case SurfaceColorFormat::X8R8G8B8_Z8R8G8B8:
+    case SurfaceColorFormat::X8R8G8B8_O8R8G8B8:
+    case SurfaceColorFormat::X1A7R8G8B8_Z1A7R8G8B8:
+    case SurfaceColorFormat::X1A7R8G8B8_O1A7R8G8B8:
+    case SurfaceColorFormat::A8R8G8B8:
+        return 4;
+    case SurfaceColorFormat::B8:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Returns the number of bytes per pixel of a zeta format, or 0 if none
+inline uint32_t GetZetaFormatSize(SurfaceZetaFormat format) {
+    switch (format) {
+    case SurfaceZetaFormat::Z16: return 2;
+    case SurfaceZetaFormat::Z24S8: return 4;
+    default: return 0;
+    }
+}
+
+// Color and depth buffers along with the clip rectangle. Either buffer may be
+// null, in which case it is not written. Buffers are linear; swizzled render
+// targets are converted by the surface cache.
+struct SurfaceTarget {
+    uint8_t* color = nullptr;
+    uint32_t colorPitch = 0;
+    SurfaceColorFormat colorFormat = SurfaceColorFormat::Unknown;
+
+    uint8_t* zeta = nullptr;
+    uint32_t zetaPitch = 0;
+    SurfaceZetaFormat zetaFormat = SurfaceZetaFormat::None;
+
+    uint32_t clipX = 0;
+    uint32_t clipY = 0;
+    uint32_t clipWidth = 0;
+    uint32_t clipHeight = 0;
+
+    // The zeta buffer lies in a tile region with Z compression enabled for
+    // its format. Renderers keep hierarchical depth data for such buffers.
+    bool zetaCompressed = false;
+};
+
+// Comparison functions; SET_DEPTH_FUNC and SET_ALPHA_FUNC use 0x200 + value
+enum class CompareFunc : uint8_t { Never, Less, Equal, LessEqual, Greater, NotEqual, GreaterEqual, Always };
+
+// Per-draw state used by the rasterizer
+struct RasterState {
+    bool depthTest = false;
+    bool depthWrite = false;
+    CompareFunc depthFunc = CompareFunc::Always;
+
+    // ARGB8888 mask of the color channels written
+    uint32_t colorMask = 0xffffffff;
+
+    // Windings of the triangles discarded by face culling
+    bool cullCW = false;
+    bool cullCCW = false;
+
+    // Decoded textures bound to each stage; null if the stage is disabled
+    std::shared_ptr<const Texture> textures[kKelvinTextureCount];
+
+    // Pixel kernel built from the register combiner and texture shader state
+    std::shared_ptr<const CombinerKernel> combiner;
+    CombinerConstants combinerConstants;
+};
+
+// A vertex in window coordinates. z is in depth buffer units.
+struct RasterVertex {
+    float position[4];
+    float diffuse[4];
+    float specular[4];
+    float fog[4];   // Fog coordinate in x
+    float texCoords[kKelvinTextureCount][4];
+};
+
+// Parameters of CLEAR_SURFACE. The rectangle bounds are inclusive.
+struct ClearParams {
+    uint32_t flags;
+    uint32_t color;
+    uint32_t zstencil;
+    uint32_t x1, x2;
+    uint32_t y1, y2;
+};
+
+class Renderer {
+public:
+    virtual ~Renderer() {}
+
+    // Changes the render target. Pending work for the previous target is
+    // completed first.
+    virtual void SetSurfaces(const SurfaceTarget& target) = 0;
+
+    // Draws a list of triangles given as triples of vertex indices
+    virtual void DrawTriangles(const RasterState& state, const RasterVertex* vertices, const uint32_t* indices, uint32_t indexCount) = 0;
+
+    // Clears the current surfaces
+    virtual void Clear(const ClearParams& params) = 0;
+
+    // Completes all pending work into guest memory
+    virtual void Flush() = 0;
+
+    // Notifies that the guest CPU wrote to size bytes at the given offset into
+    // the current zeta buffer. Invoked only while no work is pending.
+    virtual void InvalidateZeta(uint32_t offset, uint32_t size) = 0;
+};
+
+// Creates the multi-threaded software renderer
+std::unique_ptr<Renderer> CreateSoftwareRenderer();
+
+// Converts a primitive with the given number of vertices into a triangle list.
+// Points and lines are not supported; they produce no triangles and are logged.
+void AssembleTriangles(KelvinPrimitive primitive, uint32_t vertexCount, std::vector<uint32_t>& indices);
+
+}
@@ -0,0 +1,44 @@
+// StrikeBox NV2A PGRAPH S3TC texture decoding
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+//
+// The DXT formats store 4x4 texel blocks in row-major order, without
+// swizzling. Each block holds two RGB565 endpoints and a 2-bit index per
+// texel selecting an endpoint or one of two colors interpolated between them.
+// DXT3 blocks are preceded by explicit 4-bit alpha values, DXT5 blocks by two
+// alpha endpoints and a 3-bit index per texel into the eight alpha values
+// derived from them. DXT1 blocks whose first endpoint is not greater than the
+// second interpolate a single color and use the last index for transparent
+// black.
+//
+// The decoders work on four horizontally adjacent blocks at a time, one block
+// per SSE2 lane: endpoints are expanded and interpolated for all four blocks
+// at once, texels are selected with masks built from their indices and rows
+// of the four blocks are transposed into 64 contiguous bytes of output.
+// Partial groups of blocks and partial blocks of small mipmap levels go
+// through a local buffer.
+#pragma once
+
+#include <cstdint>
+
+namespace strikebox::nv2a {
+
+// Sizes of a block in bytes
+const uint32_t kDXT1BlockSize = 8;
+const uint32_t kDXT3BlockSize = 16;
+const uint32_t kDXT5BlockSize = 16;
+
+// Decode rows of blocks into A8R8G8B8. srcPitch is the distance between rows
+// of blocks in bytes. Texels are written with a row pitch of width texels.
+// The signature matches TextureDecoder; palette is not used.
+void DecodeDXT1(const uint8_t* src, uint32_t srcPitch, uint32_t* dst, uint32_t width, uint32_t height, const uint32_t* palette);
+void DecodeDXT3(const uint8_t* src, uint32_t srcPitch, uint32_t* dst, uint32_t width, uint32_t height, const uint32_t* palette);
+void DecodeDXT5(const uint8_t* src, uint32_t srcPitch, uint32_t* dst, uint32_t width, uint32_t height, const uint32_t* palette);
+
+}
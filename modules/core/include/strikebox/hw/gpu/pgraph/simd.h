@@ -0,0 +1,217 @@
+// StrikeBox NV2A PGRAPH SIMD helpers
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Thin wrappers over four-wide float vectors used by the software rendering
+// paths. SSE2 is used when available (always the case on x86-64); other hosts
+// get a portable scalar implementation with the same interface. Builds that
+// target AVX also get eight-wide vectors with the same interface.
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STRIKEBOX_SIMD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX__)
+#define STRIKEBOX_SIMD_AVX 1
+#include <immintrin.h>
+#endif
+
+namespace strikebox::nv2a::simd {
+
+#ifdef STRIKEBOX_SIMD_SSE2
+
+// Four-lane comparison mask
+struct M4 {
+    __m128 v;
+
+    friend inline M4 operator&(M4 a, M4 b) { return { _mm_and_ps(a.v, b.v) }; }
+    friend inline M4 operator|(M4 a, M4 b) { return { _mm_or_ps(a.v, b.v) }; }
+
+    // Returns one bit per lane, lane 0 in bit 0
+    inline uint32_t Bits() const { return static_cast<uint32_t>(_mm_movemask_ps(v)); }
+
+    static inline M4 FromBits(uint32_t bits) {
+        return { _mm_castsi128_ps(_mm_set_epi32(
+            (bits & 8) ? -1 : 0, (bits & 4) ? -1 : 0, (bits & 2) ? -1 : 0, (bits & 1) ? -1 : 0)) };
+    }
+};
+
+// Four-lane float vector
+struct F4 {
+    __m128 v;
+
+    static const uint32_t kLanes = 4;
+
+    static inline F4 Set(float x, float y, float z, float w) { return { _mm_setr_ps(x, y, z, w) }; }
+    static inline F4 Splat(float x) { return { _mm_set1_ps(x) }; }
+    static inline F4 Load(const float* p) { return { _mm_loadu_ps(p) }; }
+    static inline F4 LoadInt(const int32_t* p) { return { _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) }; }
+    inline void Store(float* p) const { _mm_storeu_ps(p, v); }
+
+    friend inline F4 operator+(F4 a, F4 b) { return { _mm_add_ps(a.v, b.v) }; }
+    friend inline F4 operator-(F4 a, F4 b) { return { _mm_sub_ps(a.v, b.v) }; }
+    friend inline F4 operator*(F4 a, F4 b) { return { _mm_mul_ps(a.v, b.v) }; }
+    friend inline F4 operator/(F4 a, F4 b) { return { _mm_div_ps(a.v, b.v) }; }
+
+    friend inline F4 Min(F4 a, F4 b) { return { _mm_min_ps(a.v, b.v) }; }
+    friend inline F4 Max(F4 a, F4 b) { return { _mm_max_ps(a.v, b.v) }; }
+
+    friend inline F4 Sqrt(F4 a) { return { _mm_sqrt_ps(a.v) }; }
+    friend inline F4 Abs(F4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+    friend inline F4 Negate(F4 a) { return { _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)) }; }
+
+    friend inline M4 operator<(F4 a, F4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+    friend inline M4 operator>(F4 a, F4 b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+    friend inline M4 operator>=(F4 a, F4 b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+    friend inline M4 operator==(F4 a, F4 b) { return { _mm_cmpeq_ps(a.v, b.v) }; }
+
+    // Picks a where the mask is set and b elsewhere
+    static inline F4 Select(M4 m, F4 a, F4 b) { return { _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)) }; }
+
+    // Converts to integers with rounding to nearest
+    inline void StoreInt(int32_t* p) const { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_cvtps_epi32(v)); }
+};
+
+#else
+
+struct M4 {
+    uint32_t v[4];
+
+    friend inline M4 operator&(M4 a, M4 b) { return { { a.v[0] & b.v[0], a.v[1] & b.v[1], a.v[2] & b.v[2], a.v[3] & b.v[3] } }; }
+    friend inline M4 operator|(M4 a, M4 b) { return { { a.v[0] | b.v[0], a.v[1] | b.v[1], a.v[2] | b.v[2], a.v[3] | b.v[3] } }; }
+
+    inline uint32_t Bits() const { return (v[0] & 1) | ((v[1] & 1) << 1) | ((v[2] & 1) << 2) | ((v[3] & 1) << 3); }
+
+    static inline M4 FromBits(uint32_t bits) {
+        return { { (bits & 1) ? ~0u : 0u, (bits & 2) ? ~0u : 0u, (bits & 4) ? ~0u : 0u, (bits & 8) ? ~0u : 0u } };
+    }
+};
+
+struct F4 {
+    float v[4];
+
+    static const uint32_t kLanes = 4;
+
+    static inline F4 Set(float x, float y, float z, float w) { return { { x, y, z, w } }; }
+    static inline F4 Splat(float x) { return { { x, x, x, x } }; }
+    static inline F4 Load(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+    static inline F4 LoadInt(const int32_t* p) { return { { static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2]), static_cast<float>(p[3]) } }; }
+    inline void Store(float* p) const { p[0] = v[0]; p[1] = v[1]; p[2] = v[2]; p[3] = v[3]; }
+
+#define STRIKEBOX_F4_BINOP(op) \
+    friend inline F4 operator op(F4 a, F4 b) { return { { a.v[0] op b.v[0], a.v[1] op b.v[1], a.v[2] op b.v[2], a.v[3] op b.v[3] } }; }
+    STRIKEBOX_F4_BINOP(+)
+    STRIKEBOX_F4_BINOP(-)
+    STRIKEBOX_F4_BINOP(*)
+    STRIKEBOX_F4_BINOP(/)
+#undef STRIKEBOX_F4_BINOP
+
+    friend inline F4 Min(F4 a, F4 b) { return { { std::min(a.v[0], b.v[0]), std::min(a.v[1], b.v[1]), std::min(a.v[2], b.v[2]), std::min(a.v[3], b.v[3]) } }; }
+    friend inline F4 Max(F4 a, F4 b) { return { { std::max(a.v[0], b.v[0]), std::max(a.v[1], b.v[1]), std::max(a.v[2], b.v[2]), std::max(a.v[3], b.v[3]) } }; }
+
+    friend inline F4 Sqrt(F4 a) { return { { std::sqrt(a.v[0]), std::sqrt(a.v[1]), std::sqrt(a.v[2]), std::sqrt(a.v[3]) } }; }
+    friend inline F4 Abs(F4 a) { return { { std::fabs(a.v[0]), std::fabs(a.v[1]), std::fabs(a.v[2]), std::fabs(a.v[3]) } }; }
+    friend inline F4 Negate(F4 a) { return { { -a.v[0], -a.v[1], -a.v[2], -a.v[3] } }; }
+
+    static inline F4 Select(M4 m, F4 a, F4 b) {
+        return { { m.v[0] ? a.v[0] : b.v[0], m.v[1] ? a.v[1] : b.v[1], m.v[2] ? a.v[2] : b.v[2], m.v[3] ? a.v[3] : b.v[3] } };
+    }
+
+#define STRIKEBOX_F4_CMP(op) \
+    friend inline M4 operator op(F4 a, F4 b) { return { { a.v[0] op b.v[0] ? ~0u : 0u, a.v[1] op b.v[1] ? ~0u : 0u, a.v[2] op b.v[2] ? ~0u : 0u, a.v[3] op b.v[3] ? ~0u : 0u } }; }
+    STRIKEBOX_F4_CMP(<)
+    STRIKEBOX_F4_CMP(>)
+    STRIKEBOX_F4_CMP(>=)
+    STRIKEBOX_F4_CMP(==)
+#undef STRIKEBOX_F4_CMP
+
+    inline void StoreInt(int32_t* p) const {
+        for (int i = 0; i < 4; i++) {
+            p[i] = static_cast<int32_t>(std::nearbyint(v[i]));
+        }
+    }
+};
+
+#endif
+
+#ifdef STRIKEBOX_SIMD_AVX
+
+// Eight-lane comparison mask
+struct M8 {
+    __m256 v;
+
+    friend inline M8 operator&(M8 a, M8 b) { return { _mm256_and_ps(a.v, b.v) }; }
+    friend inline M8 operator|(M8 a, M8 b) { return { _mm256_or_ps(a.v, b.v) }; }
+
+    inline uint32_t Bits() const { return static_cast<uint32_t>(_mm256_movemask_ps(v)); }
+};
+
+// Eight-lane float vector
+struct F8 {
+    __m256 v;
+
+    static const uint32_t kLanes = 8;
+
+    static inline F8 Splat(float x) { return { _mm256_set1_ps(x) }; }
+    static inline F8 Load(const float* p) { return { _mm256_loadu_ps(p) }; }
+    inline void Store(float* p) const { _mm256_storeu_ps(p, v); }
+
+    friend inline F8 operator+(F8 a, F8 b) { return { _mm256_add_ps(a.v, b.v) }; }
+    friend inline F8 operator-(F8 a, F8 b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    friend inline F8 operator*(F8 a, F8 b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    friend inline F8 operator/(F8 a, F8 b) { return { _mm256_div_ps(a.v, b.v) }; }
+
+    friend inline F8 Min(F8 a, F8 b) { return { _mm256_min_ps(a.v, b.v) }; }
+    friend inline F8 Max(F8 a, F8 b) { return { _mm256_max_ps(a.v, b.v) }; }
+
+    friend inline F8 Sqrt(F8 a) { return { _mm256_sqrt_ps(a.v) }; }
+    friend inline F8 Abs(F8 a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; }
+    friend inline F8 Negate(F8 a) { return { _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)) }; }
+
+    friend inline M8 operator<(F8 a, F8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    friend inline M8 operator>(F8 a, F8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    friend inline M8 operator>=(F8 a, F8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+    friend inline M8 operator==(F8 a, F8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ) }; }
+
+    static inline F8 Select(M8 m, F8 a, F8 b) { return { _mm256_blendv_ps(b.v, a.v, m.v) }; }
+};
+
+#endif
+
+// Widest float vector available, used by batched vertex processing
+#ifdef STRIKEBOX_SIMD_AVX
+typedef F8 FV;
+#else
+typedef F4 FV;
+#endif
+
+// a * b + c
+inline F4 MulAdd(F4 a, F4 b, F4 c) { return a * b + c; }
+
+// Clamps each lane to [lo, hi]
+inline F4 Clamp(F4 x, F4 lo, F4 hi) { return Min(Max(x, lo), hi); }
+
+// Transposes a 4x4 matrix held in four vectors
+inline void Transpose(F4& a, F4& b, F4& c, F4& d) {
+#ifdef STRIKEBOX_SIMD_SSE2
+    _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v);
+#else
+    F4 rows[4] = { a, b, c, d };
+    a = F4::Set(rows[0].v[0], rows[1].v[0], rows[2].v[0], rows[3].v[0]);
+    b = F4::Set(rows[0].v[1], rows[1].v[1], rows[2].v[1], rows[3].v[1]);
+    c = F4::Set(rows[0].v[2], rows[1].v[2], rows[2].v[2], rows[3].v[2]);
+    d = F4::Set(rows[0].v[3], rows[1].v[3], rows[2].v[3], rows[3].v[3]);
+#endif
+}
+
+#ifdef STRIKEBOX_SIMD_AVX
+inline F8 MulAdd(F8 a, F8 b, F8 c) { return a * b + c; }
+inline F8 Clamp(F8 x, F8 lo, F8 hi) { return Min(Max(x, lo), hi); }
+#endif
+
+}
@@ -0,0 +1,124 @@
+// StrikeBox NV2A PGRAPH surface cache
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Tracks the guest memory of render targets along with the working copies the
+// renderer draws into. The guest may sample surfaces as textures, read them
+// with the CPU or scan them out, so rendering must reach guest memory before
+// any of those happen, but not necessarily sooner.
+//
+// Pitch surfaces are rendered in place: their working copy is the guest
+// memory itself. Swizzled surfaces are rendered into linear working copies,
+// loaded from guest memory when first used or after the guest writes to them,
+// and written back only when needed: at GPU synchronization points and flips,
+// where the CPU may observe them, when a texture is read from their memory,
+// or when a surface with a different layout replaces them. Switching render
+// targets does not convert them.
+//
+// Each surface records the PGRAPH tile region holding it. Tiling is resolved
+// by the memory controller and transparent to every client of the memory, so
+// it does not affect the layout of the working copies.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <vector>
+
+namespace strikebox::nv2a {
+
+class NV2A;
+
+const size_t kDefaultSurfaceCacheSize = 32;
+
+// Guest memory and layout of a surface
+struct SurfaceDesc {
+    uint32_t address = 0;        // Guest physical address
+    uint32_t size = 0;           // Bytes of guest memory spanned
+    uint32_t pitch = 0;          // Row pitch of pitch surfaces
+    uint32_t bytesPerPixel = 0;
+    bool swizzled = false;
+    uint32_t width = 0;          // Dimensions of swizzled surfaces
+    uint32_t height = 0;
+    int32_t tile = -1;           // PGRAPH tile region holding the surface, or -1 if not tiled
+
+    // Determines if both describe the same memory laid out the same way
+    bool SameLayout(const SurfaceDesc& other) const {
+        return address == other.address && size == other.size && pitch == other.pitch && bytesPerPixel == other.bytesPerPixel
+            && swizzled == other.swizzled && width == other.width && height == other.height;
+    }
+
+    bool Overlaps(uint32_t otherAddress, uint32_t otherSize) const {
+        return address < otherAddress + otherSize && otherAddress < address + size;
+    }
+};
+
+struct CachedSurface {
+    SurfaceDesc desc;
+    uint8_t* data = nullptr;      // Working copy in linear layout
+    uint32_t pitch = 0;           // Row pitch of the working copy
+    std::vector<uint8_t> copy;    // Working copy of swizzled surfaces; empty if rendered in place
+    bool modified = false;        // The working copy has rendering not yet written back
+    bool stale = false;           // The guest wrote to the surface since the working copy was loaded
+
+    uint32_t GetDataSize() const { return copy.empty() ? desc.size : static_cast<uint32_t>(copy.size()); }
+};
+
+struct SurfaceCacheStats {
+    uint64_t hits = 0;          // Acquisitions of existing entries
+    uint64_t misses = 0;        // Acquisitions that created an entry
+    uint64_t loads = 0;         // Working copies loaded from guest memory
+    uint64_t writeBacks = 0;    // Working copies written back to guest memory
+    size_t bytes = 0;           // Memory used by working copies
+    size_t entries = 0;
+};
+
+class SurfaceCache {
+public:
+    SurfaceCache(NV2A& nv2a, size_t capacity = kDefaultSurfaceCacheSize);
+
+    // Returns the entry of the surface, creating it if needed and loading its
+    // working copy if new or stale. Overlapping entries with other layouts are
+    // written back and dropped. Entries remain valid until dropped by another
+    // Acquire, evicted or cleared; the two most recently acquired entries are
+    // never evicted.
+    CachedSurface* Acquire(const SurfaceDesc& desc);
+
+    // Records that the renderer completed work on the surface
+    void MarkRendered(CachedSurface* surface);
+
+    // Writes modified working copies overlapping the range back to guest
+    // memory. Returns true if any was written.
+    bool WriteBack(uint32_t address, uint32_t size);
+
+    // Writes all modified working copies back to guest memory
+    void WriteBackAll();
+
+    // Flags the surfaces written by the guest given a bitmap of dirty pages
+    // from GuestMemory::CollectDirty, or every surface if dirtyPages is null
+    void InvalidateWrites(const std::vector<uint64_t>* dirtyPages);
+
+    // Reloads the working copy of a stale surface. Returns true if reloaded.
+    bool Refresh(CachedSurface* surface);
+
+    // Writes back and drops all entries
+    void Clear();
+
+    // Sets the dirty page view used to detect guest writes to the surfaces.
+    // Rendering and write-backs are not reported to it.
+    void SetGuestMemoryView(int view) { m_memoryView = view; }
+
+    const SurfaceCacheStats& GetStats() const { return m_stats; }
+
+private:
+    NV2A& m_nv2a;
+    size_t m_capacity;
+    std::list<CachedSurface> m_entries;   // Most recently used first
+    SurfaceCacheStats m_stats;
+    int m_memoryView = -1;
+
+    void Load(CachedSurface& surface);
+    void Store(CachedSurface& surface);
+    void Drop(std::list<CachedSurface>::iterator it);
+};
+
+}
@@ -0,0 +1,72 @@
+// StrikeBox NV2A texture and surface swizzling
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+//
+// Swizzled textures and surfaces store texels in Morton order: the bits of
+// the X, Y and Z coordinates are interleaved, starting with X, until an axis
+// runs out of bits. Dimensions are always powers of two.
+//
+// For example, a 4x2 texture has the texel offsets:
+//   0 1 4 5
+//   2 3 6 7
+//
+// The kernels below convert between this layout and a linear layout with an
+// arbitrary row pitch. They work on 2x2 texel blocks, which are contiguous in
+// swizzled memory whenever both width and height are at least 2, and use SSE2
+// to move several blocks at once for texels of up to 32 bits.
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace strikebox::nv2a {
+
+// Per-axis texel offset tables. The swizzled offset of texel (x, y, z) is
+// x[x] | y[y] | z[z].
+struct SwizzleTables {
+    std::vector<uint32_t> x;
+    std::vector<uint32_t> y;
+    std::vector<uint32_t> z;
+
+    void Init(uint32_t width, uint32_t height, uint32_t depth = 1);
+
+    // Returns the tables for the given dimensions, building them on first use.
+    // Tables are shared by all threads and live until the program exits.
+    static const SwizzleTables& Get(uint32_t width, uint32_t height, uint32_t depth = 1);
+};
+
+// Converts a linear 2D image into swizzled layout
+void SwizzleRect(const uint8_t* src, uint32_t srcPitch, uint8_t* dst, uint32_t width, uint32_t height, uint32_t bytesPerTexel);
+
+// Converts a swizzled 2D image into linear layout
+void UnswizzleRect(const uint8_t* src, uint8_t* dst, uint32_t dstPitch, uint32_t width, uint32_t height, uint32_t bytesPerTexel);
+
+// Converts a linear volume into swizzled layout
+void SwizzleBox(const uint8_t* src, uint32_t srcRowPitch, uint32_t srcSlicePitch, uint8_t* dst,
+    uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerTexel);
+
+// Converts a swizzled volume into linear layout
+void UnswizzleBox(const uint8_t* src, uint8_t* dst, uint32_t dstRowPitch, uint32_t dstSlicePitch,
+    uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerTexel);
+
+// Cube maps store six faces, each with its full mipmap chain. Faces start at
+// 128-byte aligned offsets.
+const uint32_t kCubeFaceAlignment = 128;
+
+// Returns the distance in bytes between consecutive faces of a cube map
+uint32_t GetCubeFaceStride(uint32_t width, uint32_t height, uint32_t bytesPerTexel, uint32_t levels);
+
+// Converts one mip level of a cube face. levelOffset is the offset of the
+// level within the face.
+void SwizzleCubeFace(const uint8_t* src, uint32_t srcPitch, uint8_t* cube, uint32_t face, uint32_t faceStride, uint32_t levelOffset,
+    uint32_t width, uint32_t height, uint32_t bytesPerTexel);
+void UnswizzleCubeFace(const uint8_t* cube, uint32_t face, uint32_t faceStride, uint32_t levelOffset, uint8_t* dst, uint32_t dstPitch,
+    uint32_t width, uint32_t height, uint32_t bytesPerTexel);
+
+}
@@ -0,0 +1,137 @@
+// StrikeBox NV2A PGRAPH software rasterizer
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Tile-binned rasterizer that renders directly into guest memory.
+//
+// Draws and clears are set up on the submitting thread and binned into
+// kSWRastTileSize x kSWRastTileSize screen tiles. When the renderer is flushed,
+// the non-empty tiles are shaded in parallel by a pool of worker threads. Each
+// tile processes its bin in submission order, so no synchronization is needed
+// between tiles. Triangles are rasterized in 2x2 quads with four-wide edge
+// function evaluation. Attributes are interpolated with perspective
+// correction and shaded by the register combiner kernel of the draw; only the
+// attributes read by the kernel are set up.
+//
+// Depth buffers in Z compression regions keep the range of depth values of
+// each tile (hierarchical Z). The range is computed from the buffer on first
+// use and then tracked through draws and clears. Triangles whose depth range
+// fails the depth test against it are skipped in that tile, and triangles
+// that pass it everywhere skip the per-pixel depth reads. Ranges are discarded
+// when the surfaces change or the guest CPU writes to the depth buffer.
+// Depth tests run before shading in all buffers.
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "renderer.h"
+
+namespace strikebox::nv2a {
+
+const uint32_t kSWRastTileShift = 5;
+const uint32_t kSWRastTileSize = 1 << kSWRastTileShift;
+
+// Pending jobs are flushed once this many triangles are binned
+const uint32_t kSWRastMaxTriangles = 65536;
+
+class SoftwareRenderer : public Renderer {
+public:
+    // Uses one worker per host core beyond the calling thread if numWorkers is 0
+    SoftwareRenderer(uint32_t numWorkers = 0);
+    ~SoftwareRenderer();
+
+    void SetSurfaces(const SurfaceTarget& target) override;
+    void DrawTriangles(const RasterState& state, const RasterVertex* vertices, const uint32_t* indices, uint32_t indexCount) override;
+    void Clear(const ClearParams& params) override;
+    void Flush() override;
+    void InvalidateZeta(uint32_t offset, uint32_t size) override;
+
+private:
+    // Plane equation a * x + b * y + c
+    struct Plane {
+        float a, b, c;
+    };
+
+    struct Triangle {
+        Plane edges[3];
+        uint32_t topLeftMask;   // Bit N set if edge N is a top or left edge
+        Plane z;
+        Plane invW;   // 1 / w; attribute planes are premultiplied by it
+        Plane diffuse[4];
+        Plane specular[4];
+        Plane fog;
+        Plane texCoords[kKelvinTextureCount][4];
+        uint32_t inputs;   // CombinerInput bits of the attribute planes set up
+        int32_t minX, minY, maxX, maxY;
+        uint32_t state;
+    };
+
+    enum class JobType : uint8_t { Triangle, Clear };
+
+    struct Job {
+        JobType type;
+        uint32_t index;
+    };
+
+    SurfaceTarget m_target;
+    uint32_t m_tilesX = 0;
+    uint32_t m_tilesY = 0;
+
+    // Range of depth values of a tile, in depth buffer units
+    struct DepthBounds {
+        uint32_t min, max;
+        bool valid;
+    };
+
+    // Outcome of testing a triangle against the depth range of a tile
+    enum class DepthBoundsTest : uint8_t { Reject, Test, Accept };
+
+    std::vector<DepthBounds> m_depthBounds;   // Per tile; empty if hierarchical Z is disabled
+
+    std::vector<RasterState> m_states;
+    std::vector<Triangle> m_triangles;
+    std::vector<ClearParams> m_clears;
+    std::vector<Job> m_jobs;
+
+    std::vector<std::vector<uint32_t>> m_bins;   // Job indices per tile
+    std::vector<uint32_t> m_activeTiles;         // Indices of non-empty tiles
+
+    void SetupTriangle(uint32_t state, const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2);
+    void BinJob(uint32_t job, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY);
+
+    void RenderTile(uint32_t tile);
+    void RasterizeTriangle(const Triangle& tri, int32_t x0, int32_t y0, int32_t x1, int32_t y1, bool depthPass);
+    void ClearTile(const ClearParams& params, int32_t x0, int32_t y0, int32_t x1, int32_t y1);
+
+    // Computes the range of the depth values in a rectangle of the zeta buffer
+    void ComputeDepthBounds(DepthBounds& bounds, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const;
+
+    // Tests a triangle with depth values in [zmin, zmax] against the range of
+    // a tile
+    static DepthBoundsTest TestDepthBounds(CompareFunc func, uint32_t zmin, uint32_t zmax, const DepthBounds& bounds);
+
+    // Updates the range of a tile after a triangle with depth values in
+    // [zmin, zmax] is drawn with depth writes. covered is true if the
+    // triangle writes every pixel that passes the depth test.
+    static void UpdateDepthBounds(DepthBounds& bounds, CompareFunc func, uint32_t zmin, uint32_t zmax, bool covered);
+
+    // ----- Worker pool ------------------------------------------------------
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_poolMutex;
+    std::condition_variable m_workCond;
+    std::condition_variable m_doneCond;
+    uint64_t m_generation = 0;
+    uint32_t m_busyWorkers = 0;
+    bool m_quit = false;
+    std::atomic<uint32_t> m_nextTile{ 0 };
+
+    void WorkerThread();
+    void RunTiles();
+};
+
+}
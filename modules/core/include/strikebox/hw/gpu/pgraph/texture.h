@@ -0,0 +1,140 @@
+// StrikeBox NV2A PGRAPH texture formats and decoding
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+//
+// Textures are decoded from guest memory into host A8R8G8B8 copies that hold
+// every mipmap level and cube face.
+//
+// Swizzled and compressed textures are sized by SET_TEXTURE_FORMAT and may
+// have mipmaps, cube faces and, for swizzled textures, depth. Compressed
+// textures store their levels as rows of 4x4 blocks instead of swizzling
+// them. Linear image textures are sized by SET_TEXTURE_IMAGE_RECT and have a
+// single level.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace strikebox::nv2a {
+
+// Values of the SET_TEXTURE_FORMAT color field.
+// SZ = swizzled, LU = linear unnormalized, L/LC = linear compressed.
+enum class TextureColorFormat : uint8_t {
+    SZ_Y8 = 0x00,
+    SZ_AY8 = 0x01,
+    SZ_A1R5G5B5 = 0x02,
+    SZ_X1R5G5B5 = 0x03,
+    SZ_A4R4G4B4 = 0x04,
+    SZ_R5G6B5 = 0x05,
+    SZ_A8R8G8B8 = 0x06,
+    SZ_X8R8G8B8 = 0x07,
+    SZ_I8_A8R8G8B8 = 0x0b,
+    L_DXT1_A1R5G5B5 = 0x0c,
+    L_DXT23_A8R8G8B8 = 0x0e,
+    L_DXT45_A8R8G8B8 = 0x0f,
+    LU_IMAGE_A1R5G5B5 = 0x10,
+    LU_IMAGE_R5G6B5 = 0x11,
+    LU_IMAGE_A8R8G8B8 = 0x12,
+    LU_IMAGE_Y8 = 0x13,
+    SZ_A8 = 0x19,
+    SZ_A8Y8 = 0x1a,
+    LU_IMAGE_AY8 = 0x1b,
+    LU_IMAGE_X1R5G5B5 = 0x1c,
+    LU_IMAGE_A4R4G4B4 = 0x1d,
+    LU_IMAGE_X8R8G8B8 = 0x1e,
+    LU_IMAGE_A8 = 0x1f,
+    LU_IMAGE_A8Y8 = 0x20,
+    LC_IMAGE_CR8YB8CB8YA8 = 0x24,
+    LC_IMAGE_YB8CR8YA8CB8 = 0x25,
+    SZ_R6G5B5 = 0x27,
+    SZ_G8B8 = 0x28,
+    SZ_R8B8 = 0x29,
+    SZ_A8B8G8R8 = 0x3a,
+    SZ_B8G8R8A8 = 0x3b,
+    SZ_R8G8B8A8 = 0x3c,
+    LU_IMAGE_A8B8G8R8 = 0x3f,
+    LU_IMAGE_B8G8R8A8 = 0x40,
+    LU_IMAGE_R8G8B8A8 = 0x41,
+};
+
+// Converts rows of linear texels into A8R8G8B8. srcPitch is the distance
+// between rows in bytes, or between rows of blocks for compressed formats.
+// palette is only used by palettized formats and holds 256 entries.
+typedef void (*TextureDecoder)(const uint8_t* src, uint32_t srcPitch, uint32_t* dst, uint32_t width, uint32_t height, const uint32_t* palette);
+
+struct TextureFormatInfo {
+    uint8_t bytesPerTexel = 0;   // Bytes per texel, or per block if compressed; 0 if the format is not supported
+    bool swizzled = false;
+    bool compressed = false;     // Stored as 4x4 texel blocks
+    bool palettized = false;     // Texels are indices into a palette of A8R8G8B8 colors
+    bool pairs = false;          // Pairs of texels share their chroma (YUV 4:2:2)
+    TextureDecoder decode = nullptr;   // null if texels are already A8R8G8B8
+};
+
+// Returns the description of a SET_TEXTURE_FORMAT color format
+const TextureFormatInfo& GetTextureFormatInfo(uint32_t format);
+
+// Identifies a texture image in guest memory
+struct TextureKey {
+    uint32_t address = 0;          // Physical address of the first texel
+    uint32_t format = 0;           // TextureColorFormat
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t depth = 0;
+    uint32_t levels = 0;
+    uint32_t pitch = 0;            // Row pitch of linear textures; 0 if swizzled or compressed
+    bool swizzled = false;
+    bool cube = false;
+    uint32_t paletteAddress = 0;   // Physical address of the palette of palettized formats
+    uint32_t paletteLength = 0;    // Number of palette entries; 0 if not palettized
+
+    bool operator==(const TextureKey& other) const {
+        return address == other.address && format == other.format
+            && width == other.width && height == other.height && depth == other.depth
+            && levels == other.levels && pitch == other.pitch
+            && swizzled == other.swizzled && cube == other.cube
+            && paletteAddress == other.paletteAddress && paletteLength == other.paletteLength;
+    }
+};
+
+struct TextureKeyHash {
+    size_t operator()(const TextureKey& key) const;
+};
+
+// A texture decoded to A8R8G8B8. Levels of each face are stored consecutively,
+// followed by the next face.
+struct Texture {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t depth = 0;
+    uint32_t levels = 0;
+    uint32_t faces = 0;
+    std::vector<uint32_t> texels;
+    std::vector<size_t> levelOffsets;   // Indexed by face * levels + level
+
+    const uint32_t* Level(uint32_t face, uint32_t level) const {
+        return &texels[levelOffsets[face * levels + level]];
+    }
+
+    size_t SizeInBytes() const {
+        return texels.size() * sizeof(uint32_t);
+    }
+};
+
+// Returns the number of bytes of guest memory occupied by the texture, or 0
+// if the format is not supported
+uint32_t GetTextureSourceSize(const TextureKey& key);
+
+// Decodes a texture from guest memory. src points to GetTextureSourceSize
+// bytes and palette to the palette entries, if any. Returns false if the
+// format is not supported.
+bool DecodeTexture(const TextureKey& key, const uint8_t* src, const uint32_t* palette, Texture& texture);
+
+}
@@ -0,0 +1,93 @@
+// StrikeBox NV2A PGRAPH texture cache
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Caches decoded copies of guest textures so that textures bound on every
+// frame are decoded only when their contents change.
+//
+// Entries are keyed by the texture parameters and validated against a hash of
+// the guest memory backing the texels and palette. When guest RAM writes are
+// tracked, only entries whose pages were written since they were last
+// validated are hashed again. Textures are immutable
+// once decoded; a stale entry is replaced by a new texture, so renderers may
+// keep using a previously returned texture while their work is in flight.
+// The least recently used entries are evicted when the decoded copies exceed
+// the memory budget.
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "strikebox/guest_memory.h"
+
+#include "texture.h"
+
+namespace strikebox::nv2a {
+
+const size_t kDefaultTextureCacheBudget = 128 * 1024 * 1024;
+
+struct TextureCacheStats {
+    uint64_t hits = 0;         // Lookups served by a valid entry
+    uint64_t misses = 0;       // Lookups that decoded the texture, including stale entries
+    uint64_t evictions = 0;    // Entries evicted to stay within the budget
+    size_t bytes = 0;          // Memory used by decoded textures
+    size_t entries = 0;
+};
+
+class TextureCache {
+public:
+    TextureCache(size_t budget = kDefaultTextureCacheBudget) : m_budget(budget) {}
+    ~TextureCache();
+
+    // Uses the dirty page tracking of guest RAM to skip validating unmodified
+    // textures, if the guest CPU writes are tracked
+    void SetGuestMemory(GuestMemory* memory);
+
+    // Starts a new validation pass: the next lookup checks for guest writes
+    // made since the previous pass. CPU writes are seen once guest memory is
+    // synchronized.
+    void BeginValidation() { m_collectPending = true; }
+
+    // Returns the decoded texture described by the key, decoding it from
+    // guest RAM if needed. Returns nullptr if the format is not supported or
+    // the texture does not fit in RAM.
+    std::shared_ptr<const Texture> Lookup(const TextureKey& key, const uint8_t* ram, uint32_t ramSize);
+
+    // Changes the memory budget, evicting entries if necessary
+    void SetBudget(size_t budget);
+    size_t GetBudget() const { return m_budget; }
+
+    // Drops all entries
+    void Clear();
+
+    const TextureCacheStats& GetStats() const { return m_stats; }
+    void ResetStats();
+
+private:
+    struct Entry {
+        std::shared_ptr<const Texture> texture;
+        uint64_t hash;
+        uint32_t size;    // Bytes of guest memory used by the texels
+        bool written;     // Guest memory was written since the entry was validated
+        std::list<TextureKey>::iterator lru;
+    };
+
+    size_t m_budget;
+    std::unordered_map<TextureKey, Entry, TextureKeyHash> m_entries;
+    std::list<TextureKey> m_lru;   // Most recently used first
+    TextureCacheStats m_stats;
+
+    GuestMemory* m_memory = nullptr;   // Null if guest writes are not tracked
+    int m_memoryView = -1;
+    bool m_collectPending = false;
+    std::vector<uint64_t> m_dirtyPages;
+
+    void Evict(size_t budget);
+
+    // Flags the entries whose memory was written since the last collection
+    void CollectWrites();
+};
+
+}
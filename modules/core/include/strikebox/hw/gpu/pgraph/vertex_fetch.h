@@ -0,0 +1,80 @@
+// StrikeBox NV2A PGRAPH vertex fetch
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+//
+// Vertices drawn with DRAW_ARRAYS, ARRAY_ELEMENT16/32 and INLINE_ARRAY read
+// their attributes from memory in the formats given by
+// SET_VERTEX_DATA_ARRAY_FORMAT. Attributes without an array take the current
+// value set through the immediate mode methods.
+//
+// The array layout is decoded only when it changes. Each draw resolves the
+// arrays once for the range of vertices it reads, then converts one attribute
+// at a time for all vertices with a kernel specialized for the format and
+// component count, four vertices per SIMD operation. The output uses the same
+// layout as vertices built in immediate mode, so the transform stages consume
+// both alike.
+#pragma once
+
+#include <cstdint>
+
+#include "kelvin.h"
+
+namespace strikebox::nv2a {
+
+// Values of the SET_VERTEX_DATA_ARRAY_FORMAT type field
+enum class VertexArrayType : uint8_t {
+    UB_D3D = 0x0,   // Unsigned normalized bytes in D3DCOLOR order (B, G, R, A)
+    S1 = 0x1,       // Signed normalized shorts
+    F = 0x2,        // Floats
+    UB_OGL = 0x4,   // Unsigned normalized bytes in R, G, B, A order
+    S32K = 0x5,     // Signed shorts converted to floats as is
+    CMP = 0x6,      // Three signed normalized components packed in 11:11:10 bits
+};
+
+// SET_VERTEX_DATA_ARRAY_FORMAT: bits 3..0 = type, bits 7..4 = size (number
+// of components; 0 = disabled), bits 31..8 = stride in bytes
+struct VertexArrayFormat {
+    VertexArrayType type = VertexArrayType::F;
+    uint32_t size = 0;     // 0 if the attribute is not read from an array
+    uint32_t stride = 0;
+};
+
+// Returns the number of bytes read for each element of an array, or 0 if the
+// format is not supported
+uint32_t GetVertexArrayElementSize(const VertexArrayFormat& format);
+
+// Attribute arrays decoded from the Kelvin state
+struct VertexArrayLayout {
+    VertexArrayFormat formats[kKelvinAttributeCount];
+    uint32_t offsets[kKelvinAttributeCount];         // SET_VERTEX_DATA_ARRAY_OFFSET: bit 31 = context DMA B, bits 30..0 = offset
+    uint32_t enabledMask;                            // Bit N set if attribute N is read from an array
+
+    // INLINE_ARRAY vertices hold the enabled attributes in order, each
+    // padded to a multiple of four bytes
+    uint32_t inlineOffsets[kKelvinAttributeCount];
+    uint32_t inlineStride;
+};
+
+// Decodes the attribute arrays from the Kelvin state
+void DecodeVertexArrayLayout(const KelvinState& state, VertexArrayLayout& layout);
+
+// Source of an attribute for a draw
+struct VertexAttributeSource {
+    const uint8_t* data = nullptr;    // Element 0 of the array; null to use the constant value
+    uint32_t stride = 0;
+    VertexArrayFormat format;
+    const float* constant = nullptr;  // Four floats used when data is null
+};
+
+// Converts count vertices into kKelvinAttributeCount attributes of four
+// floats each. Vertex i reads element indices[i] of every array, or element
+// i if indices is null.
+void FetchVertices(const VertexAttributeSource* sources, const uint32_t* indices, uint32_t count, float* outputs);
+
+}
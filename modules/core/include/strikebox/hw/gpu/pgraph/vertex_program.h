@@ -0,0 +1,151 @@
+// StrikeBox NV2A PGRAPH vertex program engine
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+//
+// Transform programs are decoded from the 128-bit instructions in program
+// memory into a flat list of micro-ops. Each instruction pairs a MAC
+// (multiply-accumulate) and an ILU (inverse logic unit) operation; the pair
+// is split into separate micro-ops, with the inputs of the ILU operation
+// copied aside when the MAC operation would overwrite them.
+//
+// Programs are executed over batches of vertices at a time, one vertex per
+// SIMD lane, with registers laid out as structures of arrays so that every
+// component of a register is a single vector. Swizzles and write masks
+// select which vectors are used and cost nothing at run time. Constants
+// read by the program are copied into registers with every lane set to the
+// constant value, so that all operands except relative constant reads are
+// plain register loads.
+//
+// Decoded programs are cached by the contents of their instructions, so
+// programs uploaded again or to a different slot are not decoded again.
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "kelvin.h"
+
+namespace strikebox::nv2a {
+
+// Output registers of vertex programs
+const uint32_t kVertexOutputCount = 13;
+const uint32_t kVertexOut_Position = 0;
+const uint32_t kVertexOut_Diffuse = 3;
+const uint32_t kVertexOut_Specular = 4;
+const uint32_t kVertexOut_Fog = 5;
+const uint32_t kVertexOut_PointSize = 6;
+const uint32_t kVertexOut_BackDiffuse = 7;
+const uint32_t kVertexOut_BackSpecular = 8;
+const uint32_t kVertexOut_TexCoord0 = 9;
+
+// Number of temporary registers; R12 is a read-only alias of oPos
+const uint32_t kVertexTempCount = 12;
+
+enum class VertexOp : uint8_t {
+    // MAC operations
+    Mov, Mul, Add, Mad, Dp3, Dph, Dp4, Dst, Min, Max, Slt, Sge, Arl,
+    // ILU operations
+    Rcp, Rcc, Rsq, Exp, Log, Lit,
+};
+
+// Source operand of a micro-op
+struct VertexOperand {
+    enum class File : uint8_t { Register, RelativeConstant };
+
+    File file = File::Register;
+    bool negate = false;
+    uint8_t swizzle = 0xe4;   // Source component of each component, x in bits 1..0
+    uint16_t index = 0;       // Register file index, or base constant index of relative reads
+
+    inline uint32_t Component(uint32_t c) const { return (swizzle >> (c * 2)) & 3; }
+};
+
+// A single MAC or ILU operation. Results are written to up to two registers
+// and optionally to constant memory. Masks have x in bit 0.
+struct VertexMicroOp {
+    VertexOp op;
+    VertexOperand src[3];
+    uint8_t dst[2];
+    uint8_t dstMask[2];
+    uint8_t constMask;
+    uint16_t constIndex;
+    uint16_t constRegister;   // Register holding a copy of the constant written, or 0 if none
+};
+
+struct VertexProgram {
+    std::vector<VertexMicroOp> ops;
+    std::vector<uint16_t> constantRegisters;   // Constant copied into each constant register
+    uint16_t inputMask = 0;    // Input attributes read by the program
+    uint16_t outputMask = 0;   // Output registers written by the program
+    bool writesConstants = false;
+};
+
+// Describes where the outputs of a program are stored. Each output vertex
+// takes stride floats; output register N is stored offsets[N] floats from
+// the start of the vertex, or discarded if the offset is negative.
+struct VertexOutputLayout {
+    uint32_t stride;
+    int32_t offsets[kVertexOutputCount];
+};
+
+// Decodes the program that starts at the given slot of program memory and
+// ends at the first instruction with the final flag or at the end of memory
+void DecodeVertexProgram(const uint32_t (*program)[4], uint32_t start, VertexProgram& decoded);
+
+// Runs the program over count vertices. Each input vertex has
+// kKelvinAttributeCount attributes of four floats. Outputs are stored as
+// described by the layout; those not written by the program are set to
+// (0, 0, 0, 1).
+//
+// If contextWrite is set, constant writes update constants; a batch of
+// vertices writes the value computed for the last vertex of the batch.
+// Otherwise they are discarded.
+void RunVertexProgram(const VertexProgram& program, const float* inputs, uint32_t count, float (*constants)[4], bool contextWrite, const VertexOutputLayout& layout, float* outputs);
+
+// ----------------------------------------------------------------------------
+
+const size_t kDefaultVertexProgramCacheSize = 256;
+
+struct VertexProgramCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t entries = 0;
+};
+
+class VertexProgramCache {
+public:
+    VertexProgramCache(size_t capacity = kDefaultVertexProgramCacheSize) : m_capacity(capacity) {}
+
+    // Returns the decoded program that starts at the given slot of program
+    // memory, decoding it if no program with the same instructions is cached
+    std::shared_ptr<const VertexProgram> Lookup(const uint32_t (*program)[4], uint32_t start);
+
+    // Drops all entries
+    void Clear();
+
+    const VertexProgramCacheStats& GetStats() const { return m_stats; }
+
+private:
+    struct Entry {
+        uint64_t hash;
+        std::vector<uint32_t> words;   // Instructions, used to tell apart colliding hashes
+        std::shared_ptr<const VertexProgram> program;
+    };
+    typedef std::list<Entry> EntryList;
+
+    size_t m_capacity;
+    EntryList m_lru;   // Most recently used first
+    std::unordered_multimap<uint64_t, EntryList::iterator> m_entries;
+    VertexProgramCacheStats m_stats;
+};
+
+}
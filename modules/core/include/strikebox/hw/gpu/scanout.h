@@ -0,0 +1,63 @@
+// StrikeBox NV2A display scan-out
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+//
+// The scan-out reads the displayed framebuffer once per vertical blank and
+// publishes it as an RGBA frame to a FrameSink. The display mode comes from:
+// - the CRTC registers in PRMCIO: display size, framebuffer pitch and depth;
+// - PCRTC START: framebuffer address in system memory;
+// - PRAMDAC GENERAL_CONTROL: layout of 16-bit pixels.
+//
+// 32-bit framebuffers are converted straight into the sink's buffer. 16-bit
+// framebuffers are expanded one row at a time. While the video overlay is
+// active the frame is expanded into a local buffer first, so that PVIDEO can
+// draw over it.
+#pragma once
+
+#include "frame_sink.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace strikebox::nv2a {
+
+class NV2A;
+
+// Framebuffer pixel formats
+enum class ScanOutFormat {
+    X8R8G8B8,
+    R5G6B5,
+    X1R5G5B5,
+};
+
+class ScanOut {
+public:
+    ScanOut(NV2A& nv2a) : m_nv2a(nv2a) {}
+
+    // Sets the sink that receives frames, or nullptr to disable the scan-out.
+    // The sink is not owned and must be set before vertical blanks start.
+    void SetSink(FrameSink* sink) {
+        m_sink = sink;
+        m_framePeriod = 0;
+    }
+
+    // Publishes the displayed frame to the sink
+    void Run();
+
+private:
+    NV2A& m_nv2a;
+    FrameSink* m_sink = nullptr;
+
+    std::vector<uint32_t> m_frame;   // X8R8G8B8 frame drawn over by the overlay
+    std::vector<uint32_t> m_row;     // X8R8G8B8 row of a 16-bit framebuffer
+    int m_lastUnsupportedDepth = -1;
+    uint64_t m_framePeriod = 0;      // Frame period last given to the sink
+};
+
+}
@@ -9,12 +9,17 @@
 // brackets optionally followed by a quote from the documentation.
 #pragma once
 
+#include <array>
 #include <string>
-#include <map>
-#include <optional>
+#include <vector>
 #include <functional>
 
+#include "strikebox/guest_memory.h"
+#include "strikebox/scheduler.h"
+#include "strikebox/virtual_clock.h"
+
 #include "engine.h"
+#include "scanout.h"
 
 #include "engines/pmc.h"
 #include "engines/pbus.h"
@@ -44,7 +49,8 @@ using IRQHandlerFunc = std::function<void(bool level)>;
 // Represents the state of the NV2A GPU.
 class NV2A {
 public:
-    NV2A(uint8_t* systemRAM, uint32_t systemRAMSize, PCIConfigReader readPCIConfig, PCIConfigWriter writePCIConfig, IRQHandlerFunc handleIRQ);
+    NV2A(uint8_t* systemRAM, uint32_t systemRAMSize, PCIConfigReader readPCIConfig, PCIConfigWriter writePCIConfig, IRQHandlerFunc handleIRQ,
+        VirtualClock& clock, GuestMemory* guestMemory = nullptr, Scheduler* scheduler = nullptr);
 
     // PCI config space read/write access
     const PCIConfigReader readPCIConfig = [](uint8_t) -> uint32_t { return 0; };
@@ -57,6 +63,24 @@ public:
     uint8_t* systemRAM = nullptr;
     const uint32_t systemRAMSize = 0;
 
+    // Dirty page tracker of system memory; may be null
+    GuestMemory* const guestMemory = nullptr;
+
+    // Records a write made by the GPU to system memory. writerView is the
+    // dirty page view of the unit making the write, which is left out.
+    inline void MarkSystemRAMDirty(uint32_t address, uint32_t size, int writerView = -1) {
+        if (guestMemory != nullptr) {
+            guestMemory->MarkDirty(address, size, writerView);
+        }
+    }
+
+    // Virtual time source of the timers
+    VirtualClock& clock;
+
+    // Scheduler of timed events such as vertical blanks; may be null, in
+    // which case no vertical blanks are generated
+    Scheduler* const scheduler = nullptr;
+
     // NV2A engines
     PMC       pmc      { *this };
     PBUS      pbus     { *this };
@@ -77,6 +101,9 @@ public:
     PRAMIN    pramin   { *this };
     USER      user     { *this };
 
+    // Display scan-out, run by PCRTC at each vertical blank
+    ScanOut   scanOut  { *this };
+
     void Reset();
     uint32_t Read(const uint32_t addr, const uint8_t size);
     void Write(const uint32_t addr, const uint32_t value, const uint8_t size);
@@ -86,10 +113,13 @@ public:
     inline DMAObject* GetDMAObject(uint32_t address) { return reinterpret_cast<DMAObject*>(pramin.GetMemoryPointer(address)); }
 
 private:
-    // Fast engine lookup
-    std::map<uint32_t, nv2a::NV2AEngine&> engines;
+    std::vector<nv2a::NV2AEngine*> engines;
     void RegisterEngine(nv2a::NV2AEngine& engine);
-    std::optional<std::reference_wrapper<nv2a::NV2AEngine>> FindEngine(const uint32_t address);
+
+    // Fast engine lookup: one entry per 4 KiB page of the MMIO register space.
+    // Unmapped pages point to the sentinel engine.
+    UnmappedEngine unmapped { *this };
+    std::array<nv2a::NV2AEngine*, kEnginePageCount> enginePages;
 };
 
 }
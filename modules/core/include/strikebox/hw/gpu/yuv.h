@@ -0,0 +1,22 @@
+// StrikeBox NV2A YUV 4:2:2 conversion
+// (C) Ivan "StrikerX3" Oliveira
+//
+// YUV 4:2:2 images store pairs of pixels in four bytes: one luma sample per
+// pixel and one pair of chroma samples shared by both pixels. The video
+// overlay and linear YUV textures use two byte orders:
+// - UYVY (YB8CR8YA8CB8): U, Y0, V, Y1
+// - YUY2 (CR8YB8CB8YA8): Y0, U, Y1, V
+//
+// Pixels are converted from ITU-R BT.601 studio range into X8R8G8B8 with
+// alpha set to 255.
+#pragma once
+
+#include <cstdint>
+
+namespace strikebox::nv2a {
+
+// Converts width pixels, rounded up to an even count, of a row of YUV 4:2:2
+void ConvertUYVYRow(const uint8_t* src, uint32_t* dst, uint32_t width);
+void ConvertYUY2Row(const uint8_t* src, uint32_t* dst, uint32_t width);
+
+}
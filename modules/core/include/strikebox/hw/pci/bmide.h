@@ -23,7 +23,7 @@ namespace bmide {
 class BMIDEDevice : public PCIDevice {
 public:
     // constructor
-    BMIDEDevice(uint8_t *ram, uint32_t ramSize, hw::ata::ATA& ata);
+    BMIDEDevice(GuestMemory& memory, hw::ata::ATA& ata);
     virtual ~BMIDEDevice();
 
     // PCI Device functions
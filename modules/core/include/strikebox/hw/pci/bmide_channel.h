@@ -13,6 +13,7 @@
 #include "strikebox/hw/pci/bmide_defs.h"
 #include "strikebox/hw/ata/ata_common.h"
 #include "strikebox/hw/ata/ata.h"
+#include "strikebox/guest_memory.h"
 
 namespace strikebox {
 namespace hw {
@@ -20,7 +21,7 @@ namespace bmide {
 
 class BMIDEChannel {
 public:
-    BMIDEChannel(hw::ata::Channel channel, hw::ata::ATAChannel& ataChannel, uint8_t *ram, uint32_t ramSize);
+    BMIDEChannel(hw::ata::Channel channel, hw::ata::ATAChannel& ataChannel, GuestMemory& memory);
     ~BMIDEChannel();
 private:
     friend class BMIDEDevice;
@@ -30,6 +31,7 @@ private:
 
     // ----- System memory ----------------------------------------------------
 
+    GuestMemory& m_memory;
     uint8_t *m_ram = nullptr;
     uint32_t m_ramSize = 0;
 
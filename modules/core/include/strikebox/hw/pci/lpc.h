@@ -7,6 +7,7 @@
 #include "pci_irq.h"
 #include "../basic/irq.h"
 #include "../bus/isabus.h"
+#include "strikebox/virtual_clock.h"
 
 namespace strikebox {
 
@@ -22,7 +23,7 @@ namespace strikebox {
 class LPCDevice : public PCIDevice, public IRQHandler {
 public:
     // constructor
-    LPCDevice(IRQ *irqs, uint8_t *rom, uint8_t *bios, uint32_t biosSize, uint8_t *mcpxROM, bool initMcpxROM);
+    LPCDevice(IRQ *irqs, VirtualClock& clock, uint8_t *rom, uint8_t *bios, uint32_t biosSize, uint8_t *mcpxROM, bool initMcpxROM);
     virtual ~LPCDevice();
 
     void HandleIRQ(uint8_t irqNum, bool level) override;
@@ -42,6 +43,9 @@ private:
     IRQ *m_irqs;
     ISABus *m_isaBus;
 
+    VirtualClock& m_clock;
+    TickRate m_acpiTimerRate;
+
     uint8_t *m_rom;
     uint8_t *m_bios;
     uint32_t m_biosSize;
@@ -5,12 +5,14 @@
 #include "pci.h"
 #include "../basic/irq.h"
 #include "../gpu/nv2a.h"
+#include "strikebox/guest_memory.h"
+#include "strikebox/scheduler.h"
 
 namespace strikebox {
 
 class NV2ADevice : public PCIDevice {
 public:
-    NV2ADevice(uint8_t *pSystemRAM, uint32_t systemRAMSize, IRQHandler& irqHandler);
+    NV2ADevice(GuestMemory& memory, IRQHandler& irqHandler, Scheduler& scheduler);
     virtual ~NV2ADevice();
 
     // PCI Device functions
@@ -22,6 +24,10 @@ public:
     void PCIMMIORead(int barIndex, uint32_t addr, uint32_t *value, uint8_t size) override;
     void PCIMMIOWrite(int barIndex, uint32_t addr, uint32_t value, uint8_t size) override;
 
+    // Sets the sink that receives the frames scanned out at each vertical
+    // blank; the sink is not owned
+    void SetFrameSink(nv2a::FrameSink* sink);
+
 private:
     IRQHandler& m_irqHandler;
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "pci.h"
+#include "strikebox/virtual_clock.h"
 
 namespace strikebox {
 
@@ -9,7 +10,7 @@ namespace strikebox {
 
 class NVAPUDevice : public PCIDevice {
 public:
-    NVAPUDevice();
+    NVAPUDevice(VirtualClock& clock);
     virtual ~NVAPUDevice();
 
     // PCI Device functions
@@ -20,6 +21,12 @@ public:
     void PCIIOWrite(int barIndex, uint32_t port, uint32_t value, uint8_t size) override;
     void PCIMMIORead(int barIndex, uint32_t addr, uint32_t *value, uint8_t size) override;
     void PCIMMIOWrite(int barIndex, uint32_t addr, uint32_t value, uint8_t size) override;
+
+private:
+    VirtualClock& m_clock;
+    TickRate m_apuTimerRate;
+
+    uint32_t GetAPUTime();
 };
 
 }
@@ -69,6 +69,8 @@ public:
 
     bool GetIOBar(uint32_t port, uint8_t* barIndex, uint32_t *baseAddress);
     bool GetMMIOBar(uint32_t addr, uint8_t* barIndex, uint32_t *baseAddress);
+    bool GetIOBarRange(uint8_t barIndex, uint32_t *baseAddress, uint32_t *size);
+    bool GetMMIOBarRange(uint8_t barIndex, uint32_t *baseAddress, uint32_t *size);
     bool RegisterBAR(int index, uint32_t size, uint32_t type);
 
     inline PCIConfigAddressRegister GetPCIAddress() { return m_addr; }
@@ -88,6 +90,8 @@ protected:
     uint8_t m_checkMask[256];
     uint8_t m_write1ToClearMask[256];
 
+    uint8_t GetNumBARs();
+
     uint32_t m_irqState;
 
     inline uint8_t GetIRQState(uint8_t irqNum) { return (m_irqState >> irqNum) & 1; }
@@ -2,7 +2,11 @@
 
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <set>
+#include <vector>
+
+#include "strikebox/io_stats.h"
 
 namespace strikebox {
 
@@ -39,11 +43,89 @@ struct MappedDevice {
     IODevice *device;
 };
 
+/*!
+ * Direct entry points into a device that handles a mapped I/O range.
+ *
+ * The handler functions receive the address relative to baseAddress and
+ * return true if the I/O operation was handled. The context and index are
+ * passed through unmodified, which allows a single pair of functions to
+ * serve several ranges of the same device (e.g. PCI BARs).
+ */
+struct IOHandler {
+    typedef bool (*ReadFunc)(void *context, uint8_t index, uint32_t addr, uint32_t *value, uint8_t size);
+    typedef bool (*WriteFunc)(void *context, uint8_t index, uint32_t addr, uint32_t value, uint8_t size);
+
+    void *context;
+    ReadFunc read;
+    WriteFunc write;
+    uint32_t baseAddress;
+    uint8_t index;
+};
+
+/*!
+ * An I/O handler mapped to a range of addresses on behalf of an owner.
+ */
+struct MappedHandler {
+    uint32_t baseAddress;
+    uint32_t lastAddress;
+
+    // The object on whose behalf the handler was mapped
+    void *owner;
+
+    IOHandler handler;
+};
+
+/*!
+ * Number of entries in the port I/O dispatch table.
+ */
+const uint32_t kIOPortCount = 0x10000;
+
+/*!
+ * Geometry of the MMIO page table: a two-level radix table over the 32-bit
+ * physical address space with 4 KiB pages. The directory has one entry per
+ * 4 MiB region, each pointing to a lazily allocated table of pages.
+ */
+const uint32_t kMMIOPageShift = 12;
+const uint32_t kMMIOPageSize = 1 << kMMIOPageShift;
+const uint32_t kMMIODirectoryShift = 22;
+const uint32_t kMMIOPagesPerTable = 1 << (kMMIODirectoryShift - kMMIOPageShift);
+const uint32_t kMMIODirectorySize = 1 << (32 - kMMIODirectoryShift);
+
+/*!
+ * Resolves the handlers of an MMIO page that is shared by several handlers
+ * or only partially covered. Each byte of the page holds the 1-based index of
+ * the handler mapped to the corresponding address, or 0 if it is unmapped.
+ */
+struct MMIOSubPage {
+    std::vector<MappedHandler> handlers;
+    uint8_t index[kMMIOPageSize];
+};
+
+/*!
+ * An entry of the MMIO page table. Pages covered entirely by one handler
+ * point directly to it; other mapped pages have a sub-page resolver.
+ * Unmapped pages have neither.
+ */
+struct MMIOPage {
+    MappedHandler mapping;
+    std::unique_ptr<MMIOSubPage> subPage;
+};
+
 /*!
  * Maps I/O and MMIO reads and writes to the corresponding devices.
+ *
+ * Port I/O is dispatched through a flat table with one entry per port, which
+ * is kept up to date as devices and handlers are mapped and unmapped.
+ * MMIO is dispatched through a page table that points each 4 KiB page to the
+ * handler that covers it, or to a byte-granular resolver for pages split
+ * between handlers, so that every lookup costs the same.
+ * Statically mapped devices take precedence over handlers, and handlers take
+ * precedence over dynamically mapped devices.
  */
 class IOMapper {
 public:
+    IOMapper();
+
     /*!
     * Maps a device to the specified range of ports.
     */
@@ -59,29 +141,81 @@ public:
      */
     bool AddDevice(IODevice *device);
 
+    /*!
+     * Maps an I/O handler to the specified range of ports on behalf of the
+     * given owner. Overlapping handlers are allowed; the one mapped first
+     * takes precedence.
+     */
+    void MapIOHandler(uint32_t basePort, uint32_t numPorts, void *owner, const IOHandler& handler);
+
+    /*!
+     * Unmaps all I/O handlers mapped on behalf of the given owner.
+     */
+    void UnmapIOHandlers(void *owner);
+
+    /*!
+     * Maps an MMIO handler to the specified address range on behalf of the
+     * given owner. Overlapping handlers are allowed; the one mapped first
+     * takes precedence.
+     */
+    void MapMMIOHandler(uint32_t baseAddress, uint32_t numAddresses, void *owner, const IOHandler& handler);
+
+    /*!
+     * Unmaps all MMIO handlers mapped on behalf of the given owner.
+     */
+    void UnmapMMIOHandlers(void *owner);
+
     bool IORead(uint32_t addr, uint32_t *value, uint8_t size);
     bool IOWrite(uint32_t addr, uint32_t value, uint8_t size);
 
     bool MMIORead(uint32_t addr, uint32_t *value, uint8_t size);
     bool MMIOWrite(uint32_t addr, uint32_t value, uint8_t size);
 
-private:
+#ifdef STRIKEBOX_IO_STATS
     /*!
-     * Looks up the I/O device mapped to the specified I/O or MMIO address,
-     * depending on the map used.
-     *
-     * Returns true if found.
+     * Retrieves the I/O and MMIO access statistics.
      */
-    bool LookupDevice(std::map<uint32_t, MappedDevice>& iomap, uint32_t addr, IODevice **device);
+    IOStats& GetStats() { return m_stats; }
+#endif
 
+private:
     /*!
      * Maps a device to the specified address range.
      */
     bool MapDevice(std::map<uint32_t, MappedDevice>& iomap, uint32_t base, uint32_t size, IODevice *device);
 
+    /*!
+     * Rebuilds the entries of the port I/O dispatch table covering the
+     * specified range of ports.
+     */
+    void UpdateIOPortTable(uint32_t basePort, uint32_t lastPort);
+
+    /*!
+     * Rebuilds the entries of the MMIO page table covering the specified
+     * address range.
+     */
+    void UpdateMMIOPageTable(uint32_t baseAddress, uint32_t lastAddress);
+
+    /*!
+     * Looks up the MMIO handler mapped to the specified address.
+     *
+     * Returns nullptr if there is no handler mapped to the address.
+     */
+    const MappedHandler *LookupMMIOHandler(uint32_t addr);
+
+    std::unique_ptr<IOHandler[]> m_ioPortTable;
+    std::vector<MappedHandler> m_ioHandlers;
+
+    std::unique_ptr<MMIOPage[]> m_mmioPageDirectory[kMMIODirectorySize];
+    std::vector<MappedHandler> m_mmioHandlers;
+
     std::map<uint32_t, MappedDevice> m_mappedIODevices;
     std::map<uint32_t, MappedDevice> m_mappedMMIODevices;
     std::set<IODevice *> m_dynamicDevices;
+
+#ifdef STRIKEBOX_IO_STATS
+    IOStats m_stats;
+#endif
 };
 
 }
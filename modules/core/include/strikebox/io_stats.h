@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace strikebox {
+
+/*!
+ * The address space of an I/O access.
+ */
+enum IOStatsSpace : uint8_t {
+    IOStatsSpace_IO,
+    IOStatsSpace_MMIO,
+};
+
+/*!
+ * The kind of device or handler that services a region.
+ */
+enum IOStatsKind : uint8_t {
+    IOStatsKind_Unhandled,   // Accesses not handled by any device
+    IOStatsKind_Device,      // Statically mapped device; all of its ranges are merged
+    IOStatsKind_Handler,     // Mapped I/O handler, such as a PCI BAR
+    IOStatsKind_Dynamic,     // Device with dynamic address mapping
+};
+
+/*!
+ * Region index used for dynamically mapped devices.
+ */
+const uint8_t kIOStatsDynamicIndex = 0xFF;
+
+/*!
+ * Number of buckets in the handler latency histograms.
+ * Bucket N counts accesses that took between 2^N and 2^(N+1)-1 nanoseconds;
+ * the last bucket also counts everything slower than that.
+ */
+const uint32_t kIOStatsLatencyBuckets = 32;
+
+/*!
+ * Access statistics for a single mapped I/O or MMIO region.
+ */
+struct IOStatsRegion {
+    IOStatsSpace space;
+    uint32_t baseAddress;
+    uint32_t lastAddress;
+    uint8_t index;
+    IOStatsKind kind;
+
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+
+    // Number of accesses of 1, 2 and 4 bytes, and of any other size
+    uint64_t sizes[4] = { 0 };
+
+    uint64_t totalNanos = 0;
+    uint64_t maxNanos = 0;
+    uint64_t latencyHistogram[kIOStatsLatencyBuckets] = { 0 };
+};
+
+/*!
+ * Collects per-region access counts, access sizes and handler latencies for
+ * port I/O and MMIO.
+ *
+ * Regions are identified by the context and index of the handler that
+ * serviced the access. Accesses that are not handled by any device are
+ * accounted to a null context.
+ *
+ * Only available when built with the STRIKEBOX_IO_STATS CMake option.
+ */
+class IOStats {
+public:
+    /*!
+     * Describes the region serviced by the given context and index.
+     * May be invoked again to update the address range of a region, or to
+     * extend it in the case of statically mapped devices.
+     */
+    void DescribeRegion(IOStatsSpace space, const void *context, uint8_t index, uint32_t baseAddress, uint32_t lastAddress, IOStatsKind kind);
+
+    /*!
+     * Records a single access to the region serviced by the given context and
+     * index.
+     */
+    void Record(IOStatsSpace space, const void *context, uint8_t index, bool write, uint8_t size, uint64_t nanos);
+
+    /*!
+     * Clears all recorded statistics, keeping the region descriptions.
+     */
+    void Reset();
+
+    /*!
+     * Writes the statistics in JSON format to the specified file.
+     * Regions are sorted by total handler time, from slowest to fastest.
+     */
+    void DumpJSON(FILE *fp);
+
+private:
+    typedef std::tuple<IOStatsSpace, const void *, uint8_t> Key;
+
+    IOStatsRegion& GetRegion(IOStatsSpace space, const void *context, uint8_t index);
+
+    std::mutex m_mutex;
+    std::map<Key, IOStatsRegion> m_regions;
+};
+
+/*!
+ * Measures the time spent servicing an access and records it when going out
+ * of scope. The region defaults to the unhandled access region until
+ * SetRegion is invoked.
+ */
+class IOStatsScope {
+public:
+    IOStatsScope(IOStats& stats, IOStatsSpace space, bool write, uint8_t size)
+        : m_stats(stats)
+        , m_space(space)
+        , m_write(write)
+        , m_size(size)
+        , m_start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~IOStatsScope() {
+        auto elapsed = std::chrono::steady_clock::now() - m_start;
+        uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        m_stats.Record(m_space, m_context, m_index, m_write, m_size, nanos);
+    }
+
+    void SetRegion(const void *context, uint8_t index) {
+        m_context = context;
+        m_index = index;
+    }
+
+private:
+    IOStats& m_stats;
+    IOStatsSpace m_space;
+    bool m_write;
+    uint8_t m_size;
+    std::chrono::steady_clock::time_point m_start;
+
+    const void *m_context = nullptr;
+    uint8_t m_index = 0;
+};
+
+// Instrumentation hooks; these compile to nothing unless the statistics are
+// enabled
+#ifdef STRIKEBOX_IO_STATS
+  #define IOSTATS_DESCRIBE(stats, space, context, index, base, last, kind) (stats).DescribeRegion(space, context, index, base, last, kind)
+  #define IOSTATS_SCOPE(stats, space, write, size) IOStatsScope _ioStatsScope(stats, space, write, size)
+  #define IOSTATS_REGION(context, index) _ioStatsScope.SetRegion(context, index)
+#else
+  #define IOSTATS_DESCRIBE(stats, space, context, index, base, last, kind)
+  #define IOSTATS_SCOPE(stats, space, write, size)
+  #define IOSTATS_REGION(context, index)
+#endif
+
+}
@@ -1,6 +1,16 @@
 #pragma once
 
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 namespace strikebox {
 
@@ -11,24 +21,314 @@ namespace strikebox {
 #define LOG_LEVEL_DEBUG   (5)
 #define LOG_LEVEL_SPEW    (6)
 
+// Compile-time log level floor. Messages above this level are removed from
+// the build entirely. Can be set with the STRIKEBOX_LOG_LEVEL CMake option.
+#ifndef LOG_LEVEL
 #define LOG_LEVEL LOG_LEVEL_SPEW
-
-#if 1
-#define log_fatal(...)   log_print(LOG_LEVEL_FATAL,   __VA_ARGS__)
-#define log_error(...)   log_print(LOG_LEVEL_ERROR,   __VA_ARGS__)
-#define log_warning(...) log_print(LOG_LEVEL_WARNING, __VA_ARGS__)
-#define log_info(...)    log_print(LOG_LEVEL_INFO,    __VA_ARGS__)
-#define log_debug(...)   log_print(LOG_LEVEL_DEBUG,   __VA_ARGS__)
-#define log_spew(...)    log_print(LOG_LEVEL_SPEW,    __VA_ARGS__)
-#else
-#define log_fatal(...)
-#define log_error(...)
-#define log_warning(...)
-#define log_info(...)
-#define log_debug(...)
-#define log_spew(...)
 #endif
 
-int log_print(int level, const char *fmt, ...);
+/*!
+ * Log message categories. Each category has its own runtime log level.
+ */
+enum LogCategory {
+    LogCategory_General,   // Emulator core and everything else
+    LogCategory_IO,        // I/O mapper
+    LogCategory_PCI,       // PCI bus and bridges
+    LogCategory_Basic,     // PIC, PIT, CMOS, Super I/O, serial ports
+    LogCategory_SMBus,     // SMBus and system management devices
+    LogCategory_ATA,       // ATA/ATAPI and Bus Master IDE
+    LogCategory_USB,       // USB controllers
+    LogCategory_Audio,     // APU and AC97
+    LogCategory_Network,   // NVNet
+    LogCategory_NV2A,      // NV2A GPU
+
+    LogCategory_Count
+};
+
+namespace detail {
+
+// Returns true if the path contains the pattern; backslashes in the path
+// match forward slashes in the pattern
+constexpr bool LogPathContains(const char *path, const char *pattern) {
+    for (; *path != '\0'; path++) {
+        const char *p = path;
+        const char *q = pattern;
+        while (*q != '\0' && (*p == *q || (*p == '\\' && *q == '/'))) {
+            p++;
+            q++;
+        }
+        if (*q == '\0') {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
+/*!
+ * Determines the log category of a source file from its path.
+ */
+constexpr LogCategory log_category_from_path(const char *path) {
+    using detail::LogPathContains;
+    return
+        (LogPathContains(path, "hw/gpu/") || LogPathContains(path, "hw/pci/nv2a")) ? LogCategory_NV2A :
+        (LogPathContains(path, "hw/pci/usb")) ? LogCategory_USB :
+        (LogPathContains(path, "hw/pci/nvapu") || LogPathContains(path, "hw/pci/ac97")) ? LogCategory_Audio :
+        (LogPathContains(path, "hw/pci/nvnet")) ? LogCategory_Network :
+        (LogPathContains(path, "hw/ata/") || LogPathContains(path, "hw/atapi/") || LogPathContains(path, "hw/pci/bmide")) ? LogCategory_ATA :
+        (LogPathContains(path, "hw/pci/") || LogPathContains(path, "hw/bus/pci")) ? LogCategory_PCI :
+        (LogPathContains(path, "hw/bus/smbus") || LogPathContains(path, "hw/sm/")) ? LogCategory_SMBus :
+        (LogPathContains(path, "hw/basic/")) ? LogCategory_Basic :
+        (LogPathContains(path, "strikebox/io.") || LogPathContains(path, "strikebox/io_")) ? LogCategory_IO :
+        LogCategory_General;
+}
+
+// The log category of the current source file
+#define LOG_CATEGORY (std::integral_constant<::strikebox::LogCategory, ::strikebox::log_category_from_path(__FILE__)>::value)
+
+#define log_at(level, ...) ((LOG_LEVEL >= (level)) ? ::strikebox::log_print(level, LOG_CATEGORY, __VA_ARGS__) : 0)
+
+#define log_fatal(...)   log_at(LOG_LEVEL_FATAL,   __VA_ARGS__)
+#define log_error(...)   log_at(LOG_LEVEL_ERROR,   __VA_ARGS__)
+#define log_warning(...) log_at(LOG_LEVEL_WARNING, __VA_ARGS__)
+#define log_info(...)    log_at(LOG_LEVEL_INFO,    __VA_ARGS__)
+#define log_debug(...)   log_at(LOG_LEVEL_DEBUG,   __VA_ARGS__)
+#define log_spew(...)    log_at(LOG_LEVEL_SPEW,    __VA_ARGS__)
+
+/*!
+ * Logs a message at the specified level if allowed by the rate limiter.
+ * When messages resume after being suppressed, the number of suppressed
+ * messages is logged first.
+ */
+#define log_ratelimited(limiter, level, ...) \
+    do { \
+        uint64_t _suppressed; \
+        if ((limiter).Allow(&_suppressed)) { \
+            if (_suppressed > 0) { \
+                log_at(level, "(%llu similar messages suppressed)\n", (unsigned long long)_suppressed); \
+            } \
+            log_at(level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+/*!
+ * Returns the name of the log category.
+ */
+const char *log_category_name(LogCategory category);
+
+/*!
+ * Sets the runtime log level of a category.
+ */
+void log_set_level(LogCategory category, int level);
+
+/*!
+ * Sets the runtime log level of all categories.
+ */
+void log_set_level(int level);
+
+/*!
+ * Returns the runtime log level of a category.
+ */
+int log_get_level(LogCategory category);
+
+/*!
+ * Configures log levels from a comma-separated list of levels, optionally
+ * prefixed by a category name, such as "warning,nv2a=spew,ata=debug".
+ * A level without a category applies to all categories.
+ *
+ * Returns false if the specification is invalid.
+ */
+bool log_configure(const char *spec);
+
+/*!
+ * Writes out all pending log messages.
+ */
+void log_flush();
+
+/*!
+ * Limits the rate of log messages. Allows a burst of messages, then one
+ * message per interval.
+ */
+class LogRateLimiter {
+public:
+    LogRateLimiter(uint32_t burst, uint32_t intervalMillis);
+
+    /*!
+     * Returns true if a message may be logged now, in which case suppressed
+     * receives the number of messages suppressed since the last one allowed.
+     */
+    bool Allow(uint64_t *suppressed);
+
+private:
+    std::mutex m_mutex;
+    const uint32_t m_burst;
+    const std::chrono::steady_clock::duration m_interval;
+    uint32_t m_tokens;
+    uint64_t m_suppressed;
+    std::chrono::steady_clock::time_point m_lastRefill;
+};
+
+// ----- Asynchronous logging backend -----------------------------------------
+//
+// Log messages are not formatted on the calling thread. Instead, the format
+// string pointer and the arguments are captured into a lock-free ring buffer
+// owned by the calling thread, and a background thread formats and writes
+// them out in the order they were logged. Arguments of %s conversions are
+// copied into the record, so they may refer to temporary buffers.
+
+namespace detail {
+
+extern std::atomic<int> g_logLevels[LogCategory_Count];
+
+typedef void (*LogFormatFunc)(FILE *fp, const char *fmt, const uint8_t *payload);
+
+struct LogRecordHeader {
+    uint64_t sequence;
+    const char *fmt;
+    LogFormatFunc format;   // nullptr for padding records
+    uint32_t size;
+};
+
+// Longest string argument copied into a record; longer strings are truncated
+const size_t kLogMaxStringLength = 1023;
+
+// Returns a mask of the arguments consumed by %s conversions in the format
+// string, with the first argument in bit 0
+uint64_t LogStringArgs(const char *fmt);
+
+// Captured argument of any type that is passed to printf as is
+template<typename T>
+struct LogArg {
+    typedef T Stored;
+    static const bool kIsString = false;
+
+    static size_t ExtraSize(T, bool) { return 0; }
+    static Stored Store(T value, bool, uint8_t *, size_t&) { return value; }
+    static T Load(const Stored& stored, const uint8_t *) { return stored; }
+};
+
+// Captured character pointer. Arguments of %s conversions are copied after
+// the argument tuple; any other pointer is kept as is.
+struct LogStringRef {
+    const char *pointer;
+    uint32_t offset;
+    bool copied;
+};
+
+template<>
+struct LogArg<const char *> {
+    typedef LogStringRef Stored;
+    static const bool kIsString = true;
+
+    static size_t Length(const char *value) {
+        size_t len = 0;
+        while (len < kLogMaxStringLength && value[len] != '\0') {
+            len++;
+        }
+        return len;
+    }
+
+    static size_t ExtraSize(const char *value, bool copy) {
+        return (copy && value != nullptr) ? Length(value) + 1 : 0;
+    }
+
+    static Stored Store(const char *value, bool copy, uint8_t *strings, size_t& offset) {
+        if (!copy || value == nullptr) {
+            return LogStringRef{ value, 0, false };
+        }
+        LogStringRef ref{ nullptr, (uint32_t)offset, true };
+        size_t len = Length(value);
+        memcpy(&strings[offset], value, len);
+        strings[offset + len] = '\0';
+        offset += len + 1;
+        return ref;
+    }
+
+    static const char *Load(const Stored& stored, const uint8_t *strings) {
+        return stored.copied ? reinterpret_cast<const char *>(&strings[stored.offset]) : stored.pointer;
+    }
+};
+
+template<>
+struct LogArg<char *> : public LogArg<const char *> {
+};
+
+template<typename... Args, size_t... I>
+size_t LogStringsSize([[maybe_unused]] uint64_t stringArgs, std::index_sequence<I...>, const Args&... args) {
+    return (size_t(0) + ... + LogArg<Args>::ExtraSize(args, (stringArgs >> I) & 1));
+}
+
+template<typename... Args, size_t... I>
+void LogStore(uint8_t *payload, [[maybe_unused]] uint8_t *strings, [[maybe_unused]] uint64_t stringArgs, std::index_sequence<I...>, const Args&... args) {
+    // Braced initializers are evaluated in order, so strings are laid out in
+    // argument order
+    [[maybe_unused]] size_t offset = 0;
+    new (payload) std::tuple<typename LogArg<Args>::Stored...>{ LogArg<Args>::Store(args, (stringArgs >> I) & 1, strings, offset)... };
+}
+
+template<typename... Args, size_t... I>
+void LogFormatUnpack(FILE *fp, const char *fmt, const std::tuple<typename LogArg<Args>::Stored...>& stored, [[maybe_unused]] const uint8_t *strings, std::index_sequence<I...>) {
+    fprintf(fp, fmt, LogArg<Args>::Load(std::get<I>(stored), strings)...);
+}
+
+template<typename... Args>
+void LogFormat(FILE *fp, const char *fmt, const uint8_t *payload) {
+    typedef std::tuple<typename LogArg<Args>::Stored...> Stored;
+    const Stored& stored = *reinterpret_cast<const Stored *>(payload);
+    LogFormatUnpack<Args...>(fp, fmt, stored, payload + sizeof(Stored), std::index_sequence_for<Args...>{});
+}
+
+// Reserves space for a record in the calling thread's ring buffer and assigns
+// it the next sequence number, which orders records across threads.
+// If the ring buffer is full, either waits for the backend to catch up or
+// returns nullptr, in which case the message is dropped and accounted for.
+uint8_t *LogReserve(size_t size, bool wait, uint64_t *sequence);
+
+// Publishes the record previously reserved by the calling thread.
+void LogCommit();
+
+}
+
+template<typename... Args>
+int log_print(int level, LogCategory category, const char *fmt, Args... args) {
+    using namespace detail;
+
+    if (level > g_logLevels[category].load(std::memory_order_relaxed)) {
+        return 0;
+    }
+
+    typedef std::tuple<typename LogArg<Args>::Stored...> Stored;
+    static_assert(alignof(Stored) <= alignof(LogRecordHeader), "log argument alignment is too large");
+    static_assert(sizeof...(Args) <= 64, "too many log arguments");
+
+    // Only messages with character pointer arguments need their format
+    // string scanned for %s conversions
+    uint64_t stringArgs = 0;
+    if constexpr ((false || ... || LogArg<Args>::kIsString)) {
+        stringArgs = LogStringArgs(fmt);
+    }
+
+    auto indices = std::index_sequence_for<Args...>{};
+    size_t size = sizeof(LogRecordHeader) + sizeof(Stored) + LogStringsSize(stringArgs, indices, args...);
+
+    // Warnings and errors are never dropped
+    uint64_t sequence;
+    uint8_t *record = LogReserve(size, level <= LOG_LEVEL_WARNING, &sequence);
+    if (record == nullptr) {
+        return 0;
+    }
+
+    uint8_t *payload = record + sizeof(LogRecordHeader);
+    LogStore(payload, payload + sizeof(Stored), stringArgs, indices, args...);
+    new (record) LogRecordHeader{ sequence, fmt, &LogFormat<Args...>, (uint32_t)size };
+    LogCommit();
+
+    if (level <= LOG_LEVEL_FATAL) {
+        log_flush();
+    }
+
+    return (int)size;
+}
 
 }
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "virtual_clock.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace strikebox {
+
+enum class SchedulerMode {
+    RealTime,      // Virtual time follows the clock
+    Unthrottled,   // Virtual time also skips ahead while the guest waits for an event
+};
+
+/*!
+ * Runs timed device events on a shared virtual timeline.
+ *
+ * Devices register events and schedule them at absolute virtual times, in
+ * nanoseconds. A single thread fires the events in order as virtual time
+ * reaches them; callbacks run without locks held and may schedule events,
+ * including their own.
+ *
+ * Virtual time comes from the VirtualClock shared with the devices' timers.
+ * In real-time mode the clock paces the events. In unthrottled mode the
+ * scheduler also advances the clock to the next event whenever a device
+ * reports that the guest is waiting for one, so a guest that spends its time
+ * waiting for vertical blanks runs as fast as the host allows.
+ */
+class Scheduler {
+public:
+    using EventID = uint32_t;
+    using Callback = std::function<void()>;
+
+    static const EventID kInvalidEvent = ~0u;
+
+    Scheduler(VirtualClock& clock, SchedulerMode mode = SchedulerMode::RealTime);
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    SchedulerMode GetMode() const { return m_mode; }
+    VirtualClock& GetClock() const { return m_clock; }
+
+    /*!
+     * Starts and stops the event thread. Events may be scheduled while the
+     * thread is stopped; they fire once it starts.
+     */
+    void Start();
+    void Stop();
+
+    /*!
+     * Registers an event. Events cannot be unregistered.
+     */
+    EventID RegisterEvent(Callback callback);
+
+    /*!
+     * Schedules the event to fire at the given virtual time, replacing any
+     * previously scheduled time.
+     */
+    void Schedule(EventID event, uint64_t time);
+
+    /*!
+     * Cancels the event if it is scheduled.
+     */
+    void Cancel(EventID event);
+
+    /*!
+     * Returns the current virtual time in nanoseconds.
+     */
+    uint64_t Now() const { return m_clock.Now(); }
+
+    /*!
+     * Reports that the guest is waiting for an event. In unthrottled mode,
+     * virtual time skips ahead to the next scheduled event.
+     */
+    void NotifyGuestWaiting();
+
+private:
+    struct Event {
+        Callback callback;
+        uint64_t time;
+        bool pending;
+    };
+
+    VirtualClock& m_clock;
+    const SchedulerMode m_mode;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::vector<std::unique_ptr<Event>> m_events;
+    std::atomic<bool> m_guestWaiting{ false };
+    bool m_running = false;
+    std::thread m_thread;
+
+    void Run();
+};
+
+}
@@ -24,6 +24,14 @@ enum VirtualDVDDriveType {
     // TODO: VDVD_HostDirectory   // Virtual DVD drive mapped to a directory on the host
 };
 
+enum VideoExportType {
+    VEX_None,           // Frames are not scanned out
+    VEX_Null,           // Frames are scanned out and discarded
+    VEX_SharedMemory,   // Frames are published to a shared memory ring
+    VEX_PPM,            // Frames are written to numbered PPM images
+    VEX_Y4M,            // Frames are written to a Y4M video file
+};
+
 struct StrikeBoxSettings {
     // false: the CPU emulator will execute until interrupted
     // true: the CPU emulator will execute one instruction at a time
@@ -36,6 +44,10 @@ struct StrikeBoxSettings {
     // true: the emulator will stop on a fatal error
     bool emu_stopOnSMCFatalErrors = false;
 
+    // false: timed events such as vertical blanks are paced in real time
+    // true: time skips ahead to the next event whenever the guest waits for one
+    bool emu_unthrottled = false;
+
     // true: the emulator will stop on a kernel bug check
     // (only applies to original or modified Microsoft kernels)
     bool emu_stopOnBugChecks = false;
@@ -61,6 +73,10 @@ struct StrikeBoxSettings {
     // The number of instructions to disassemble
     uint32_t debug_dumpDisassembly_length = 15;
 
+    // File to which I/O and MMIO access statistics are written on exit, if
+    // the emulator was built with STRIKEBOX_IO_STATS; nullptr disables the dump
+    const char *debug_ioStatsPath = "iostats.json";
+
     // The Xbox hardware revision to use
     HardwareModel hw_revision = DebugKit;
 
@@ -81,6 +97,16 @@ struct StrikeBoxSettings {
         } params;
     } hw_charDrivers[2];
 
+    // Export of the frames scanned out at each vertical blank
+    VideoExportType video_exportType = VEX_None;
+
+    // VEX_PPM: prefix of the image file names
+    // VEX_Y4M: path to the video file
+    const char *video_exportPath = "frame";
+
+    // Export one out of every this many frames (VEX_PPM and VEX_Y4M only)
+    uint32_t video_exportInterval = 1;
+
     // Path to MCPX ROM file
     const char *rom_mcpx;
 
@@ -24,6 +24,8 @@ enum EmulatorStatus {
     EMUS_INIT_INVALID_DVD_DRIVE_TYPE,    // An invalid DVD drive type was specified
     EMUS_INIT_DVD_DRIVE_INIT_FAILED,     // Virtual DVD drive initialization failed
 
+    EMUS_INIT_VIDEO_EXPORT_FAILED,       // Frame export initialization failed
+
     EMUS_INIT_DEBUGGER_FAILED,           // Debugger initialization failed
 };
 
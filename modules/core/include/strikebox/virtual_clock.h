@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace strikebox {
+
+/*!
+ * Returns (a * b) >> 32 using only 64-bit arithmetic, for compilers without
+ * a 128-bit multiplication.
+ */
+inline uint64_t MulShift32Portable(uint64_t a, uint64_t b) {
+    uint64_t aHigh = a >> 32, aLow = a & 0xFFFFFFFFull;
+    uint64_t bHigh = b >> 32, bLow = b & 0xFFFFFFFFull;
+    uint64_t low = aLow * bLow;
+    uint64_t mid1 = aHigh * bLow;
+    uint64_t mid2 = aLow * bHigh;
+
+    // Sum bits 32..63 of the product separately so that their carry is kept
+    uint64_t cross = (low >> 32) + (mid1 & 0xFFFFFFFFull) + (mid2 & 0xFFFFFFFFull);
+    uint64_t high = aHigh * bHigh + (mid1 >> 32) + (mid2 >> 32) + (cross >> 32);
+    return (high << 32) | (cross & 0xFFFFFFFFull);
+}
+
+/*!
+ * Returns (a * b) >> 32 without overflowing the intermediate product.
+ */
+inline uint64_t MulShift32(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 32);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    uint64_t high;
+    uint64_t low = _umul128(a, b, &high);
+    return __shiftright128(low, high, 32);
+#else
+    return MulShift32Portable(a, b);
+#endif
+}
+
+/*!
+ * Converts virtual time into ticks of a device clock.
+ *
+ * The frequency is turned into a 32.32 fixed-point ticks-per-nanosecond
+ * factor once, so that each conversion costs a single multiplication.
+ */
+class TickRate {
+public:
+    TickRate(uint64_t frequency = 0) { SetFrequency(frequency); }
+
+    void SetFrequency(uint64_t frequency) {
+        m_frequency = frequency;
+        m_factor = ((frequency / 1000000000ull) << 32) + (((frequency % 1000000000ull) << 32) + 500000000ull) / 1000000000ull;
+    }
+
+    uint64_t GetFrequency() const { return m_frequency; }
+
+    /*!
+     * Returns the 32.32 fixed-point ticks-per-nanosecond factor used by ToTicks.
+     */
+    uint64_t GetFactor() const { return m_factor; }
+
+    /*!
+     * Returns the number of ticks elapsed in the given number of nanoseconds.
+     */
+    uint64_t ToTicks(uint64_t nanos) const { return MulShift32(nanos, m_factor); }
+
+private:
+    uint64_t m_frequency;
+    uint64_t m_factor;
+};
+
+/*!
+ * Virtual time source shared by all emulated devices, in nanoseconds.
+ *
+ * Virtual time is derived from the host's invariant timestamp counter when
+ * the processor has one, calibrated once against the host steady clock when
+ * the clock is created. Reading it then costs an RDTSC and a fixed-point
+ * multiplication, with no system calls. Hosts without an invariant TSC fall
+ * back to the steady clock.
+ *
+ * Virtual time starts at zero and can be paused, scaled relative to host time
+ * and advanced by arbitrary amounts. While paused, virtual time only moves
+ * through Advance, which allows the emulator to step time deterministically.
+ *
+ * Reads are lock-free and may happen on any thread. Changes are serialized
+ * and never make virtual time go backwards.
+ */
+class VirtualClock {
+public:
+    VirtualClock();
+
+    VirtualClock(const VirtualClock&) = delete;
+    VirtualClock& operator=(const VirtualClock&) = delete;
+
+    /*!
+     * Returns the current virtual time in nanoseconds.
+     */
+    uint64_t Now() const;
+
+    /*!
+     * Stops and restarts the flow of virtual time.
+     */
+    void Pause();
+    void Resume();
+    bool IsPaused() const { return m_paused.load(std::memory_order_relaxed); }
+
+    /*!
+     * Sets the rate at which virtual time flows relative to host time;
+     * 1.0 is real time. Non-positive scales are ignored.
+     */
+    void SetScale(double scale);
+    double GetScale() const { return m_scale.load(std::memory_order_relaxed); }
+
+    /*!
+     * Moves virtual time forward by the given number of nanoseconds.
+     */
+    void Advance(uint64_t nanos);
+
+    /*!
+     * Returns how long the host has to wait for the given amount of virtual
+     * time to pass, or the maximum duration if the clock is paused.
+     */
+    std::chrono::nanoseconds ToHostDuration(uint64_t nanos) const;
+
+    /*!
+     * Determines if virtual time is derived from the timestamp counter.
+     */
+    bool UsesTSC() const { return m_useTSC; }
+
+    /*!
+     * Returns the calibrated timestamp counter frequency in Hz, or zero if the
+     * counter is not used.
+     */
+    uint64_t GetTSCFrequency() const { return m_tscFrequency; }
+
+private:
+    bool m_useTSC = false;
+    uint64_t m_tscFrequency = 0;
+    uint64_t m_hostFactor;   // 32.32 fixed-point nanoseconds per host tick at 1x
+
+    // Virtual time is m_baseTime + (host ticks - m_baseTicks) * m_factor,
+    // published under a sequence lock
+    std::atomic<uint32_t> m_sequence{ 0 };
+    std::atomic<uint64_t> m_baseTicks{ 0 };
+    std::atomic<uint64_t> m_baseTime{ 0 };
+    std::atomic<uint64_t> m_factor{ 0 };
+
+    std::mutex m_mutex;
+    std::atomic<bool> m_paused{ false };
+    std::atomic<double> m_scale{ 1.0 };
+
+    uint64_t ReadHostTicks() const;
+    void Calibrate();
+
+    // Restarts the timeline at the current time with the current settings,
+    // moved forward by the given amount; requires m_mutex
+    void Rebase(uint64_t advance = 0);
+};
+
+}
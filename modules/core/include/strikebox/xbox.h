@@ -14,8 +14,11 @@
 
 #include "strikebox/log.h"
 #include "strikebox/mem.h"
+#include "strikebox/guest_memory.h"
 #include "strikebox/util.h"
 #include "strikebox/thread.h"
+#include "strikebox/scheduler.h"
+#include "strikebox/virtual_clock.h"
 #include "strikebox/settings.h"
 #include "strikebox/status.h"
 
@@ -77,6 +80,13 @@ public:
     EmulatorStatus Run();
     void Stop();
 
+    /*!
+     * Writes the I/O and MMIO access statistics to the specified file in JSON
+     * format. Returns false if the file could not be written or if the
+     * emulator was built without STRIKEBOX_IO_STATS.
+     */
+    bool DumpIOStats(const char *path);
+
 protected:
     // ----- Initialization and cleanup ---------------------------------------
     EmulatorStatus Initialize();
@@ -109,6 +119,7 @@ protected:
     virt86::Platform& m_virt86Platform;
     std::optional<std::reference_wrapper<virt86::VirtualMachine>> m_vm;
 
+    GuestMemory       m_guestMemory;
     uint32_t          m_ramSize = 0;
     uint8_t          *m_ram = nullptr;
     uint8_t          *m_rom = nullptr;
@@ -116,6 +127,8 @@ protected:
     uint32_t          m_biosSize = 0;
     uint8_t          *m_mcpxROM = nullptr;
     IOMapper          m_ioMapper;
+    VirtualClock     *m_clock = nullptr;
+    Scheduler        *m_scheduler = nullptr;
 
     GSI              *m_GSI = nullptr;
     IRQ              *m_IRQs = nullptr;
@@ -150,6 +163,8 @@ protected:
     AGPBridgeDevice  *m_AGPBridge = nullptr;
     NV2ADevice       *m_NV2A = nullptr;
 
+    nv2a::FrameSink  *m_frameSink = nullptr;
+
     // ----- Configuration ----------------------------------------------------
     StrikeBoxSettings     m_settings;
 
@@ -0,0 +1,151 @@
+#include "strikebox/guest_memory.h"
+
+#include "strikebox/log.h"
+
+#include <algorithm>
+
+namespace strikebox {
+
+GuestMemory::~GuestMemory() {
+    DestroyWriteTracker();
+    if (m_data != nullptr) {
+        FreePages(m_data, m_size);
+    }
+}
+
+bool GuestMemory::Allocate(uint32_t size) {
+    m_data = AllocatePages(size);
+    if (m_data == nullptr) {
+        return false;
+    }
+    m_size = size;
+    m_pageCount = (size + kPageSize - 1) >> kPageShift;
+    m_bitmapWords = (m_pageCount + 63) / 64;
+    m_scanned.resize(m_bitmapWords);
+
+    m_tracker = CreateWriteTracker();
+    if (m_tracker != nullptr) {
+        log_debug("Tracking guest RAM writes with the host page tables\n");
+    }
+    else {
+        log_debug("Guest CPU writes to RAM cannot be tracked on this host\n");
+    }
+    return true;
+}
+
+void GuestMemory::MarkDirty(uint32_t address, uint32_t size, int writerView) {
+    if (size == 0 || address >= m_size) {
+        return;
+    }
+    uint32_t first = address >> kPageShift;
+    uint32_t last = (std::min<uint64_t>(static_cast<uint64_t>(address) + size, m_size) - 1) >> kPageShift;
+
+    uint32_t active = m_activeViews.load(std::memory_order_acquire);
+    if (writerView >= 0 && writerView < static_cast<int>(kMaxSubscribers)) {
+        active &= ~(1 << writerView);
+    }
+    for (uint32_t view = 0; view < kMaxSubscribers; view++) {
+        if (!(active & (1 << view))) {
+            continue;
+        }
+        std::atomic<uint64_t> *bits = m_views[view].get();
+        for (uint32_t word = first / 64; word <= last / 64; word++) {
+            uint32_t lo = std::max(first, word * 64) - word * 64;
+            uint32_t hi = std::min(last, word * 64 + 63) - word * 64;
+            uint64_t mask = (~0ull >> (63 - hi)) & (~0ull << lo);
+            bits[word].fetch_or(mask, std::memory_order_release);
+        }
+    }
+}
+
+int GuestMemory::Subscribe() {
+    std::lock_guard<std::mutex> lk(m_viewMutex);
+    uint32_t active = m_activeViews.load(std::memory_order_relaxed);
+    for (uint32_t view = 0; view < kMaxSubscribers; view++) {
+        if (active & (1 << view)) {
+            continue;
+        }
+        // Views are never freed so that concurrent markers can't touch freed memory
+        if (!m_views[view]) {
+            m_views[view] = std::make_unique<std::atomic<uint64_t>[]>(m_bitmapWords);
+        }
+        for (uint32_t word = 0; word < m_bitmapWords; word++) {
+            m_views[view][word].store(~0ull, std::memory_order_relaxed);
+        }
+        m_activeViews.fetch_or(1 << view, std::memory_order_release);
+        return static_cast<int>(view);
+    }
+    log_warning("GuestMemory: Too many dirty page subscribers\n");
+    return -1;
+}
+
+void GuestMemory::Unsubscribe(int view) {
+    if (view < 0 || view >= static_cast<int>(kMaxSubscribers)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lk(m_viewMutex);
+    m_activeViews.fetch_and(~(1 << view), std::memory_order_release);
+}
+
+void GuestMemory::Synchronize() {
+    if (m_tracker == nullptr) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lk(m_viewMutex);
+    uint32_t active = m_activeViews.load(std::memory_order_relaxed);
+    if (active == 0) {
+        return;
+    }
+
+    // CPU writes are cleared from the host when scanned, so they are handed
+    // to every view
+    std::fill(m_scanned.begin(), m_scanned.end(), 0);
+    ScanCPUWrites(m_scanned);
+    for (uint32_t word = 0; word < m_bitmapWords; word++) {
+        if (m_scanned[word] == 0) {
+            continue;
+        }
+        for (uint32_t view = 0; view < kMaxSubscribers; view++) {
+            if (active & (1 << view)) {
+                m_views[view][word].fetch_or(m_scanned[word], std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void GuestMemory::CollectDirty(int view, std::vector<uint64_t>& bitmap) {
+    bitmap.assign(m_bitmapWords, 0);
+    if (view < 0 || view >= static_cast<int>(kMaxSubscribers)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lk(m_viewMutex);
+    uint32_t active = m_activeViews.load(std::memory_order_relaxed);
+    if (!(active & (1 << view))) {
+        return;
+    }
+
+    std::atomic<uint64_t> *bits = m_views[view].get();
+    for (uint32_t word = 0; word < m_bitmapWords; word++) {
+        if (bits[word].load(std::memory_order_relaxed) != 0) {
+            bitmap[word] = bits[word].exchange(0, std::memory_order_acquire);
+        }
+    }
+}
+
+bool GuestMemory::AnyPageDirty(const std::vector<uint64_t>& bitmap, uint32_t address, uint32_t size) {
+    if (size == 0) {
+        return false;
+    }
+    uint32_t first = address >> kPageShift;
+    uint32_t last = static_cast<uint32_t>((static_cast<uint64_t>(address) + size - 1) >> kPageShift);
+    for (uint32_t page = first; page <= last && page / 64 < bitmap.size(); page++) {
+        if (bitmap[page / 64] & (1ull << (page & 63))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
@@ -100,10 +100,6 @@ namespace strikebox {
 
 #define SEC_TO_NANO   1000000000ULL
 
-static inline uint64_t GetNanos() {
-    return std::chrono::high_resolution_clock::now().time_since_epoch().count();
-}
-
 int Serial::CanReceiveCB(void *userData) {
     return ((Serial *)userData)->CanReceive();
 }
@@ -124,8 +120,9 @@ void Serial::FifoTimeoutInterruptCB(void *userData) {
     ((Serial *)userData)->FifoTimeoutInterrupt();
 }
 
-Serial::Serial(IRQHandler& irqHandler, uint32_t ioBase)
+Serial::Serial(IRQHandler& irqHandler, VirtualClock& clock, uint32_t ioBase)
     : m_irqHandler(irqHandler)
+    , m_clock(clock)
     , m_ioBase(ioBase)
 {
     m_recvFifo = new Fifo<uint8_t>(UART_FIFO_LENGTH);
@@ -189,7 +186,7 @@ void Serial::Reset() {
     m_recvFifo->Clear();
     m_xmitFifo->Clear();
 
-    m_lastXmitTs = GetNanos();
+    m_lastXmitTs = m_clock.Now();
 
     m_thr_ipending = 0;
     m_lastBreakEnable = 0;
@@ -523,7 +520,7 @@ void Serial::Transmit() {
         m_tsrRetry = 0;
     }
 
-    m_lastXmitTs = GetNanos();
+    m_lastXmitTs = m_clock.Now();
 
     if (m_lsr & UART_LSR_THRE) {
         m_lsr |= UART_LSR_TEMT;
@@ -698,7 +695,7 @@ void Serial::UpdateParameters() {
     params.baudRate = m_baudbase;
     params.divider = m_divider;
     frameSize += params.dataBits + params.stopBits;
-    m_charTransmitTime = (GetNanos() / params.baudRate / m_divider) * frameSize;
+    m_charTransmitTime = (SEC_TO_NANO * m_divider / params.baudRate) * frameSize;
     m_chr->SetSerialParameters(&params);
 }
 
@@ -35,6 +35,7 @@ namespace strikebox {
 
 PCIBus::PCIBus() {
     m_owner = nullptr;
+    m_ioMapper = nullptr;
     m_irqMapper = new DefaultIRQMapper();
     m_numIRQs = 0;
     m_irqCount = nullptr;
@@ -50,9 +51,54 @@ bool PCIBus::MapIO(IOMapper *mapper) {
     if (!mapper->MapIODevice(PORT_PCI_CONFIG_DATA, 4, this)) return false;
     if (!mapper->AddDevice(this)) return false;
 
+    // Map the I/O BARs of all devices connected so far
+    m_ioMapper = mapper;
+    for (auto it = m_Devices.begin(); it != m_Devices.end(); ++it) {
+        UpdateMappings(it->second);
+    }
+
+    return true;
+}
+
+static bool PCIBarIORead(void *context, uint8_t barIndex, uint32_t port, uint32_t *value, uint8_t size) {
+    reinterpret_cast<PCIDevice *>(context)->PCIIORead(barIndex, port, value, size);
+    return true;
+}
+
+static bool PCIBarIOWrite(void *context, uint8_t barIndex, uint32_t port, uint32_t value, uint8_t size) {
+    reinterpret_cast<PCIDevice *>(context)->PCIIOWrite(barIndex, port, value, size);
+    return true;
+}
+
+static bool PCIBarMMIORead(void *context, uint8_t barIndex, uint32_t addr, uint32_t *value, uint8_t size) {
+    reinterpret_cast<PCIDevice *>(context)->PCIMMIORead(barIndex, addr, value, size);
+    return true;
+}
+
+static bool PCIBarMMIOWrite(void *context, uint8_t barIndex, uint32_t addr, uint32_t value, uint8_t size) {
+    reinterpret_cast<PCIDevice *>(context)->PCIMMIOWrite(barIndex, addr, value, size);
     return true;
 }
 
+void PCIBus::UpdateMappings(PCIDevice *dev) {
+    if (m_ioMapper == nullptr) {
+        return;
+    }
+
+    m_ioMapper->UnmapIOHandlers(dev);
+    m_ioMapper->UnmapMMIOHandlers(dev);
+    for (uint8_t i = 0; i < PCI_NUM_BARS_DEVICE; i++) {
+        uint32_t baseAddress;
+        uint32_t size;
+        if (dev->GetIOBarRange(i, &baseAddress, &size)) {
+            m_ioMapper->MapIOHandler(baseAddress, size, dev, IOHandler{ dev, PCIBarIORead, PCIBarIOWrite, baseAddress, i });
+        }
+        else if (dev->GetMMIOBarRange(i, &baseAddress, &size)) {
+            m_ioMapper->MapMMIOHandler(baseAddress, size, dev, IOHandler{ dev, PCIBarMMIORead, PCIBarMMIOWrite, baseAddress, i });
+        }
+    }
+}
+
 void PCIBus::ConnectDevice(uint32_t deviceId, PCIDevice *pDevice) {
     if (m_Devices.find(deviceId) != m_Devices.end()) {
         log_warning("PCIBus: Attempting to connect two devices to the same device address\n");
@@ -63,6 +109,7 @@ void PCIBus::ConnectDevice(uint32_t deviceId, PCIDevice *pDevice) {
     pDevice->Init();
     pDevice->m_bus = this;
     *(uint32_t *)(&pDevice->m_addr) = deviceId;
+    UpdateMappings(pDevice);
 }
 
 void PCIBus::IOWriteConfigAddress(uint32_t pData) {
@@ -143,17 +190,9 @@ bool PCIBus::IORead(uint32_t port, uint32_t *value, uint8_t size) {
     case PORT_PCI_CONFIG_DATA + 3: // 0xCFF
         *value = IOReadConfigData(size, port - PORT_PCI_CONFIG_DATA);
         return true;
-    default:
-        for (auto it = m_Devices.begin(); it != m_Devices.end(); ++it) {
-            uint8_t barIndex;
-            uint32_t baseAddress;
-            if (it->second->GetIOBar(port, &barIndex, &baseAddress)) {
-                it->second->PCIIORead(barIndex, port - baseAddress, value, size);
-                return true;
-            }
-        }
     }
 
+    // I/O BARs are dispatched directly by the I/O mapper
     return false;
 }
 
@@ -176,44 +215,9 @@ bool PCIBus::IOWrite(uint32_t port, uint32_t value, uint8_t size) {
     case PORT_PCI_CONFIG_DATA + 3: // 0xCFF
         IOWriteConfigData(value, size, port - PORT_PCI_CONFIG_DATA);
         return true; // TODO : Should IOWriteConfigData() success/failure be returned?
-    default:
-        for (auto it = m_Devices.begin(); it != m_Devices.end(); ++it) {
-            uint8_t barIndex;
-            uint32_t baseAddress;
-            if (it->second->GetIOBar(port, &barIndex, &baseAddress)) {
-                it->second->PCIIOWrite(barIndex, port - baseAddress, value, size);
-                return true;
-            }
-        }
-    }
-
-    return false;
-}
-
-bool PCIBus::MMIORead(uint32_t addr, uint32_t *value, uint8_t size) {
-    for (auto it = m_Devices.begin(); it != m_Devices.end(); ++it) {
-        uint8_t barIndex;
-        uint32_t baseAddress;
-        if (it->second->GetMMIOBar(addr, &barIndex, &baseAddress)) {
-            it->second->PCIMMIORead(barIndex, addr - baseAddress, value, size);
-            return true;
-        }
-    }
-
-    return false;
-}
-
-bool PCIBus::MMIOWrite(uint32_t addr, uint32_t value, uint8_t size) {
-    for (auto it = m_Devices.begin(); it != m_Devices.end(); ++it) {
-        PCIDevice *dev = it->second;
-        uint8_t barIndex;
-        uint32_t baseAddress;
-        if (dev->GetMMIOBar(addr, &barIndex, &baseAddress)) {
-            dev->PCIMMIOWrite(barIndex, addr - baseAddress, value, size);
-            return true;
-        }
     }
 
+    // I/O BARs are dispatched directly by the I/O mapper
     return false;
 }
 
@@ -43,4 +43,23 @@ void NV2AEngine::WriteUnaligned(const uint32_t addr, const uint32_t value, const
     Write(addr & ~3, value);
 }
 
+// ----- Unmapped region sentinel ---------------------------------------------
+
+uint32_t UnmappedEngine::Read(const uint32_t addr) {
+    return ReadUnaligned(addr, 4);
+}
+
+void UnmappedEngine::Write(const uint32_t addr, const uint32_t value) {
+    WriteUnaligned(addr, value, 4);
+}
+
+uint32_t UnmappedEngine::ReadUnaligned(const uint32_t addr, const uint8_t size) {
+    log_spew("NV2A::Read:   Unmapped read!   address = 0x%x,  size = %u\n", addr, size);
+    return 0;
+}
+
+void UnmappedEngine::WriteUnaligned(const uint32_t addr, const uint32_t value, const uint8_t size) {
+    log_spew("NV2A::Write:  Unmapped write!  address = 0x%x,  value = 0x%x,  size = %u\n", addr, value, size);
+}
+
 }
@@ -18,7 +18,15 @@ void PCRTC::SetEnabled(bool enabled) {
     if (m_enabled != enabled) {
         m_enabled = enabled;
         if (enabled) {
-            // TODO: start
+            auto scheduler = m_nv2a.scheduler;
+            if (scheduler != nullptr) {
+                if (m_vblankEvent == Scheduler::kInvalidEvent) {
+                    m_vblankEvent = scheduler->RegisterEvent([this]() { OnVerticalBlank(); });
+                }
+                UpdateFrameTiming();
+                m_frameStart = scheduler->Now();
+                ScheduleVerticalBlank(m_frameStart + m_framePeriod);
+            }
         }
         else {
             Reset();
@@ -30,12 +38,27 @@ void PCRTC::Reset() {
     m_enabled = false;
     m_interruptLevels = 0;
     m_enabledInterrupts = 0;
+    m_start = 0;
+    if (m_vblankEvent != Scheduler::kInvalidEvent) {
+        m_nv2a.scheduler->Cancel(m_vblankEvent);
+    }
 }
 
 uint32_t PCRTC::Read(const uint32_t addr) {
     switch (addr) {
-    case Reg_PCRTC_INTR: return m_interruptLevels;
+    case Reg_PCRTC_INTR:
+    {
+        // Reading the status with no vertical blank pending means the guest
+        // is polling for one
+        uint32_t levels = m_interruptLevels;
+        if (!(levels & Val_PCRTC_INTR_VBLANK) && m_nv2a.scheduler != nullptr) {
+            m_nv2a.scheduler->NotifyGuestWaiting();
+        }
+        return levels;
+    }
     case Reg_PCRTC_INTR_ENABLE: return m_enabledInterrupts;
+    case Reg_PCRTC_START: return m_start;
+    case Reg_PCRTC_RASTER: return ReadRaster();
     default:
         log_spew("[NV2A] PCRTC::Read:   Unimplemented read!   address = 0x%x\n", addr);
         return 0;
@@ -46,17 +69,118 @@ void PCRTC::Write(const uint32_t addr, const uint32_t value) {
     switch (addr) {
     case Reg_PCRTC_INTR:
         // Clear specified interrupts
-        m_interruptLevels &= ~value;
+        m_interruptLevels.fetch_and(~value);
         m_nv2a.UpdateIRQ();
         break;
     case Reg_PCRTC_INTR_ENABLE:
         m_enabledInterrupts = value;
         m_nv2a.UpdateIRQ();
         break;
+    case Reg_PCRTC_START:
+        m_start = value & Mask_PCRTC_START;
+        break;
     default:
         log_spew("[NV2A] PCRTC::Write:  Unimplemented write!   address = 0x%x,  value = 0x%x\n", addr, value);
         break;
     }
 }
 
+void PCRTC::VerticalBlank() {
+    if (!m_enabled) {
+        return;
+    }
+
+    // The overlay switches buffers after the frame is displayed
+    m_nv2a.scanOut.Run();
+    m_nv2a.pvideo.VerticalBlank();
+
+    m_interruptLevels.fetch_or(Val_PCRTC_INTR_VBLANK);
+    m_nv2a.UpdateIRQ();
+}
+
+void PCRTC::UpdateFrameTiming() {
+    // The Xbox programs the flat panel timings for every output; the VGA
+    // CRTC timings are used before that
+    auto& pramdac = m_nv2a.pramdac;
+    auto& prmcio = m_nv2a.prmcio;
+    uint64_t totalPixels = 0;
+    uint32_t totalLines = 0;
+    uint32_t displayLines = 0;
+    if (pramdac.GetFPHorizontalTotal() != 0 && pramdac.GetFPVerticalTotal() != 0) {
+        totalPixels = pramdac.GetFPHorizontalTotal() + 1;
+        totalLines = pramdac.GetFPVerticalTotal() + 1;
+        displayLines = pramdac.GetFPVerticalDisplayEnd() + 1;
+    }
+    else if (prmcio.GetCRTCRegister(Reg_CR_HT) != 0 && prmcio.GetCRTCRegister(Reg_CR_VT) != 0) {
+        totalPixels = prmcio.GetHorizontalTotal();
+        totalLines = prmcio.GetVerticalTotal();
+        displayLines = prmcio.GetDisplayHeight();
+    }
+
+    // [https://envytools.readthedocs.io/en/latest/hw/display/nv3/pramdac.html]
+    // The VPLL generates the pixel clock
+    ClockCoefficients vpll = pramdac.GetVideoClockCoefficients();
+    if (totalPixels != 0 && vpll.M != 0 && vpll.N != 0) {
+        uint64_t pixelClock = vpll.CalcClock();
+        uint64_t period = totalPixels * totalLines * 1000000000ull / pixelClock;
+        if (period >= kMinFramePeriod && period <= kMaxFramePeriod) {
+            m_framePeriod = period;
+            m_totalLines = totalLines;
+            m_displayLines = std::min(displayLines, totalLines);
+            return;
+        }
+    }
+    m_framePeriod = kDefaultFramePeriod;
+    m_totalLines = kDefaultTotalLines;
+    m_displayLines = kDefaultDisplayLines;
+}
+
+void PCRTC::ScheduleVerticalBlank(uint64_t time) {
+    m_nextVerticalBlank = time;
+    m_nv2a.scheduler->Schedule(m_vblankEvent, time);
+}
+
+void PCRTC::OnVerticalBlank() {
+    if (!m_enabled) {
+        return;
+    }
+
+    uint64_t start = m_nextVerticalBlank;
+    m_frameStart = start;
+    VerticalBlank();
+
+    // The mode may have changed during the frame. If the host fell behind by
+    // more than a frame, drop the missed frames instead of catching up.
+    UpdateFrameTiming();
+    uint64_t next = start + m_framePeriod;
+    uint64_t now = m_nv2a.scheduler->Now();
+    if (next < now) {
+        next = now;
+    }
+    ScheduleVerticalBlank(next);
+}
+
+uint32_t PCRTC::ReadRaster() {
+    auto scheduler = m_nv2a.scheduler;
+    if (!m_enabled || scheduler == nullptr) {
+        return 0;
+    }
+    scheduler->NotifyGuestWaiting();
+
+    // Frames start with the vertical blank, which follows the last displayed line
+    uint64_t now = scheduler->Now();
+    uint64_t frameStart = m_frameStart;
+    uint64_t elapsed = (now > frameStart) ? now - frameStart : 0;
+    uint64_t period = m_framePeriod;
+    uint32_t totalLines = m_totalLines;
+    uint32_t displayLines = m_displayLines;
+    uint32_t line = static_cast<uint32_t>((displayLines + std::min(elapsed, period - 1) * totalLines / period) % totalLines);
+
+    uint32_t value = line & Mask_PCRTC_RASTER_POSITION;
+    if (line >= displayLines) {
+        value |= Val_PCRTC_RASTER_VBLANK;
+    }
+    return value;
+}
+
 }
@@ -61,9 +61,10 @@ void PFIFO::SetEnabled(bool enabled) {
 }
 
 void PFIFO::Reset() {
+    // Stop the threads; they check the enabled flag whenever they wake up
     m_enabled = false;
-    
-    // TODO: send signal to stop threads
+    WakePusher();
+    WakePuller();
 
     if (m_pullerThread.joinable()) m_pullerThread.join();
     if (m_pusherThread.joinable()) m_pusherThread.join();
@@ -77,6 +78,7 @@ void PFIFO::Reset() {
     m_caches = 0;
     m_ramhtParams.u32 = 0;
     m_ramfcParams.u32 = 0;
+    UpdateRAMHTRegion();
 
     m_channelModes = 0;
     m_channelDMA = 0;
@@ -86,8 +88,6 @@ void PFIFO::Reset() {
 
     m_cache0_push0.u32 = 0;
 
-    m_cache1_getAddress = 0;
-    m_cache1_putAddress = 0;
     m_cache1_dmaFetch.u32 = 0;
     m_cache1_dmaControl = 0;
     m_cache1_referenceCounter = 0;
@@ -97,8 +97,7 @@ void PFIFO::Reset() {
     m_cache1_acquireValue = 0;
     m_cache1_semaphore = 0;
     m_cache1_status.u32 = 0;
-    m_cache1_status.lowMark = 1;
-    std::fill(std::begin(m_cache1_commands), std::end(m_cache1_commands), FIFOCommand{ 0 });
+    m_cache1.Reset();
 
     m_dmaPusher.push0.u32 = 0;
     m_dmaPusher.push1.u32 = 0;
@@ -141,7 +140,7 @@ uint32_t PFIFO::Read(const uint32_t addr) {
     case Reg_PFIFO_CACHE0_PULL0: return m_cache0_pull0.u32;
     case Reg_PFIFO_CACHE0_HASH: return m_cache0_hash;
 
-    case Reg_PFIFO_CACHE1_PUT: return m_cache1_putAddress;
+    case Reg_PFIFO_CACHE1_PUT: return m_cache1.GetPutAddress();
     case Reg_PFIFO_CACHE1_DMA_FETCH: return m_cache1_dmaFetch.u32;
     case Reg_PFIFO_CACHE1_DMA_CTL: return m_cache1_dmaControl;
     case Reg_PFIFO_CACHE1_REF: return m_cache1_referenceCounter;
@@ -150,8 +149,13 @@ uint32_t PFIFO::Read(const uint32_t addr) {
     case Reg_PFIFO_CACHE1_ACQUIRE_TIMESTAMP: return m_cache1_acquireTimestamp;
     case Reg_PFIFO_CACHE1_ACQUIRE_VALUE: return m_cache1_acquireValue;
     case Reg_PFIFO_CACHE1_SEMAPHORE: return m_cache1_semaphore;
-    case Reg_PFIFO_CACHE1_GET: return m_cache1_getAddress;
-    case Reg_PFIFO_CACHE1_STATUS: return m_cache1_status.u32;
+    case Reg_PFIFO_CACHE1_GET: return m_cache1.GetGetAddress();
+    case Reg_PFIFO_CACHE1_STATUS: {
+        PFIFOCacheStatus status = m_cache1_status;
+        status.lowMark = m_cache1.IsEmpty();
+        status.highMark = m_cache1.IsFull();
+        return status.u32;
+    }
 
     case Reg_PFIFO_CACHE1_PUSH0: return m_dmaPusher.push0.u32;
     case Reg_PFIFO_CACHE1_PUSH1: return m_dmaPusher.push1.u32;
@@ -174,7 +178,7 @@ uint32_t PFIFO::Read(const uint32_t addr) {
         if (addr >= Reg_PFIFO_CACHE1_COMMAND_BASE && addr < Reg_PFIFO_CACHE1_COMMAND_BASE + kPFIFO_CommandBufferSize * sizeof(FIFOCommand)) {
             size_t cmdIndex = (addr - Reg_PFIFO_CACHE1_COMMAND_BASE) / sizeof(FIFOCommand);
             size_t offset = ((addr - Reg_PFIFO_CACHE1_COMMAND_BASE) >> 2) & 1;
-            return m_cache1_commands[cmdIndex].u32[offset];
+            return m_cache1[cmdIndex].u32[offset];
         }
         log_spew("[NV2A] PFIFO::Read:   Unimplemented read!   address = 0x%x\n", addr);
         return 0;
@@ -200,6 +204,7 @@ void PFIFO::Write(const uint32_t addr, const uint32_t value) {
     case Reg_PFIFO_RAMHT:
         m_ramhtParams.u32 = value;
         printRAMHTParameters(m_ramhtParams);
+        UpdateRAMHTRegion();
         break;
     case Reg_PFIFO_RAMFC:
         m_ramfcParams.u32 = value;
@@ -216,7 +221,7 @@ void PFIFO::Write(const uint32_t addr, const uint32_t value) {
     case Reg_PFIFO_CACHE0_PULL0: m_cache0_pull0.u32 = value; break;
     case Reg_PFIFO_CACHE0_HASH: m_cache0_hash = value; break;
 
-    case Reg_PFIFO_CACHE1_PUT: m_cache1_putAddress = value; break;
+    case Reg_PFIFO_CACHE1_PUT: m_cache1.SetPutAddress(value); break;
     case Reg_PFIFO_CACHE1_DMA_FETCH: m_cache1_dmaFetch.u32 = value; break;
     case Reg_PFIFO_CACHE1_DMA_CTL: m_cache1_dmaControl = value; break;
     case Reg_PFIFO_CACHE1_REF: m_cache1_referenceCounter = value; break;
@@ -225,8 +230,11 @@ void PFIFO::Write(const uint32_t addr, const uint32_t value) {
     case Reg_PFIFO_CACHE1_ACQUIRE_TIMESTAMP: m_cache1_acquireTimestamp = value; break;
     case Reg_PFIFO_CACHE1_ACQUIRE_VALUE: m_cache1_acquireValue = value; break;
     case Reg_PFIFO_CACHE1_SEMAPHORE: m_cache1_semaphore = value; break;
-    case Reg_PFIFO_CACHE1_GET: m_cache1_getAddress = value; break;
-    case Reg_PFIFO_CACHE1_STATUS: m_cache1_status.u32 = value; break;
+    case Reg_PFIFO_CACHE1_GET: m_cache1.SetGetAddress(value); break;
+    case Reg_PFIFO_CACHE1_STATUS:
+        m_cache1_status.u32 = value;
+        m_cache1.SetMarks(m_cache1_status.lowMark, m_cache1_status.highMark);
+        break;
     
     case Reg_PFIFO_CACHE1_PUSH0: m_dmaPusher.push0.u32 = value; break;
     case Reg_PFIFO_CACHE1_PUSH1: m_dmaPusher.push1.u32 = value; break;
@@ -249,13 +257,18 @@ void PFIFO::Write(const uint32_t addr, const uint32_t value) {
         if (addr >= Reg_PFIFO_CACHE1_COMMAND_BASE && addr < Reg_PFIFO_CACHE1_COMMAND_BASE + kPFIFO_CommandBufferSize * sizeof(FIFOCommand)) {
             size_t cmdIndex = (addr - Reg_PFIFO_CACHE1_COMMAND_BASE) / sizeof(FIFOCommand);
             size_t offset = ((addr - Reg_PFIFO_CACHE1_COMMAND_BASE) >> 2) & 1;
-            m_cache1_commands[cmdIndex].u32[offset] = value;
+            m_cache1[cmdIndex].u32[offset] = value;
         }
         else {
             log_spew("[NV2A] PFIFO::Write:  Unimplemented write!   address = 0x%x,  value = 0x%x\n", addr, value);
         }
         break;
     }
+
+    // Any register write may unblock the pusher or the puller, including
+    // writes to DMA_PUT forwarded from the USER channel control area
+    WakePusher();
+    WakePuller();
 }
 
 RAMHT::Entry* PFIFO::GetRAMHTEntry(uint32_t handle, uint32_t channelID) {
@@ -264,6 +277,23 @@ RAMHT::Entry* PFIFO::GetRAMHTEntry(uint32_t handle, uint32_t channelID) {
     return reinterpret_cast<RAMHT::Entry*>(m_nv2a.pramin.GetMemoryPointer(address));
 }
 
+const RAMHT::Entry& PFIFO::LookupRAMHTEntry(uint32_t handle, uint32_t channelID) {
+    // The generation must be read before the hash table so that a concurrent
+    // write invalidates the entry we're about to cache
+    uint32_t generation = m_nv2a.pramin.GetRAMHTGeneration();
+    const RAMHT::Entry* entry = m_ramhtCache.Find(handle, channelID, generation);
+    if (entry != nullptr) {
+        return *entry;
+    }
+    return m_ramhtCache.Insert(handle, channelID, generation, *GetRAMHTEntry(handle, channelID));
+}
+
+void PFIFO::UpdateRAMHTRegion() {
+    // RAMHT::Hash produces indices of (size + 12) bits into 8-byte entries
+    uint32_t size = sizeof(RAMHT::Entry) << (static_cast<uint32_t>(m_ramhtParams.size) + 12);
+    m_nv2a.pramin.SetRAMHTRegion(m_ramhtParams.baseAddress << 12, size);
+}
+
 void PFIFO::ThrowDMAPusherError(PFIFOPusherDMAState::ErrorCode errorCode) {
     m_dmaPusher.dmaState.error = errorCode;
     m_interruptLevels |= Val_PFIFO_INTR_DMA_PUSHER;
@@ -275,225 +305,329 @@ void PFIFO::ThrowCacheError() {
     m_nv2a.UpdateIRQ();
 }
 
+void PFIFO::WakePusher() {
+    // Acquiring the mutex guarantees that the thread either sees the new state
+    // when it evaluates its wait condition or is already waiting for the
+    // notification
+    { std::lock_guard<std::mutex> lk(m_threadMutex); }
+    m_pusherCond.notify_one();
+}
+
+void PFIFO::WakePuller() {
+    { std::lock_guard<std::mutex> lk(m_threadMutex); }
+    m_pullerCond.notify_one();
+}
+
 void PFIFO::PusherThread() {
     Thread_SetName("[HW] NV2A FIFO pusher");
 
-    // [https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#the-pusher-pseudocode-pre-gf100]
-    
-    // TODO: this is very inefficient; introduce some condvars
     while (m_enabled) {
-        // DMA pusher must be enabled and not suspended
-        if (m_dmaPusher.push0.access == PFIFOCachePush0Parameters::Access::Disabled) continue;
-        if (m_dmaPusher.dmaPush.access == PFIFOCacheDMAPush::Access::Disabled) continue;
-        if (m_dmaPusher.dmaPush.status == PFIFOCacheDMAPush::Status::Suspended) continue;
-        
-        // Channel must be in DMA mode
-        uint32_t channelID = m_dmaPusher.push1.channelID;
-        if ((m_channelModes & (1 << channelID)) == 0) continue;
-        if (m_dmaPusher.push1.mode != ChannelMode::DMA) continue;
-
-        // Bail out if we have an error
-        if (m_dmaPusher.dmaState.error != PFIFOPusherDMAState::ErrorCode::None) continue;
-
-        DMAObject* dmaObj = m_nv2a.GetDMAObject(static_cast<uint32_t>(m_dmaPusher.dmaInstanceAddress) << 4);
-        uint8_t* dmaData = &m_nv2a.systemRAM[dmaObj->GetAddress()];
-
-        uint32_t dmaLen = dmaObj->limit;
-
-        uint32_t dmaGet = m_dmaPusher.dmaGetAddress;
-        if (dmaGet != m_dmaPusher.dmaPutAddress) {
-            // Pushbuffer non-empty, read a word
-            if (dmaGet >= dmaLen) {
-                ThrowDMAPusherError(PFIFOPusherDMAState::ErrorCode::Protection);
-                continue;
+        // Process the pushbuffer for as long as possible, then sleep until
+        // something changes
+        while (m_enabled && CanRunPusher()) {
+            RunPusher();
+        }
+
+        std::unique_lock<std::mutex> lk(m_threadMutex);
+        m_pusherCond.wait(lk, [this]() { return !m_enabled || CanRunPusher(); });
+    }
+}
+
+bool PFIFO::CanRunPusher() {
+    // DMA pusher must be enabled and not suspended
+    if (m_dmaPusher.push0.access == PFIFOCachePush0Parameters::Access::Disabled) return false;
+    if (m_dmaPusher.dmaPush.access == PFIFOCacheDMAPush::Access::Disabled) return false;
+    if (m_dmaPusher.dmaPush.status == PFIFOCacheDMAPush::Status::Suspended) return false;
+
+    // Channel must be in DMA mode
+    uint32_t channelID = m_dmaPusher.push1.channelID;
+    if ((m_channelModes & (1 << channelID)) == 0) return false;
+    if (m_dmaPusher.push1.mode != ChannelMode::DMA) return false;
+
+    // Bail out if we have an error
+    if (m_dmaPusher.dmaState.error != PFIFOPusherDMAState::ErrorCode::None) return false;
+
+    // Pushbuffer must be non-empty
+    if (m_dmaPusher.dmaGetAddress == m_dmaPusher.dmaPutAddress) return false;
+
+    // Do not proceed with method data if cache is full
+    if (m_dmaPusher.dmaState.methodCount && m_cache1.IsFull()) return false;
+
+    return true;
+}
+
+void PFIFO::RunPusher() {
+    // [https://envytools.readthedocs.io/en/latest/hw/fifo/dma-pusher.html#the-pusher-pseudocode-pre-gf100]
+
+    // Resolve the pushbuffer once and decode the whole GET..PUT window.
+    // Method data is forwarded to the cache in runs rather than word by word.
+    DMAObject* dmaObj = m_nv2a.GetDMAObject(static_cast<uint32_t>(m_dmaPusher.dmaInstanceAddress) << 4);
+    const uint8_t* dmaData = &m_nv2a.systemRAM[dmaObj->GetAddress()];
+    const uint32_t dmaLen = dmaObj->limit;
+    const uint32_t dmaPut = m_dmaPusher.dmaPutAddress;
+
+    uint32_t dmaGet = m_dmaPusher.dmaGetAddress;
+    while (dmaGet != dmaPut && m_enabled) {
+        if (dmaGet >= dmaLen) {
+            ThrowDMAPusherError(PFIFOPusherDMAState::ErrorCode::Protection);
+            break;
+        }
+
+        // See if we're in the middle of a command
+        if (m_dmaPusher.dmaState.methodCount) {
+            // Data words of methods command; take as many as are contiguous in
+            // the pushbuffer
+            uint32_t dmaEnd = (dmaPut > dmaGet) ? std::min(dmaPut, dmaLen) : dmaLen;
+
+            PFIFOMethodRun run;
+            run.subchannel = m_dmaPusher.dmaState.subchannel;
+            run.method = m_dmaPusher.dmaState.method;
+            run.type = m_dmaPusher.dmaState.methodType;
+            run.count = std::min<uint32_t>(m_dmaPusher.dmaState.methodCount, (dmaEnd - dmaGet + 3) / 4);
+            run.data = reinterpret_cast<const uint32_t*>(&dmaData[dmaGet]);
+
+            uint32_t count = PushMethodRun(run);
+            if (count == 0) {
+                // Cache is full; resume when the puller catches up
+                break;
             }
-            uint32_t word = *reinterpret_cast<uint32_t*>(&dmaData[dmaGet]);
-            dmaGet += 4;
 
-            // Now, see if we're in the middle of a command
-            if (m_dmaPusher.dmaState.methodCount) {
-                // Do not proceed if cache is full
-                if (m_cache1_status.highMark) continue;
-
-                // Data word of methods command
-                m_dmaPusher.lastData = word;
-
-                // Write next command
-                size_t putIndex = m_cache1_putAddress >> 2;
-                m_cache1_commands[putIndex] = { 0 };
-                m_cache1_commands[putIndex].address = m_dmaPusher.dmaState.method >> 2;
-                m_cache1_commands[putIndex].type = m_dmaPusher.dmaState.methodType;
-                m_cache1_commands[putIndex].subchannel = m_dmaPusher.dmaState.subchannel;
-                m_cache1_commands[putIndex].data = word;
-                m_cache1_putAddress = (m_cache1_putAddress + 4) & 0x1fc;
-                
-                if (m_dmaPusher.dmaState.methodType == MethodType::Increasing) {
-                    m_dmaPusher.dmaState.method++;
-                }
-                m_dmaPusher.dmaState.methodCount--;
-                m_dmaPusher.dcount++;
-
-                // Update full/empty cache flags
-                if (m_cache1_putAddress == m_cache1_getAddress) {
-                    m_cache1_status.lowMark = 1;
-                }
-                m_cache1_status.highMark = 0;
+            if (run.type == MethodType::Increasing) {
+                m_dmaPusher.dmaState.method += count;
             }
-            else {
-                // No command active - this is the first word of a new one
-                m_dmaPusher.lastCommand = word;
-                
-                // Match all forms
-                if ((word & 0xe0000003) == 0x20000000) {
-                    // Old jump
-                    m_dmaPusher.lastJMPAddress = dmaGet;
-                    dmaGet = word & 0x1fffffff;
-                }
-                else if ((word & 3) == 1) {
-                    // Jump
-                    m_dmaPusher.lastJMPAddress = dmaGet;
-                    dmaGet = word & 0xfffffffc;
-                }
-                else if ((word & 3) == 2) {
-                    // Call
-                    if (m_dmaPusher.dmaSubroutine.state == PFIFODMASubroutine::State::Active) {
-                        ThrowDMAPusherError(PFIFOPusherDMAState::ErrorCode::Call);
-                        continue;
-                    }
-                    m_dmaPusher.dmaSubroutine.returnOffset = dmaGet;
-                    m_dmaPusher.dmaSubroutine.state = PFIFODMASubroutine::State::Active;
-                    dmaGet = word & 0xfffffffc;
-                }
-                else if (word == 0x00020000) {
-                    // Return
-                    if (m_dmaPusher.dmaSubroutine.state == PFIFODMASubroutine::State::Inactive) {
-                        ThrowDMAPusherError(PFIFOPusherDMAState::ErrorCode::Return);
-                        continue;
-                    }
-                    dmaGet = m_dmaPusher.dmaSubroutine.returnOffset;
-                    m_dmaPusher.dmaSubroutine.state = PFIFODMASubroutine::State::Inactive;
-                }
-                else if ((word & 0xe0030003) == 0) {
-                    // Increasing methods
-                    m_dmaPusher.dmaState.method = (word >> 2) & 0x7ff;
-                    m_dmaPusher.dmaState.subchannel = (word >> 13) & 7;
-                    m_dmaPusher.dmaState.methodCount = (word >> 18) & 0x7ff;
-                    m_dmaPusher.dmaState.methodType = MethodType::Increasing;
-                    m_dmaPusher.dcount = 0;
-                }
-                else if ((word & 0xe0030003) == 0x40000000) {
-                    // Non-increasing methods
-                    m_dmaPusher.dmaState.method = (word >> 2) & 0x7ff;
-                    m_dmaPusher.dmaState.subchannel = (word >> 13) & 7;
-                    m_dmaPusher.dmaState.methodCount = (word >> 18) & 0x7ff;
-                    m_dmaPusher.dmaState.methodType = MethodType::NonIncreasing;
-                    m_dmaPusher.dcount = 0;
-                }
-                else {
-                    ThrowDMAPusherError(PFIFOPusherDMAState::ErrorCode::ReservedCommand);
-                    continue;
-                }
+            m_dmaPusher.dmaState.methodCount -= count;
+            m_dmaPusher.dcount += count;
+            m_dmaPusher.lastData = run.data[count - 1];
+            dmaGet += count * 4;
+            continue;
+        }
+
+        // No command active - this is the first word of a new one
+        uint32_t word = *reinterpret_cast<const uint32_t*>(&dmaData[dmaGet]);
+        m_dmaPusher.lastCommand = word;
+
+        // Match all forms
+        if ((word & 0xe0000003) == 0x20000000) {
+            // Old jump
+            m_dmaPusher.lastJMPAddress = dmaGet + 4;
+            dmaGet = word & 0x1fffffff;
+        }
+        else if ((word & 3) == 1) {
+            // Jump
+            m_dmaPusher.lastJMPAddress = dmaGet + 4;
+            dmaGet = word & 0xfffffffc;
+        }
+        else if ((word & 3) == 2) {
+            // Call
+            if (m_dmaPusher.dmaSubroutine.state == PFIFODMASubroutine::State::Active) {
+                ThrowDMAPusherError(PFIFOPusherDMAState::ErrorCode::Call);
+                break;
             }
-            m_dmaPusher.dmaGetAddress = dmaGet;
+            m_dmaPusher.dmaSubroutine.returnOffset = dmaGet + 4;
+            m_dmaPusher.dmaSubroutine.state = PFIFODMASubroutine::State::Active;
+            dmaGet = word & 0xfffffffc;
+        }
+        else if (word == 0x00020000) {
+            // Return
+            if (m_dmaPusher.dmaSubroutine.state == PFIFODMASubroutine::State::Inactive) {
+                ThrowDMAPusherError(PFIFOPusherDMAState::ErrorCode::Return);
+                break;
+            }
+            dmaGet = m_dmaPusher.dmaSubroutine.returnOffset;
+            m_dmaPusher.dmaSubroutine.state = PFIFODMASubroutine::State::Inactive;
+        }
+        else if ((word & 0xe0030003) == 0) {
+            // Increasing methods
+            m_dmaPusher.dmaState.method = (word >> 2) & 0x7ff;
+            m_dmaPusher.dmaState.subchannel = (word >> 13) & 7;
+            m_dmaPusher.dmaState.methodCount = (word >> 18) & 0x7ff;
+            m_dmaPusher.dmaState.methodType = MethodType::Increasing;
+            m_dmaPusher.dcount = 0;
+            dmaGet += 4;
+        }
+        else if ((word & 0xe0030003) == 0x40000000) {
+            // Non-increasing methods
+            m_dmaPusher.dmaState.method = (word >> 2) & 0x7ff;
+            m_dmaPusher.dmaState.subchannel = (word >> 13) & 7;
+            m_dmaPusher.dmaState.methodCount = (word >> 18) & 0x7ff;
+            m_dmaPusher.dmaState.methodType = MethodType::NonIncreasing;
+            m_dmaPusher.dcount = 0;
+            dmaGet += 4;
+        }
+        else {
+            ThrowDMAPusherError(PFIFOPusherDMAState::ErrorCode::ReservedCommand);
+            break;
         }
     }
+    m_dmaPusher.dmaGetAddress = dmaGet;
+}
+
+uint32_t PFIFO::PushMethodRun(const PFIFOMethodRun& run) {
+    uint32_t count = std::min(run.count, m_cache1.FreeSpace());
+    uint32_t method = run.method;
+    for (uint32_t i = 0; i < count; i++) {
+        FIFOCommand& cmd = m_cache1.PutSlot(i);
+        cmd = { 0 };
+        cmd.address = method;
+        cmd.type = run.type;
+        cmd.subchannel = run.subchannel;
+        cmd.data = run.data[i];
+        if (run.type == MethodType::Increasing) {
+            method++;
+        }
+    }
+    if (count > 0) {
+        m_cache1.Publish(count);
+        WakePuller();
+    }
+    return count;
 }
 
 void PFIFO::PullerThread() {
     Thread_SetName("[HW] NV2A FIFO puller");
 
-    // [https://envytools.readthedocs.io/en/latest/hw/fifo/puller.html]
-    
-    // TODO: this is very inefficient; introduce some condvars
     while (m_enabled) {
-        // Puller must be enabled
-        if (m_puller.pull0.access == PFIFOCachePull0Parameters::Access::Disabled) continue;
+        // Drain the cache, then sleep until the pusher adds more commands
+        while (m_enabled && CanRunPuller()) {
+            RunPuller();
+        }
 
-        // Can't do anything with an empty cache
-        if (m_cache1_status.lowMark) continue;
+        std::unique_lock<std::mutex> lk(m_threadMutex);
+        m_pullerCond.wait(lk, [this]() { return !m_enabled || CanRunPuller(); });
+    }
+}
 
-        // Read next command
-        size_t getIndex = m_cache1_getAddress >> 2;
-        FIFOCommand& cmd = m_cache1_commands[getIndex];
-        m_cache1_getAddress = (m_cache1_getAddress + 4) & 0x1fc;
+bool PFIFO::CanRunPuller() {
+    // Puller must be enabled
+    if (m_puller.pull0.access == PFIFOCachePull0Parameters::Access::Disabled) return false;
 
-        // Update full/empty cache flags
-        if (m_cache1_getAddress == m_cache1_putAddress) {
-            m_cache1_status.lowMark = 1;
-        }
-        m_cache1_status.highMark = 0;
+    // Can't do anything with an empty cache
+    if (m_cache1.IsEmpty()) return false;
 
-        // Process commands
-        // [https://envytools.readthedocs.io/en/latest/hw/fifo/puller.html#engine-objects]
-        // Methods < 0x100 are processed by the puller itself.
-        // Methods >= 0x100 are forwarded to the corresponding engine. 
+    return true;
+}
 
-        // TODO: implement engines
+void PFIFO::RunPuller() {
+    // Process all commands in the cache, then hand the slots back to the
+    // pusher at once
+    uint32_t count = m_cache1.Available();
+    uint32_t i = 0;
+    while (i < count) {
+        const FIFOCommand& cmd = m_cache1.GetSlot(i);
+        if (cmd.address < 0x100 / 4) {
+            PullCommand(cmd);
+            i++;
+        }
+        else {
+            i += PullMethodRun(i, count);
+        }
+    }
+    m_cache1.Release(count);
+    WakePusher();
+}
 
-        uint32_t channelID = m_dmaPusher.push1.channelID;
+void PFIFO::PullCommand(const FIFOCommand& cmd) {
+    // [https://envytools.readthedocs.io/en/latest/hw/fifo/puller.html]
 
-        log_spew("[NV2A] [PFIFO puller] Processing command\n"
-            "    address = %u\n"
-            "    subchannel = %u\n"
-            "    data = %u\n"
-            "    type = %s\n", cmd.address, cmd.subchannel, cmd.data, cmd.type == MethodType::Increasing ? "increasing" : "non-increasing");
+    // Process commands
+    // [https://envytools.readthedocs.io/en/latest/hw/fifo/puller.html#engine-objects]
+    // Methods < 0x100 are processed by the puller itself.
+    // Methods >= 0x100 are forwarded to the corresponding engine by PullMethodRun.
 
-        auto ramhtEntry = GetRAMHTEntry(cmd.data, channelID);
-        auto engine = ramhtEntry->engine;
+    uint32_t channelID = m_dmaPusher.push1.channelID;
 
-        if (cmd.address == 0) {
-            uint16_t eparam = ramhtEntry->instance;
-            
-            if (engine != m_puller.lastEngine) {
-                // TODO: if switching engines, we should wait until the current engine is idle
-                //while (ENGINE_CUR_CHANNEL(last_engine) == chan && !ENGINE_IDLE(last_engine));
-            }
+    log_spew("[NV2A] [PFIFO puller] Processing command\n"
+        "    address = %u\n"
+        "    subchannel = %u\n"
+        "    data = %u\n"
+        "    type = %s\n", cmd.address, cmd.subchannel, cmd.data, cmd.type == MethodType::Increasing ? "increasing" : "non-increasing");
 
-            if (engine == FIFOEngine::Software) {
-                ThrowCacheError();
-                continue;
-            }
+    if (cmd.address == 0) {
+        // Bind object to subchannel
+        const RAMHT::Entry& ramhtEntry = LookupRAMHTEntry(cmd.data, channelID);
+        FIFOEngine engine = ramhtEntry.engine;
+        uint16_t eparam = ramhtEntry.instance;
 
-            // TODO: tell engine to switch channel if necessary and submit method to it
-            //if (ENGINE_CUR_CHANNEL(engine) != chan)
-            //    ENGINE_CHANNEL_SWITCH(engine, chan);
-            //ENGINE_SUBMIT_MTHD(engine, subc, 0, eparam);
 
-            uint32_t shift = (cmd.subchannel << 2);
-            m_puller.engines &= ~(3 << shift);
-            m_puller.engines |= (static_cast<uint8_t>(engine) << shift);
-            m_puller.lastEngine = engine;
-            m_puller.pull1.engine = engine;
+        if (engine != m_puller.lastEngine) {
+            // TODO: if switching engines, we should wait until the current engine is idle
+            //while (ENGINE_CUR_CHANNEL(last_engine) == chan && !ENGINE_IDLE(last_engine));
         }
-        else if (cmd.address >= 0x100) {
-            uint32_t param;
-            if (cmd.address >= 0x180 / 4 && cmd.address < 0x200 / 4) {
-                auto ramhtEntry = GetRAMHTEntry(cmd.data, channelID);
-                param = ramhtEntry->instance;
-            }
-            else {
-                param = cmd.data;
-            }
 
-            if (engine != m_puller.lastEngine) {
-                // TODO: if switching engines, we should wait until the current engine is idle
-                //while (ENGINE_CUR_CHANNEL(last_engine) == chan && !ENGINE_IDLE(last_engine));
-            }
+        if (engine == FIFOEngine::Software) {
+            ThrowCacheError();
+            return;
+        }
 
-            if (engine == FIFOEngine::Software) {
-                ThrowCacheError();
-                continue;
-            }
+        // TODO: tell engine to switch channel if necessary
+        //if (ENGINE_CUR_CHANNEL(engine) != chan)
+        //    ENGINE_CHANNEL_SWITCH(engine, chan);
+        m_nv2a.pgraph.BindObject(cmd.subchannel, eparam);
 
-            // TODO: tell engine to switch channel if necessary and submit method to it
-            //if (ENGINE_CUR_CHANNEL(engine) != chan)
-            //    ENGINE_CHANNEL_SWITCH(engine, chan);
-            //ENGINE_SUBMIT_MTHD(engine, subc, mthd, eparam);
+        uint32_t shift = (cmd.subchannel << 2);
+        m_puller.engines &= ~(3 << shift);
+        m_puller.engines |= (static_cast<uint8_t>(engine) << shift);
+        m_puller.lastEngine = engine;
+        m_puller.pull1.engine = engine;
+    }
+}
 
-            uint32_t shift = (cmd.subchannel << 2);
-            m_puller.lastEngine = static_cast<FIFOEngine>((m_puller.engines >> shift) & 3);
+uint32_t PFIFO::PullMethodRun(uint32_t first, uint32_t end) {
+    // Gather a run of methods for the same subchannel that are either
+    // consecutive (increasing) or repeated (non-increasing), and submit it to
+    // the engine all at once
+    const FIFOCommand& head = m_cache1.GetSlot(first);
+    uint32_t channelID = m_dmaPusher.push1.channelID;
+    uint32_t subchannel = head.subchannel;
+    uint32_t method = head.address;
+    MethodType type = head.type;
+    bool increasing = (type == MethodType::Increasing);
+
+    uint32_t data[kPFIFO_CommandBufferSize];
+    uint32_t count = 0;
+    for (uint32_t i = first; i < end; i++) {
+        const FIFOCommand& cmd = m_cache1.GetSlot(i);
+        uint32_t expectedAddress = increasing ? method + count : method;
+        if (cmd.subchannel != subchannel || cmd.type != type || cmd.address != expectedAddress) {
+            break;
+        }
+        if (cmd.address >= 0x180 / 4 && cmd.address < 0x200 / 4) {
+            // Object handle parameter
+            data[count] = LookupRAMHTEntry(cmd.data, channelID).instance;
         }
+        else {
+            data[count] = cmd.data;
+        }
+        count++;
+    }
+
+    log_spew("[NV2A] [PFIFO puller] Processing method run\n"
+        "    method = 0x%x\n"
+        "    subchannel = %u\n"
+        "    count = %u\n"
+        "    type = %s\n", method << 2, subchannel, count, increasing ? "increasing" : "non-increasing");
+
+    // Methods go to the engine of the object bound to the subchannel
+    uint32_t shift = (subchannel << 2);
+    FIFOEngine engine = static_cast<FIFOEngine>((m_puller.engines >> shift) & 3);
+
+    if (engine != m_puller.lastEngine) {
+        // TODO: if switching engines, we should wait until the current engine is idle
+        //while (ENGINE_CUR_CHANNEL(last_engine) == chan && !ENGINE_IDLE(last_engine));
+    }
+
+    if (engine == FIFOEngine::Software) {
+        ThrowCacheError();
+        return count;
     }
+
+    // TODO: tell engine to switch channel if necessary
+    //if (ENGINE_CUR_CHANNEL(engine) != chan)
+    //    ENGINE_CHANNEL_SWITCH(engine, chan);
+    m_nv2a.pgraph.SubmitMethods(subchannel, method, data, count, increasing);
+
+    m_puller.lastEngine = engine;
+    return count;
 }
 
 }
@@ -47,6 +47,13 @@ void PGRAPH::Reset() {
 
     std::fill(std::begin(m_tiles), std::end(m_tiles), PGRAPHTile{ 0 });
     std::fill(std::begin(m_zcomp), std::end(m_zcomp), 0);
+
+    m_dispatcher.Reset();
+}
+
+void PGRAPH::RaiseInterrupt(uint32_t interrupts) {
+    m_interruptLevels |= interrupts;
+    m_nv2a.UpdateIRQ();
 }
 
 uint32_t PGRAPH::Read(const uint32_t addr) {
@@ -8,6 +8,7 @@
 // References to particular items in the documentation are denoted between
 // brackets optionally followed by a quote from the documentation.
 #include "strikebox/hw/gpu/engines/pramdac.h"
+#include "strikebox/hw/gpu/state.h"
 
 #include "strikebox/log.h"
 
@@ -22,6 +23,11 @@ void PRAMDAC::Reset() {
     m_coreClockCoeff = ClockCoefficients{ 1, 28, 1 };
     m_memoryClockCoeff = ClockCoefficients{ 1, 24, 1 };
     m_videoClockCoeff = ClockCoefficients{ 3, 157, 13 };
+    m_nv2a.ptimer.CoreClockChanged();
+    m_generalControl = 0;
+    m_fpHTotal = 0;
+    m_fpVTotal = 0;
+    m_fpVDisplayEnd = 0;
 
     std::fill(std::begin(m_mem), std::end(m_mem), 0);
 }
@@ -31,6 +37,10 @@ uint32_t PRAMDAC::Read(const uint32_t addr) {
     case Reg_RAMDAC_NVPLL: return m_coreClockCoeff.u32;
     case Reg_RAMDAC_MPLL: return m_memoryClockCoeff.u32;
     case Reg_RAMDAC_VPLL: return m_videoClockCoeff.u32;
+    case Reg_RAMDAC_GENERAL_CONTROL: return m_generalControl;
+    case Reg_RAMDAC_FP_VDISPLAY_END: return m_fpVDisplayEnd;
+    case Reg_RAMDAC_FP_VTOTAL: return m_fpVTotal;
+    case Reg_RAMDAC_FP_HTOTAL: return m_fpHTotal;
     default:
         log_spew("[NV2A] PRAMDAC::Read:   Unimplemented read!   address = 0x%x\n", addr);
         return m_mem[addr >> 2];
@@ -39,9 +49,16 @@ uint32_t PRAMDAC::Read(const uint32_t addr) {
 
 void PRAMDAC::Write(const uint32_t addr, const uint32_t value) {
     switch (addr) {
-    case Reg_RAMDAC_NVPLL: m_coreClockCoeff.u32 = value; break;
+    case Reg_RAMDAC_NVPLL:
+        m_coreClockCoeff.u32 = value;
+        m_nv2a.ptimer.CoreClockChanged();
+        break;
     case Reg_RAMDAC_MPLL: m_memoryClockCoeff.u32 = value; break;
     case Reg_RAMDAC_VPLL: m_videoClockCoeff.u32 = value; break;
+    case Reg_RAMDAC_GENERAL_CONTROL: m_generalControl = value; break;
+    case Reg_RAMDAC_FP_VDISPLAY_END: m_fpVDisplayEnd = value & 0xfff; break;
+    case Reg_RAMDAC_FP_VTOTAL: m_fpVTotal = value & 0xfff; break;
+    case Reg_RAMDAC_FP_HTOTAL: m_fpHTotal = value & 0xfff; break;
     default:
         log_spew("[NV2A] PRAMDAC::Write:  Unimplemented write!   address = 0x%x,  value = 0x%x\n", addr, value);
         m_mem[addr >> 2] = value;
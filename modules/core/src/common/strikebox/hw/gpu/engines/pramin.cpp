@@ -15,6 +15,7 @@ namespace strikebox::nv2a {
 
 void PRAMIN::Reset() {
     std::fill(m_mem, m_mem + m_length, 0);
+    InvalidateRAMHT();
 }
 
 uint32_t PRAMIN::Read(const uint32_t addr) {
@@ -23,6 +24,15 @@ uint32_t PRAMIN::Read(const uint32_t addr) {
 
 void PRAMIN::Write(const uint32_t addr, const uint32_t value) {
     *reinterpret_cast<uint32_t*>(&m_mem[addr]) = value;
+    if (addr - m_ramhtAddress < m_ramhtLength) {
+        InvalidateRAMHT();
+    }
+}
+
+void PRAMIN::SetRAMHTRegion(uint32_t address, uint32_t length) {
+    m_ramhtAddress = address;
+    m_ramhtLength = length;
+    InvalidateRAMHT();
 }
 
 }
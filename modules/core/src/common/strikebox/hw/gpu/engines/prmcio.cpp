@@ -14,24 +14,112 @@
 namespace strikebox::nv2a {
 
 void PRMCIO::Reset() {
+    m_crIndex = 0;
+    for (auto& reg : m_cr) {
+        reg = 0;
+    }
 }
 
 uint32_t PRMCIO::Read(const uint32_t addr) {
-    log_spew("[NV2A] PRMCIO::Read:   Unimplemented read!   address = 0x%x\n", addr);
-    return 0;
+    return ReadUnaligned(addr, 4);
 }
 
 void PRMCIO::Write(const uint32_t addr, const uint32_t value) {
-    log_spew("[NV2A] PRMCIO::Write:  Unimplemented write!   address = 0x%x,  value = 0x%x\n", addr, value);
+    WriteUnaligned(addr, value, 4);
 }
 
+// The ports are byte-wide; wider accesses touch consecutive ports, so that a
+// 16-bit write to the index port selects a register and writes its value
+
 uint32_t PRMCIO::ReadUnaligned(const uint32_t addr, const uint8_t size) {
-    log_spew("[NV2A] PRMCIO::ReadUnaligned:   Unimplemented unaligned read!   address = 0x%x,  size = %u\n", addr, size);
-    return 0;
+    uint32_t value = 0;
+    bool handled = false;
+    for (uint8_t i = 0; i < size; i++) {
+        uint8_t byte;
+        if (ReadPort(addr + i, byte)) {
+            value |= byte << (i * 8);
+            handled = true;
+        }
+    }
+    if (!handled) {
+        log_spew("[NV2A] PRMCIO::ReadUnaligned:   Unimplemented unaligned read!   address = 0x%x,  size = %u\n", addr, size);
+    }
+    return value;
 }
 
 void PRMCIO::WriteUnaligned(const uint32_t addr, const uint32_t value, const uint8_t size) {
-    log_spew("[NV2A] PRMCIO::WriteUnaligned:  Unimplemented unaligned write!   address = 0x%x,  value = 0x%x,  size = %u\n", addr, value, size);
+    bool handled = false;
+    for (uint8_t i = 0; i < size; i++) {
+        handled |= WritePort(addr + i, static_cast<uint8_t>(value >> (i * 8)));
+    }
+    if (!handled) {
+        log_spew("[NV2A] PRMCIO::WriteUnaligned:  Unimplemented unaligned write!   address = 0x%x,  value = 0x%x,  size = %u\n", addr, value, size);
+    }
+}
+
+bool PRMCIO::ReadPort(const uint32_t addr, uint8_t& value) {
+    switch (addr) {
+    case Reg_PRMCIO_CRX_MONO:
+    case Reg_PRMCIO_CRX_COLOR:
+        value = m_crIndex;
+        return true;
+    case Reg_PRMCIO_CR_MONO:
+    case Reg_PRMCIO_CR_COLOR:
+        value = m_cr[m_crIndex];
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool PRMCIO::WritePort(const uint32_t addr, const uint8_t value) {
+    switch (addr) {
+    case Reg_PRMCIO_CRX_MONO:
+    case Reg_PRMCIO_CRX_COLOR:
+        m_crIndex = value;
+        return true;
+    case Reg_PRMCIO_CR_MONO:
+    case Reg_PRMCIO_CR_COLOR:
+        m_cr[m_crIndex] = value;
+        return true;
+    default:
+        return false;
+    }
+}
+
+uint32_t PRMCIO::GetDisplayWidth() const {
+    uint32_t hde = GetCRTCRegister(Reg_CR_HDE) | ((GetCRTCRegister(Reg_CR_HEB) & 0x02) << 7);
+    return (hde + 1) * 8;
+}
+
+uint32_t PRMCIO::GetDisplayHeight() const {
+    uint8_t ovl = GetCRTCRegister(Reg_CR_OVL);
+    uint32_t vde = GetCRTCRegister(Reg_CR_VDE)
+        | ((ovl & 0x02) << 7)
+        | ((ovl & 0x40) << 3)
+        | ((GetCRTCRegister(Reg_CR_LSR) & 0x02) << 9);
+    return vde + 1;
+}
+
+uint32_t PRMCIO::GetHorizontalTotal() const {
+    uint32_t ht = GetCRTCRegister(Reg_CR_HT) | ((GetCRTCRegister(Reg_CR_HEB) & 0x01) << 8);
+    return (ht + 5) * 8;
+}
+
+uint32_t PRMCIO::GetVerticalTotal() const {
+    uint8_t ovl = GetCRTCRegister(Reg_CR_OVL);
+    uint32_t vt = GetCRTCRegister(Reg_CR_VT)
+        | ((ovl & 0x01) << 8)
+        | ((ovl & 0x20) << 4)
+        | ((GetCRTCRegister(Reg_CR_LSR) & 0x01) << 10);
+    return vt + 2;
+}
+
+uint32_t PRMCIO::GetFramebufferPitch() const {
+    uint32_t offset = GetCRTCRegister(Reg_CR_OFFSET)
+        | ((GetCRTCRegister(Reg_CR_RPC0) & 0xe0) << 3)
+        | ((GetCRTCRegister(Reg_CR_LSR) & 0x20) << 6);
+    return offset * 8;
 }
 
 }
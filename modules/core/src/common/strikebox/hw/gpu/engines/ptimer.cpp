@@ -33,8 +33,12 @@ void PTIMER::Reset() {
     m_clockMul = 1;
     m_clockDiv = 1;
     m_alarm = 0;
-    m_lastTickCountRead = std::chrono::high_resolution_clock::now();
-    m_tickCount = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint64_t now;
+        BeginUpdate(now);
+        EndUpdate(0, now);
+    }
     // TODO: stop alarm thread
 }
 
@@ -69,19 +73,23 @@ void PTIMER::Write(const uint32_t addr, const uint32_t value) {
         m_nv2a.UpdateIRQ();
         break;
     case Reg_PTIMER_CLOCK_MUL:
-        GetTickCount(); // ensure the tick count rate is updated immediately
-        m_clockMul = value;
-        break;
     case Reg_PTIMER_CLOCK_DIV:
-        GetTickCount(); // ensure the tick count rate is updated immediately
-        m_clockDiv = value;
-        break;
     case Reg_PTIMER_TIME_LOW:
-        m_tickCount = (m_tickCount & 0xFFFFFFF8000000ull) | (value & 0x7FFFFFFull);
-        break;
     case Reg_PTIMER_TIME_HIGH:
-        m_tickCount = (m_tickCount & 0x7FFFFFFull) | ((value & 0x1FFFFFFFull) << 27ull);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint64_t now;
+        uint64_t tickCount = BeginUpdate(now);
+        switch (addr) {
+        case Reg_PTIMER_CLOCK_MUL: m_clockMul = value; break;
+        case Reg_PTIMER_CLOCK_DIV: m_clockDiv = value; break;
+        case Reg_PTIMER_TIME_LOW: tickCount = (tickCount & 0xFFFFFFF8000000ull) | (value & 0x7FFFFFFull); break;
+        case Reg_PTIMER_TIME_HIGH: tickCount = (tickCount & 0x7FFFFFFull) | ((value & 0x1FFFFFFFull) << 27ull); break;
+        }
+        // The counter continues from its current value at the new rate
+        EndUpdate(tickCount, now);
         break;
+    }
     case Reg_PTIMER_ALARM:
         m_alarm = value;
         break;
@@ -91,29 +99,70 @@ void PTIMER::Write(const uint32_t addr, const uint32_t value) {
     }
 }
 
-uint64_t PTIMER::GetTickCount() {
-    // Compute time delta since last read
-    auto now = std::chrono::high_resolution_clock::now();
-    auto delta = now - m_lastTickCountRead;
-    double deltaSeconds = delta.count() / 1000000000.0;
-    m_lastTickCountRead = now;
+void PTIMER::CoreClockChanged() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t now;
+    uint64_t tickCount = BeginUpdate(now);
+    EndUpdate(tickCount, now);
+}
+
+// Computes the value of the counter at the given time from a published base
+static inline uint64_t TickCountAt(uint64_t baseTickCount, uint64_t baseTime, uint64_t tickFactor, uint64_t now) {
+    uint64_t tickCount = baseTickCount;
+    if (now > baseTime) {
+        tickCount += MulShift32(now - baseTime, tickFactor);
+    }
+
+    // [https://envytools.readthedocs.io/en/latest/hw/bus/ptimer.html#the-time-counter]
+    // "PTIMER's clock is a 56-bit value"
+    return tickCount & 0xFFFFFFFFFFFFFFull;
+}
+
+uint64_t PTIMER::GetTickCount() const {
+    uint32_t sequence;
+    uint64_t baseTickCount, baseTime, tickFactor, now;
+    do {
+        sequence = m_sequence.load(std::memory_order_acquire);
+        baseTickCount = m_baseTickCount.load(std::memory_order_relaxed);
+        baseTime = m_baseTime.load(std::memory_order_relaxed);
+        tickFactor = m_tickFactor.load(std::memory_order_relaxed);
+        now = m_nv2a.clock.Now();
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((sequence & 1) || sequence != m_sequence.load(std::memory_order_relaxed));
+
+    return TickCountAt(baseTickCount, baseTime, tickFactor, now);
+}
+
+uint64_t PTIMER::BeginUpdate(uint64_t& now) {
+    // Mark the counter as being updated before reading the clock, so that no
+    // reader computes a count past the new base with the old rate
+    uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    now = m_nv2a.clock.Now();
+    return TickCountAt(m_baseTickCount.load(std::memory_order_relaxed), m_baseTime.load(std::memory_order_relaxed),
+        m_tickFactor.load(std::memory_order_relaxed), now);
+}
+
+void PTIMER::EndUpdate(uint64_t tickCount, uint64_t now) {
+    auto coreClockCoeff = m_nv2a.pramdac.GetCoreClockCoefficients();
 
     // [https://envytools.readthedocs.io/en/latest/hw/bus/ptimer.html#the-clock-source]
     // "The clock that PTIMER counts is generated by applying a selectable ratio to a clock source. The clock source depends on the card:
     //  [...]
     //  NV4:NV40: the clock source is NVCLK, the core clock"
-    uint64_t coreClock = static_cast<uint64_t>(m_nv2a.pramdac.GetCoreClockCoefficients().CalcClock());
+    uint64_t coreClock = (coreClockCoeff.M != 0) ? static_cast<uint64_t>(coreClockCoeff.CalcClock()) : 0;
 
     // [https://envytools.readthedocs.io/en/latest/hw/bus/ptimer.html#the-clock-ratio]
     // "The clock used for the counter is clock_source * CLOCK_MUL / CLOCK_DIV."
-    uint64_t timerClock = coreClock * m_clockMul / m_clockDiv;
-
-    // Increment tick count
-    m_tickCount += timerClock * deltaSeconds;
+    // The counter stops if the divider is zero.
+    uint64_t timerClock = (m_clockDiv != 0) ? coreClock * m_clockMul / m_clockDiv : 0;
 
-    // [https://envytools.readthedocs.io/en/latest/hw/bus/ptimer.html#the-time-counter]
-    // "PTIMER's clock is a 56-bit value"
-    return m_tickCount & 0xFFFFFFFFFFFFFFull;
+    m_baseTickCount.store(tickCount, std::memory_order_relaxed);
+    m_baseTime.store(now, std::memory_order_relaxed);
+    m_tickFactor.store(TickRate(timerClock).GetFactor(), std::memory_order_relaxed);
+    m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
 }
 
 }
@@ -8,12 +8,104 @@
 // References to particular items in the documentation are denoted between
 // brackets optionally followed by a quote from the documentation.
 #include "strikebox/hw/gpu/engines/pvideo.h"
+#include "strikebox/hw/gpu/pgraph/simd.h"
 #include "strikebox/hw/gpu/state.h"
+#include "strikebox/hw/gpu/yuv.h"
 
 #include "strikebox/log.h"
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 namespace strikebox::nv2a {
 
+// --- Kernels ---------------
+//
+// Images are converted one source row at a time into X8R8G8B8, scaled
+// horizontally and blended between the two nearest source rows. Interpolation
+// weights have 7 bits so that the weighted differences of 8-bit channels fit
+// in 16-bit lanes.
+
+namespace {
+
+inline uint32_t Lerp(uint32_t a, uint32_t b, uint32_t weight) {
+    uint32_t result = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        int ca = (a >> shift) & 0xff;
+        int cb = (b >> shift) & 0xff;
+        result |= static_cast<uint32_t>(ca + (((cb - ca) * static_cast<int>(weight)) >> 7)) << shift;
+    }
+    return result;
+}
+
+// Samples count pixels at the given source columns, each blended with the
+// next column by its weight
+void ScaleRow(const uint32_t* src, const uint32_t* columns, const uint8_t* weights, uint32_t* dst, uint32_t count) {
+    uint32_t x = 0;
+#ifdef STRIKEBOX_SIMD_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 2 <= count; x += 2) {
+        // Two pixels, four 16-bit channels each
+        __m128i a = _mm_unpacklo_epi32(_mm_cvtsi32_si128(src[columns[x]]), _mm_cvtsi32_si128(src[columns[x + 1]]));
+        __m128i b = _mm_unpacklo_epi32(_mm_cvtsi32_si128(src[columns[x] + 1]), _mm_cvtsi32_si128(src[columns[x + 1] + 1]));
+        a = _mm_unpacklo_epi8(a, zero);
+        b = _mm_unpacklo_epi8(b, zero);
+        __m128i w = _mm_unpacklo_epi64(_mm_set1_epi16(weights[x]), _mm_set1_epi16(weights[x + 1]));
+        __m128i result = _mm_add_epi16(a, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(b, a), w), 7));
+        _mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(result, zero));
+    }
+#endif
+    for (; x < count; x++) {
+        dst[x] = Lerp(src[columns[x]], src[columns[x] + 1], weights[x]);
+    }
+}
+
+// Blends two rows by weight
+void BlendRows(const uint32_t* a, const uint32_t* b, uint32_t weight, uint32_t* dst, uint32_t count) {
+    uint32_t x = 0;
+#ifdef STRIKEBOX_SIMD_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w = _mm_set1_epi16(static_cast<int16_t>(weight));
+    for (; x + 4 <= count; x += 4) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + x));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + x));
+        __m128i lo = _mm_unpacklo_epi8(va, zero);
+        __m128i hi = _mm_unpackhi_epi8(va, zero);
+        lo = _mm_add_epi16(lo, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(vb, zero), lo), w), 7));
+        hi = _mm_add_epi16(hi, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(vb, zero), hi), w), 7));
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; x < count; x++) {
+        dst[x] = Lerp(a[x], b[x], weight);
+    }
+}
+
+// Writes the pixels over the destination pixels whose color matches the key
+void WriteKeyedRow(const uint32_t* src, uint32_t* dst, uint32_t count, uint32_t colorKey) {
+    uint32_t x = 0;
+#ifdef STRIKEBOX_SIMD_SSE2
+    const __m128i colorMask = _mm_set1_epi32(0xffffff);
+    const __m128i key = _mm_set1_epi32(static_cast<int32_t>(colorKey & 0xffffff));
+    for (; x + 4 <= count; x += 4) {
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + x));
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + x));
+        __m128i match = _mm_cmpeq_epi32(_mm_and_si128(d, colorMask), key);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(_mm_and_si128(match, s), _mm_andnot_si128(match, d)));
+    }
+#endif
+    for (; x < count; x++) {
+        if ((dst[x] & 0xffffff) == (colorKey & 0xffffff)) {
+            dst[x] = src[x];
+        }
+    }
+}
+
+}
+
+// --- Engine ---------------
+
 void PVIDEO::SetEnabled(bool enabled) {
     if (m_enabled != enabled) {
         m_enabled = enabled;
@@ -27,36 +119,259 @@ void PVIDEO::SetEnabled(bool enabled) {
 }
 
 void PVIDEO::Reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
     m_enabled = false;
     m_interruptLevels = 0;
     m_enabledInterrupts = 0;
+    std::memset(m_buffers, 0, sizeof(m_buffers));
+    m_bufferUse = 0;
+    m_stop = 0;
+    m_colorKey = 0;
+    m_displayedBuffer = -1;
+    m_submitOrder = 0;
+}
+
+uint32_t* PVIDEO::BufferRegister(uint32_t addr) {
+    if (addr < Reg_PVIDEO_BASE || addr >= Reg_PVIDEO_FORMAT + 8) {
+        return nullptr;
+    }
+    // Registers of both buffers are interleaved
+    uint32_t index = (addr - Reg_PVIDEO_BASE) >> 2;
+    return reinterpret_cast<uint32_t*>(&m_buffers[index & 1]) + (index >> 1);
 }
 
 uint32_t PVIDEO::Read(const uint32_t addr) {
+    std::lock_guard<std::mutex> lock(m_mutex);
     switch (addr) {
     case Reg_PVIDEO_INTR: return m_interruptLevels;
     case Reg_PVIDEO_INTR_ENABLE: return m_enabledInterrupts;
+    case Reg_PVIDEO_BUFFER: return m_bufferUse;
+    case Reg_PVIDEO_STOP: return m_stop;
+    case Reg_PVIDEO_COLOR_KEY: return m_colorKey;
     default:
+        if (uint32_t* reg = BufferRegister(addr)) {
+            return *reg;
+        }
         log_spew("[NV2A] PVIDEO::Read:   Unimplemented read!   address = 0x%x\n", addr);
         return 0;
     }
 }
 
 void PVIDEO::Write(const uint32_t addr, const uint32_t value) {
+    std::unique_lock<std::mutex> lock(m_mutex);
     switch (addr) {
     case Reg_PVIDEO_INTR:
         // Clear specified interrupts
         m_interruptLevels &= ~value;
+        lock.unlock();
         m_nv2a.UpdateIRQ();
         break;
     case Reg_PVIDEO_INTR_ENABLE:
         m_enabledInterrupts = value;
+        lock.unlock();
         m_nv2a.UpdateIRQ();
         break;
+    case Reg_PVIDEO_BUFFER:
+        // Buffers are submitted by setting their bits; clear bits are ignored
+        m_bufferUse |= value & (Val_PVIDEO_BUFFER_0_USE | Val_PVIDEO_BUFFER_1_USE);
+        if (value & Val_PVIDEO_BUFFER_1_USE) {
+            m_submitOrder = 1;
+        }
+        else if (value & Val_PVIDEO_BUFFER_0_USE) {
+            m_submitOrder = 0;
+        }
+        break;
+    case Reg_PVIDEO_STOP:
+        m_stop = value & Val_PVIDEO_STOP_ACTIVE;
+        break;
+    case Reg_PVIDEO_COLOR_KEY:
+        m_colorKey = value;
+        break;
+    case Reg_PVIDEO_LUMINANCE:
+    case Reg_PVIDEO_LUMINANCE + 4:
+    case Reg_PVIDEO_CHROMINANCE:
+    case Reg_PVIDEO_CHROMINANCE + 4:
+        // Color adjustments read back but are not applied to the overlay
+        log_spew("[NV2A] PVIDEO::Write:  Color adjustment not supported   address = 0x%x,  value = 0x%x\n", addr, value);
+        *BufferRegister(addr) = value;
+        break;
     default:
+        if (uint32_t* reg = BufferRegister(addr)) {
+            *reg = value;
+            break;
+        }
         log_spew("[NV2A] PVIDEO::Write:  Unimplemented write!   address = 0x%x,  value = 0x%x\n", addr, value);
         break;
     }
 }
 
+void PVIDEO::VerticalBlank() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const uint32_t useBits[2] = { Val_PVIDEO_BUFFER_0_USE, Val_PVIDEO_BUFFER_1_USE };
+    const uint32_t interruptBits[2] = { Val_PVIDEO_INTR_BUFFER_0, Val_PVIDEO_INTR_BUFFER_1 };
+
+    uint32_t released = 0;
+    if (m_stop & Val_PVIDEO_STOP_ACTIVE) {
+        for (uint32_t i = 0; i < 2; i++) {
+            if (m_bufferUse & useBits[i]) {
+                released |= interruptBits[i];
+            }
+        }
+        m_bufferUse = 0;
+        m_stop = 0;
+        m_displayedBuffer = -1;
+    }
+    else {
+        // Show the most recently submitted buffer
+        int32_t next = -1;
+        if (m_bufferUse & useBits[m_submitOrder]) {
+            next = m_submitOrder;
+        }
+        else if (m_bufferUse & useBits[m_submitOrder ^ 1]) {
+            next = m_submitOrder ^ 1;
+        }
+        if (next >= 0 && next != m_displayedBuffer) {
+            if (m_displayedBuffer >= 0 && (m_bufferUse & useBits[m_displayedBuffer])) {
+                m_bufferUse &= ~useBits[m_displayedBuffer];
+                released |= interruptBits[m_displayedBuffer];
+            }
+            m_displayedBuffer = next;
+        }
+    }
+
+    if (released != 0) {
+        m_interruptLevels |= released;
+        lock.unlock();
+        m_nv2a.UpdateIRQ();
+    }
+}
+
+bool PVIDEO::IsDisplaying() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_enabled && m_displayedBuffer >= 0;
+}
+
+void PVIDEO::Compose(uint32_t* frame, uint32_t pitch, uint32_t width, uint32_t height, uint32_t colorKey) {
+    PVIDEOBuffer buffer;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_enabled || m_displayedBuffer < 0) {
+            return;
+        }
+        buffer = m_buffers[m_displayedBuffer];
+    }
+
+    const uint32_t inWidth = buffer.sizeIn & 0x7ff;
+    const uint32_t inHeight = (buffer.sizeIn >> 16) & 0x7ff;
+    const uint32_t outX = buffer.pointOut & 0xfff;
+    const uint32_t outY = (buffer.pointOut >> 16) & 0xfff;
+    const uint32_t outWidth = buffer.sizeOut & 0xfff;
+    const uint32_t outHeight = (buffer.sizeOut >> 16) & 0xfff;
+    const uint32_t srcPitch = buffer.format & 0x1fff;
+    const uint32_t color = (buffer.format >> 16) & 3;
+    const bool keyed = (buffer.format & Val_PVIDEO_FORMAT_DISPLAY) != 0;
+    if (inWidth == 0 || inHeight == 0 || outWidth == 0 || outHeight == 0) {
+        return;
+    }
+    if (color != Val_PVIDEO_FORMAT_COLOR_YB8CR8YA8CB8 && color != Val_PVIDEO_FORMAT_COLOR_CR8YB8CB8YA8) {
+        log_spew("[NV2A] PVIDEO: Unsupported overlay format %u\n", color);
+        return;
+    }
+
+    // Pixels are read in pairs that share their chroma
+    const uint32_t evenWidth = (inWidth + 1) & ~1;
+    const uint64_t lastByte = static_cast<uint64_t>(buffer.offset) + static_cast<uint64_t>(inHeight - 1) * srcPitch + evenWidth * 2 - 1;
+    if (lastByte > buffer.limit || buffer.base + lastByte >= m_nv2a.systemRAMSize) {
+        log_spew("[NV2A] PVIDEO: Overlay image at 0x%x + 0x%x exceeds its limit\n", buffer.base, buffer.offset);
+        return;
+    }
+    const uint8_t* src = &m_nv2a.systemRAM[buffer.base + buffer.offset];
+
+    // Clip the output rectangle to the frame
+    const uint32_t x0 = std::min(outX, width);
+    const uint32_t x1 = std::min(outX + outWidth, width);
+    const uint32_t y0 = std::min(outY, height);
+    const uint32_t y1 = std::min(outY + outHeight, height);
+    if (x0 == x1 || y0 == y1) {
+        return;
+    }
+    const uint32_t count = x1 - x0;
+
+    // Image coordinates have 20 fractional bits
+    const uint64_t s0 = static_cast<uint64_t>(buffer.pointIn & 0x7fff) << 16;
+    const uint64_t t0 = static_cast<uint64_t>(buffer.pointIn >> 17) << 17;
+
+    // Source columns and weights of every output column. Converted rows
+    // repeat their last pixel so that every column can read its neighbor.
+    static thread_local std::vector<uint32_t> columns;
+    static thread_local std::vector<uint8_t> weights;
+    static thread_local std::vector<uint32_t> rows[2];
+    static thread_local std::vector<uint32_t> scaled[3];
+    columns.resize(count);
+    weights.resize(count);
+    for (uint32_t x = 0; x < count; x++) {
+        uint64_t s = s0 + static_cast<uint64_t>(x0 - outX + x) * buffer.dsdx;
+        uint64_t column = s >> 20;
+        columns[x] = static_cast<uint32_t>(std::min<uint64_t>(column, inWidth - 1));
+        weights[x] = (column < inWidth - 1) ? static_cast<uint8_t>((s >> 13) & 0x7f) : 0;
+    }
+    for (auto& row : rows) {
+        row.resize(evenWidth + 1);
+    }
+
+    // Unscaled rows are used as converted
+    const bool unscaled = buffer.dsdx == kPVIDEOScaleUnity && (s0 & (kPVIDEOScaleUnity - 1)) == 0 && columns[0] + count <= inWidth;
+    for (auto& row : scaled) {
+        row.resize(count);
+    }
+
+    // Rows are cached by source row; consecutive output lines usually share
+    // one or both of their source rows
+    int64_t scaledRows[2] = { -1, -1 };
+    auto getScaledRow = [&](uint32_t row) -> const uint32_t* {
+        for (uint32_t i = 0; i < 2; i++) {
+            if (scaledRows[i] == row) {
+                return unscaled ? rows[i].data() + columns[0] : scaled[i].data();
+            }
+        }
+        // Keep the row above, which the caller may be blending with
+        uint32_t slot = (scaledRows[0] == row - 1) ? 1 : 0;
+        uint32_t* converted = rows[slot].data();
+        if (color == Val_PVIDEO_FORMAT_COLOR_YB8CR8YA8CB8) {
+            ConvertUYVYRow(src + static_cast<size_t>(row) * srcPitch, converted, inWidth);
+        }
+        else {
+            ConvertYUY2Row(src + static_cast<size_t>(row) * srcPitch, converted, inWidth);
+        }
+        converted[inWidth] = converted[inWidth - 1];
+        scaledRows[slot] = row;
+        if (unscaled) {
+            return converted + columns[0];
+        }
+        ScaleRow(converted, columns.data(), weights.data(), scaled[slot].data(), count);
+        return scaled[slot].data();
+    };
+
+    for (uint32_t y = y0; y < y1; y++) {
+        uint64_t t = t0 + static_cast<uint64_t>(y - outY) * buffer.dtdy;
+        uint32_t row = static_cast<uint32_t>(std::min<uint64_t>(t >> 20, inHeight - 1));
+        uint32_t weight = (row < inHeight - 1) ? static_cast<uint32_t>((t >> 13) & 0x7f) : 0;
+
+        const uint32_t* pixels = getScaledRow(row);
+        if (weight != 0) {
+            const uint32_t* next = getScaledRow(row + 1);
+            BlendRows(pixels, next, weight, scaled[2].data(), count);
+            pixels = scaled[2].data();
+        }
+
+        uint32_t* dst = frame + static_cast<size_t>(y) * pitch + x0;
+        if (keyed) {
+            WriteKeyedRow(pixels, dst, count, colorKey);
+        }
+        else {
+            std::memcpy(dst, pixels, count * sizeof(uint32_t));
+        }
+    }
+}
+
 }
@@ -0,0 +1,253 @@
+// StrikeBox NV2A frame export sinks
+// (C) Ivan "StrikerX3" Oliveira
+#include "strikebox/hw/gpu/frame_sink.h"
+
+#include "strikebox/log.h"
+#include "strikebox/thread.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
+#include <numeric>
+
+namespace strikebox::nv2a {
+
+// --- Null sink --------------
+
+uint8_t* NullFrameSink::BeginFrame(uint32_t width, uint32_t height, uint32_t& pitch) {
+    pitch = width * 4;
+    m_buffer.resize(static_cast<size_t>(pitch) * height);
+    return m_buffer.data();
+}
+
+// --- File sink --------------
+
+FileFrameSink::FileFrameSink(FrameFileFormat format, const std::string& path, uint32_t interval)
+    : m_format(format)
+    , m_path(path)
+    , m_interval(std::max(interval, 1u))
+{
+}
+
+FileFrameSink::~FileFrameSink() {
+    if (m_thread.joinable()) {
+        // Let the writer finish the queued frames
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+        }
+        m_cond.notify_one();
+        m_thread.join();
+    }
+    if (m_file != nullptr) {
+        fclose(m_file);
+    }
+    if (m_droppedFrames > 0) {
+        log_info("[NV2A] Scan-out: %" PRIu64 " frames were dropped while writing to %s\n", m_droppedFrames, m_path.c_str());
+    }
+}
+
+bool FileFrameSink::Start() {
+    if (m_format == FrameFileFormat::Y4M) {
+        m_file = fopen(m_path.c_str(), "wb");
+        if (m_file == nullptr) {
+            log_warning("[NV2A] Scan-out: Could not create %s\n", m_path.c_str());
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < kBufferCount; i++) {
+        m_free.push_back(std::make_unique<Frame>());
+    }
+    m_running = true;
+    m_thread = std::thread([this]() { WriterThread(); });
+    return true;
+}
+
+uint8_t* FileFrameSink::BeginFrame(uint32_t width, uint32_t height, uint32_t& pitch) {
+    uint64_t number = m_frameNumber++;
+    if (number % m_interval != 0) {
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_free.empty()) {
+            m_droppedFrames++;
+            return nullptr;
+        }
+        m_current = std::move(m_free.back());
+        m_free.pop_back();
+    }
+
+    m_current->width = width;
+    m_current->height = height;
+    m_current->number = number;
+    m_current->period = m_framePeriod;
+    m_current->pixels.resize(static_cast<size_t>(width) * height * 4);
+    pitch = width * 4;
+    return m_current->pixels.data();
+}
+
+void FileFrameSink::EndFrame() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(m_current));
+    }
+    m_cond.notify_one();
+}
+
+void FileFrameSink::WriterThread() {
+    Thread_SetName("[HW] NV2A Frame Writer");
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cond.wait(lock, [this]() { return !m_queue.empty() || !m_running; });
+        if (m_queue.empty()) {
+            break;
+        }
+        auto frame = std::move(m_queue.front());
+        m_queue.pop_front();
+        lock.unlock();
+
+        if (m_format == FrameFileFormat::PPM) {
+            WritePPM(*frame);
+        }
+        else {
+            WriteY4M(*frame);
+        }
+
+        lock.lock();
+        m_free.push_back(std::move(frame));
+    }
+}
+
+void FileFrameSink::WritePPM(const Frame& frame) {
+    char name[32];
+    snprintf(name, sizeof(name), "_%06" PRIu64 ".ppm", frame.number);
+    std::string path = m_path + name;
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        log_warning("[NV2A] Scan-out: Could not create %s\n", path.c_str());
+        return;
+    }
+
+    // PPM has no alpha channel
+    std::vector<uint8_t> row(frame.width * 3);
+    fprintf(file, "P6\n%u %u\n255\n", frame.width, frame.height);
+    for (uint32_t y = 0; y < frame.height; y++) {
+        const uint8_t* src = &frame.pixels[static_cast<size_t>(y) * frame.width * 4];
+        for (uint32_t x = 0; x < frame.width; x++) {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+    fclose(file);
+}
+
+void FileFrameSink::WriteY4M(const Frame& frame) {
+    // The stream header fixes the frame size
+    if (m_streamWidth == 0) {
+        m_streamWidth = frame.width;
+        m_streamHeight = frame.height;
+        // The frame rate is the display's, as a ratio of frames per second;
+        // assume 60 Hz if it was never given
+        uint64_t rateNum = 60;
+        uint64_t rateDen = m_interval;
+        if (frame.period != 0) {
+            rateNum = 1000000000ull;
+            rateDen = frame.period * m_interval;
+        }
+        uint64_t divisor = std::gcd(rateNum, rateDen);
+        fprintf(m_file, "YUV4MPEG2 W%u H%u F%" PRIu64 ":%" PRIu64 " Ip A1:1 C444\n", frame.width, frame.height, rateNum / divisor, rateDen / divisor);
+    }
+    if (frame.width != m_streamWidth || frame.height != m_streamHeight) {
+        log_spew("[NV2A] Scan-out: Skipping %ux%u frame in %ux%u video stream\n", frame.width, frame.height, m_streamWidth, m_streamHeight);
+        return;
+    }
+
+    // ITU-R BT.601 studio range YCbCr, with coefficients scaled by 256
+    const size_t planeSize = static_cast<size_t>(frame.width) * frame.height;
+    m_planes.resize(planeSize * 3);
+    uint8_t* yPlane = &m_planes[0];
+    uint8_t* cbPlane = &m_planes[planeSize];
+    uint8_t* crPlane = &m_planes[planeSize * 2];
+    for (size_t i = 0; i < planeSize; i++) {
+        int r = frame.pixels[i * 4 + 0];
+        int g = frame.pixels[i * 4 + 1];
+        int b = frame.pixels[i * 4 + 2];
+        yPlane[i] = static_cast<uint8_t>(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+        cbPlane[i] = static_cast<uint8_t>(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+        crPlane[i] = static_cast<uint8_t>(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+    }
+
+    fputs("FRAME\n", m_file);
+    fwrite(m_planes.data(), 1, m_planes.size(), m_file);
+}
+
+// --- Shared memory sink -----
+
+SharedMemoryFrameSink::~SharedMemoryFrameSink() {
+    if (m_data != nullptr) {
+        UnmapSharedMemory();
+    }
+}
+
+bool SharedMemoryFrameSink::Create() {
+    const uint32_t headerSize = 4096;
+    const uint32_t dataOffset = 64;
+    const uint32_t slotSize = (dataOffset + kFrameRingMaxWidth * kFrameRingMaxHeight * 4 + 4095) & ~4095;
+    static_assert(sizeof(FrameRingHeader) <= 4096 && sizeof(FrameSlotHeader) <= 64);
+
+    if (!MapSharedMemory(headerSize + static_cast<size_t>(slotSize) * kFrameRingSlotCount)) {
+        return false;
+    }
+
+    // The object is zero-filled; fill in the layout last so that viewers
+    // that check the magic value see a complete header
+    m_header = reinterpret_cast<FrameRingHeader*>(m_data);
+    m_header->version = kFrameRingVersion;
+    m_header->headerSize = headerSize;
+    m_header->slotCount = kFrameRingSlotCount;
+    m_header->slotSize = slotSize;
+    m_header->dataOffset = dataOffset;
+    m_header->frameCount.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_header->magic = kFrameRingMagic;
+    return true;
+}
+
+uint8_t* SharedMemoryFrameSink::BeginFrame(uint32_t width, uint32_t height, uint32_t& pitch) {
+    if (width > kFrameRingMaxWidth || height > kFrameRingMaxHeight) {
+        if (!m_warnedSize) {
+            log_warning("[NV2A] Scan-out: %ux%u frames do not fit in the shared memory ring\n", width, height);
+            m_warnedSize = true;
+        }
+        return nullptr;
+    }
+
+    uint64_t frame = m_header->frameCount.load(std::memory_order_relaxed);
+    uint8_t* slot = m_data + m_header->headerSize + (frame % m_header->slotCount) * m_header->slotSize;
+    m_slot = reinterpret_cast<FrameSlotHeader*>(slot);
+
+    // Mark the slot as being written before touching its contents
+    uint32_t sequence = m_slot->sequence.load(std::memory_order_relaxed);
+    m_slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_slot->width = width;
+    m_slot->height = height;
+    m_slot->pitch = width * 4;
+    m_slot->frameNumber = frame;
+    pitch = width * 4;
+    return slot + m_header->dataOffset;
+}
+
+void SharedMemoryFrameSink::EndFrame() {
+    m_slot->sequence.fetch_add(1, std::memory_order_release);
+    m_header->frameCount.fetch_add(1, std::memory_order_release);
+}
+
+}
@@ -0,0 +1,992 @@
+// StrikeBox NV2A PGRAPH register combiners and texture shaders
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+#include "strikebox/hw/gpu/pgraph/combiner.h"
+#include "strikebox/hw/gpu/pgraph/hash.h"
+
+#include "strikebox/log.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iterator>
+#include <utility>
+
+namespace strikebox::nv2a {
+
+using simd::F4;
+using simd::M4;
+
+// ----------------------------------------------------------------------------
+// State decoding
+
+// Unpacks an ARGB8888 color into RGBA floats
+static void UnpackARGB(uint32_t color, float* out) {
+    out[0] = ((color >> 16) & 0xff) * (1.0f / 255.0f);
+    out[1] = ((color >> 8) & 0xff) * (1.0f / 255.0f);
+    out[2] = (color & 0xff) * (1.0f / 255.0f);
+    out[3] = (color >> 24) * (1.0f / 255.0f);
+}
+
+void DecodeCombinerState(const KelvinState& state, CombinerKey& key, CombinerConstants& constants) {
+    std::memset(&key, 0, sizeof(key));
+    for (uint32_t i = 0; i < kCombinerStageCount; i++) {
+        key.colorICW[i] = state.Reg(Mthd_KELVIN_SET_COMBINER_COLOR_ICW + i * 4);
+        key.colorOCW[i] = state.Reg(Mthd_KELVIN_SET_COMBINER_COLOR_OCW + i * 4);
+        key.alphaICW[i] = state.Reg(Mthd_KELVIN_SET_COMBINER_ALPHA_ICW + i * 4);
+        key.alphaOCW[i] = state.Reg(Mthd_KELVIN_SET_COMBINER_ALPHA_OCW + i * 4);
+        UnpackARGB(state.Reg(Mthd_KELVIN_SET_COMBINER_FACTOR0 + i * 4), constants.factor0[i]);
+        UnpackARGB(state.Reg(Mthd_KELVIN_SET_COMBINER_FACTOR1 + i * 4), constants.factor1[i]);
+    }
+    key.finalCW0 = state.Reg(Mthd_KELVIN_SET_COMBINER_SPECULAR_FOG_CW0);
+    key.finalCW1 = state.Reg(Mthd_KELVIN_SET_COMBINER_SPECULAR_FOG_CW1);
+    key.control = state.Reg(Mthd_KELVIN_SET_COMBINER_CONTROL);
+    key.shaderProgram = state.Reg(Mthd_KELVIN_SET_SHADER_STAGE_PROGRAM);
+    key.dotMapping = state.Reg(Mthd_KELVIN_SET_DOT_RGBMAPPING);
+    key.otherStageInput = state.Reg(Mthd_KELVIN_SET_SHADER_OTHER_STAGE_INPUT);
+    key.clipPlaneMode = state.Reg(Mthd_KELVIN_SET_SHADER_CLIP_PLANE_MODE);
+    key.fogMode = state.Reg(Mthd_KELVIN_SET_FOG_MODE);
+
+    for (uint32_t i = 0; i < 2; i++) {
+        UnpackARGB(state.Reg(Mthd_KELVIN_SET_SPECULAR_FOG_FACTOR + i * 4), constants.specularFog[i]);
+    }
+
+    // SET_FOG_COLOR has red in the low byte
+    uint32_t fogColor = state.Reg(Mthd_KELVIN_SET_FOG_COLOR);
+    for (uint32_t c = 0; c < 4; c++) {
+        constants.fogColor[c] = ((fogColor >> (c * 8)) & 0xff) * (1.0f / 255.0f);
+    }
+    for (uint32_t i = 0; i < 3; i++) {
+        constants.fogParams[i] = state.RegFloat(Mthd_KELVIN_SET_FOG_PARAMS + i * 4);
+    }
+
+    for (uint32_t stage = 0; stage < kKelvinTextureCount; stage++) {
+        const uint32_t base = stage * kKelvinTextureStride;
+        key.textureAddress[stage] = state.Reg(Mthd_KELVIN_SET_TEXTURE_ADDRESS + base);
+        key.textureFilter[stage] = state.Reg(Mthd_KELVIN_SET_TEXTURE_FILTER + base);
+
+        // Linear image formats are addressed with texel coordinates
+        uint32_t format = (state.Reg(Mthd_KELVIN_SET_TEXTURE_FORMAT + base) >> 8) & 0xff;
+        const TextureFormatInfo& info = GetTextureFormatInfo(format);
+        if (info.swizzled || info.compressed) {
+            key.normalizedCoords |= 1 << stage;
+        }
+
+        for (uint32_t i = 0; i < 4; i++) {
+            constants.bumpEnvMatrix[stage][i] = state.RegFloat(Mthd_KELVIN_SET_TEXTURE_SET_BUMP_ENV_MAT + base + i * 4);
+        }
+        constants.bumpEnvScale[stage] = state.RegFloat(Mthd_KELVIN_SET_TEXTURE_SET_BUMP_ENV_SCALE + base);
+        constants.bumpEnvOffset[stage] = state.RegFloat(Mthd_KELVIN_SET_TEXTURE_SET_BUMP_ENV_OFFSET + base);
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Kernel building blocks
+
+namespace {
+
+// Combiner registers
+const uint32_t kReg_Zero = 0x0;
+const uint32_t kReg_Constant0 = 0x1;
+const uint32_t kReg_Constant1 = 0x2;
+const uint32_t kReg_Fog = 0x3;
+const uint32_t kReg_Diffuse = 0x4;
+const uint32_t kReg_Specular = 0x5;
+const uint32_t kReg_Texture0 = 0x8;
+const uint32_t kReg_Spare0 = 0xc;
+const uint32_t kReg_Spare1 = 0xd;
+const uint32_t kReg_SpecularSum = 0xe;   // Final combiner only: spare0 + specular
+const uint32_t kReg_EFProduct = 0xf;     // Final combiner only: E * F
+const uint32_t kRegCount = 16;
+
+// Texture shader modes of SET_SHADER_STAGE_PROGRAM
+enum TextureMode : uint32_t {
+    TextureMode_None = 0x00,
+    TextureMode_Project2D = 0x01,
+    TextureMode_Project3D = 0x02,
+    TextureMode_CubeMap = 0x03,
+    TextureMode_PassThrough = 0x04,
+    TextureMode_ClipPlane = 0x05,
+    TextureMode_BumpEnvMap = 0x06,
+    TextureMode_BumpEnvMapLuminance = 0x07,
+    TextureMode_DotST = 0x09,
+    TextureMode_DotSTR3D = 0x0d,
+    TextureMode_DotSTRCube = 0x0e,
+    TextureMode_DependentAR = 0x0f,
+    TextureMode_DependentGB = 0x10,
+    TextureMode_DotProduct = 0x11,
+};
+
+// Values of SET_TEXTURE_ADDRESS fields
+const uint32_t kAddress_Wrap = 1;
+const uint32_t kAddress_Mirror = 2;
+
+// Values of SET_FOG_MODE
+const uint32_t kFogMode_Linear = 0x2601;
+const uint32_t kFogMode_Exp = 0x800;
+const uint32_t kFogMode_Exp2 = 0x801;
+const uint32_t kFogMode_ExpAbs = 0x802;
+const uint32_t kFogMode_Exp2Abs = 0x803;
+const uint32_t kFogMode_LinearAbs = 0x804;
+
+// Register file of a quad; every component of a register is a vector
+struct Registers {
+    F4 r[kRegCount][4];
+    F4 dot[kKelvinTextureCount];   // Dot products computed by texture shader stages
+};
+
+// Component selection of an operand
+enum class Source : uint8_t {
+    RGB,      // RGB portion reading the color components
+    Alpha,    // RGB portion reading alpha into every component, or alpha portion reading alpha
+    Blue,     // Alpha portion reading blue
+};
+
+// Reads an operand and applies its input mapping
+typedef void (*FetchFn)(const Registers& regs, uint32_t reg, F4* out);
+
+template <uint32_t Mapping>
+inline F4 MapInput(F4 x) {
+    const F4 zero = F4::Splat(0.0f);
+    const F4 one = F4::Splat(1.0f);
+    const F4 half = F4::Splat(0.5f);
+    if constexpr (Mapping == 0) {         // Unsigned identity
+        return Max(x, zero);
+    }
+    else if constexpr (Mapping == 1) {    // Unsigned invert
+        return one - simd::Clamp(x, zero, one);
+    }
+    else if constexpr (Mapping == 2) {    // Expand normal
+        return Max(x, zero) * F4::Splat(2.0f) - one;
+    }
+    else if constexpr (Mapping == 3) {    // Expand negate
+        return one - Max(x, zero) * F4::Splat(2.0f);
+    }
+    else if constexpr (Mapping == 4) {    // Half bias normal
+        return Max(x, zero) - half;
+    }
+    else if constexpr (Mapping == 5) {    // Half bias negate
+        return half - Max(x, zero);
+    }
+    else if constexpr (Mapping == 6) {    // Signed identity
+        return x;
+    }
+    else {                                // Signed negate
+        return Negate(x);
+    }
+}
+
+template <uint32_t Mapping, Source S, uint32_t Components>
+void Fetch(const Registers& regs, uint32_t reg, F4* out) {
+    const F4* value = regs.r[reg];
+    for (uint32_t c = 0; c < Components; c++) {
+        if constexpr (S == Source::RGB) {
+            out[c] = MapInput<Mapping>(value[c]);
+        }
+        else if constexpr (S == Source::Alpha) {
+            out[c] = MapInput<Mapping>(value[3]);
+        }
+        else {
+            out[c] = MapInput<Mapping>(value[2]);
+        }
+    }
+}
+
+template <Source S, uint32_t Components, uint32_t... Mappings>
+constexpr std::array<FetchFn, 8> MakeFetchTable(std::integer_sequence<uint32_t, Mappings...>) {
+    return { { &Fetch<Mappings, S, Components>... } };
+}
+
+const std::array<FetchFn, 8> kFetchRGB = MakeFetchTable<Source::RGB, 3>(std::make_integer_sequence<uint32_t, 8>{});
+const std::array<FetchFn, 8> kFetchAlphaRGB = MakeFetchTable<Source::Alpha, 3>(std::make_integer_sequence<uint32_t, 8>{});
+const std::array<FetchFn, 8> kFetchAlpha = MakeFetchTable<Source::Alpha, 1>(std::make_integer_sequence<uint32_t, 8>{});
+const std::array<FetchFn, 8> kFetchBlue = MakeFetchTable<Source::Blue, 1>(std::make_integer_sequence<uint32_t, 8>{});
+
+struct Operand {
+    FetchFn fetch;
+    uint8_t reg;
+};
+
+// Decodes an 8-bit input field: bits 3..0 = register, bit 4 = alpha, bits 7..5 = mapping
+Operand DecodeOperand(uint32_t field, bool alphaPortion) {
+    uint32_t reg = field & 0xf;
+    bool alpha = (field & 0x10) != 0;
+    uint32_t mapping = (field >> 5) & 7;
+    if (alphaPortion) {
+        return { alpha ? kFetchAlpha[mapping] : kFetchBlue[mapping], static_cast<uint8_t>(reg) };
+    }
+    return { alpha ? kFetchAlphaRGB[mapping] : kFetchRGB[mapping], static_cast<uint8_t>(reg) };
+}
+
+// One portion (RGB or alpha) of a general combiner stage
+struct Portion;
+
+// Computes the A * B, C * D and sum or mux results of a portion
+typedef void (*CombineFn)(const Portion& p, const Registers& regs, M4 muxCD, F4* ab, F4* cd, F4* sum);
+
+struct Portion {
+    Operand inputs[4];   // A, B, C, D
+    CombineFn combine;
+    uint8_t abDst, cdDst, sumDst;
+    float bias, scale;
+};
+
+template <uint32_t Components, bool DotAB, bool DotCD, bool Mux>
+void Combine(const Portion& p, const Registers& regs, M4 muxCD, F4* ab, F4* cd, F4* sum) {
+    F4 a[3], b[3], c[3], d[3];
+    p.inputs[0].fetch(regs, p.inputs[0].reg, a);
+    p.inputs[1].fetch(regs, p.inputs[1].reg, b);
+    p.inputs[2].fetch(regs, p.inputs[2].reg, c);
+    p.inputs[3].fetch(regs, p.inputs[3].reg, d);
+
+    if constexpr (DotAB) {
+        F4 dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        for (uint32_t i = 0; i < Components; i++) ab[i] = dot;
+    }
+    else {
+        for (uint32_t i = 0; i < Components; i++) ab[i] = a[i] * b[i];
+    }
+    if constexpr (DotCD) {
+        F4 dot = c[0] * d[0] + c[1] * d[1] + c[2] * d[2];
+        for (uint32_t i = 0; i < Components; i++) cd[i] = dot;
+    }
+    else {
+        for (uint32_t i = 0; i < Components; i++) cd[i] = c[i] * d[i];
+    }
+    for (uint32_t i = 0; i < Components; i++) {
+        if constexpr (Mux) {
+            sum[i] = F4::Select(muxCD, cd[i], ab[i]);
+        }
+        else {
+            sum[i] = ab[i] + cd[i];
+        }
+    }
+
+    // Output mapping: (x + bias) * scale, clamped to [-1, 1]
+    const F4 bias = F4::Splat(p.bias);
+    const F4 scale = F4::Splat(p.scale);
+    const F4 lo = F4::Splat(-1.0f);
+    const F4 hi = F4::Splat(1.0f);
+    for (uint32_t i = 0; i < Components; i++) {
+        ab[i] = simd::Clamp((ab[i] + bias) * scale, lo, hi);
+        cd[i] = simd::Clamp((cd[i] + bias) * scale, lo, hi);
+        sum[i] = simd::Clamp((sum[i] + bias) * scale, lo, hi);
+    }
+}
+
+// Indexed by dot AB (bit 2), dot CD (bit 1) and mux (bit 0)
+const CombineFn kCombineRGB[8] = {
+    &Combine<3, false, false, false>, &Combine<3, false, false, true>,
+    &Combine<3, false, true, false>, &Combine<3, false, true, true>,
+    &Combine<3, true, false, false>, &Combine<3, true, false, true>,
+    &Combine<3, true, true, false>, &Combine<3, true, true, true>,
+};
+const CombineFn kCombineAlpha[2] = {
+    &Combine<1, false, false, false>, &Combine<1, false, false, true>,
+};
+
+// Decodes a portion from its input and output control words. Output words
+// have bits 3..0 = CD destination, 7..4 = AB destination, 11..8 = sum
+// destination, bit 12 = CD dot product, bit 13 = AB dot product,
+// bit 14 = mux, bits 17..15 = output mapping
+Portion DecodePortion(uint32_t icw, uint32_t ocw, bool alpha) {
+    Portion p;
+    for (uint32_t i = 0; i < 4; i++) {
+        p.inputs[i] = DecodeOperand(icw >> (24 - i * 8), alpha);
+    }
+    p.cdDst = ocw & 0xf;
+    p.abDst = (ocw >> 4) & 0xf;
+    p.sumDst = (ocw >> 8) & 0xf;
+    bool cdDot = !alpha && (ocw & (1 << 12));
+    bool abDot = !alpha && (ocw & (1 << 13));
+    bool mux = (ocw & (1 << 14)) != 0;
+    p.combine = alpha ? kCombineAlpha[mux] : kCombineRGB[(abDot << 2) | (cdDot << 1) | mux];
+
+    switch ((ocw >> 15) & 7) {
+    case 1: p.bias = -0.5f; p.scale = 1.0f; break;   // Bias
+    case 2: p.bias = 0.0f; p.scale = 2.0f; break;    // Shift left by 1
+    case 3: p.bias = -0.5f; p.scale = 2.0f; break;   // Bias, shift left by 1
+    case 4: p.bias = 0.0f; p.scale = 4.0f; break;    // Shift left by 2
+    case 6: p.bias = 0.0f; p.scale = 0.5f; break;    // Shift right by 1
+    default: p.bias = 0.0f; p.scale = 1.0f; break;
+    }
+    return p;
+}
+
+struct GeneralStage {
+    Portion rgb;
+    Portion alpha;
+    bool abBlueToAlpha;
+    bool cdBlueToAlpha;
+    bool active;   // Writes at least one register
+};
+
+struct FinalStage {
+    Operand inputs[6];   // A, B, C, D, E, F
+    Operand g;
+    bool clampSum;
+    bool invertSpecular;
+    bool invertSpare0;
+};
+
+// ----------------------------------------------------------------------------
+// Texture sampling
+
+struct TextureStage;
+
+// Computes the color of a texture stage
+typedef void (*TextureFn)(const TextureStage& ts, uint32_t stage, const CombinerConstants& k, const Texture* tex, const PixelQuad& in, Registers& regs, uint32_t& mask);
+
+struct TextureStage {
+    TextureFn fn;
+    uint8_t input;         // Stage providing the input of dependent modes
+    uint8_t wrapU, wrapV;
+    bool bilinear;
+    bool normalized;
+    uint8_t clipMode;      // SET_SHADER_CLIP_PLANE_MODE bits of the stage
+    bool expandDot;        // Dot products map input colors to [-1, 1]
+};
+
+inline int32_t WrapCoord(int32_t i, int32_t size, uint32_t mode) {
+    if (mode == kAddress_Wrap) {
+        i %= size;
+        return (i < 0) ? i + size : i;
+    }
+    if (mode == kAddress_Mirror) {
+        int32_t period = size * 2;
+        i %= period;
+        if (i < 0) i += period;
+        return (i < size) ? i : period - 1 - i;
+    }
+    return std::min(std::max(i, 0), size - 1);
+}
+
+inline void UnpackTexel(uint32_t texel, float* out) {
+    UnpackARGB(texel, out);
+}
+
+// Samples the top level of a texture at the given coordinates. Each lane
+// reads from its own image, which selects cube faces and volume slices.
+void SampleQuad(const Texture* tex, const TextureStage& ts, const uint32_t* const* images, F4 s, F4 t, F4* out) {
+    if (tex == nullptr || tex->width == 0 || tex->height == 0) {
+        for (uint32_t c = 0; c < 4; c++) out[c] = F4::Splat(0.0f);
+        return;
+    }
+
+    const int32_t width = static_cast<int32_t>(tex->width);
+    const int32_t height = static_cast<int32_t>(tex->height);
+    if (ts.normalized) {
+        s = s * F4::Splat(static_cast<float>(width));
+        t = t * F4::Splat(static_cast<float>(height));
+    }
+
+    alignas(16) float u[4], v[4];
+    alignas(16) float result[4][4];
+    s.Store(u);
+    t.Store(v);
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        const uint32_t* image = images[lane];
+        float texel[4];
+        if (!std::isfinite(u[lane]) || !std::isfinite(v[lane])) {
+            u[lane] = v[lane] = 0.0f;
+        }
+        if (ts.bilinear) {
+            float fu = u[lane] - 0.5f;
+            float fv = v[lane] - 0.5f;
+            float x0f = std::floor(fu);
+            float y0f = std::floor(fv);
+            float fx = fu - x0f;
+            float fy = fv - y0f;
+            int32_t x0 = static_cast<int32_t>(std::max(std::min(x0f, 1e9f), -1e9f));
+            int32_t y0 = static_cast<int32_t>(std::max(std::min(y0f, 1e9f), -1e9f));
+            int32_t xa = WrapCoord(x0, width, ts.wrapU);
+            int32_t xb = WrapCoord(x0 + 1, width, ts.wrapU);
+            int32_t ya = WrapCoord(y0, height, ts.wrapV);
+            int32_t yb = WrapCoord(y0 + 1, height, ts.wrapV);
+            float t00[4], t10[4], t01[4], t11[4];
+            UnpackTexel(image[ya * width + xa], t00);
+            UnpackTexel(image[ya * width + xb], t10);
+            UnpackTexel(image[yb * width + xa], t01);
+            UnpackTexel(image[yb * width + xb], t11);
+            for (uint32_t c = 0; c < 4; c++) {
+                float top = t00[c] + (t10[c] - t00[c]) * fx;
+                float bottom = t01[c] + (t11[c] - t01[c]) * fx;
+                texel[c] = top + (bottom - top) * fy;
+            }
+        }
+        else {
+            int32_t x = static_cast<int32_t>(std::max(std::min(std::floor(u[lane]), 1e9f), -1e9f));
+            int32_t y = static_cast<int32_t>(std::max(std::min(std::floor(v[lane]), 1e9f), -1e9f));
+            UnpackTexel(image[WrapCoord(y, height, ts.wrapV) * width + WrapCoord(x, width, ts.wrapU)], texel);
+        }
+        for (uint32_t c = 0; c < 4; c++) {
+            result[c][lane] = texel[c];
+        }
+    }
+    for (uint32_t c = 0; c < 4; c++) {
+        out[c] = F4::Load(result[c]);
+    }
+}
+
+// Samples a 2D texture, or the first face or slice of other textures
+void Sample2D(const Texture* tex, const TextureStage& ts, F4 s, F4 t, F4* out) {
+    const uint32_t* image = (tex != nullptr && !tex->texels.empty()) ? tex->Level(0, 0) : nullptr;
+    const uint32_t* images[4] = { image, image, image, image };
+    SampleQuad(image != nullptr ? tex : nullptr, ts, images, s, t, out);
+}
+
+// Samples a volume texture, selecting the nearest slice
+void Sample3D(const Texture* tex, const TextureStage& ts, F4 s, F4 t, F4 r, F4* out) {
+    if (tex == nullptr || tex->texels.empty() || tex->depth <= 1) {
+        Sample2D(tex, ts, s, t, out);
+        return;
+    }
+    alignas(16) float slices[4];
+    r.Store(slices);
+    const uint32_t* images[4];
+    const size_t sliceSize = static_cast<size_t>(tex->width) * tex->height;
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        float z = ts.normalized ? slices[lane] * tex->depth : slices[lane];
+        int32_t slice = std::isfinite(z) ? static_cast<int32_t>(std::max(std::min(std::floor(z), 1e9f), -1e9f)) : 0;
+        slice = WrapCoord(slice, static_cast<int32_t>(tex->depth), ts.wrapU);
+        images[lane] = tex->Level(0, 0) + slice * sliceSize;
+    }
+    SampleQuad(tex, ts, images, s, t, out);
+}
+
+// Samples a cube map in the direction (s, t, r). Faces are stored in the
+// order +X, -X, +Y, -Y, +Z, -Z.
+void SampleCube(const Texture* tex, const TextureStage& ts, F4 s, F4 t, F4 r, F4* out) {
+    if (tex == nullptr || tex->texels.empty() || tex->faces < 6) {
+        Sample2D(tex, ts, s, t, out);
+        return;
+    }
+    alignas(16) float x[4], y[4], z[4], u[4], v[4];
+    s.Store(x);
+    t.Store(y);
+    r.Store(z);
+    const uint32_t* images[4];
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        float ax = std::fabs(x[lane]), ay = std::fabs(y[lane]), az = std::fabs(z[lane]);
+        uint32_t face;
+        float sc, tc, ma;
+        if (ax >= ay && ax >= az) {
+            face = (x[lane] >= 0.0f) ? 0 : 1;
+            sc = (x[lane] >= 0.0f) ? -z[lane] : z[lane];
+            tc = -y[lane];
+            ma = ax;
+        }
+        else if (ay >= az) {
+            face = (y[lane] >= 0.0f) ? 2 : 3;
+            sc = x[lane];
+            tc = (y[lane] >= 0.0f) ? z[lane] : -z[lane];
+            ma = ay;
+        }
+        else {
+            face = (z[lane] >= 0.0f) ? 4 : 5;
+            sc = (z[lane] >= 0.0f) ? x[lane] : -x[lane];
+            tc = -y[lane];
+            ma = az;
+        }
+        float inv = (ma > 0.0f) ? 0.5f / ma : 0.0f;
+        u[lane] = sc * inv + 0.5f;
+        v[lane] = tc * inv + 0.5f;
+        images[lane] = tex->Level(face, 0);
+    }
+    TextureStage cube = ts;
+    cube.normalized = true;
+    SampleQuad(tex, cube, images, F4::Load(u), F4::Load(v), out);
+}
+
+inline F4 SafeReciprocal(F4 q) {
+    const F4 zero = F4::Splat(0.0f);
+    return F4::Select(q == zero, F4::Splat(1.0f), F4::Splat(1.0f) / q);
+}
+
+// Converts a color channel holding a signed 8-bit value to [-1, 1]
+inline F4 SignedChannel(F4 x) {
+    F4 byte = x * F4::Splat(255.0f);
+    byte = F4::Select(byte >= F4::Splat(127.5f), byte - F4::Splat(256.0f), byte);
+    return byte * F4::Splat(1.0f / 127.0f);
+}
+
+// Dot product of the texture coordinates with the color of the input stage
+inline F4 TexCoordDot(const TextureStage& ts, uint32_t stage, const PixelQuad& in, const Registers& regs) {
+    const F4* color = regs.r[kReg_Texture0 + ts.input];
+    F4 result = F4::Splat(0.0f);
+    for (uint32_t c = 0; c < 3; c++) {
+        F4 value = ts.expandDot ? color[c] * F4::Splat(2.0f) - F4::Splat(1.0f) : color[c];
+        result = result + in.texCoords[stage][c] * value;
+    }
+    return result;
+}
+
+template <uint32_t Mode>
+void ShadeTexture(const TextureStage& ts, uint32_t stage, const CombinerConstants& k, const Texture* tex, const PixelQuad& in, Registers& regs, uint32_t& mask) {
+    F4* out = regs.r[kReg_Texture0 + stage];
+    const F4* tc = in.texCoords[stage];
+    const F4 zero = F4::Splat(0.0f);
+
+    if constexpr (Mode == TextureMode_Project2D) {
+        F4 invQ = SafeReciprocal(tc[3]);
+        Sample2D(tex, ts, tc[0] * invQ, tc[1] * invQ, out);
+    }
+    else if constexpr (Mode == TextureMode_Project3D) {
+        F4 invQ = SafeReciprocal(tc[3]);
+        Sample3D(tex, ts, tc[0] * invQ, tc[1] * invQ, tc[2] * invQ, out);
+    }
+    else if constexpr (Mode == TextureMode_CubeMap) {
+        SampleCube(tex, ts, tc[0], tc[1], tc[2], out);
+    }
+    else if constexpr (Mode == TextureMode_PassThrough) {
+        for (uint32_t c = 0; c < 4; c++) {
+            out[c] = simd::Clamp(tc[c], zero, F4::Splat(1.0f));
+        }
+    }
+    else if constexpr (Mode == TextureMode_ClipPlane) {
+        // Each coordinate discards pixels where it is negative, or where it
+        // is not negative if its mode bit is set
+        for (uint32_t c = 0; c < 4; c++) {
+            M4 negative = tc[c] < zero;
+            uint32_t negativeBits = negative.Bits();
+            mask &= (ts.clipMode & (1 << c)) ? negativeBits : ~negativeBits;
+            out[c] = zero;
+        }
+    }
+    else if constexpr (Mode == TextureMode_BumpEnvMap || Mode == TextureMode_BumpEnvMapLuminance) {
+        // The input texture holds signed offsets: du in blue, dv in green
+        const F4* bump = regs.r[kReg_Texture0 + ts.input];
+        F4 du = SignedChannel(bump[2]);
+        F4 dv = SignedChannel(bump[1]);
+        const float* m = k.bumpEnvMatrix[stage];
+        F4 s = tc[0] + du * F4::Splat(m[0]) + dv * F4::Splat(m[2]);
+        F4 t = tc[1] + du * F4::Splat(m[1]) + dv * F4::Splat(m[3]);
+        Sample2D(tex, ts, s, t, out);
+        if constexpr (Mode == TextureMode_BumpEnvMapLuminance) {
+            F4 luminance = simd::Clamp(bump[0] * F4::Splat(k.bumpEnvScale[stage]) + F4::Splat(k.bumpEnvOffset[stage]), zero, F4::Splat(1.0f));
+            for (uint32_t c = 0; c < 3; c++) {
+                out[c] = out[c] * luminance;
+            }
+        }
+    }
+    else if constexpr (Mode == TextureMode_DependentAR) {
+        const F4* source = regs.r[kReg_Texture0 + ts.input];
+        TextureStage normalized = ts;
+        normalized.normalized = true;
+        Sample2D(tex, normalized, source[3], source[0], out);
+    }
+    else if constexpr (Mode == TextureMode_DependentGB) {
+        const F4* source = regs.r[kReg_Texture0 + ts.input];
+        TextureStage normalized = ts;
+        normalized.normalized = true;
+        Sample2D(tex, normalized, source[1], source[2], out);
+    }
+    else if constexpr (Mode == TextureMode_DotProduct) {
+        regs.dot[stage] = TexCoordDot(ts, stage, in, regs);
+        for (uint32_t c = 0; c < 4; c++) out[c] = zero;
+    }
+    else if constexpr (Mode == TextureMode_DotST) {
+        F4 t = TexCoordDot(ts, stage, in, regs);
+        Sample2D(tex, ts, regs.dot[stage - 1], t, out);
+    }
+    else if constexpr (Mode == TextureMode_DotSTR3D || Mode == TextureMode_DotSTRCube) {
+        F4 r = TexCoordDot(ts, stage, in, regs);
+        if constexpr (Mode == TextureMode_DotSTR3D) {
+            Sample3D(tex, ts, regs.dot[stage - 2], regs.dot[stage - 1], r, out);
+        }
+        else {
+            SampleCube(tex, ts, regs.dot[stage - 2], regs.dot[stage - 1], r, out);
+        }
+    }
+    else {
+        for (uint32_t c = 0; c < 4; c++) out[c] = zero;
+    }
+}
+
+// Returns the function implementing a texture shader mode, or null if the
+// mode is not supported at the given stage
+TextureFn GetTextureFn(uint32_t mode, uint32_t stage) {
+    switch (mode) {
+    case TextureMode_None: return &ShadeTexture<TextureMode_None>;
+    case TextureMode_Project2D: return &ShadeTexture<TextureMode_Project2D>;
+    case TextureMode_Project3D: return &ShadeTexture<TextureMode_Project3D>;
+    case TextureMode_CubeMap: return &ShadeTexture<TextureMode_CubeMap>;
+    case TextureMode_PassThrough: return &ShadeTexture<TextureMode_PassThrough>;
+    case TextureMode_ClipPlane: return &ShadeTexture<TextureMode_ClipPlane>;
+    case TextureMode_BumpEnvMap: return (stage >= 1) ? &ShadeTexture<TextureMode_BumpEnvMap> : nullptr;
+    case TextureMode_BumpEnvMapLuminance: return (stage >= 1) ? &ShadeTexture<TextureMode_BumpEnvMapLuminance> : nullptr;
+    case TextureMode_DependentAR: return (stage >= 1) ? &ShadeTexture<TextureMode_DependentAR> : nullptr;
+    case TextureMode_DependentGB: return (stage >= 1) ? &ShadeTexture<TextureMode_DependentGB> : nullptr;
+    case TextureMode_DotProduct: return (stage >= 1) ? &ShadeTexture<TextureMode_DotProduct> : nullptr;
+    case TextureMode_DotST: return (stage >= 2) ? &ShadeTexture<TextureMode_DotST> : nullptr;
+    case TextureMode_DotSTR3D: return (stage >= 3) ? &ShadeTexture<TextureMode_DotSTR3D> : nullptr;
+    case TextureMode_DotSTRCube: return (stage >= 3) ? &ShadeTexture<TextureMode_DotSTRCube> : nullptr;
+    default: return nullptr;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Fog
+
+typedef F4 (*FogFn)(const CombinerConstants& k, F4 coord);
+
+// Applies a scalar function to each lane
+template <typename Fn>
+inline F4 PerLane(F4 x, Fn&& fn) {
+    alignas(16) float lanes[4];
+    x.Store(lanes);
+    for (uint32_t lane = 0; lane < 4; lane++) {
+        lanes[lane] = fn(lanes[lane]);
+    }
+    return F4::Load(lanes);
+}
+
+// Computes the fog factor from the fog coordinate. FOG_PARAMS hold a bias
+// and a scale prepared by the driver for the fog mode.
+template <uint32_t Mode>
+F4 FogFactor(const CombinerConstants& k, F4 coord) {
+    const F4 bias = F4::Splat(k.fogParams[0]);
+    const F4 scale = F4::Splat(k.fogParams[1]);
+    if constexpr (Mode == kFogMode_LinearAbs || Mode == kFogMode_ExpAbs || Mode == kFogMode_Exp2Abs) {
+        coord = Abs(coord);
+    }
+    F4 factor;
+    if constexpr (Mode == kFogMode_Exp || Mode == kFogMode_ExpAbs) {
+        factor = bias + PerLane(coord * scale * F4::Splat(16.0f), [](float x) { return std::exp2(x); }) - F4::Splat(1.5f);
+    }
+    else if constexpr (Mode == kFogMode_Exp2 || Mode == kFogMode_Exp2Abs) {
+        F4 scaled = coord * scale;
+        factor = bias + PerLane(scaled * scaled * F4::Splat(-32.0f), [](float x) { return std::exp2(x); }) - F4::Splat(1.5f);
+    }
+    else {
+        factor = bias + coord * scale;
+    }
+    return simd::Clamp(factor, F4::Splat(0.0f), F4::Splat(1.0f));
+}
+
+FogFn GetFogFn(uint32_t mode) {
+    switch (mode) {
+    case kFogMode_Exp: return &FogFactor<kFogMode_Exp>;
+    case kFogMode_Exp2: return &FogFactor<kFogMode_Exp2>;
+    case kFogMode_ExpAbs: return &FogFactor<kFogMode_ExpAbs>;
+    case kFogMode_Exp2Abs: return &FogFactor<kFogMode_Exp2Abs>;
+    case kFogMode_LinearAbs: return &FogFactor<kFogMode_LinearAbs>;
+    default: return &FogFactor<kFogMode_Linear>;
+    }
+}
+
+}
+
+// ----------------------------------------------------------------------------
+// Kernels
+
+typedef uint32_t (*ShadeFn)(const CombinerKernel::Program& p, const CombinerConstants& k, const Texture* const* textures, const PixelQuad& in, F4* out);
+
+struct CombinerKernel::Program {
+    ShadeFn shade;
+    GeneralStage stages[kCombinerStageCount];
+    FinalStage final;
+    TextureStage textures[kKelvinTextureCount];
+    uint32_t textureMask;   // Stages with a texture shader mode other than none
+    FogFn fog;
+    bool muxMSB;
+    bool factor0PerStage;
+    bool factor1PerStage;
+};
+
+namespace {
+
+inline void SetConstant(Registers& regs, uint32_t reg, const float* color) {
+    for (uint32_t c = 0; c < 4; c++) {
+        regs.r[reg][c] = F4::Splat(color[c]);
+    }
+}
+
+void RunStage(const CombinerKernel::Program& p, const GeneralStage& stage, uint32_t index, const CombinerConstants& k, Registers& regs) {
+    SetConstant(regs, kReg_Constant0, k.factor0[p.factor0PerStage ? index : 0]);
+    SetConstant(regs, kReg_Constant1, k.factor1[p.factor1PerStage ? index : 0]);
+
+    // The mux picks CD where the most or least significant bit of the
+    // spare0 alpha is set
+    M4 muxCD;
+    if (p.muxMSB) {
+        muxCD = regs.r[kReg_Spare0][3] >= F4::Splat(0.5f);
+    }
+    else {
+        alignas(16) float alpha[4];
+        regs.r[kReg_Spare0][3].Store(alpha);
+        uint32_t bits = 0;
+        for (uint32_t lane = 0; lane < 4; lane++) {
+            if (static_cast<int32_t>(std::nearbyint(std::max(alpha[lane], 0.0f) * 255.0f)) & 1) {
+                bits |= 1 << lane;
+            }
+        }
+        muxCD = M4::FromBits(bits);
+    }
+
+    // Both portions read their inputs before any register is written
+    F4 rgbAB[3], rgbCD[3], rgbSum[3];
+    F4 alphaAB, alphaCD, alphaSum;
+    stage.rgb.combine(stage.rgb, regs, muxCD, rgbAB, rgbCD, rgbSum);
+    stage.alpha.combine(stage.alpha, regs, muxCD, &alphaAB, &alphaCD, &alphaSum);
+
+    auto writeRGB = [&](uint32_t dst, const F4* value) {
+        if (dst != kReg_Zero) {
+            for (uint32_t c = 0; c < 3; c++) regs.r[dst][c] = value[c];
+        }
+    };
+    auto writeAlpha = [&](uint32_t dst, F4 value) {
+        if (dst != kReg_Zero) {
+            regs.r[dst][3] = value;
+        }
+    };
+    writeRGB(stage.rgb.abDst, rgbAB);
+    writeRGB(stage.rgb.cdDst, rgbCD);
+    writeRGB(stage.rgb.sumDst, rgbSum);
+    writeAlpha(stage.alpha.abDst, alphaAB);
+    writeAlpha(stage.alpha.cdDst, alphaCD);
+    writeAlpha(stage.alpha.sumDst, alphaSum);
+    if (stage.abBlueToAlpha) {
+        writeAlpha(stage.rgb.abDst, rgbAB[2]);
+    }
+    if (stage.cdBlueToAlpha) {
+        writeAlpha(stage.rgb.cdDst, rgbCD[2]);
+    }
+}
+
+void RunFinal(const FinalStage& final, const CombinerConstants& k, Registers& regs, F4* out) {
+    const F4 zero = F4::Splat(0.0f);
+    const F4 one = F4::Splat(1.0f);
+    SetConstant(regs, kReg_Constant0, k.specularFog[0]);
+    SetConstant(regs, kReg_Constant1, k.specularFog[1]);
+
+    // Spare0 plus specular, each optionally complemented
+    for (uint32_t c = 0; c < 3; c++) {
+        F4 spare0 = simd::Clamp(regs.r[kReg_Spare0][c], zero, one);
+        F4 specular = simd::Clamp(regs.r[kReg_Specular][c], zero, one);
+        if (final.invertSpare0) spare0 = one - spare0;
+        if (final.invertSpecular) specular = one - specular;
+        F4 sum = spare0 + specular;
+        regs.r[kReg_SpecularSum][c] = final.clampSum ? Min(sum, one) : sum;
+    }
+    regs.r[kReg_SpecularSum][3] = zero;
+
+    F4 e[3], f[3];
+    final.inputs[4].fetch(regs, final.inputs[4].reg, e);
+    final.inputs[5].fetch(regs, final.inputs[5].reg, f);
+    for (uint32_t c = 0; c < 3; c++) {
+        regs.r[kReg_EFProduct][c] = e[c] * f[c];
+    }
+    regs.r[kReg_EFProduct][3] = zero;
+
+    // A * B + (1 - A) * C + D
+    F4 a[3], b[3], c[3], d[3];
+    final.inputs[0].fetch(regs, final.inputs[0].reg, a);
+    final.inputs[1].fetch(regs, final.inputs[1].reg, b);
+    final.inputs[2].fetch(regs, final.inputs[2].reg, c);
+    final.inputs[3].fetch(regs, final.inputs[3].reg, d);
+    for (uint32_t i = 0; i < 3; i++) {
+        out[i] = simd::Clamp(a[i] * b[i] + (one - a[i]) * c[i] + d[i], zero, one);
+    }
+    final.g.fetch(regs, final.g.reg, &out[3]);
+    out[3] = simd::Clamp(out[3], zero, one);
+}
+
+// Shades a quad with the given number of general combiner stages
+template <uint32_t StageCount>
+uint32_t ShadeQuad(const CombinerKernel::Program& p, const CombinerConstants& k, const Texture* const* textures, const PixelQuad& in, F4* out) {
+    const F4 zero = F4::Splat(0.0f);
+    Registers regs;
+    for (uint32_t reg = 0; reg < kRegCount; reg++) {
+        for (uint32_t c = 0; c < 4; c++) {
+            regs.r[reg][c] = zero;
+        }
+    }
+    for (uint32_t c = 0; c < 4; c++) {
+        regs.r[kReg_Diffuse][c] = in.diffuse[c];
+        regs.r[kReg_Specular][c] = in.specular[c];
+    }
+    for (uint32_t c = 0; c < 3; c++) {
+        regs.r[kReg_Fog][c] = F4::Splat(k.fogColor[c]);
+    }
+    regs.r[kReg_Fog][3] = p.fog(k, in.fog);
+
+    uint32_t mask = 0xf;
+    for (uint32_t stage = 0; stage < kKelvinTextureCount; stage++) {
+        if (p.textureMask & (1 << stage)) {
+            p.textures[stage].fn(p.textures[stage], stage, k, textures[stage], in, regs, mask);
+        }
+    }
+
+    // The alpha of spare0 starts out as the alpha of texture 0
+    regs.r[kReg_Spare0][3] = regs.r[kReg_Texture0][3];
+
+    for (uint32_t i = 0; i < StageCount; i++) {
+        if (p.stages[i].active) {
+            RunStage(p, p.stages[i], i, k, regs);
+        }
+    }
+    RunFinal(p.final, k, regs, out);
+    return mask;
+}
+
+template <uint32_t... Counts>
+constexpr std::array<ShadeFn, sizeof...(Counts)> MakeShadeTable(std::integer_sequence<uint32_t, Counts...>) {
+    return { { &ShadeQuad<Counts>... } };
+}
+
+// Shading loops indexed by the number of general combiner stages
+const std::array<ShadeFn, kCombinerStageCount + 1> kShadeVariants = MakeShadeTable(std::make_integer_sequence<uint32_t, kCombinerStageCount + 1>{});
+
+// Registers read by an operand, as a mask
+inline uint32_t OperandRegs(const Operand& op) {
+    return 1 << op.reg;
+}
+
+}
+
+CombinerKernel::CombinerKernel(const CombinerKey& key)
+    : m_program(std::make_unique<Program>())
+{
+    Program& p = *m_program;
+
+    // SET_COMBINER_CONTROL: bits 7..0 = stage count, bit 8 = mux select (1 = MSB),
+    //   bit 12 = factor 0 per stage, bit 16 = factor 1 per stage
+    uint32_t stageCount = std::min<uint32_t>(key.control & 0xff, kCombinerStageCount);
+    p.shade = kShadeVariants[stageCount];
+    p.muxMSB = (key.control & (1 << 8)) != 0;
+    p.factor0PerStage = (key.control & (1 << 12)) != 0;
+    p.factor1PerStage = (key.control & (1 << 16)) != 0;
+    p.fog = GetFogFn(key.fogMode);
+
+    uint32_t readRegs = 0;
+    for (uint32_t i = 0; i < stageCount; i++) {
+        GeneralStage& stage = p.stages[i];
+        stage.rgb = DecodePortion(key.colorICW[i], key.colorOCW[i], false);
+        stage.alpha = DecodePortion(key.alphaICW[i], key.alphaOCW[i], true);
+        stage.abBlueToAlpha = (key.colorOCW[i] & (1 << 19)) != 0;
+        stage.cdBlueToAlpha = (key.colorOCW[i] & (1 << 18)) != 0;
+        stage.active = (key.colorOCW[i] & 0xfff) != 0 || (key.alphaOCW[i] & 0xfff) != 0;
+        if (stage.active) {
+            for (uint32_t j = 0; j < 4; j++) {
+                readRegs |= OperandRegs(stage.rgb.inputs[j]) | OperandRegs(stage.alpha.inputs[j]);
+            }
+        }
+    }
+
+    // Final combiner: SPECULAR_FOG_CW0 holds A, B, C and D; SPECULAR_FOG_CW1
+    // holds E, F and G, followed by bit 5 = complement spare0, bit 6 =
+    // complement specular and bit 7 = clamp the sum
+    FinalStage& final = p.final;
+    for (uint32_t i = 0; i < 4; i++) {
+        final.inputs[i] = DecodeOperand(key.finalCW0 >> (24 - i * 8), false);
+    }
+    final.inputs[4] = DecodeOperand(key.finalCW1 >> 24, false);
+    final.inputs[5] = DecodeOperand(key.finalCW1 >> 16, false);
+    final.g = DecodeOperand(key.finalCW1 >> 8, true);
+    final.invertSpare0 = (key.finalCW1 & (1 << 5)) != 0;
+    final.invertSpecular = (key.finalCW1 & (1 << 6)) != 0;
+    final.clampSum = (key.finalCW1 & (1 << 7)) != 0;
+    for (uint32_t i = 0; i < 6; i++) {
+        readRegs |= OperandRegs(final.inputs[i]);
+    }
+    readRegs |= OperandRegs(final.g);
+    if (readRegs & (1 << kReg_SpecularSum)) {
+        readRegs |= 1 << kReg_Specular;
+    }
+
+    // SET_SHADER_STAGE_PROGRAM: 5 bits per stage
+    // SET_SHADER_OTHER_STAGE_INPUT: input of stage 2 in bits 19..16 and of stage 3 in bits 23..20
+    // SET_DOT_RGBMAPPING: 4 bits per stage; non-zero values map colors to [-1, 1]
+    // SET_TEXTURE_ADDRESS: bits 3..0 = U mode, bits 11..8 = V mode
+    // SET_TEXTURE_FILTER: bits 27..24 = magnification filter (1 = nearest)
+    p.textureMask = 0;
+    for (uint32_t stage = 0; stage < kKelvinTextureCount; stage++) {
+        TextureStage& ts = p.textures[stage];
+        uint32_t mode = (key.shaderProgram >> (stage * 5)) & 0x1f;
+        ts.fn = GetTextureFn(mode, stage);
+        if (ts.fn == nullptr) {
+            log_warning("[NV2A] PGRAPH: Unsupported texture shader mode 0x%x on stage %u\n", mode, stage);
+            ts.fn = &ShadeTexture<TextureMode_None>;
+        }
+        if (mode != TextureMode_None) {
+            p.textureMask |= 1 << stage;
+            m_inputMask |= CombinerInput_TexCoord0 << stage;
+        }
+        if (mode == TextureMode_ClipPlane) {
+            m_canDiscard = true;
+        }
+        switch (stage) {
+        case 2: ts.input = (key.otherStageInput >> 16) & 3; break;
+        case 3: ts.input = (key.otherStageInput >> 20) & 3; break;
+        default: ts.input = 0; break;
+        }
+        ts.input = std::min<uint8_t>(ts.input, stage > 0 ? stage - 1 : 0);
+        ts.wrapU = key.textureAddress[stage] & 0xf;
+        ts.wrapV = (key.textureAddress[stage] >> 8) & 0xf;
+        ts.bilinear = ((key.textureFilter[stage] >> 24) & 0xf) != 1;
+        ts.normalized = (key.normalizedCoords & (1 << stage)) != 0;
+        ts.clipMode = (key.clipPlaneMode >> (stage * 4)) & 0xf;
+        ts.expandDot = ((key.dotMapping >> (stage * 4)) & 0xf) != 0;
+    }
+
+    if (readRegs & (1 << kReg_Diffuse)) m_inputMask |= CombinerInput_Diffuse;
+    if (readRegs & (1 << kReg_Specular)) m_inputMask |= CombinerInput_Specular;
+    if (readRegs & (1 << kReg_Fog)) m_inputMask |= CombinerInput_Fog;
+}
+
+CombinerKernel::~CombinerKernel() {}
+
+uint32_t CombinerKernel::Shade(const CombinerConstants& constants, const Texture* const* textures, const PixelQuad& in, F4 out[4]) const {
+    return m_program->shade(*m_program, constants, textures, in, out);
+}
+
+// ----------------------------------------------------------------------------
+// Cache
+
+std::shared_ptr<const CombinerKernel> CombinerCache::Lookup(const CombinerKey& key) {
+    uint64_t hash = HashMemory(&key, sizeof(key));
+    auto range = m_entries.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        Entry& entry = *it->second;
+        if (entry.key == key) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            m_stats.hits++;
+            return entry.kernel;
+        }
+    }
+    m_stats.misses++;
+
+    auto kernel = std::make_shared<const CombinerKernel>(key);
+    m_lru.push_front(Entry{ hash, key, kernel });
+    m_entries.emplace(hash, m_lru.begin());
+    m_stats.entries++;
+
+    while (m_stats.entries > m_capacity) {
+        auto last = std::prev(m_lru.end());
+        auto victims = m_entries.equal_range(last->hash);
+        for (auto it = victims.first; it != victims.second; ++it) {
+            if (it->second == last) {
+                m_entries.erase(it);
+                break;
+            }
+        }
+        m_lru.pop_back();
+        m_stats.entries--;
+    }
+    return kernel;
+}
+
+void CombinerCache::Clear() {
+    m_entries.clear();
+    m_lru.clear();
+    m_stats.entries = 0;
+}
+
+}
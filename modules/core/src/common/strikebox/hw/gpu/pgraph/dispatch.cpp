@@ -0,0 +1,771 @@
+// StrikeBox NV2A PGRAPH method dispatcher
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+#include "strikebox/hw/gpu/pgraph/dispatch.h"
+#include "strikebox/hw/gpu/state.h"
+
+#include "strikebox/log.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <unordered_map>
+
+namespace strikebox::nv2a {
+
+// Indexed draws spanning up to this many indices map indices to transformed
+// vertices with a table; wider ranges use a hash map
+static const uint32_t kMaxIndexSlotTableSize = 1 << 20;
+
+// Methods of unsupported object classes are dropped
+static uint32_t UnknownClassMethod(MethodDispatcher&, const MethodEntry& entry, uint32_t method, const uint32_t*, uint32_t count, bool increasing) {
+    uint32_t n = increasing ? std::min<uint32_t>(count, entry.runLength) : count;
+    log_spew("[NV2A] PGRAPH: Dropping %u %s method(s) starting at 0x%x\n", n, increasing ? "increasing" : "non-increasing", method << 2);
+    return n;
+}
+
+static constexpr MethodTable kUnknownClassMethodTable = MethodTableBuilder(UnknownClassMethod).Finish();
+
+const MethodTable& GetUnknownClassMethodTable() {
+    return kUnknownClassMethodTable;
+}
+
+// ----------------------------------------------------------------------------
+
+MethodDispatcher::MethodDispatcher(NV2A& nv2a)
+    : m_nv2a(nv2a)
+    , m_renderer(CreateSoftwareRenderer())
+    , m_surfaceCache(nv2a)
+{
+    m_textureCache.SetGuestMemory(nv2a.guestMemory);
+    if (nv2a.guestMemory != nullptr && nv2a.guestMemory->TracksCPUWrites()) {
+        m_memoryView = nv2a.guestMemory->Subscribe();
+        if (m_memoryView >= 0) {
+            m_memory = nv2a.guestMemory;
+            m_surfaceCache.SetGuestMemoryView(m_memoryView);
+        }
+    }
+    Reset();
+}
+
+MethodDispatcher::~MethodDispatcher() {
+    if (m_memory != nullptr) {
+        m_memory->Unsubscribe(m_memoryView);
+    }
+}
+
+void MethodDispatcher::Reset() {
+    CompleteRendering();
+    m_surfaceCache.Clear();
+    m_colorSurface = m_zetaSurface = nullptr;
+
+    std::fill(std::begin(m_tables), std::end(m_tables), &GetUnknownClassMethodTable());
+    std::fill(std::begin(m_classes), std::end(m_classes), 0);
+
+    std::memset(&m_state, 0, sizeof(m_state));
+    m_state.dirty = KelvinDirty_All;
+    for (auto& attr : m_state.attributes) {
+        attr[3] = 1.0f;
+    }
+
+    m_batch.primitive = KelvinPrimitive::End;
+    m_batch.Clear();
+
+    m_rasterState = RasterState();
+    m_textureCache.Clear();
+    m_programCache.Clear();
+    m_vertexProgram.reset();
+}
+
+void MethodDispatcher::SetRenderer(std::unique_ptr<Renderer> renderer) {
+    CompleteRendering();
+    m_renderer = std::move(renderer);
+    m_state.dirty |= KelvinDirty_Surface;
+}
+
+void MethodDispatcher::BindObject(uint32_t subchannel, uint32_t instance) {
+    // [https://envytools.readthedocs.io/en/latest/hw/graph/intro.html#graph-objects]
+    // The object class is in the low bits of the first word of the object
+    uint8_t* obj = m_nv2a.pramin.GetMemoryPointer(instance << 4);
+    uint32_t objClass = (obj != nullptr) ? (*reinterpret_cast<uint32_t*>(obj) & 0xff) : 0;
+
+    subchannel &= kNumSubchannels - 1;
+    m_classes[subchannel] = objClass;
+    switch (objClass) {
+    case kKelvinClass:
+        m_tables[subchannel] = &GetKelvinMethodTable();
+        break;
+    default:
+        log_spew("[NV2A] PGRAPH: Unsupported object class 0x%x bound to subchannel %u\n", objClass, subchannel);
+        m_tables[subchannel] = &GetUnknownClassMethodTable();
+        break;
+    }
+}
+
+uint8_t* MethodDispatcher::GetDMAPointer(uint32_t instance, uint32_t offset, uint32_t size) {
+    uint32_t address;
+    if (!GetDMAAddress(instance, offset, size, address)) {
+        return nullptr;
+    }
+    return &m_nv2a.systemRAM[address];
+}
+
+bool MethodDispatcher::GetDMAAddress(uint32_t instance, uint32_t offset, uint32_t size, uint32_t& address) {
+    DMAObject* dmaObj = m_nv2a.GetDMAObject(instance << 4);
+    if (dmaObj == nullptr) {
+        log_warning("[NV2A] PGRAPH: Invalid DMA object instance 0x%x\n", instance);
+        return false;
+    }
+    uint64_t end = static_cast<uint64_t>(offset) + size;
+    if (end > static_cast<uint64_t>(dmaObj->limit) + 1) {
+        log_warning("[NV2A] PGRAPH: DMA access out of bounds: offset 0x%x, size %u, limit 0x%x\n", offset, size, dmaObj->limit);
+        return false;
+    }
+    uint64_t physAddress = static_cast<uint64_t>(dmaObj->GetAddress()) + offset;
+    if (physAddress + size > m_nv2a.systemRAMSize) {
+        log_warning("[NV2A] PGRAPH: DMA access outside system RAM: address 0x%llx, size %u\n", (unsigned long long)physAddress, size);
+        return false;
+    }
+    address = static_cast<uint32_t>(physAddress);
+    return true;
+}
+
+void MethodDispatcher::MarkGuestWrite(const uint8_t* pointer, uint32_t size) {
+    m_nv2a.MarkSystemRAMDirty(static_cast<uint32_t>(pointer - m_nv2a.systemRAM), size);
+}
+
+void MethodDispatcher::FlushRenderer() {
+    CompleteRendering();
+
+    // The CPU may read surfaces and modify textures once the GPU is idle
+    m_surfaceCache.WriteBackAll();
+    m_textureCache.BeginValidation();
+    m_state.dirty |= KelvinDirty_Textures;
+
+    // Likewise for surfaces. Rendering and write-backs are not recorded in
+    // the view of the surfaces, so every write it holds came from elsewhere.
+    m_collectPending = true;
+}
+
+void MethodDispatcher::CompleteRendering() {
+    m_renderer->Flush();
+    if (m_surfacesWritten) {
+        if (m_colorSurface != nullptr) {
+            m_surfaceCache.MarkRendered(m_colorSurface);
+        }
+        if (m_zetaSurface != nullptr) {
+            m_surfaceCache.MarkRendered(m_zetaSurface);
+        }
+        m_surfacesWritten = false;
+    }
+}
+
+void MethodDispatcher::CollectGuestWrites() {
+    m_collectPending = false;
+
+    // This is the synchronization point of guest RAM for the GPU: gather the
+    // CPU writes once for the surfaces here and for the texture cache
+    if (m_nv2a.guestMemory != nullptr) {
+        m_nv2a.guestMemory->Synchronize();
+    }
+
+    // Without write tracking, assume every surface was modified
+    const std::vector<uint64_t>* dirtyPages = nullptr;
+    if (m_memory != nullptr) {
+        m_memory->CollectDirty(m_memoryView, m_dirtyPages);
+        dirtyPages = &m_dirtyPages;
+    }
+    m_surfaceCache.InvalidateWrites(dirtyPages);
+
+    if (m_colorSurface != nullptr) {
+        m_surfaceCache.Refresh(m_colorSurface);
+    }
+    if (m_zetaSurface == nullptr) {
+        return;
+    }
+    if (m_surfaceCache.Refresh(m_zetaSurface) || (dirtyPages == nullptr && m_zetaSurface->copy.empty())) {
+        m_renderer->InvalidateZeta(0, m_zetaSurface->GetDataSize());
+        return;
+    }
+    if (dirtyPages == nullptr || !m_zetaSurface->copy.empty()) {
+        return;
+    }
+
+    // Notify runs of dirty pages overlapping a zeta buffer rendered in place
+    uint32_t address = m_zetaSurface->desc.address;
+    uint32_t end = address + m_zetaSurface->desc.size;
+    uint32_t page = address >> GuestMemory::kPageShift;
+    uint32_t lastPage = (end - 1) >> GuestMemory::kPageShift;
+    auto dirty = [&](uint32_t index) {
+        return GuestMemory::AnyPageDirty(m_dirtyPages, index << GuestMemory::kPageShift, GuestMemory::kPageSize);
+    };
+    while (page <= lastPage) {
+        if (!dirty(page)) {
+            page++;
+            continue;
+        }
+        uint32_t first = page;
+        while (page <= lastPage && dirty(page)) {
+            page++;
+        }
+        uint32_t start = std::max(address, first << GuestMemory::kPageShift);
+        uint32_t stop = std::min(end, page << GuestMemory::kPageShift);
+        m_renderer->InvalidateZeta(start - address, stop - start);
+    }
+}
+
+void MethodDispatcher::ResolveSurfaceWrites(uint32_t address, uint32_t size) {
+    auto overlaps = [&](const CachedSurface* surface) {
+        return surface != nullptr && surface->desc.Overlaps(address, size);
+    };
+    bool pending = m_surfacesWritten && (overlaps(m_colorSurface) || overlaps(m_zetaSurface));
+    if (pending) {
+        CompleteRendering();
+    }
+    if (m_surfaceCache.WriteBack(address, size) || pending) {
+        m_textureCache.BeginValidation();
+    }
+}
+
+void MethodDispatcher::EmitVertex() {
+    if (m_batch.primitive == KelvinPrimitive::End) {
+        log_spew("[NV2A] PGRAPH: Vertex emitted outside of SET_BEGIN_END\n");
+        return;
+    }
+    const float* attrs = &m_state.attributes[0][0];
+    m_batch.immediate.insert(m_batch.immediate.end(), attrs, attrs + kKelvinAttributeCount * 4);
+}
+
+void MethodDispatcher::BeginEnd(KelvinPrimitive primitive) {
+    if (primitive == KelvinPrimitive::End) {
+        if (m_batch.primitive != KelvinPrimitive::End) {
+            FlushBatch();
+        }
+        m_batch.primitive = KelvinPrimitive::End;
+        return;
+    }
+    if (primitive > KelvinPrimitive::Polygon) {
+        log_spew("[NV2A] PGRAPH: Invalid primitive %u\n", static_cast<uint32_t>(primitive));
+        return;
+    }
+    m_batch.primitive = primitive;
+    m_batch.Clear();
+}
+
+void MethodDispatcher::ClearSurface(uint32_t flags) {
+    UpdateRenderState();
+
+    uint32_t horizontal = m_state.Reg(Mthd_KELVIN_SET_CLEAR_RECT_HORIZONTAL);
+    uint32_t vertical = m_state.Reg(Mthd_KELVIN_SET_CLEAR_RECT_VERTICAL);
+    ClearParams params;
+    params.flags = flags;
+    params.color = m_state.Reg(Mthd_KELVIN_SET_COLOR_CLEAR_VALUE);
+    params.zstencil = m_state.Reg(Mthd_KELVIN_SET_ZSTENCIL_CLEAR_VALUE);
+    params.x1 = horizontal & 0xffff;
+    params.x2 = horizontal >> 16;
+    params.y1 = vertical & 0xffff;
+    params.y2 = vertical >> 16;
+    m_renderer->Clear(params);
+    m_surfacesWritten = true;
+}
+
+void MethodDispatcher::UpdateRenderState() {
+    // The pixel kernel depends on texture formats and modes, fog and clip
+    // plane modes, which are cleared by the blocks below
+    const uint32_t combinerDirty = KelvinDirty_Combiners | KelvinDirty_Textures | KelvinDirty_Fog | KelvinDirty_Rasterizer;
+    const bool updateCombiners = (m_state.dirty & combinerDirty) != 0;
+
+    if (m_state.dirty & KelvinDirty_Surface) {
+        UpdateSurfaces();
+        m_state.dirty &= ~KelvinDirty_Surface;
+    }
+    if (m_collectPending) {
+        CollectGuestWrites();
+    }
+    const uint32_t rasterDirty = KelvinDirty_Rasterizer | KelvinDirty_Blend | KelvinDirty_DepthStencil;
+    if (m_state.dirty & rasterDirty) {
+        UpdateRasterState();
+        m_state.dirty &= ~rasterDirty;
+    }
+    for (uint32_t stage = 0; stage < kKelvinTextureCount; stage++) {
+        if (m_state.dirty & (KelvinDirty_Texture0 << stage)) {
+            UpdateTexture(stage);
+            m_state.dirty &= ~(KelvinDirty_Texture0 << stage);
+        }
+    }
+    if (m_state.dirty & KelvinDirty_VertexArrays) {
+        DecodeVertexArrayLayout(m_state, m_arrayLayout);
+        m_state.dirty &= ~KelvinDirty_VertexArrays;
+    }
+    if (m_state.dirty & KelvinDirty_VertexProgram) {
+        UpdateVertexProgram();
+        m_state.dirty &= ~KelvinDirty_VertexProgram;
+    }
+    const uint32_t fixedFunctionDirty = KelvinDirty_Transform | KelvinDirty_Lighting | KelvinDirty_Fog;
+    if (m_state.dirty & fixedFunctionDirty) {
+        DecodeFixedFunctionState(m_state, m_fixedFunction);
+        m_state.dirty &= ~fixedFunctionDirty;
+    }
+    if (updateCombiners) {
+        UpdateCombiners();
+        m_state.dirty &= ~KelvinDirty_Combiners;
+    }
+}
+
+void MethodDispatcher::UpdateSurfaces() {
+    // Bound textures may alias the surfaces rendered so far
+    if (m_surfacesWritten) {
+        m_state.dirty |= KelvinDirty_Textures;
+    }
+    CompleteRendering();
+    m_colorSurface = m_zetaSurface = nullptr;
+
+    // SET_SURFACE_FORMAT: bits 3..0 = color format, bits 7..4 = zeta format, bits 11..8 = type,
+    //   bits 23..16 = log2 width and bits 31..24 = log2 height of swizzled surfaces
+    // SET_SURFACE_PITCH: bits 15..0 = color pitch, bits 31..16 = zeta pitch
+    // SET_SURFACE_CLIP_*: bits 15..0 = origin, bits 31..16 = size
+    uint32_t format = m_state.Reg(Mthd_KELVIN_SET_SURFACE_FORMAT);
+    uint32_t pitch = m_state.Reg(Mthd_KELVIN_SET_SURFACE_PITCH);
+    uint32_t horizontal = m_state.Reg(Mthd_KELVIN_SET_SURFACE_CLIP_HORIZONTAL);
+    uint32_t vertical = m_state.Reg(Mthd_KELVIN_SET_SURFACE_CLIP_VERTICAL);
+
+    SurfaceTarget target;
+    target.colorFormat = static_cast<SurfaceColorFormat>(format & 0xf);
+    target.zetaFormat = static_cast<SurfaceZetaFormat>((format >> 4) & 0xf);
+    target.clipX = horizontal & 0xffff;
+    target.clipWidth = horizontal >> 16;
+    target.clipY = vertical & 0xffff;
+    target.clipHeight = vertical >> 16;
+
+    SurfaceDesc color;
+    color.bytesPerPixel = GetColorFormatSize(target.colorFormat);
+    color.pitch = pitch & 0xffff;
+    SurfaceDesc zeta;
+    zeta.bytesPerPixel = GetZetaFormatSize(target.zetaFormat);
+    zeta.pitch = pitch >> 16;
+
+    SurfaceType type = static_cast<SurfaceType>((format >> 8) & 0xf);
+    if (type == SurfaceType::Swizzle) {
+        uint32_t widthShift = (format >> 16) & 0xff;
+        uint32_t heightShift = (format >> 24) & 0xff;
+        if (widthShift > 12 || heightShift > 12) {
+            log_warning("[NV2A] PGRAPH: Invalid swizzled surface size 2^%u x 2^%u\n", widthShift, heightShift);
+            m_renderer->SetSurfaces(SurfaceTarget());
+            return;
+        }
+        uint32_t width = 1 << widthShift;
+        uint32_t height = 1 << heightShift;
+        for (SurfaceDesc* desc : { &color, &zeta }) {
+            desc->swizzled = true;
+            desc->width = width;
+            desc->height = height;
+            desc->pitch = 0;
+            desc->size = width * height * desc->bytesPerPixel;
+        }
+        target.clipWidth = std::min(target.clipX + target.clipWidth, width) - std::min(target.clipX, width);
+        target.clipHeight = std::min(target.clipY + target.clipHeight, height) - std::min(target.clipY, height);
+    }
+    else {
+        uint32_t rows = target.clipY + target.clipHeight;
+        color.size = color.pitch * rows;
+        zeta.size = zeta.pitch * rows;
+    }
+    if (color.bytesPerPixel == 0) {
+        color.size = 0;
+    }
+    if (zeta.bytesPerPixel == 0) {
+        zeta.size = 0;
+    }
+
+    uint32_t colorDMA = m_state.Reg(Mthd_KELVIN_SET_CONTEXT_DMA_COLOR);
+    if (colorDMA != 0 && color.size != 0 && GetDMAAddress(colorDMA, m_state.Reg(Mthd_KELVIN_SET_SURFACE_COLOR_OFFSET), color.size, color.address)) {
+        color.tile = FindTileRegion(color.address, color.size);
+        m_colorSurface = m_surfaceCache.Acquire(color);
+        target.color = m_colorSurface->data;
+        target.colorPitch = m_colorSurface->pitch;
+    }
+    uint32_t zetaDMA = m_state.Reg(Mthd_KELVIN_SET_CONTEXT_DMA_ZETA);
+    if (zetaDMA != 0 && zeta.size != 0 && GetDMAAddress(zetaDMA, m_state.Reg(Mthd_KELVIN_SET_SURFACE_ZETA_OFFSET), zeta.size, zeta.address)) {
+        if (m_colorSurface != nullptr && m_colorSurface->desc.Overlaps(zeta.address, zeta.size)) {
+            log_warning("[NV2A] PGRAPH: Zeta surface at 0x%x overlaps the color surface; disabling it\n", zeta.address);
+        }
+        else {
+            zeta.tile = FindTileRegion(zeta.address, zeta.size);
+            m_zetaSurface = m_surfaceCache.Acquire(zeta);
+            target.zeta = m_zetaSurface->data;
+            target.zetaPitch = m_zetaSurface->pitch;
+
+            // Changes to the tile regions take effect on the next surface change
+            target.zetaCompressed = IsZetaCompressed(zeta.tile, target.zetaFormat);
+        }
+    }
+    m_renderer->SetSurfaces(target);
+}
+
+int32_t MethodDispatcher::FindTileRegion(uint32_t address, uint32_t size) const {
+    // [https://github.com/torvalds/linux/blob/master/drivers/gpu/drm/nouveau/nvkm/subdev/fb/nv20.c]
+    // TILE: bit 0 = valid, bits 31..14 = start address; TLIMIT: bits 31..14 = end address
+    const PGRAPH& pgraph = m_nv2a.pgraph;
+    uint64_t end = static_cast<uint64_t>(address) + size - 1;
+    for (uint32_t i = 0; i < kPGRAPH_NumTiles; i++) {
+        const PGRAPHTile& tile = pgraph.GetTile(i);
+        if (!(tile.address & Reg_PGRAPH_TILE_VALID)) {
+            continue;
+        }
+        uint32_t start = tile.address & ~0x3fff;
+        uint32_t limit = tile.limit | 0x3fff;
+        if (address >= start && end <= limit) {
+            return static_cast<int32_t>(i);
+        }
+    }
+    return -1;
+}
+
+bool MethodDispatcher::IsZetaCompressed(int32_t tile, SurfaceZetaFormat format) const {
+    // ZCOMP N applies to tile region N: bit 31 = enabled, bit 26 = Z24S8 (0 = Z16)
+    if (tile < 0 || static_cast<uint32_t>(tile) >= kPGRAPH_NumZCOMP) {
+        return false;
+    }
+    uint32_t zcomp = m_nv2a.pgraph.GetZComp(tile);
+    if (!(zcomp & Reg_PGRAPH_ZCOMP_ENABLE)) {
+        return false;
+    }
+    bool z24 = (zcomp & Reg_PGRAPH_ZCOMP_Z24S8) != 0;
+    return z24 == (format == SurfaceZetaFormat::Z24S8);
+}
+
+void MethodDispatcher::UpdateRasterState() {
+    RasterState& rs = m_rasterState;
+
+    rs.depthTest = m_state.Reg(Mthd_KELVIN_SET_DEPTH_TEST_ENABLE) != 0;
+    rs.depthWrite = m_state.Reg(Mthd_KELVIN_SET_DEPTH_MASK) != 0;
+    rs.depthFunc = static_cast<CompareFunc>(m_state.Reg(Mthd_KELVIN_SET_DEPTH_FUNC) & 7);
+
+    // SET_COLOR_MASK has one byte per channel in ARGB order
+    uint32_t colorMask = m_state.Reg(Mthd_KELVIN_SET_COLOR_MASK);
+    rs.colorMask = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+        if ((colorMask >> shift) & 0xff) {
+            rs.colorMask |= 0xff << shift;
+        }
+    }
+
+    // SET_CULL_FACE: 0x404 = front, 0x405 = back, 0x408 = front and back
+    // SET_FRONT_FACE: 0x900 = clockwise, 0x901 = counter-clockwise
+    rs.cullCW = rs.cullCCW = false;
+    if (m_state.Reg(Mthd_KELVIN_SET_CULL_FACE_ENABLE)) {
+        uint32_t cullFace = m_state.Reg(Mthd_KELVIN_SET_CULL_FACE);
+        bool frontCW = m_state.Reg(Mthd_KELVIN_SET_FRONT_FACE) == 0x900;
+        bool cullFront = cullFace == 0x404 || cullFace == 0x408;
+        bool cullBack = cullFace == 0x405 || cullFace == 0x408;
+        rs.cullCW = frontCW ? cullFront : cullBack;
+        rs.cullCCW = frontCW ? cullBack : cullFront;
+    }
+}
+
+void MethodDispatcher::UpdateTexture(uint32_t stage) {
+    const uint32_t base = stage * kKelvinTextureStride;
+    std::shared_ptr<const Texture>& texture = m_rasterState.textures[stage];
+    texture.reset();
+    if (!(m_state.Reg(Mthd_KELVIN_SET_TEXTURE_CONTROL0 + base) & Val_KELVIN_TEXTURE_CONTROL0_ENABLE)) {
+        return;
+    }
+
+    uint32_t format = m_state.Reg(Mthd_KELVIN_SET_TEXTURE_FORMAT + base);
+    TextureKey key;
+    key.format = (format >> 8) & 0xff;
+    const TextureFormatInfo& info = GetTextureFormatInfo(key.format);
+    if (info.bytesPerTexel == 0) {
+        log_spew("[NV2A] PGRAPH: Unsupported texture format 0x%x on stage %u\n", key.format, stage);
+        return;
+    }
+
+    // Compressed textures are sized like swizzled textures
+    key.swizzled = info.swizzled;
+    if (info.swizzled || info.compressed) {
+        key.width = 1 << ((format >> 20) & 0xf);
+        key.height = 1 << ((format >> 24) & 0xf);
+        key.depth = (((format >> 4) & 0xf) == Val_KELVIN_TEXTURE_FORMAT_DIMENSIONALITY_3D) ? 1 << (format >> 28) : 1;
+        key.levels = std::max<uint32_t>((format >> 16) & 0xf, 1);
+        key.cube = (format & Val_KELVIN_TEXTURE_FORMAT_CUBEMAP) != 0;
+    }
+    else {
+        // SET_TEXTURE_IMAGE_RECT: bits 15..0 = height, bits 31..16 = width
+        // SET_TEXTURE_CONTROL1: bits 31..16 = pitch
+        uint32_t rect = m_state.Reg(Mthd_KELVIN_SET_TEXTURE_IMAGE_RECT + base);
+        key.width = rect >> 16;
+        key.height = rect & 0xffff;
+        key.depth = 1;
+        key.levels = 1;
+        key.pitch = m_state.Reg(Mthd_KELVIN_SET_TEXTURE_CONTROL1 + base) >> 16;
+    }
+
+    uint32_t size = GetTextureSourceSize(key);
+    if (size == 0) {
+        log_spew("[NV2A] PGRAPH: Invalid texture on stage %u: format 0x%x, %ux%u, pitch %u\n", stage, key.format, key.width, key.height, key.pitch);
+        return;
+    }
+    uint32_t dma = ((format & 3) == Val_KELVIN_TEXTURE_FORMAT_CONTEXT_DMA_B)
+        ? m_state.Reg(Mthd_KELVIN_SET_CONTEXT_DMA_B)
+        : m_state.Reg(Mthd_KELVIN_SET_CONTEXT_DMA_A);
+    if (!GetDMAAddress(dma, m_state.Reg(Mthd_KELVIN_SET_TEXTURE_OFFSET + base), size, key.address)) {
+        return;
+    }
+
+    if (info.palettized) {
+        uint32_t palette = m_state.Reg(Mthd_KELVIN_SET_TEXTURE_PALETTE + base);
+        uint32_t paletteDMA = (palette & Val_KELVIN_TEXTURE_PALETTE_CONTEXT_DMA_B)
+            ? m_state.Reg(Mthd_KELVIN_SET_CONTEXT_DMA_B)
+            : m_state.Reg(Mthd_KELVIN_SET_CONTEXT_DMA_A);
+        key.paletteLength = 256 >> ((palette >> 2) & 3);
+        if (!GetDMAAddress(paletteDMA, palette & ~0x3f, key.paletteLength * sizeof(uint32_t), key.paletteAddress)) {
+            return;
+        }
+    }
+
+    ResolveSurfaceWrites(key.address, size);
+    texture = m_textureCache.Lookup(key, m_nv2a.systemRAM, m_nv2a.systemRAMSize);
+}
+
+// Stores vertex program outputs into RasterVertex structures
+static VertexOutputLayout MakeRasterVertexLayout() {
+    VertexOutputLayout layout;
+    layout.stride = sizeof(RasterVertex) / sizeof(float);
+    std::fill(std::begin(layout.offsets), std::end(layout.offsets), -1);
+    layout.offsets[kVertexOut_Position] = offsetof(RasterVertex, position) / sizeof(float);
+    layout.offsets[kVertexOut_Diffuse] = offsetof(RasterVertex, diffuse) / sizeof(float);
+    layout.offsets[kVertexOut_Specular] = offsetof(RasterVertex, specular) / sizeof(float);
+    layout.offsets[kVertexOut_Fog] = offsetof(RasterVertex, fog) / sizeof(float);
+    for (uint32_t i = 0; i < kKelvinTextureCount; i++) {
+        layout.offsets[kVertexOut_TexCoord0 + i] = (offsetof(RasterVertex, texCoords) / sizeof(float)) + i * 4;
+    }
+    return layout;
+}
+
+static const VertexOutputLayout kRasterVertexLayout = MakeRasterVertexLayout();
+
+void MethodDispatcher::UpdateVertexProgram() {
+    m_vertexProgram.reset();
+    if ((m_state.Reg(Mthd_KELVIN_SET_TRANSFORM_EXECUTION_MODE) & 3) != Val_KELVIN_TRANSFORM_EXECUTION_MODE_PROGRAM) {
+        return;
+    }
+    uint32_t start = m_state.Reg(Mthd_KELVIN_SET_TRANSFORM_PROGRAM_START);
+    if (start >= kKelvinProgramSize) {
+        log_spew("[NV2A] PGRAPH: Transform program start out of bounds: %u\n", start);
+        return;
+    }
+    m_vertexProgram = m_programCache.Lookup(m_state.program, start);
+}
+
+void MethodDispatcher::UpdateCombiners() {
+    CombinerKey key;
+    DecodeCombinerState(m_state, key, m_rasterState.combinerConstants);
+    m_rasterState.combiner = m_combinerCache.Lookup(key);
+}
+
+void MethodDispatcher::FlushBatch() {
+    UpdateRenderState();
+
+    uint32_t vertexCount = static_cast<uint32_t>(m_batch.immediate.size() / (kKelvinAttributeCount * 4));
+    if (vertexCount > 0) {
+        TransformVertices(m_batch.immediate.data(), vertexCount);
+        m_indices.clear();
+        AssembleTriangles(m_batch.primitive, vertexCount, m_indices);
+        DrawVertices();
+    }
+    if (!m_batch.inlineArray.empty()) {
+        DrawInlineArray();
+    }
+    if (!m_batch.drawArrays.empty()) {
+        DrawArrays();
+    }
+    if (!m_batch.elements.empty()) {
+        DrawElements();
+    }
+    m_batch.Clear();
+}
+
+bool MethodDispatcher::ResolveVertexArrays(uint32_t first, uint32_t count, VertexAttributeSource* sources) {
+    for (uint32_t attr = 0; attr < kKelvinAttributeCount; attr++) {
+        VertexAttributeSource& source = sources[attr];
+        source.constant = m_state.attributes[attr];
+        source.data = nullptr;
+        if (!(m_arrayLayout.enabledMask & (1 << attr))) {
+            continue;
+        }
+
+        const VertexArrayFormat& format = m_arrayLayout.formats[attr];
+        uint32_t offset = m_arrayLayout.offsets[attr];
+        uint32_t dma = (offset & 0x80000000)
+            ? m_state.Reg(Mthd_KELVIN_SET_CONTEXT_DMA_VERTEX_B)
+            : m_state.Reg(Mthd_KELVIN_SET_CONTEXT_DMA_VERTEX_A);
+        uint64_t start = (offset & 0x7fffffff) + static_cast<uint64_t>(first) * format.stride;
+        uint64_t size = static_cast<uint64_t>(count - 1) * format.stride + GetVertexArrayElementSize(format);
+        if (start + size > 0xffffffffull) {
+            log_spew("[NV2A] PGRAPH: Vertex array %u out of bounds\n", attr);
+            return false;
+        }
+        source.data = GetDMAPointer(dma, static_cast<uint32_t>(start), static_cast<uint32_t>(size));
+        if (source.data == nullptr) {
+            return false;
+        }
+        source.stride = format.stride;
+        source.format = format;
+    }
+    return true;
+}
+
+void MethodDispatcher::TransformVertices(const float* inputs, uint32_t count) {
+    m_vertices.resize(count);
+    if (m_vertexProgram) {
+        // Vertex programs output window coordinates in oPos
+        bool contextWrite = m_state.Reg(Mthd_KELVIN_SET_TRANSFORM_PROGRAM_CXT_WRITE_EN) != 0;
+        RunVertexProgram(*m_vertexProgram, inputs, count, m_state.constants, contextWrite,
+            kRasterVertexLayout, reinterpret_cast<float*>(m_vertices.data()));
+    }
+    else {
+        RunFixedFunction(m_fixedFunction, inputs, count, m_vertices.data());
+    }
+}
+
+void MethodDispatcher::DrawVertices() {
+    if (m_indices.empty()) {
+        return;
+    }
+    m_renderer->DrawTriangles(m_rasterState, m_vertices.data(), m_indices.data(), static_cast<uint32_t>(m_indices.size()));
+    m_surfacesWritten = true;
+}
+
+void MethodDispatcher::DrawInlineArray() {
+    const uint32_t stride = m_arrayLayout.inlineStride;
+    if (stride == 0) {
+        log_spew("[NV2A] PGRAPH: INLINE_ARRAY with no enabled vertex arrays\n");
+        return;
+    }
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(m_batch.inlineArray.data());
+    uint32_t vertexCount = static_cast<uint32_t>(m_batch.inlineArray.size() * 4 / stride);
+
+    VertexAttributeSource sources[kKelvinAttributeCount];
+    for (uint32_t attr = 0; attr < kKelvinAttributeCount; attr++) {
+        VertexAttributeSource& source = sources[attr];
+        source.constant = m_state.attributes[attr];
+        if (m_arrayLayout.enabledMask & (1 << attr)) {
+            source.data = data + m_arrayLayout.inlineOffsets[attr];
+            source.stride = stride;
+            source.format = m_arrayLayout.formats[attr];
+        }
+    }
+
+    m_fetched.resize(static_cast<size_t>(vertexCount) * kKelvinAttributeCount * 4);
+    FetchVertices(sources, nullptr, vertexCount, m_fetched.data());
+    TransformVertices(m_fetched.data(), vertexCount);
+    m_indices.clear();
+    AssembleTriangles(m_batch.primitive, vertexCount, m_indices);
+    DrawVertices();
+}
+
+void MethodDispatcher::DrawArrays() {
+    // Consecutive ranges continue the same primitive; others start a new one
+    auto& ranges = m_batch.drawArrays;
+    std::vector<std::pair<uint32_t, uint32_t>> merged;
+    merged.reserve(ranges.size());
+    for (const auto& range : ranges) {
+        if (!merged.empty() && merged.back().first + merged.back().second == range.first) {
+            merged.back().second += range.second;
+        }
+        else {
+            merged.push_back(range);
+        }
+    }
+
+    // Fetch every range into one buffer so that they are transformed together
+    uint32_t total = 0;
+    for (const auto& range : merged) {
+        total += range.second;
+    }
+    m_fetched.resize(static_cast<size_t>(total) * kKelvinAttributeCount * 4);
+    uint32_t base = 0;
+    for (auto& range : merged) {
+        VertexAttributeSource sources[kKelvinAttributeCount];
+        if (!ResolveVertexArrays(range.first, range.second, sources)) {
+            range.second = 0;
+            continue;
+        }
+        FetchVertices(sources, nullptr, range.second, &m_fetched[static_cast<size_t>(base) * kKelvinAttributeCount * 4]);
+        range.first = base;
+        base += range.second;
+    }
+    if (base == 0) {
+        return;
+    }
+
+    TransformVertices(m_fetched.data(), base);
+    m_indices.clear();
+    for (const auto& range : merged) {
+        size_t start = m_indices.size();
+        AssembleTriangles(m_batch.primitive, range.second, m_indices);
+        for (size_t i = start; i < m_indices.size(); i++) {
+            m_indices[i] += range.first;
+        }
+    }
+    DrawVertices();
+}
+
+void MethodDispatcher::DrawElements() {
+    const std::vector<uint32_t>& elements = m_batch.elements;
+    auto bounds = std::minmax_element(elements.begin(), elements.end());
+    uint32_t minIndex = *bounds.first;
+    uint32_t range = *bounds.second - minIndex + 1;
+
+    VertexAttributeSource sources[kKelvinAttributeCount];
+    if (!ResolveVertexArrays(minIndex, range, sources)) {
+        return;
+    }
+
+    // Post-transform vertex cache: each distinct index is fetched and
+    // transformed once, and repeated indices refer to the same vertex
+    m_uniqueIndices.clear();
+    m_elementSlots.resize(elements.size());
+    auto assignSlot = [&](uint32_t& slot, uint32_t index) {
+        if (slot == ~0u) {
+            slot = static_cast<uint32_t>(m_uniqueIndices.size());
+            m_uniqueIndices.push_back(index);
+        }
+        return slot;
+    };
+    if (range <= kMaxIndexSlotTableSize) {
+        m_indexSlots.assign(range, ~0u);
+        for (size_t i = 0; i < elements.size(); i++) {
+            uint32_t index = elements[i] - minIndex;
+            m_elementSlots[i] = assignSlot(m_indexSlots[index], index);
+        }
+    }
+    else {
+        std::unordered_map<uint32_t, uint32_t> slots;
+        for (size_t i = 0; i < elements.size(); i++) {
+            uint32_t index = elements[i] - minIndex;
+            auto it = slots.try_emplace(index, ~0u).first;
+            m_elementSlots[i] = assignSlot(it->second, index);
+        }
+    }
+
+    uint32_t vertexCount = static_cast<uint32_t>(m_uniqueIndices.size());
+    m_fetched.resize(static_cast<size_t>(vertexCount) * kKelvinAttributeCount * 4);
+    FetchVertices(sources, m_uniqueIndices.data(), vertexCount, m_fetched.data());
+    TransformVertices(m_fetched.data(), vertexCount);
+
+    m_indices.clear();
+    AssembleTriangles(m_batch.primitive, static_cast<uint32_t>(elements.size()), m_indices);
+    for (uint32_t& index : m_indices) {
+        index = m_elementSlots[index];
+    }
+    DrawVertices();
+}
+
+}
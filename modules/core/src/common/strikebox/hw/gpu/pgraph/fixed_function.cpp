@@ -0,0 +1,569 @@
+// StrikeBox NV2A PGRAPH fixed-function transform and lighting
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+#include "strikebox/hw/gpu/pgraph/fixed_function.h"
+#include "strikebox/hw/gpu/pgraph/simd.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <utility>
+
+namespace strikebox::nv2a {
+
+// ----------------------------------------------------------------------------
+// State decoding
+
+static void ReadFloats(const KelvinState& state, uint32_t method, float* out, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        out[i] = state.RegFloat(method + i * 4);
+    }
+}
+
+void DecodeFixedFunctionState(const KelvinState& state, FixedFunctionState& ff) {
+    ff.features = 0;
+
+    // Transform
+    uint32_t skinMode = state.Reg(Mthd_KELVIN_SET_SKIN_MODE);
+    if (skinMode >= 1 && skinMode <= 6) {
+        ff.features |= FixedFunction_Skinning;
+        ff.skinMatrices = (skinMode + 3) / 2;
+        ff.skinImplicitWeight = (skinMode & 1) != 0;
+    }
+    else {
+        ff.skinMatrices = 1;
+        ff.skinImplicitWeight = false;
+    }
+    ff.normalize = state.Reg(Mthd_KELVIN_SET_NORMALIZATION_ENABLE) != 0;
+    for (uint32_t i = 0; i < 4; i++) {
+        ReadFloats(state, Mthd_KELVIN_SET_MODEL_VIEW_MATRIX + i * 0x40, ff.modelView[i], 16);
+        ReadFloats(state, Mthd_KELVIN_SET_INVERSE_MODEL_VIEW_MATRIX + i * 0x40, ff.inverseModelView[i], 16);
+    }
+    ReadFloats(state, Mthd_KELVIN_SET_COMPOSITE_MATRIX, ff.composite, 16);
+
+    // Lighting
+    ff.lightCount = 0;
+    if (state.Reg(Mthd_KELVIN_SET_LIGHTING_ENABLE) != 0) {
+        ff.features |= FixedFunction_Lighting;
+        if (state.Reg(Mthd_KELVIN_SET_SPECULAR_ENABLE) != 0) {
+            ff.features |= FixedFunction_Specular;
+        }
+
+        uint32_t enableMask = state.Reg(Mthd_KELVIN_SET_LIGHT_ENABLE_MASK);
+        for (uint32_t i = 0; i < kKelvinLightCount; i++) {
+            LightType type = static_cast<LightType>((enableMask >> (i * 2)) & 3);
+            if (type == LightType::Off) {
+                continue;
+            }
+            const uint32_t base = Mthd_KELVIN_SET_LIGHT + i * kKelvinLightStride;
+            FixedFunctionLight& light = ff.lights[ff.lightCount++];
+            light.type = type;
+            ReadFloats(state, base + Mthd_KELVIN_LIGHT_AMBIENT_COLOR, light.ambient, 3);
+            ReadFloats(state, base + Mthd_KELVIN_LIGHT_DIFFUSE_COLOR, light.diffuse, 3);
+            ReadFloats(state, base + Mthd_KELVIN_LIGHT_SPECULAR_COLOR, light.specular, 3);
+            light.range = state.RegFloat(base + Mthd_KELVIN_LIGHT_LOCAL_RANGE);
+            ReadFloats(state, base + Mthd_KELVIN_LIGHT_INFINITE_HALF_VECTOR, light.halfVector, 3);
+            ReadFloats(state, base + Mthd_KELVIN_LIGHT_INFINITE_DIRECTION, light.direction, 3);
+            ReadFloats(state, base + Mthd_KELVIN_LIGHT_SPOT_FALLOFF, light.spotFalloff, 3);
+            ReadFloats(state, base + Mthd_KELVIN_LIGHT_SPOT_DIRECTION, light.spotDirection, 4);
+            ReadFloats(state, base + Mthd_KELVIN_LIGHT_LOCAL_POSITION, light.position, 3);
+            ReadFloats(state, base + Mthd_KELVIN_LIGHT_LOCAL_ATTENUATION, light.attenuation, 3);
+        }
+
+        uint32_t colorMaterial = state.Reg(Mthd_KELVIN_SET_COLOR_MATERIAL);
+        auto source = [&](uint32_t shift) {
+            uint32_t value = (colorMaterial >> shift) & 3;
+            return (value <= 2) ? static_cast<MaterialSource>(value) : MaterialSource::Material;
+        };
+        ff.emissionSource = source(0);
+        ff.ambientSource = source(2);
+        ff.diffuseSource = source(4);
+        ff.specularSource = source(6);
+        ReadFloats(state, Mthd_KELVIN_SET_SCENE_AMBIENT_COLOR, ff.sceneAmbient, 3);
+        ReadFloats(state, Mthd_KELVIN_SET_MATERIAL_EMISSION, ff.materialEmission, 3);
+        ff.materialAlpha = state.RegFloat(Mthd_KELVIN_SET_MATERIAL_ALPHA);
+        ReadFloats(state, Mthd_KELVIN_SET_SPECULAR_PARAMS, ff.specularParams, 6);
+    }
+
+    // Texture coordinate generation
+    for (uint32_t stage = 0; stage < kKelvinTextureCount; stage++) {
+        for (uint32_t coord = 0; coord < 4; coord++) {
+            ff.texgen[stage][coord] = state.Reg(Mthd_KELVIN_SET_TEXGEN_S + stage * 0x10 + coord * 4);
+            ReadFloats(state, Mthd_KELVIN_SET_TEXGEN_PLANE_S + stage * 0x40 + coord * 0x10, ff.texgenPlanes[stage][coord], 4);
+            if (ff.texgen[stage][coord] != Val_KELVIN_TEXGEN_DISABLE) {
+                ff.features |= FixedFunction_Texgen;
+            }
+        }
+        ff.textureMatrixEnable[stage] = state.Reg(Mthd_KELVIN_SET_TEXTURE_MATRIX_ENABLE + stage * 4) != 0;
+        ReadFloats(state, Mthd_KELVIN_SET_TEXTURE_MATRIX + stage * 0x40, ff.textureMatrix[stage], 16);
+        if (ff.textureMatrixEnable[stage]) {
+            ff.features |= FixedFunction_Texgen;
+        }
+    }
+
+    // Fog
+    if (state.Reg(Mthd_KELVIN_SET_FOG_ENABLE) != 0) {
+        ff.features |= FixedFunction_Fog;
+    }
+    ff.fogGenMode = state.Reg(Mthd_KELVIN_SET_FOG_GEN_MODE);
+    ReadFloats(state, Mthd_KELVIN_SET_FOG_PLANE, ff.fogPlane, 4);
+}
+
+// ----------------------------------------------------------------------------
+// Execution
+
+namespace {
+
+typedef simd::FV Vec;
+
+const uint32_t kLanes = Vec::kLanes;
+
+// Attributes of a batch of vertices, one vertex per lane
+struct Batch {
+    Vec position[4];      // Object space
+    Vec weight[4];
+    Vec eye[4];           // Eye space
+    Vec normal[3];        // Eye space
+    Vec diffuse[4];
+    Vec specular[4];
+    Vec fog;
+    Vec texCoords[kKelvinTextureCount][4];
+    Vec clip[4];
+};
+
+// Loads the first components of an attribute of every vertex in the batch.
+// Lanes past the end repeat the last vertex.
+inline void LoadAttribute(const float* inputs, uint32_t base, uint32_t n, uint32_t attr, uint32_t components, Vec* out) {
+    const uint32_t inputStride = kKelvinAttributeCount * 4;
+    alignas(32) float lanes[4][kLanes];
+    for (uint32_t lane = 0; lane < kLanes; lane++) {
+        const float* in = &inputs[(base + std::min(lane, n - 1)) * inputStride + attr * 4];
+        for (uint32_t c = 0; c < components; c++) {
+            lanes[c][lane] = in[c];
+        }
+    }
+    for (uint32_t c = 0; c < components; c++) {
+        out[c] = Vec::Load(lanes[c]);
+    }
+}
+
+// Stores four components of every vertex in the batch at the given offset
+// of the output vertices
+inline void StoreOutput(RasterVertex* outputs, uint32_t base, uint32_t n, size_t offset, const Vec* in) {
+    alignas(32) float lanes[4][kLanes];
+    for (uint32_t c = 0; c < 4; c++) {
+        in[c].Store(lanes[c]);
+    }
+    for (uint32_t lane = 0; lane < n; lane++) {
+        float* out = reinterpret_cast<float*>(reinterpret_cast<uint8_t*>(&outputs[base + lane]) + offset);
+        for (uint32_t c = 0; c < 4; c++) {
+            out[c] = lanes[c][lane];
+        }
+    }
+}
+
+// Multiplies the vector by each row of the matrix
+inline void Transform(const float* m, const Vec* in, uint32_t outComponents, Vec* out) {
+    for (uint32_t row = 0; row < outComponents; row++) {
+        const float* r = &m[row * 4];
+        out[row] = in[0] * Vec::Splat(r[0]) + in[1] * Vec::Splat(r[1]) + in[2] * Vec::Splat(r[2]) + in[3] * Vec::Splat(r[3]);
+    }
+}
+
+// Multiplies a direction by each row of the upper 3x3 part of the matrix
+inline void TransformDirection(const float* m, const Vec* in, Vec* out) {
+    for (uint32_t row = 0; row < 3; row++) {
+        const float* r = &m[row * 4];
+        out[row] = in[0] * Vec::Splat(r[0]) + in[1] * Vec::Splat(r[1]) + in[2] * Vec::Splat(r[2]);
+    }
+}
+
+inline Vec Dot3(const Vec* a, const Vec* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+inline Vec Dot3(const Vec* a, const float* b) {
+    return a[0] * Vec::Splat(b[0]) + a[1] * Vec::Splat(b[1]) + a[2] * Vec::Splat(b[2]);
+}
+
+// Normalizes the vector; zero vectors are left unchanged
+inline Vec Normalize3(Vec* v) {
+    const Vec zero = Vec::Splat(0.0f);
+    Vec length = Sqrt(Dot3(v, v));
+    Vec scale = Vec::Select(length > zero, Vec::Splat(1.0f) / length, zero);
+    for (uint32_t c = 0; c < 3; c++) {
+        v[c] = v[c] * scale;
+    }
+    return length;
+}
+
+// ----------------------------------------------------------------------------
+// Lighting
+
+// Per-vertex inputs of the lighting computations, in eye space
+struct LightingInputs {
+    Vec position[3];   // Divided by w
+    Vec normal[3];
+    Vec view[3];       // Normalized direction from the vertex to the eye
+};
+
+// Light contributions accumulated over all lights
+struct LightingSums {
+    Vec ambient[3];
+    Vec diffuse[3];
+    Vec specular[3];
+};
+
+// The shape of the specular curve defined by SET_SPECULAR_PARAMS is not
+// documented; it is evaluated as the ratio of two quadratics in N.H, which
+// can closely approximate the power function the parameters are derived from
+inline Vec SpecularFactor(Vec nDotH, const float* params) {
+    const Vec zero = Vec::Splat(0.0f);
+    Vec num = Vec::Splat(params[0]) + nDotH * (Vec::Splat(params[1]) + nDotH * Vec::Splat(params[2]));
+    Vec den = Vec::Splat(params[3]) + nDotH * (Vec::Splat(params[4]) + nDotH * Vec::Splat(params[5]));
+    Vec factor = Vec::Select(den == zero, zero, num / den);
+    return simd::Clamp(factor, zero, Vec::Splat(1.0f));
+}
+
+// Adds the contribution of a light. Each type of light, with and without
+// specular lighting, has its own instance.
+template <LightType Type, bool Specular>
+inline void AccumulateLight(const FixedFunctionLight& light, const float* specularParams, const LightingInputs& in, LightingSums& sums) {
+    const Vec zero = Vec::Splat(0.0f);
+    const Vec one = Vec::Splat(1.0f);
+
+    Vec toLight[3];
+    Vec half[3];
+    Vec attenuation = one;
+    if constexpr (Type == LightType::Infinite) {
+        for (uint32_t c = 0; c < 3; c++) {
+            toLight[c] = Vec::Splat(light.direction[c]);
+            half[c] = Vec::Splat(light.halfVector[c]);
+        }
+    }
+    else {
+        for (uint32_t c = 0; c < 3; c++) {
+            toLight[c] = Vec::Splat(light.position[c]) - in.position[c];
+        }
+        Vec distance = Normalize3(toLight);
+        Vec denom = Vec::Splat(light.attenuation[0]) + distance * (Vec::Splat(light.attenuation[1]) + distance * Vec::Splat(light.attenuation[2]));
+        attenuation = Vec::Select(denom > zero, one / denom, one);
+        attenuation = Vec::Select(distance > Vec::Splat(light.range), zero, attenuation);
+
+        if constexpr (Type == LightType::Spot) {
+            // The falloff is a quadratic in the cosine of the angle between
+            // the spot direction and the vertex; the w component of the
+            // direction holds the cosine of the cutoff angle
+            Vec cosine = Negate(Dot3(toLight, light.spotDirection));
+            Vec spot = Vec::Splat(light.spotFalloff[0]) + cosine * (Vec::Splat(light.spotFalloff[1]) + cosine * Vec::Splat(light.spotFalloff[2]));
+            spot = Vec::Select(cosine < Vec::Splat(light.spotDirection[3]), zero, simd::Clamp(spot, zero, one));
+            attenuation = attenuation * spot;
+        }
+
+        if constexpr (Specular) {
+            for (uint32_t c = 0; c < 3; c++) {
+                half[c] = toLight[c] + in.view[c];
+            }
+            Normalize3(half);
+        }
+    }
+
+    Vec nDotL = Max(Dot3(in.normal, toLight), zero);
+    Vec diffuse = attenuation * nDotL;
+    for (uint32_t c = 0; c < 3; c++) {
+        sums.ambient[c] = sums.ambient[c] + attenuation * Vec::Splat(light.ambient[c]);
+        sums.diffuse[c] = sums.diffuse[c] + diffuse * Vec::Splat(light.diffuse[c]);
+    }
+    if constexpr (Specular) {
+        Vec nDotH = Max(Dot3(in.normal, half), zero);
+        Vec specular = Vec::Select(nDotL > zero, attenuation * SpecularFactor(nDotH, specularParams), zero);
+        for (uint32_t c = 0; c < 3; c++) {
+            sums.specular[c] = sums.specular[c] + specular * Vec::Splat(light.specular[c]);
+        }
+    }
+}
+
+inline const Vec* SourceColor(const Batch& b, MaterialSource source) {
+    return (source == MaterialSource::Specular) ? b.specular : b.diffuse;
+}
+
+// Computes the lit colors. With colors taken from the material, the scene
+// ambient color holds the combined ambient and emissive terms and light
+// colors are premultiplied by the material colors; vertex colors used as
+// the ambient source are scaled by the material emission color.
+template <bool Specular>
+void Light(const FixedFunctionState& ff, Batch& b) {
+    const Vec zero = Vec::Splat(0.0f);
+    const Vec one = Vec::Splat(1.0f);
+
+    LightingInputs in;
+    Vec invW = Vec::Select(b.eye[3] == zero, one, one / b.eye[3]);
+    for (uint32_t c = 0; c < 3; c++) {
+        in.position[c] = b.eye[c] * invW;
+        in.normal[c] = b.normal[c];
+        in.view[c] = Negate(in.position[c]);
+    }
+    Normalize3(in.view);
+
+    LightingSums sums;
+    for (uint32_t c = 0; c < 3; c++) {
+        sums.ambient[c] = sums.diffuse[c] = sums.specular[c] = zero;
+    }
+    for (uint32_t i = 0; i < ff.lightCount; i++) {
+        const FixedFunctionLight& light = ff.lights[i];
+        switch (light.type) {
+        case LightType::Infinite: AccumulateLight<LightType::Infinite, Specular>(light, ff.specularParams, in, sums); break;
+        case LightType::Local: AccumulateLight<LightType::Local, Specular>(light, ff.specularParams, in, sums); break;
+        case LightType::Spot: AccumulateLight<LightType::Spot, Specular>(light, ff.specularParams, in, sums); break;
+        default: break;
+        }
+    }
+
+    Vec front[4];
+    Vec back[4];
+    for (uint32_t c = 0; c < 3; c++) {
+        Vec color = (ff.ambientSource == MaterialSource::Material)
+            ? Vec::Splat(ff.sceneAmbient[c])
+            : SourceColor(b, ff.ambientSource)[c] * Vec::Splat(ff.materialEmission[c]);
+        if (ff.emissionSource != MaterialSource::Material) {
+            color = color + SourceColor(b, ff.emissionSource)[c];
+        }
+        color = color + sums.ambient[c];
+        color = color + ((ff.diffuseSource == MaterialSource::Material) ? sums.diffuse[c] : SourceColor(b, ff.diffuseSource)[c] * sums.diffuse[c]);
+        front[c] = simd::Clamp(color, zero, one);
+
+        if constexpr (Specular) {
+            Vec specular = (ff.specularSource == MaterialSource::Material) ? sums.specular[c] : SourceColor(b, ff.specularSource)[c] * sums.specular[c];
+            back[c] = simd::Clamp(specular, zero, one);
+        }
+        else {
+            back[c] = zero;
+        }
+    }
+    front[3] = (ff.diffuseSource == MaterialSource::Material) ? Vec::Splat(ff.materialAlpha) : SourceColor(b, ff.diffuseSource)[3];
+    back[3] = b.specular[3];
+    for (uint32_t c = 0; c < 4; c++) {
+        b.diffuse[c] = front[c];
+        b.specular[c] = back[c];
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Texture coordinates and fog
+
+void GenerateTexCoords(const FixedFunctionState& ff, Batch& b) {
+    // Reflection of the view vector around the normal, used by sphere and
+    // reflection mapping
+    Vec reflection[3];
+    bool reflectionReady = false;
+    auto reflect = [&]() {
+        if (reflectionReady) {
+            return;
+        }
+        Vec view[3] = { b.eye[0], b.eye[1], b.eye[2] };
+        Normalize3(view);
+        Vec twoDot = Vec::Splat(2.0f) * Dot3(view, b.normal);
+        for (uint32_t c = 0; c < 3; c++) {
+            reflection[c] = view[c] - twoDot * b.normal[c];
+        }
+        reflectionReady = true;
+    };
+
+    for (uint32_t stage = 0; stage < kKelvinTextureCount; stage++) {
+        Vec* tex = b.texCoords[stage];
+        for (uint32_t coord = 0; coord < 4; coord++) {
+            const float* plane = ff.texgenPlanes[stage][coord];
+            switch (ff.texgen[stage][coord]) {
+            case Val_KELVIN_TEXGEN_EYE_LINEAR:
+                tex[coord] = Dot3(b.eye, plane) + b.eye[3] * Vec::Splat(plane[3]);
+                break;
+            case Val_KELVIN_TEXGEN_OBJECT_LINEAR:
+                tex[coord] = Dot3(b.position, plane) + b.position[3] * Vec::Splat(plane[3]);
+                break;
+            case Val_KELVIN_TEXGEN_SPHERE_MAP:
+                if (coord < 2) {
+                    reflect();
+                    Vec z = reflection[2] + Vec::Splat(1.0f);
+                    Vec m = Vec::Splat(2.0f) * Sqrt(reflection[0] * reflection[0] + reflection[1] * reflection[1] + z * z);
+                    m = Vec::Select(m == Vec::Splat(0.0f), Vec::Splat(1.0f), m);
+                    tex[coord] = reflection[coord] / m + Vec::Splat(0.5f);
+                }
+                break;
+            case Val_KELVIN_TEXGEN_NORMAL_MAP:
+                if (coord < 3) {
+                    tex[coord] = b.normal[coord];
+                }
+                break;
+            case Val_KELVIN_TEXGEN_REFLECTION_MAP:
+                if (coord < 3) {
+                    reflect();
+                    tex[coord] = reflection[coord];
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        if (ff.textureMatrixEnable[stage]) {
+            Vec in[4] = { tex[0], tex[1], tex[2], tex[3] };
+            Transform(ff.textureMatrix[stage], in, 4, tex);
+        }
+    }
+}
+
+void GenerateFog(const FixedFunctionState& ff, Batch& b) {
+    switch (ff.fogGenMode) {
+    case Val_KELVIN_FOG_GEN_SPEC_ALPHA:
+        b.fog = simd::Clamp(b.specular[3], Vec::Splat(0.0f), Vec::Splat(1.0f));
+        break;
+    case Val_KELVIN_FOG_GEN_RADIAL:
+        b.fog = Sqrt(Dot3(b.eye, b.eye));
+        break;
+    case Val_KELVIN_FOG_GEN_PLANAR:
+        b.fog = Dot3(b.eye, ff.fogPlane) + Vec::Splat(ff.fogPlane[3]);
+        break;
+    case Val_KELVIN_FOG_GEN_ABS_PLANAR:
+        b.fog = Abs(Dot3(b.eye, ff.fogPlane) + Vec::Splat(ff.fogPlane[3]));
+        break;
+    default:
+        // FOG_X uses the fog coordinate of the vertex as is
+        break;
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Pipeline
+
+// Transforms one batch of vertices with the features given at compile time
+template <uint32_t Features>
+void ProcessBatch(const FixedFunctionState& ff, const float* inputs, uint32_t base, uint32_t n, RasterVertex* outputs) {
+    constexpr bool kSkinning = (Features & FixedFunction_Skinning) != 0;
+    constexpr bool kLighting = (Features & FixedFunction_Lighting) != 0;
+    constexpr bool kSpecular = (Features & FixedFunction_Specular) != 0;
+    constexpr bool kTexgen = (Features & FixedFunction_Texgen) != 0;
+    constexpr bool kFog = (Features & FixedFunction_Fog) != 0;
+    constexpr bool kEyeSpace = kSkinning || kLighting || kTexgen || kFog;
+    constexpr bool kNormal = kLighting || kTexgen;
+
+    Batch b;
+    LoadAttribute(inputs, base, n, kKelvinAttr_Position, 4, b.position);
+    LoadAttribute(inputs, base, n, kKelvinAttr_Diffuse, 4, b.diffuse);
+    LoadAttribute(inputs, base, n, kKelvinAttr_Specular, 4, b.specular);
+    LoadAttribute(inputs, base, n, kKelvinAttr_Fog, 1, &b.fog);
+    for (uint32_t stage = 0; stage < kKelvinTextureCount; stage++) {
+        LoadAttribute(inputs, base, n, kKelvinAttr_TexCoord0 + stage, 4, b.texCoords[stage]);
+    }
+
+    if constexpr (kSkinning) {
+        const Vec zero = Vec::Splat(0.0f);
+        LoadAttribute(inputs, base, n, kKelvinAttr_Weight, 4, b.weight);
+        if (ff.skinImplicitWeight) {
+            Vec last = Vec::Splat(1.0f);
+            for (uint32_t i = 0; i + 1 < ff.skinMatrices; i++) {
+                last = last - b.weight[i];
+            }
+            b.weight[ff.skinMatrices - 1] = last;
+        }
+
+        Vec normal[3];
+        if constexpr (kNormal) {
+            LoadAttribute(inputs, base, n, kKelvinAttr_Normal, 3, normal);
+        }
+        for (uint32_t c = 0; c < 4; c++) {
+            b.eye[c] = zero;
+        }
+        for (uint32_t c = 0; c < 3; c++) {
+            b.normal[c] = zero;
+        }
+        for (uint32_t i = 0; i < ff.skinMatrices; i++) {
+            Vec eye[4];
+            Transform(ff.modelView[i], b.position, 4, eye);
+            for (uint32_t c = 0; c < 4; c++) {
+                b.eye[c] = b.eye[c] + b.weight[i] * eye[c];
+            }
+            if constexpr (kNormal) {
+                Vec transformed[3];
+                TransformDirection(ff.inverseModelView[i], normal, transformed);
+                for (uint32_t c = 0; c < 3; c++) {
+                    b.normal[c] = b.normal[c] + b.weight[i] * transformed[c];
+                }
+            }
+        }
+
+        // The composite matrix does not include the model-view transform
+        // when skinning
+        Transform(ff.composite, b.eye, 4, b.clip);
+    }
+    else {
+        if constexpr (kEyeSpace) {
+            Transform(ff.modelView[0], b.position, 4, b.eye);
+        }
+        if constexpr (kNormal) {
+            Vec normal[3];
+            LoadAttribute(inputs, base, n, kKelvinAttr_Normal, 3, normal);
+            TransformDirection(ff.inverseModelView[0], normal, b.normal);
+        }
+        Transform(ff.composite, b.position, 4, b.clip);
+    }
+
+    if constexpr (kNormal) {
+        if (ff.normalize) {
+            Normalize3(b.normal);
+        }
+    }
+    if constexpr (kLighting) {
+        Light<kSpecular>(ff, b);
+    }
+    if constexpr (kTexgen) {
+        GenerateTexCoords(ff, b);
+    }
+    if constexpr (kFog) {
+        GenerateFog(ff, b);
+    }
+
+    // The composite matrix includes the viewport transform, so the
+    // perspective divide yields window coordinates
+    const Vec zero = Vec::Splat(0.0f);
+    Vec w = Vec::Select(b.clip[3] == zero, Vec::Splat(1e-20f), b.clip[3]);
+    Vec invW = Vec::Splat(1.0f) / w;
+    Vec position[4] = { b.clip[0] * invW, b.clip[1] * invW, b.clip[2] * invW, b.clip[3] };
+    Vec fog[4] = { b.fog, zero, zero, Vec::Splat(1.0f) };
+    StoreOutput(outputs, base, n, offsetof(RasterVertex, position), position);
+    StoreOutput(outputs, base, n, offsetof(RasterVertex, diffuse), b.diffuse);
+    StoreOutput(outputs, base, n, offsetof(RasterVertex, specular), b.specular);
+    StoreOutput(outputs, base, n, offsetof(RasterVertex, fog), fog);
+    for (uint32_t stage = 0; stage < kKelvinTextureCount; stage++) {
+        StoreOutput(outputs, base, n, offsetof(RasterVertex, texCoords) + stage * sizeof(RasterVertex::texCoords[0]), b.texCoords[stage]);
+    }
+}
+
+template <uint32_t Features>
+void Process(const FixedFunctionState& ff, const float* inputs, uint32_t count, RasterVertex* outputs) {
+    for (uint32_t base = 0; base < count; base += kLanes) {
+        ProcessBatch<Features>(ff, inputs, base, std::min(kLanes, count - base), outputs);
+    }
+}
+
+typedef void (*ProcessFn)(const FixedFunctionState& ff, const float* inputs, uint32_t count, RasterVertex* outputs);
+
+template <uint32_t... Features>
+constexpr std::array<ProcessFn, sizeof...(Features)> MakeVariants(std::integer_sequence<uint32_t, Features...>) {
+    return { { &Process<Features>... } };
+}
+
+// Pipeline variants indexed by the feature bitmask
+const std::array<ProcessFn, FixedFunction_All + 1> kVariants = MakeVariants(std::make_integer_sequence<uint32_t, FixedFunction_All + 1>{});
+
+}
+
+void RunFixedFunction(const FixedFunctionState& ff, const float* inputs, uint32_t count, RasterVertex* outputs) {
+    kVariants[ff.features & FixedFunction_All](ff, inputs, count, outputs);
+}
+
+}
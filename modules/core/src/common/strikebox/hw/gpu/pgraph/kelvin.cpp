@@ -0,0 +1,468 @@
+// StrikeBox NV2A PGRAPH Kelvin (NV20-class 3D) object methods
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+#include "strikebox/hw/gpu/pgraph/dispatch.h"
+#include "strikebox/hw/gpu/state.h"
+
+#include "strikebox/log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace strikebox::nv2a {
+
+// Number of methods of the run handled by a single handler invocation.
+// Non-increasing runs always target the same method.
+static inline uint32_t RunCount(const MethodEntry& entry, uint32_t count, bool increasing) {
+    return increasing ? std::min<uint32_t>(count, entry.runLength) : count;
+}
+
+// --- Plain state -----------------
+
+// Stores the values into the shadow state and marks the state as dirty.
+// Only the last value of a non-increasing run matters.
+static uint32_t Store(MethodDispatcher& d, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+    KelvinState& s = d.State();
+    s.dirty |= entry.dirty;
+    if (increasing) {
+        uint32_t n = std::min<uint32_t>(count, entry.runLength);
+        if (n == 1) {
+            s.regs[method] = data[0];
+        }
+        else {
+            std::memcpy(&s.regs[method], data, n * sizeof(uint32_t));
+        }
+        return n;
+    }
+    s.regs[method] = data[count - 1];
+    return count;
+}
+
+// --- Synchronization -------------
+
+// Notifications written to the notifies DMA object
+static const uint32_t kNotificationSize = 16;
+static const uint32_t Val_NOTIFICATION_STATUS_DONE_SUCCESS = 0x0000;
+
+static uint32_t Notify(MethodDispatcher& d, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+    // [https://envytools.readthedocs.io/en/latest/hw/graph/intro.html#notify]
+    // Writes a notification to the notifies DMA object. A value of 1 also
+    // raises the NOTIFY interrupt.
+    // The 16-byte notification consists of:
+    //   0x0: timestamp, low word   (PTIMER TIME_LOW)
+    //   0x4: timestamp, high word  (PTIMER TIME_HIGH)
+    //   0x8: 32-bit return value
+    //   0xC: bits 15..0 = 16-bit return value, bits 31..16 = status
+    // The status is written last; zero means the notification is done.
+    KelvinState& s = d.State();
+    uint32_t n = RunCount(entry, count, increasing);
+    d.FlushRenderer();
+    for (uint32_t i = 0; i < n; i++) {
+        s.regs[method] = data[i];
+
+        uint8_t* notification = d.GetDMAPointer(s.Reg(Mthd_KELVIN_SET_CONTEXT_DMA_NOTIFIES), 0, kNotificationSize);
+        if (notification != nullptr) {
+            uint64_t time = d.GetNV2A().ptimer.GetTime();
+            uint32_t words[4] = {
+                static_cast<uint32_t>(time),
+                static_cast<uint32_t>(time >> 32),
+                0,
+                Val_NOTIFICATION_STATUS_DONE_SUCCESS << 16,
+            };
+            std::memcpy(notification, words, 12);
+            std::atomic_thread_fence(std::memory_order_release);
+            std::memcpy(notification + 12, &words[3], sizeof(uint32_t));
+            d.MarkGuestWrite(notification, kNotificationSize);
+        }
+        if (data[i] == 1) {
+            d.GetNV2A().pgraph.RaiseInterrupt(Reg_PGRAPH_INTR_NOTIFY);
+        }
+    }
+    return n;
+}
+
+static uint32_t SemaphoreRelease(MethodDispatcher& d, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+    KelvinState& s = d.State();
+    uint32_t n = RunCount(entry, count, increasing);
+    s.regs[method] = data[n - 1];
+    d.FlushRenderer();
+
+    uint8_t* semaphore = d.GetDMAPointer(s.Reg(Mthd_KELVIN_SET_CONTEXT_DMA_SEMAPHORE), s.Reg(Mthd_KELVIN_SET_SEMAPHORE_OFFSET), sizeof(uint32_t));
+    if (semaphore != nullptr) {
+        std::memcpy(semaphore, &data[n - 1], sizeof(uint32_t));
+        d.MarkGuestWrite(semaphore, sizeof(uint32_t));
+    }
+    return n;
+}
+
+static uint32_t FlipIncrementWrite(MethodDispatcher& d, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+    KelvinState& s = d.State();
+    uint32_t n = RunCount(entry, count, increasing);
+    d.FlushRenderer();
+    uint32_t modulo = s.Reg(Mthd_KELVIN_SET_FLIP_MODULO);
+    uint32_t& write = s.regs[Mthd_KELVIN_SET_FLIP_WRITE >> 2];
+    for (uint32_t i = 0; i < n; i++) {
+        write++;
+        if (write >= modulo) {
+            write = 0;
+        }
+    }
+    s.regs[method] = data[n - 1];
+    return n;
+}
+
+// Completes pending rendering before the guest can observe it
+static uint32_t Sync(MethodDispatcher& d, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+    uint32_t n = Store(d, entry, method, data, count, increasing);
+    d.FlushRenderer();
+    return n;
+}
+
+// --- Transform engine memories ---
+
+static uint32_t TransformProgram(MethodDispatcher& d, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+    // Words are streamed into program memory at the load cursor, which
+    // advances after each complete instruction
+    KelvinState& s = d.State();
+    s.dirty |= entry.dirty;
+    uint32_t n = RunCount(entry, count, increasing);
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t slot = (increasing ? method + i : method) - (Mthd_KELVIN_SET_TRANSFORM_PROGRAM >> 2);
+        if (s.programLoad >= kKelvinProgramSize) {
+            log_spew("[NV2A] PGRAPH: Transform program load out of bounds: %u\n", s.programLoad);
+            break;
+        }
+        s.program[s.programLoad][slot & 3] = data[i];
+        if ((slot & 3) == 3) {
+            s.programLoad++;
+        }
+    }
+    return n;
+}
+
+static uint32_t TransformConstant(MethodDispatcher& d, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+    // Words are streamed into constant memory at the load cursor, which
+    // advances after each complete vector
+    KelvinState& s = d.State();
+    s.dirty |= entry.dirty;
+    uint32_t n = RunCount(entry, count, increasing);
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t slot = (increasing ? method + i : method) - (Mthd_KELVIN_SET_TRANSFORM_CONSTANT >> 2);
+        if (s.constantLoad >= kKelvinConstantCount) {
+            log_spew("[NV2A] PGRAPH: Transform constant load out of bounds: %u\n", s.constantLoad);
+            break;
+        }
+        std::memcpy(&s.constants[s.constantLoad][slot & 3], &data[i], sizeof(float));
+        if ((slot & 3) == 3) {
+            s.constantLoad++;
+        }
+    }
+    return n;
+}
+
+static uint32_t TransformProgramLoad(MethodDispatcher& d, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+    uint32_t n = Store(d, entry, method, data, RunCount(entry, count, increasing), increasing);
+    d.State().programLoad = d.State().Reg(Mthd_KELVIN_SET_TRANSFORM_PROGRAM_LOAD);
+    return n;
+}
+
+static uint32_t TransformConstantLoad(MethodDispatcher& d, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+    uint32_t n = Store(d, entry, method, data, RunCount(entry, count, increasing), increasing);
+    d.State().constantLoad = d.State().Reg(Mthd_KELVIN_SET_TRANSFORM_CONSTANT_LOAD);
+    return n;
+}
+
+// --- Immediate mode attributes ---
+
+// Completes an attribute written with fewer than four components and emits a
+// vertex when the position is complete
+static inline void FinishAttribute(MethodDispatcher& d, uint32_t attr, uint32_t components) {
+    float* a = d.State().attributes[attr];
+    if (components < 3) a[2] = 0.0f;
+    if (components < 4) a[3] = 1.0f;
+    if (attr == kKelvinAttr_Position) {
+        d.EmitVertex();
+    }
+}
+
+// Sets Components floats of consecutive attributes starting at FirstAttr from
+// the methods starting at Base
+template<uint32_t Base, uint32_t FirstAttr, uint32_t Components>
+static uint32_t SetAttributeFloats(MethodDispatcher& d, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+    KelvinState& s = d.State();
+    uint32_t n = RunCount(entry, count, increasing);
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t m = increasing ? method + i : method;
+        uint32_t slot = m - (Base >> 2);
+        uint32_t attr = FirstAttr + slot / Components;
+        uint32_t component = slot % Components;
+        s.regs[m] = data[i];
+        std::memcpy(&s.attributes[attr][component], &data[i], sizeof(float));
+        if (component == Components - 1) {
+            FinishAttribute(d, attr, Components);
+        }
+    }
+    return n;
+}
+
+enum class PackedFormat { UB4, S2, S4 };
+
+// Sets consecutive attributes starting at FirstAttr from packed values in the
+// methods starting at Base. S4 attributes take two words each.
+template<uint32_t Base, uint32_t FirstAttr, PackedFormat Format>
+static uint32_t SetAttributePacked(MethodDispatcher& d, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+    KelvinState& s = d.State();
+    uint32_t n = RunCount(entry, count, increasing);
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t m = increasing ? method + i : method;
+        uint32_t slot = m - (Base >> 2);
+        uint32_t value = data[i];
+        s.regs[m] = value;
+
+        if constexpr (Format == PackedFormat::UB4) {
+            float* a = s.attributes[FirstAttr + slot];
+            a[0] = (value & 0xff) / 255.0f;
+            a[1] = ((value >> 8) & 0xff) / 255.0f;
+            a[2] = ((value >> 16) & 0xff) / 255.0f;
+            a[3] = (value >> 24) / 255.0f;
+            FinishAttribute(d, FirstAttr + slot, 4);
+        }
+        else if constexpr (Format == PackedFormat::S2) {
+            float* a = s.attributes[FirstAttr + slot];
+            a[0] = static_cast<int16_t>(value & 0xffff);
+            a[1] = static_cast<int16_t>(value >> 16);
+            FinishAttribute(d, FirstAttr + slot, 2);
+        }
+        else {
+            uint32_t attr = FirstAttr + slot / 2;
+            float* a = &s.attributes[attr][(slot & 1) * 2];
+            a[0] = static_cast<int16_t>(value & 0xffff);
+            a[1] = static_cast<int16_t>(value >> 16);
+            if (slot & 1) {
+                FinishAttribute(d, attr, 4);
+            }
+        }
+    }
+    return n;
+}
+
+// --- Primitives ------------------
+
+static uint32_t BeginEnd(MethodDispatcher& d, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+    KelvinState& s = d.State();
+    uint32_t n = RunCount(entry, count, increasing);
+    for (uint32_t i = 0; i < n; i++) {
+        s.regs[method] = data[i];
+        d.BeginEnd(static_cast<KelvinPrimitive>(data[i]));
+    }
+    return n;
+}
+
+static uint32_t ArrayElement16(MethodDispatcher& d, const MethodEntry& entry, uint32_t, const uint32_t* data, uint32_t count, bool increasing) {
+    // Each word contains two 16-bit indices
+    std::vector<uint32_t>& elements = d.Batch().elements;
+    uint32_t n = RunCount(entry, count, increasing);
+    for (uint32_t i = 0; i < n; i++) {
+        elements.push_back(data[i] & 0xffff);
+        elements.push_back(data[i] >> 16);
+    }
+    return n;
+}
+
+static uint32_t ArrayElement32(MethodDispatcher& d, const MethodEntry& entry, uint32_t, const uint32_t* data, uint32_t count, bool increasing) {
+    std::vector<uint32_t>& elements = d.Batch().elements;
+    uint32_t n = RunCount(entry, count, increasing);
+    elements.insert(elements.end(), data, data + n);
+    return n;
+}
+
+static uint32_t DrawArrays(MethodDispatcher& d, const MethodEntry& entry, uint32_t, const uint32_t* data, uint32_t count, bool increasing) {
+    // bits 23..0 = first vertex, bits 31..24 = vertex count - 1
+    auto& drawArrays = d.Batch().drawArrays;
+    uint32_t n = RunCount(entry, count, increasing);
+    for (uint32_t i = 0; i < n; i++) {
+        drawArrays.emplace_back(data[i] & 0xffffff, (data[i] >> 24) + 1);
+    }
+    return n;
+}
+
+static uint32_t InlineArray(MethodDispatcher& d, const MethodEntry& entry, uint32_t, const uint32_t* data, uint32_t count, bool increasing) {
+    std::vector<uint32_t>& inlineArray = d.Batch().inlineArray;
+    uint32_t n = RunCount(entry, count, increasing);
+    inlineArray.insert(inlineArray.end(), data, data + n);
+    return n;
+}
+
+static uint32_t ClearSurface(MethodDispatcher& d, const MethodEntry& entry, uint32_t method, const uint32_t* data, uint32_t count, bool increasing) {
+    KelvinState& s = d.State();
+    uint32_t n = RunCount(entry, count, increasing);
+    for (uint32_t i = 0; i < n; i++) {
+        s.regs[method] = data[i];
+        d.ClearSurface(data[i]);
+    }
+    return n;
+}
+
+// ----------------------------------------------------------------------------
+
+static constexpr MethodTable BuildKelvinMethodTable() {
+    MethodTableBuilder b(Store);
+
+    b.Set(Mthd_KELVIN_NOTIFY, 1, Notify);
+    b.Set(Mthd_KELVIN_FLIP_INCREMENT_WRITE, 1, FlipIncrementWrite);
+    b.Set(Mthd_KELVIN_BACK_END_WRITE_SEMAPHORE_RELEASE, 1, SemaphoreRelease);
+    b.Set(Mthd_KELVIN_WAIT_FOR_IDLE, 1, Sync);
+    b.Set(Mthd_KELVIN_FLIP_STALL, 1, Sync);
+
+    // Surfaces
+    b.Set(Mthd_KELVIN_SET_CONTEXT_DMA_COLOR, 2, Store, KelvinDirty_Surface);
+    b.Set(Mthd_KELVIN_SET_SURFACE_CLIP_HORIZONTAL, 6, Store, KelvinDirty_Surface);
+
+    // Register combiners and shader stages
+    b.Set(Mthd_KELVIN_SET_COMBINER_ALPHA_ICW, 8, Store, KelvinDirty_Combiners);
+    b.Set(Mthd_KELVIN_SET_COMBINER_SPECULAR_FOG_CW0, 2, Store, KelvinDirty_Combiners);
+    b.Set(Mthd_KELVIN_SET_COMBINER_FACTOR0, 32, Store, KelvinDirty_Combiners);
+    b.Set(Mthd_KELVIN_SET_SPECULAR_FOG_FACTOR, 2, Store, KelvinDirty_Combiners);
+    b.Set(Mthd_KELVIN_SET_COMBINER_COLOR_OCW, 9, Store, KelvinDirty_Combiners);
+    b.Set(Mthd_KELVIN_SET_SHADER_STAGE_PROGRAM, 3, Store, KelvinDirty_Combiners);
+
+    // Fixed-function transform
+    b.Set(Mthd_KELVIN_SET_CONTROL0, 1, Store, KelvinDirty_Transform);
+    b.Set(Mthd_KELVIN_SET_SKIN_MODE, 1, Store, KelvinDirty_Transform);
+    b.Set(Mthd_KELVIN_SET_NORMALIZATION_ENABLE, 1, Store, KelvinDirty_Transform);
+    b.Set(Mthd_KELVIN_SET_TEXGEN_S, 16, Store, KelvinDirty_Transform);
+    b.Set(Mthd_KELVIN_SET_PROJECTION_MATRIX, (Mthd_KELVIN_SET_FOG_PARAMS - Mthd_KELVIN_SET_PROJECTION_MATRIX) >> 2, Store, KelvinDirty_Transform);
+    b.Set(Mthd_KELVIN_SET_TEXGEN_VIEW_MODEL, 1, Store, KelvinDirty_Transform);
+    b.Set(Mthd_KELVIN_SET_EYE_POSITION, 4, Store, KelvinDirty_Transform);
+    b.Set(Mthd_KELVIN_SET_TL_CONST_ZERO, 6, Store, KelvinDirty_Transform);
+    b.Set(Mthd_KELVIN_SET_EYE_VECTOR, 3, Store, KelvinDirty_Transform);
+    b.Set(Mthd_KELVIN_SET_POINT_SIZE, 1, Store, KelvinDirty_Transform);
+    b.Set(Mthd_KELVIN_SET_POINT_PARAMS_ENABLE, 1, Store, KelvinDirty_Transform);
+    b.Set(Mthd_KELVIN_SET_POINT_PARAMS, 8, Store, KelvinDirty_Transform);
+
+    // Lighting
+    b.Set(Mthd_KELVIN_SET_LIGHT_CONTROL, 2, Store, KelvinDirty_Lighting);
+    b.Set(Mthd_KELVIN_SET_LIGHTING_ENABLE, 1, Store, KelvinDirty_Lighting);
+    b.Set(Mthd_KELVIN_SET_MATERIAL_EMISSION, 6, Store, KelvinDirty_Lighting);
+    b.Set(Mthd_KELVIN_SET_SPECULAR_PARAMS, 6, Store, KelvinDirty_Lighting);
+    b.Set(Mthd_KELVIN_SET_SCENE_AMBIENT_COLOR, 3, Store, KelvinDirty_Lighting);
+    b.Set(Mthd_KELVIN_SET_BACK_LIGHT, (Mthd_KELVIN_SET_STIPPLE_CONTROL - Mthd_KELVIN_SET_BACK_LIGHT) >> 2, Store, KelvinDirty_Lighting);
+    b.Set(Mthd_KELVIN_SET_BACK_SCENE_AMBIENT_COLOR, 7, Store, KelvinDirty_Lighting);
+    b.Set(Mthd_KELVIN_SET_TWO_SIDE_LIGHT_EN, 1, Store, KelvinDirty_Lighting);
+    b.Set(Mthd_KELVIN_SET_BACK_SPECULAR_PARAMS, 6, Store, KelvinDirty_Lighting);
+
+    // Fog
+    b.Set(Mthd_KELVIN_SET_FOG_MODE, 4, Store, KelvinDirty_Fog);
+    b.Set(Mthd_KELVIN_SET_FOG_PARAMS, 3, Store, KelvinDirty_Fog);
+    b.Set(Mthd_KELVIN_SET_FOG_PLANE, 4, Store, KelvinDirty_Fog);
+    b.Set(Mthd_KELVIN_SET_LINEAR_FOG_CONST, 3, Store, KelvinDirty_Fog);
+
+    // Viewport and clipping
+    b.Set(Mthd_KELVIN_SET_WINDOW_CLIP_TYPE, 1, Store, KelvinDirty_Viewport);
+    b.Set(Mthd_KELVIN_SET_WINDOW_CLIP_HORIZONTAL, 16, Store, KelvinDirty_Viewport);
+    b.Set(Mthd_KELVIN_SET_CLIP_MIN, 2, Store, KelvinDirty_Viewport);
+    b.Set(Mthd_KELVIN_SET_VIEWPORT_OFFSET, 4, Store, KelvinDirty_Viewport);
+    b.Set(Mthd_KELVIN_SET_VIEWPORT_SCALE, 4, Store, KelvinDirty_Viewport);
+
+    // Rasterizer
+    b.Set(Mthd_KELVIN_SET_CULL_FACE_ENABLE, 1, Store, KelvinDirty_Rasterizer);
+    b.Set(Mthd_KELVIN_SET_POINT_SMOOTH_ENABLE, 3, Store, KelvinDirty_Rasterizer);
+    b.Set(Mthd_KELVIN_SET_POLY_OFFSET_POINT_ENABLE, 3, Store, KelvinDirty_Rasterizer);
+    b.Set(Mthd_KELVIN_SET_SHADE_MODE, 6, Store, KelvinDirty_Rasterizer);
+    b.Set(Mthd_KELVIN_SET_CULL_FACE, 2, Store, KelvinDirty_Rasterizer);
+    b.Set(Mthd_KELVIN_SET_FLAT_SHADE_OP, 1, Store, KelvinDirty_Rasterizer);
+    b.Set(Mthd_KELVIN_SET_SWATH_WIDTH, 1, Store, KelvinDirty_Rasterizer);
+    b.Set(Mthd_KELVIN_SET_STIPPLE_CONTROL, 33, Store, KelvinDirty_Rasterizer);
+    b.Set(Mthd_KELVIN_SET_SHADER_CLIP_PLANE_MODE, 1, Store, KelvinDirty_Rasterizer);
+
+    // Blending and output
+    b.Set(Mthd_KELVIN_SET_BLEND_ENABLE, 1, Store, KelvinDirty_Blend);
+    b.Set(Mthd_KELVIN_SET_DITHER_ENABLE, 1, Store, KelvinDirty_Blend);
+    b.Set(Mthd_KELVIN_SET_BLEND_FUNC_SFACTOR, 4, Store, KelvinDirty_Blend);
+    b.Set(Mthd_KELVIN_SET_COLOR_MASK, 1, Store, KelvinDirty_Blend);
+    b.Set(Mthd_KELVIN_SET_LOGIC_OP_ENABLE, 2, Store, KelvinDirty_Blend);
+
+    // Depth, stencil and alpha tests
+    b.Set(Mthd_KELVIN_SET_ALPHA_TEST_ENABLE, 1, Store, KelvinDirty_DepthStencil);
+    b.Set(Mthd_KELVIN_SET_DEPTH_TEST_ENABLE, 1, Store, KelvinDirty_DepthStencil);
+    b.Set(Mthd_KELVIN_SET_STENCIL_TEST_ENABLE, 1, Store, KelvinDirty_DepthStencil);
+    b.Set(Mthd_KELVIN_SET_ALPHA_FUNC, 2, Store, KelvinDirty_DepthStencil);
+    b.Set(Mthd_KELVIN_SET_DEPTH_FUNC, 1, Store, KelvinDirty_DepthStencil);
+    b.Set(Mthd_KELVIN_SET_DEPTH_MASK, 8, Store, KelvinDirty_DepthStencil);
+    b.Set(Mthd_KELVIN_SET_SHADOW_ZSLOPE_THRESHOLD, 2, Store, KelvinDirty_DepthStencil);
+
+    // Control
+    b.Set(Mthd_KELVIN_SET_ZMIN_MAX_CONTROL, 4, Store, KelvinDirty_Control);
+    b.Set(Mthd_KELVIN_SET_ZPASS_PIXEL_COUNT_ENABLE, 1, Store, KelvinDirty_Control);
+
+    // Textures
+    b.Set(Mthd_KELVIN_SET_CONTEXT_DMA_A, 2, Store, KelvinDirty_Textures);
+    for (uint32_t i = 0; i < kKelvinTextureCount; i++) {
+        b.Set(Mthd_KELVIN_SET_TEXTURE_OFFSET + i * kKelvinTextureStride, kKelvinTextureStride >> 2, Store, KelvinDirty_Texture0 << i);
+        b.Set(Mthd_KELVIN_SET_TEXTURE_MATRIX_ENABLE + i * 4, 1, Store, KelvinDirty_Transform);
+    }
+    b.Set(Mthd_KELVIN_SET_COLOR_KEY_COLOR, 4, Store, KelvinDirty_Combiners);
+
+    // Vertex arrays
+    b.Set(Mthd_KELVIN_SET_CONTEXT_DMA_VERTEX_A, 2, Store, KelvinDirty_VertexArrays);
+    b.Set(Mthd_KELVIN_SET_VERTEX_DATA_ARRAY_OFFSET, 2 * kKelvinAttributeCount, Store, KelvinDirty_VertexArrays);
+
+    // Transform program and constants
+    b.Set(Mthd_KELVIN_SET_TRANSFORM_PROGRAM, 32, TransformProgram, KelvinDirty_VertexProgram);
+    b.Set(Mthd_KELVIN_SET_TRANSFORM_CONSTANT, 32, TransformConstant, KelvinDirty_VertexConstants);
+    b.Set(Mthd_KELVIN_SET_TRANSFORM_EXECUTION_MODE, 2, Store, KelvinDirty_VertexProgram);
+    b.Set(Mthd_KELVIN_SET_TRANSFORM_PROGRAM_LOAD, 1, TransformProgramLoad);
+    b.Set(Mthd_KELVIN_SET_TRANSFORM_PROGRAM_START, 1, Store, KelvinDirty_VertexProgram);
+    b.Set(Mthd_KELVIN_SET_TRANSFORM_CONSTANT_LOAD, 1, TransformConstantLoad);
+
+    // Immediate mode attributes
+    b.Set(Mthd_KELVIN_SET_VERTEX3F, 3, SetAttributeFloats<Mthd_KELVIN_SET_VERTEX3F, kKelvinAttr_Position, 3>);
+    b.Set(Mthd_KELVIN_SET_VERTEX4F, 4, SetAttributeFloats<Mthd_KELVIN_SET_VERTEX4F, kKelvinAttr_Position, 4>);
+    b.Set(Mthd_KELVIN_SET_NORMAL3F, 3, SetAttributeFloats<Mthd_KELVIN_SET_NORMAL3F, kKelvinAttr_Normal, 3>);
+    b.Set(Mthd_KELVIN_SET_DIFFUSE_COLOR4F, 4, SetAttributeFloats<Mthd_KELVIN_SET_DIFFUSE_COLOR4F, kKelvinAttr_Diffuse, 4>);
+    b.Set(Mthd_KELVIN_SET_DIFFUSE_COLOR3F, 3, SetAttributeFloats<Mthd_KELVIN_SET_DIFFUSE_COLOR3F, kKelvinAttr_Diffuse, 3>);
+    b.Set(Mthd_KELVIN_SET_DIFFUSE_COLOR4UB, 1, SetAttributePacked<Mthd_KELVIN_SET_DIFFUSE_COLOR4UB, kKelvinAttr_Diffuse, PackedFormat::UB4>);
+    b.Set(Mthd_KELVIN_SET_SPECULAR_COLOR4F, 4, SetAttributeFloats<Mthd_KELVIN_SET_SPECULAR_COLOR4F, kKelvinAttr_Specular, 4>);
+    b.Set(Mthd_KELVIN_SET_SPECULAR_COLOR3F, 3, SetAttributeFloats<Mthd_KELVIN_SET_SPECULAR_COLOR3F, kKelvinAttr_Specular, 3>);
+    b.Set(Mthd_KELVIN_SET_SPECULAR_COLOR4UB, 1, SetAttributePacked<Mthd_KELVIN_SET_SPECULAR_COLOR4UB, kKelvinAttr_Specular, PackedFormat::UB4>);
+    b.Set(Mthd_KELVIN_SET_TEXCOORD0_2F + 0 * 0x28, 2, SetAttributeFloats<Mthd_KELVIN_SET_TEXCOORD0_2F + 0 * 0x28, kKelvinAttr_TexCoord0 + 0, 2>);
+    b.Set(Mthd_KELVIN_SET_TEXCOORD0_2F + 1 * 0x28, 2, SetAttributeFloats<Mthd_KELVIN_SET_TEXCOORD0_2F + 1 * 0x28, kKelvinAttr_TexCoord0 + 1, 2>);
+    b.Set(Mthd_KELVIN_SET_TEXCOORD0_2F + 2 * 0x28, 2, SetAttributeFloats<Mthd_KELVIN_SET_TEXCOORD0_2F + 2 * 0x28, kKelvinAttr_TexCoord0 + 2, 2>);
+    b.Set(Mthd_KELVIN_SET_TEXCOORD0_2F + 3 * 0x28, 2, SetAttributeFloats<Mthd_KELVIN_SET_TEXCOORD0_2F + 3 * 0x28, kKelvinAttr_TexCoord0 + 3, 2>);
+    b.Set(Mthd_KELVIN_SET_TEXCOORD0_4F + 0 * 0x28, 4, SetAttributeFloats<Mthd_KELVIN_SET_TEXCOORD0_4F + 0 * 0x28, kKelvinAttr_TexCoord0 + 0, 4>);
+    b.Set(Mthd_KELVIN_SET_TEXCOORD0_4F + 1 * 0x28, 4, SetAttributeFloats<Mthd_KELVIN_SET_TEXCOORD0_4F + 1 * 0x28, kKelvinAttr_TexCoord0 + 1, 4>);
+    b.Set(Mthd_KELVIN_SET_TEXCOORD0_4F + 2 * 0x28, 4, SetAttributeFloats<Mthd_KELVIN_SET_TEXCOORD0_4F + 2 * 0x28, kKelvinAttr_TexCoord0 + 2, 4>);
+    b.Set(Mthd_KELVIN_SET_TEXCOORD0_4F + 3 * 0x28, 4, SetAttributeFloats<Mthd_KELVIN_SET_TEXCOORD0_4F + 3 * 0x28, kKelvinAttr_TexCoord0 + 3, 4>);
+    b.Set(Mthd_KELVIN_SET_FOG1F, 1, SetAttributeFloats<Mthd_KELVIN_SET_FOG1F, kKelvinAttr_Fog, 1>);
+    b.Set(Mthd_KELVIN_SET_WEIGHT1F, 1, SetAttributeFloats<Mthd_KELVIN_SET_WEIGHT1F, kKelvinAttr_Weight, 1>);
+    b.Set(Mthd_KELVIN_SET_VERTEX_DATA2F_M, 2 * kKelvinAttributeCount, SetAttributeFloats<Mthd_KELVIN_SET_VERTEX_DATA2F_M, 0, 2>);
+    b.Set(Mthd_KELVIN_SET_VERTEX_DATA2S, kKelvinAttributeCount, SetAttributePacked<Mthd_KELVIN_SET_VERTEX_DATA2S, 0, PackedFormat::S2>);
+    b.Set(Mthd_KELVIN_SET_VERTEX_DATA4UB, kKelvinAttributeCount, SetAttributePacked<Mthd_KELVIN_SET_VERTEX_DATA4UB, 0, PackedFormat::UB4>);
+    b.Set(Mthd_KELVIN_SET_VERTEX_DATA4S_M, 2 * kKelvinAttributeCount, SetAttributePacked<Mthd_KELVIN_SET_VERTEX_DATA4S_M, 0, PackedFormat::S4>);
+    b.Set(Mthd_KELVIN_SET_VERTEX_DATA4F_M, 4 * kKelvinAttributeCount, SetAttributeFloats<Mthd_KELVIN_SET_VERTEX_DATA4F_M, 0, 4>);
+
+    // Primitives
+    b.Set(Mthd_KELVIN_SET_BEGIN_END, 1, BeginEnd);
+    b.Set(Mthd_KELVIN_ARRAY_ELEMENT16, 2, ArrayElement16);
+    b.Set(Mthd_KELVIN_ARRAY_ELEMENT32, 1, ArrayElement32);
+    b.Set(Mthd_KELVIN_DRAW_ARRAYS, 1, DrawArrays);
+    b.Set(Mthd_KELVIN_INLINE_ARRAY, 1, InlineArray);
+    b.Set(Mthd_KELVIN_CLEAR_SURFACE, 1, ClearSurface);
+
+    return b.Finish();
+}
+
+static constexpr MethodTable kKelvinMethodTable = BuildKelvinMethodTable();
+
+const MethodTable& GetKelvinMethodTable() {
+    return kKelvinMethodTable;
+}
+
+}
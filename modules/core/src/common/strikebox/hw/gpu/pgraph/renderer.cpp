@@ -0,0 +1,78 @@
+// StrikeBox NV2A PGRAPH renderer interface
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+#include "strikebox/hw/gpu/pgraph/renderer.h"
+
+#include "strikebox/log.h"
+
+namespace strikebox::nv2a {
+
+static LogRateLimiter s_unsupportedLimiter(16, 1000);
+
+static const char* GetPrimitiveName(KelvinPrimitive primitive) {
+    switch (primitive) {
+    case KelvinPrimitive::Points: return "points";
+    case KelvinPrimitive::Lines: return "lines";
+    case KelvinPrimitive::LineLoop: return "line loop";
+    case KelvinPrimitive::LineStrip: return "line strip";
+    default: return "unknown primitive";
+    }
+}
+
+void AssembleTriangles(KelvinPrimitive primitive, uint32_t vertexCount, std::vector<uint32_t>& indices) {
+    auto tri = [&](uint32_t a, uint32_t b, uint32_t c) {
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    };
+
+    switch (primitive) {
+    case KelvinPrimitive::Triangles:
+        for (uint32_t i = 0; i + 2 < vertexCount; i += 3) {
+            tri(i, i + 1, i + 2);
+        }
+        break;
+    case KelvinPrimitive::TriangleStrip:
+        // Every other triangle is flipped to keep the winding consistent
+        for (uint32_t i = 2; i < vertexCount; i++) {
+            if (i & 1) {
+                tri(i - 1, i - 2, i);
+            }
+            else {
+                tri(i - 2, i - 1, i);
+            }
+        }
+        break;
+    case KelvinPrimitive::TriangleFan:
+    case KelvinPrimitive::Polygon:
+        for (uint32_t i = 2; i < vertexCount; i++) {
+            tri(0, i - 1, i);
+        }
+        break;
+    case KelvinPrimitive::Quads:
+        for (uint32_t i = 0; i + 3 < vertexCount; i += 4) {
+            tri(i, i + 1, i + 2);
+            tri(i, i + 2, i + 3);
+        }
+        break;
+    case KelvinPrimitive::QuadStrip:
+        // Vertices 0, 1, 3, 2 form the first quad
+        for (uint32_t i = 0; i + 3 < vertexCount; i += 2) {
+            tri(i, i + 1, i + 3);
+            tri(i, i + 3, i + 2);
+        }
+        break;
+    default:
+        log_ratelimited(s_unsupportedLimiter, LOG_LEVEL_SPEW, "[NV2A] PGRAPH: Skipping %u vertices of %s (%u); only triangles are rasterized\n",
+            vertexCount, GetPrimitiveName(primitive), static_cast<uint32_t>(primitive));
+        break;
+    }
+}
+
+}
@@ -0,0 +1,312 @@
+// StrikeBox NV2A PGRAPH S3TC texture decoding
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+#include "strikebox/hw/gpu/pgraph/s3tc.h"
+#include "strikebox/hw/gpu/pgraph/simd.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace strikebox::nv2a {
+
+namespace {
+
+enum class BlockFormat { DXT1, DXT3, DXT5 };
+
+template <BlockFormat Format>
+constexpr uint32_t kBlockSize = (Format == BlockFormat::DXT1) ? kDXT1BlockSize : (Format == BlockFormat::DXT3) ? kDXT3BlockSize : kDXT5BlockSize;
+
+// Blocks decoded at a time and the texels they span horizontally
+const uint32_t kGroupBlocks = 4;
+const uint32_t kGroupWidth = kGroupBlocks * 4;
+
+#ifdef STRIKEBOX_SIMD_SSE2
+
+inline __m128i Select(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Returns all ones in the lanes where bit N is set
+template <int N>
+inline __m128i BitMask(__m128i v) {
+    return _mm_srai_epi32(_mm_slli_epi32(v, 31 - N), 31);
+}
+
+// Divide values of up to 7 * 255 held in 32-bit lanes, rounding down. The
+// reciprocals are exact for this range.
+inline __m128i Div3(__m128i x) { return _mm_mulhi_epu16(x, _mm_set1_epi32(0x5556)); }
+inline __m128i Div5(__m128i x) { return _mm_mulhi_epu16(x, _mm_set1_epi32(0x3334)); }
+inline __m128i Div7(__m128i x) { return _mm_mulhi_epu16(x, _mm_set1_epi32(0x2493)); }
+
+// Expands RGB565 colors in the low 16 bits of each lane into 8-bit channels
+inline void Expand565(__m128i c, __m128i& r, __m128i& g, __m128i& b) {
+    const __m128i mask5 = _mm_set1_epi32(0x1f);
+    r = _mm_and_si128(_mm_srli_epi32(c, 11), mask5);
+    g = _mm_and_si128(_mm_srli_epi32(c, 5), _mm_set1_epi32(0x3f));
+    b = _mm_and_si128(c, mask5);
+    r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+    g = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 4));
+    b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+}
+
+inline __m128i PackRGB(__m128i r, __m128i g, __m128i b) {
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(g, 8)), b);
+}
+
+// Returns (2 * a + b) / 3
+inline __m128i OneThird(__m128i a, __m128i b) {
+    return Div3(_mm_add_epi32(_mm_add_epi32(a, a), b));
+}
+
+// Decodes the color part of four blocks, one per lane. endpoints holds c0 in
+// bits 15..0 and c1 in bits 31..16, indices the 2-bit index of every texel.
+// alpha is combined with every color but transparent black.
+template <bool ThreeColorMode>
+inline void DecodeColors(__m128i endpoints, __m128i indices, __m128i alpha, __m128i* texels) {
+    __m128i c0 = _mm_and_si128(endpoints, _mm_set1_epi32(0xffff));
+    __m128i c1 = _mm_srli_epi32(endpoints, 16);
+    __m128i r0, g0, b0, r1, g1, b1;
+    Expand565(c0, r0, g0, b0);
+    Expand565(c1, r1, g1, b1);
+
+    __m128i colors[4];
+    colors[0] = _mm_or_si128(PackRGB(r0, g0, b0), alpha);
+    colors[1] = _mm_or_si128(PackRGB(r1, g1, b1), alpha);
+    colors[2] = _mm_or_si128(PackRGB(OneThird(r0, r1), OneThird(g0, g1), OneThird(b0, b1)), alpha);
+    colors[3] = _mm_or_si128(PackRGB(OneThird(r1, r0), OneThird(g1, g0), OneThird(b1, b0)), alpha);
+    if constexpr (ThreeColorMode) {
+        // Blocks whose first endpoint is not greater than the second use the
+        // midpoint and transparent black instead
+        __m128i fourColors = _mm_cmpgt_epi32(c0, c1);
+        auto half = [](__m128i a, __m128i b) { return _mm_srli_epi32(_mm_add_epi32(a, b), 1); };
+        __m128i midpoint = _mm_or_si128(PackRGB(half(r0, r1), half(g0, g1), half(b0, b1)), alpha);
+        colors[2] = Select(fourColors, colors[2], midpoint);
+        colors[3] = _mm_and_si128(fourColors, colors[3]);
+    }
+
+    for (uint32_t t = 0; t < 16; t++) {
+        __m128i bit0 = BitMask<0>(indices);
+        __m128i bit1 = BitMask<1>(indices);
+        texels[t] = Select(bit1, Select(bit0, colors[3], colors[2]), Select(bit0, colors[1], colors[0]));
+        indices = _mm_srli_epi32(indices, 2);
+    }
+}
+
+// Adds the explicit 4-bit alpha of DXT3 blocks. bits0 and bits1 hold the
+// alpha of texels 0..7 and 8..15.
+inline void DecodeExplicitAlpha(__m128i bits0, __m128i bits1, __m128i* texels) {
+    const __m128i mask = _mm_set1_epi32(0xf);
+    for (uint32_t t = 0; t < 16; t++) {
+        __m128i& bits = (t < 8) ? bits0 : bits1;
+        __m128i alpha = _mm_and_si128(bits, mask);
+        texels[t] = _mm_or_si128(texels[t], _mm_or_si128(_mm_slli_epi32(alpha, 24), _mm_slli_epi32(alpha, 28)));
+        bits = _mm_srli_epi32(bits, 4);
+    }
+}
+
+// Adds the interpolated alpha of DXT5 blocks. word0 holds both endpoints in
+// bits 15..0 followed by the first 16 bits of indices, word1 the other 32.
+inline void DecodeInterpolatedAlpha(__m128i word0, __m128i word1, __m128i* texels) {
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    __m128i a0 = _mm_and_si128(word0, byteMask);
+    __m128i a1 = _mm_and_si128(_mm_srli_epi32(word0, 8), byteMask);
+    auto weigh = [&](int w0, int w1) {
+        return _mm_add_epi32(_mm_mullo_epi16(a0, _mm_set1_epi32(w0)), _mm_mullo_epi16(a1, _mm_set1_epi32(w1)));
+    };
+
+    // Blocks whose first endpoint is greater than the second interpolate six
+    // values; the others interpolate four and add 0 and 255
+    __m128i eightValues = _mm_cmpgt_epi32(a0, a1);
+    __m128i values[8];
+    values[0] = a0;
+    values[1] = a1;
+    for (int i = 1; i <= 4; i++) {
+        values[i + 1] = Select(eightValues, Div7(weigh(7 - i, i)), Div5(weigh(5 - i, i)));
+    }
+    values[6] = _mm_and_si128(eightValues, Div7(weigh(2, 5)));
+    values[7] = Select(eightValues, Div7(weigh(1, 6)), byteMask);
+    for (__m128i& value : values) {
+        value = _mm_slli_epi32(value, 24);
+    }
+
+    // 3-bit indices of texels 0..7 and 8..15
+    __m128i indices[2] = {
+        _mm_or_si128(_mm_srli_epi32(word0, 16), _mm_slli_epi32(_mm_and_si128(word1, byteMask), 16)),
+        _mm_srli_epi32(word1, 8),
+    };
+    for (uint32_t t = 0; t < 16; t++) {
+        __m128i& index = indices[t >> 3];
+        __m128i bit0 = BitMask<0>(index);
+        __m128i bit1 = BitMask<1>(index);
+        __m128i bit2 = BitMask<2>(index);
+        __m128i low = Select(bit1, Select(bit0, values[3], values[2]), Select(bit0, values[1], values[0]));
+        __m128i high = Select(bit1, Select(bit0, values[7], values[6]), Select(bit0, values[5], values[4]));
+        texels[t] = _mm_or_si128(texels[t], Select(bit2, high, low));
+        index = _mm_srli_epi32(index, 3);
+    }
+}
+
+// Decodes four consecutive blocks into four rows of kGroupWidth texels
+template <BlockFormat Format>
+void DecodeGroup(const uint8_t* blocks, uint32_t* dst, uint32_t dstPitch) {
+    __m128i texels[16];
+    if constexpr (Format == BlockFormat::DXT1) {
+        __m128 blocks01 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)blocks));
+        __m128 blocks23 = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(blocks + 16)));
+        __m128i endpoints = _mm_castps_si128(_mm_shuffle_ps(blocks01, blocks23, _MM_SHUFFLE(2, 0, 2, 0)));
+        __m128i indices = _mm_castps_si128(_mm_shuffle_ps(blocks01, blocks23, _MM_SHUFFLE(3, 1, 3, 1)));
+        DecodeColors<true>(endpoints, indices, _mm_set1_epi32(static_cast<int32_t>(0xff000000)), texels);
+    }
+    else {
+        // Gather the Nth word of every block into lane N of word N
+        __m128 words[4];
+        for (uint32_t i = 0; i < 4; i++) {
+            words[i] = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(blocks + i * 16)));
+        }
+        _MM_TRANSPOSE4_PS(words[0], words[1], words[2], words[3]);
+        DecodeColors<false>(_mm_castps_si128(words[2]), _mm_castps_si128(words[3]), _mm_setzero_si128(), texels);
+        if constexpr (Format == BlockFormat::DXT3) {
+            DecodeExplicitAlpha(_mm_castps_si128(words[0]), _mm_castps_si128(words[1]), texels);
+        }
+        else {
+            DecodeInterpolatedAlpha(_mm_castps_si128(words[0]), _mm_castps_si128(words[1]), texels);
+        }
+    }
+
+    // Texels hold one block per lane; transpose each row into texel order
+    for (uint32_t y = 0; y < 4; y++) {
+        __m128 r0 = _mm_castsi128_ps(texels[y * 4 + 0]);
+        __m128 r1 = _mm_castsi128_ps(texels[y * 4 + 1]);
+        __m128 r2 = _mm_castsi128_ps(texels[y * 4 + 2]);
+        __m128 r3 = _mm_castsi128_ps(texels[y * 4 + 3]);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        uint32_t* row = dst + y * dstPitch;
+        _mm_storeu_ps((float*)(row + 0), r0);
+        _mm_storeu_ps((float*)(row + 4), r1);
+        _mm_storeu_ps((float*)(row + 8), r2);
+        _mm_storeu_ps((float*)(row + 12), r3);
+    }
+}
+
+#else
+
+inline uint32_t Expand5(uint32_t v) { return (v << 3) | (v >> 2); }
+inline uint32_t Expand6(uint32_t v) { return (v << 2) | (v >> 4); }
+
+template <BlockFormat Format>
+void DecodeBlock(const uint8_t* block, uint32_t* dst, uint32_t dstPitch) {
+    const uint8_t* colorBlock = (Format == BlockFormat::DXT1) ? block : block + 8;
+    uint16_t c0, c1;
+    uint32_t indices;
+    std::memcpy(&c0, colorBlock, 2);
+    std::memcpy(&c1, colorBlock + 2, 2);
+    std::memcpy(&indices, colorBlock + 4, 4);
+
+    uint32_t r[4] = { Expand5(c0 >> 11), Expand5(c1 >> 11) };
+    uint32_t g[4] = { Expand6((c0 >> 5) & 0x3f), Expand6((c1 >> 5) & 0x3f) };
+    uint32_t b[4] = { Expand5(c0 & 0x1f), Expand5(c1 & 0x1f) };
+    const uint32_t alpha = (Format == BlockFormat::DXT1) ? 0xff000000 : 0;
+    uint32_t colors[4];
+    for (uint32_t i = 0; i < 2; i++) {
+        colors[i] = alpha | (r[i] << 16) | (g[i] << 8) | b[i];
+    }
+    if (Format != BlockFormat::DXT1 || c0 > c1) {
+        colors[2] = alpha | (((2 * r[0] + r[1]) / 3) << 16) | (((2 * g[0] + g[1]) / 3) << 8) | ((2 * b[0] + b[1]) / 3);
+        colors[3] = alpha | (((r[0] + 2 * r[1]) / 3) << 16) | (((g[0] + 2 * g[1]) / 3) << 8) | ((b[0] + 2 * b[1]) / 3);
+    }
+    else {
+        colors[2] = alpha | (((r[0] + r[1]) / 2) << 16) | (((g[0] + g[1]) / 2) << 8) | ((b[0] + b[1]) / 2);
+        colors[3] = 0;
+    }
+
+    uint32_t alphas[16] = {};
+    if constexpr (Format == BlockFormat::DXT3) {
+        uint64_t bits;
+        std::memcpy(&bits, block, 8);
+        for (uint32_t t = 0; t < 16; t++) {
+            alphas[t] = ((bits >> (t * 4)) & 0xf) * 0x11;
+        }
+    }
+    else if constexpr (Format == BlockFormat::DXT5) {
+        uint32_t a0 = block[0], a1 = block[1];
+        uint32_t values[8] = { a0, a1 };
+        for (uint32_t i = 1; i <= 6; i++) {
+            values[i + 1] = (a0 > a1) ? ((7 - i) * a0 + i * a1) / 7
+                : (i <= 4) ? ((5 - i) * a0 + i * a1) / 5
+                : (i == 5) ? 0 : 0xff;
+        }
+        uint64_t bits = 0;
+        std::memcpy(&bits, block + 2, 6);
+        for (uint32_t t = 0; t < 16; t++) {
+            alphas[t] = values[(bits >> (t * 3)) & 7];
+        }
+    }
+
+    for (uint32_t t = 0; t < 16; t++) {
+        dst[(t >> 2) * dstPitch + (t & 3)] = colors[(indices >> (t * 2)) & 3] | (alphas[t] << 24);
+    }
+}
+
+// Decodes four consecutive blocks into four rows of kGroupWidth texels
+template <BlockFormat Format>
+void DecodeGroup(const uint8_t* blocks, uint32_t* dst, uint32_t dstPitch) {
+    for (uint32_t i = 0; i < kGroupBlocks; i++) {
+        DecodeBlock<Format>(blocks + i * kBlockSize<Format>, dst + i * 4, dstPitch);
+    }
+}
+
+#endif
+
+template <BlockFormat Format>
+void Decode(const uint8_t* src, uint32_t srcPitch, uint32_t* dst, uint32_t width, uint32_t height) {
+    const uint32_t blockSize = kBlockSize<Format>;
+    const uint32_t blocksWide = (width + 3) / 4;
+    alignas(16) uint8_t blocks[kGroupBlocks * 16];
+    alignas(16) uint32_t texels[4 * kGroupWidth];
+
+    for (uint32_t y = 0; y < height; y += 4) {
+        const uint8_t* row = src + (y / 4) * srcPitch;
+        const uint32_t rows = std::min(4u, height - y);
+        for (uint32_t bx = 0; bx < blocksWide; bx += kGroupBlocks) {
+            const uint32_t x = bx * 4;
+            const uint32_t columns = std::min(kGroupWidth, width - x);
+            uint32_t* out = dst + static_cast<size_t>(y) * width + x;
+            if (columns == kGroupWidth && rows == 4) {
+                DecodeGroup<Format>(row + bx * blockSize, out, width);
+                continue;
+            }
+
+            // Decode partial groups locally to stay within both buffers
+            uint32_t count = std::min(kGroupBlocks, blocksWide - bx);
+            std::memset(blocks, 0, sizeof(blocks));
+            std::memcpy(blocks, row + bx * blockSize, count * blockSize);
+            DecodeGroup<Format>(blocks, texels, kGroupWidth);
+            for (uint32_t r = 0; r < rows; r++) {
+                std::memcpy(out + r * width, texels + r * kGroupWidth, columns * sizeof(uint32_t));
+            }
+        }
+    }
+}
+
+}
+
+void DecodeDXT1(const uint8_t* src, uint32_t srcPitch, uint32_t* dst, uint32_t width, uint32_t height, const uint32_t*) {
+    Decode<BlockFormat::DXT1>(src, srcPitch, dst, width, height);
+}
+
+void DecodeDXT3(const uint8_t* src, uint32_t srcPitch, uint32_t* dst, uint32_t width, uint32_t height, const uint32_t*) {
+    Decode<BlockFormat::DXT3>(src, srcPitch, dst, width, height);
+}
+
+void DecodeDXT5(const uint8_t* src, uint32_t srcPitch, uint32_t* dst, uint32_t width, uint32_t height, const uint32_t*) {
+    Decode<BlockFormat::DXT5>(src, srcPitch, dst, width, height);
+}
+
+}
@@ -0,0 +1,139 @@
+// StrikeBox NV2A PGRAPH surface cache
+// (C) Ivan "StrikerX3" Oliveira
+#include "strikebox/hw/gpu/pgraph/surface_cache.h"
+#include "strikebox/hw/gpu/pgraph/swizzle.h"
+#include "strikebox/hw/gpu/state.h"
+
+#include "strikebox/log.h"
+
+#include <algorithm>
+
+namespace strikebox::nv2a {
+
+SurfaceCache::SurfaceCache(NV2A& nv2a, size_t capacity)
+    : m_nv2a(nv2a)
+    , m_capacity(std::max<size_t>(capacity, 2))
+{
+}
+
+CachedSurface* SurfaceCache::Acquire(const SurfaceDesc& desc) {
+    for (auto it = m_entries.begin(); it != m_entries.end(); ) {
+        auto next = std::next(it);
+        if (it->desc.SameLayout(desc)) {
+            m_entries.splice(m_entries.begin(), m_entries, it);
+            it->desc.tile = desc.tile;
+            Refresh(&*it);
+            m_stats.hits++;
+            return &*it;
+        }
+        if (it->desc.Overlaps(desc.address, desc.size)) {
+            // The memory is being reinterpreted; the old contents must be
+            // in guest memory before the new surface reads them
+            Drop(it);
+        }
+        it = next;
+    }
+
+    m_stats.misses++;
+    m_entries.emplace_front();
+    CachedSurface& surface = m_entries.front();
+    surface.desc = desc;
+    if (desc.swizzled) {
+        surface.pitch = desc.width * desc.bytesPerPixel;
+        surface.copy.resize(static_cast<size_t>(surface.pitch) * desc.height);
+        surface.data = surface.copy.data();
+        m_stats.bytes += surface.copy.size();
+        Load(surface);
+    }
+    else {
+        surface.pitch = desc.pitch;
+        surface.data = &m_nv2a.systemRAM[desc.address];
+    }
+
+    while (m_entries.size() > m_capacity) {
+        Drop(std::prev(m_entries.end()));
+    }
+    m_stats.entries = m_entries.size();
+    return &surface;
+}
+
+void SurfaceCache::MarkRendered(CachedSurface* surface) {
+    if (surface->copy.empty()) {
+        m_nv2a.MarkSystemRAMDirty(surface->desc.address, surface->desc.size, m_memoryView);
+    }
+    else {
+        surface->modified = true;
+    }
+}
+
+bool SurfaceCache::WriteBack(uint32_t address, uint32_t size) {
+    bool written = false;
+    for (CachedSurface& surface : m_entries) {
+        if (surface.modified && surface.desc.Overlaps(address, size)) {
+            Store(surface);
+            written = true;
+        }
+    }
+    return written;
+}
+
+void SurfaceCache::WriteBackAll() {
+    for (CachedSurface& surface : m_entries) {
+        if (surface.modified) {
+            Store(surface);
+        }
+    }
+}
+
+void SurfaceCache::InvalidateWrites(const std::vector<uint64_t>* dirtyPages) {
+    for (CachedSurface& surface : m_entries) {
+        if (!surface.copy.empty() && !surface.stale) {
+            surface.stale = (dirtyPages == nullptr) || GuestMemory::AnyPageDirty(*dirtyPages, surface.desc.address, surface.desc.size);
+        }
+    }
+}
+
+bool SurfaceCache::Refresh(CachedSurface* surface) {
+    if (!surface->stale) {
+        return false;
+    }
+    if (surface->modified) {
+        log_spew("[NV2A] PGRAPH: Guest wrote to surface at 0x%x with pending rendering; discarding rendering\n", surface->desc.address);
+    }
+    Load(*surface);
+    return true;
+}
+
+void SurfaceCache::Clear() {
+    WriteBackAll();
+    m_entries.clear();
+    m_stats.bytes = 0;
+    m_stats.entries = 0;
+}
+
+void SurfaceCache::Load(CachedSurface& surface) {
+    const SurfaceDesc& desc = surface.desc;
+    UnswizzleRect(&m_nv2a.systemRAM[desc.address], surface.copy.data(), surface.pitch, desc.width, desc.height, desc.bytesPerPixel);
+    surface.modified = false;
+    surface.stale = false;
+    m_stats.loads++;
+}
+
+void SurfaceCache::Store(CachedSurface& surface) {
+    const SurfaceDesc& desc = surface.desc;
+    SwizzleRect(surface.copy.data(), surface.pitch, &m_nv2a.systemRAM[desc.address], desc.width, desc.height, desc.bytesPerPixel);
+    m_nv2a.MarkSystemRAMDirty(desc.address, desc.size, m_memoryView);
+    surface.modified = false;
+    m_stats.writeBacks++;
+}
+
+void SurfaceCache::Drop(std::list<CachedSurface>::iterator it) {
+    if (it->modified) {
+        Store(*it);
+    }
+    m_stats.bytes -= it->copy.size();
+    m_entries.erase(it);
+    m_stats.entries = m_entries.size();
+}
+
+}
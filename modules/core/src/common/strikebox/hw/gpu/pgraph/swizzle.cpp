@@ -0,0 +1,308 @@
+// StrikeBox NV2A texture and surface swizzling
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+#include "strikebox/hw/gpu/pgraph/swizzle.h"
+#include "strikebox/hw/gpu/pgraph/simd.h"
+
+#include "strikebox/log.h"
+
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+namespace strikebox::nv2a {
+
+// Spreads the low bits of value into the set bits of mask
+static uint32_t DepositBits(uint32_t value, uint32_t mask) {
+    uint32_t result = 0;
+    for (uint32_t bit = 1; mask != 0; bit <<= 1) {
+        uint32_t lowest = mask & (~mask + 1);
+        if (value & bit) {
+            result |= lowest;
+        }
+        mask &= mask - 1;
+    }
+    return result;
+}
+
+void SwizzleTables::Init(uint32_t width, uint32_t height, uint32_t depth) {
+    // Assign offset bits to the axes in X, Y, Z order while they have bits left
+    uint32_t maskX = 0, maskY = 0, maskZ = 0;
+    uint32_t bit = 1;
+    for (uint32_t w = 1, h = 1, d = 1; w < width || h < height || d < depth; ) {
+        if (w < width) {
+            maskX |= bit;
+            bit <<= 1;
+            w <<= 1;
+        }
+        if (h < height) {
+            maskY |= bit;
+            bit <<= 1;
+            h <<= 1;
+        }
+        if (d < depth) {
+            maskZ |= bit;
+            bit <<= 1;
+            d <<= 1;
+        }
+    }
+
+    x.resize(width);
+    y.resize(height);
+    z.resize(depth);
+    for (uint32_t i = 0; i < width; i++) {
+        x[i] = DepositBits(i, maskX);
+    }
+    for (uint32_t i = 0; i < height; i++) {
+        y[i] = DepositBits(i, maskY);
+    }
+    for (uint32_t i = 0; i < depth; i++) {
+        z[i] = DepositBits(i, maskZ);
+    }
+}
+
+const SwizzleTables& SwizzleTables::Get(uint32_t width, uint32_t height, uint32_t depth) {
+    // Most callers convert the same size over and over; remember the last
+    // tables used by this thread to skip the lock
+    struct LastTables {
+        uint32_t width = 0, height = 0, depth = 0;
+        const SwizzleTables* tables = nullptr;
+    };
+    static thread_local LastTables last;
+    if (last.tables != nullptr && last.width == width && last.height == height && last.depth == depth) {
+        return *last.tables;
+    }
+
+    static std::mutex mutex;
+    static std::map<std::tuple<uint32_t, uint32_t, uint32_t>, std::unique_ptr<SwizzleTables>> cache;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto& entry = cache[std::make_tuple(width, height, depth)];
+    if (!entry) {
+        entry = std::make_unique<SwizzleTables>();
+        entry->Init(width, height, depth);
+    }
+    last = { width, height, depth, entry.get() };
+    return *entry;
+}
+
+// ----- Block kernels --------------------------------------------------------
+
+// Moves one 2x2 block between two linear rows and its four contiguous
+// swizzled texels
+template <uint32_t BPP, bool Swizzle>
+static inline void CopyBlock(uint8_t* swizzled, uint8_t* row0, uint8_t* row1) {
+    if constexpr (Swizzle) {
+        memcpy(swizzled, row0, BPP * 2);
+        memcpy(swizzled + BPP * 2, row1, BPP * 2);
+    }
+    else {
+        memcpy(row0, swizzled, BPP * 2);
+        memcpy(row1, swizzled + BPP * 2, BPP * 2);
+    }
+}
+
+#ifdef STRIKEBOX_SIMD_SSE2
+
+// Number of texels covered by one 16-byte row load
+template <uint32_t BPP>
+constexpr uint32_t kVectorTexels = (BPP <= 4) ? 16 / BPP : 0;
+
+// Moves 16 bytes worth of texels from two linear rows. blockBase is the
+// swizzled offset of the row pair and xTable points to the X offsets of the
+// first column.
+template <uint32_t BPP, bool Swizzle>
+static inline void CopyBlocksSSE2(uint8_t* base, uint32_t blockBase, const uint32_t* xTable, uint8_t* row0, uint8_t* row1) {
+    auto block = [&](uint32_t x) { return base + (blockBase | xTable[x]) * BPP; };
+
+    if constexpr (BPP == 4) {
+        // 4 texels per row, 2 blocks of 16 bytes
+        if constexpr (Swizzle) {
+            __m128i r0 = _mm_loadu_si128((const __m128i*)row0);
+            __m128i r1 = _mm_loadu_si128((const __m128i*)row1);
+            _mm_storeu_si128((__m128i*)block(0), _mm_unpacklo_epi64(r0, r1));
+            _mm_storeu_si128((__m128i*)block(2), _mm_unpackhi_epi64(r0, r1));
+        }
+        else {
+            __m128i b0 = _mm_loadu_si128((const __m128i*)block(0));
+            __m128i b1 = _mm_loadu_si128((const __m128i*)block(2));
+            _mm_storeu_si128((__m128i*)row0, _mm_unpacklo_epi64(b0, b1));
+            _mm_storeu_si128((__m128i*)row1, _mm_unpackhi_epi64(b0, b1));
+        }
+    }
+    else if constexpr (BPP == 2) {
+        // 8 texels per row, 4 blocks of 8 bytes
+        if constexpr (Swizzle) {
+            __m128i r0 = _mm_loadu_si128((const __m128i*)row0);
+            __m128i r1 = _mm_loadu_si128((const __m128i*)row1);
+            __m128i lo = _mm_unpacklo_epi32(r0, r1);
+            __m128i hi = _mm_unpackhi_epi32(r0, r1);
+            _mm_storel_epi64((__m128i*)block(0), lo);
+            _mm_storel_epi64((__m128i*)block(2), _mm_srli_si128(lo, 8));
+            _mm_storel_epi64((__m128i*)block(4), hi);
+            _mm_storel_epi64((__m128i*)block(6), _mm_srli_si128(hi, 8));
+        }
+        else {
+            __m128i lo = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)block(0)), _mm_loadl_epi64((const __m128i*)block(2)));
+            __m128i hi = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)block(4)), _mm_loadl_epi64((const __m128i*)block(6)));
+            // Gather the row 0 and row 1 halves of each pair of blocks
+            lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+            hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i*)row0, _mm_unpacklo_epi64(lo, hi));
+            _mm_storeu_si128((__m128i*)row1, _mm_unpackhi_epi64(lo, hi));
+        }
+    }
+    else if constexpr (BPP == 1) {
+        // 16 texels per row, 8 blocks of 4 bytes
+        if constexpr (Swizzle) {
+            __m128i r0 = _mm_loadu_si128((const __m128i*)row0);
+            __m128i r1 = _mm_loadu_si128((const __m128i*)row1);
+            __m128i lo = _mm_unpacklo_epi16(r0, r1);
+            __m128i hi = _mm_unpackhi_epi16(r0, r1);
+            for (uint32_t i = 0; i < 4; i++) {
+                uint32_t l = (uint32_t)_mm_cvtsi128_si32(lo);
+                uint32_t h = (uint32_t)_mm_cvtsi128_si32(hi);
+                memcpy(block(i * 2), &l, 4);
+                memcpy(block(8 + i * 2), &h, 4);
+                lo = _mm_srli_si128(lo, 4);
+                hi = _mm_srli_si128(hi, 4);
+            }
+        }
+        else {
+            uint32_t b[8];
+            for (uint32_t i = 0; i < 8; i++) {
+                memcpy(&b[i], block(i * 2), 4);
+            }
+            __m128i lo = _mm_setr_epi32((int)b[0], (int)b[1], (int)b[2], (int)b[3]);
+            __m128i hi = _mm_setr_epi32((int)b[4], (int)b[5], (int)b[6], (int)b[7]);
+            // Each 32-bit lane holds a row 0 pair followed by a row 1 pair;
+            // move the row 0 pairs to the low half and row 1 pairs to the high half
+            lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+            hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+            lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+            hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i*)row0, _mm_unpacklo_epi64(lo, hi));
+            _mm_storeu_si128((__m128i*)row1, _mm_unpackhi_epi64(lo, hi));
+        }
+    }
+}
+
+#endif
+
+// ----- Slice conversion -----------------------------------------------------
+
+// Converts one 2D slice. sliceBase is the swizzled offset of the slice.
+template <uint32_t BPP, bool Swizzle>
+static void ConvertSlice(uint8_t* swizzled, uint8_t* linear, uint32_t pitch, uint32_t width, uint32_t height,
+    const SwizzleTables& tables, uint32_t sliceBase) {
+    const uint32_t* xTable = tables.x.data();
+
+    if (width < 2 || height < 2) {
+        // Degenerate images have no 2x2 blocks
+        for (uint32_t y = 0; y < height; y++) {
+            uint8_t* row = linear + y * pitch;
+            uint32_t rowBase = sliceBase | tables.y[y];
+            for (uint32_t x = 0; x < width; x++) {
+                uint8_t* texel = swizzled + (rowBase | xTable[x]) * BPP;
+                if constexpr (Swizzle) {
+                    memcpy(texel, row + x * BPP, BPP);
+                }
+                else {
+                    memcpy(row + x * BPP, texel, BPP);
+                }
+            }
+        }
+        return;
+    }
+
+    for (uint32_t y = 0; y < height; y += 2) {
+        uint8_t* row0 = linear + y * pitch;
+        uint8_t* row1 = row0 + pitch;
+        uint32_t blockBase = sliceBase | tables.y[y];
+        uint32_t x = 0;
+#ifdef STRIKEBOX_SIMD_SSE2
+        if constexpr (kVectorTexels<BPP> != 0) {
+            for (; x + kVectorTexels<BPP> <= width; x += kVectorTexels<BPP>) {
+                CopyBlocksSSE2<BPP, Swizzle>(swizzled, blockBase, xTable + x, row0 + x * BPP, row1 + x * BPP);
+            }
+        }
+#endif
+        for (; x < width; x += 2) {
+            CopyBlock<BPP, Swizzle>(swizzled + (blockBase | xTable[x]) * BPP, row0 + x * BPP, row1 + x * BPP);
+        }
+    }
+}
+
+template <bool Swizzle>
+static void ConvertBox(uint8_t* swizzled, uint8_t* linear, uint32_t rowPitch, uint32_t slicePitch,
+    uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerTexel) {
+    if (width == 0 || height == 0 || depth == 0) {
+        return;
+    }
+
+    const SwizzleTables& tables = SwizzleTables::Get(width, height, depth);
+
+    for (uint32_t z = 0; z < depth; z++) {
+        uint8_t* slice = linear + z * slicePitch;
+        uint32_t sliceBase = tables.z[z];
+        switch (bytesPerTexel) {
+        case 1: ConvertSlice<1, Swizzle>(swizzled, slice, rowPitch, width, height, tables, sliceBase); break;
+        case 2: ConvertSlice<2, Swizzle>(swizzled, slice, rowPitch, width, height, tables, sliceBase); break;
+        case 4: ConvertSlice<4, Swizzle>(swizzled, slice, rowPitch, width, height, tables, sliceBase); break;
+        case 8: ConvertSlice<8, Swizzle>(swizzled, slice, rowPitch, width, height, tables, sliceBase); break;
+        default:
+            log_warning("Swizzle: unsupported texel size %u\n", bytesPerTexel);
+            return;
+        }
+    }
+}
+
+// ----- Public interface -----------------------------------------------------
+
+void SwizzleRect(const uint8_t* src, uint32_t srcPitch, uint8_t* dst, uint32_t width, uint32_t height, uint32_t bytesPerTexel) {
+    ConvertBox<true>(dst, const_cast<uint8_t*>(src), srcPitch, 0, width, height, 1, bytesPerTexel);
+}
+
+void UnswizzleRect(const uint8_t* src, uint8_t* dst, uint32_t dstPitch, uint32_t width, uint32_t height, uint32_t bytesPerTexel) {
+    ConvertBox<false>(const_cast<uint8_t*>(src), dst, dstPitch, 0, width, height, 1, bytesPerTexel);
+}
+
+void SwizzleBox(const uint8_t* src, uint32_t srcRowPitch, uint32_t srcSlicePitch, uint8_t* dst,
+    uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerTexel) {
+    ConvertBox<true>(dst, const_cast<uint8_t*>(src), srcRowPitch, srcSlicePitch, width, height, depth, bytesPerTexel);
+}
+
+void UnswizzleBox(const uint8_t* src, uint8_t* dst, uint32_t dstRowPitch, uint32_t dstSlicePitch,
+    uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerTexel) {
+    ConvertBox<false>(const_cast<uint8_t*>(src), dst, dstRowPitch, dstSlicePitch, width, height, depth, bytesPerTexel);
+}
+
+uint32_t GetCubeFaceStride(uint32_t width, uint32_t height, uint32_t bytesPerTexel, uint32_t levels) {
+    uint32_t size = 0;
+    for (uint32_t level = 0; level < levels; level++) {
+        size += width * height * bytesPerTexel;
+        if (width > 1) width >>= 1;
+        if (height > 1) height >>= 1;
+    }
+    return (size + kCubeFaceAlignment - 1) & ~(kCubeFaceAlignment - 1);
+}
+
+void SwizzleCubeFace(const uint8_t* src, uint32_t srcPitch, uint8_t* cube, uint32_t face, uint32_t faceStride, uint32_t levelOffset,
+    uint32_t width, uint32_t height, uint32_t bytesPerTexel) {
+    SwizzleRect(src, srcPitch, cube + face * faceStride + levelOffset, width, height, bytesPerTexel);
+}
+
+void UnswizzleCubeFace(const uint8_t* cube, uint32_t face, uint32_t faceStride, uint32_t levelOffset, uint8_t* dst, uint32_t dstPitch,
+    uint32_t width, uint32_t height, uint32_t bytesPerTexel) {
+    UnswizzleRect(cube + face * faceStride + levelOffset, dst, dstPitch, width, height, bytesPerTexel);
+}
+
+}
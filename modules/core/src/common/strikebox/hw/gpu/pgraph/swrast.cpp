@@ -0,0 +1,788 @@
+// StrikeBox NV2A PGRAPH software rasterizer
+// (C) Ivan "StrikerX3" Oliveira
+#include "strikebox/hw/gpu/pgraph/swrast.h"
+#include "strikebox/hw/gpu/pgraph/simd.h"
+
+#include "strikebox/log.h"
+#include "strikebox/thread.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace strikebox::nv2a {
+
+using simd::F4;
+using simd::M4;
+
+std::unique_ptr<Renderer> CreateSoftwareRenderer() {
+    return std::make_unique<SoftwareRenderer>();
+}
+
+// --- Pixel formats ---------------
+
+// Packs an 8-bit per channel color into the surface format
+static inline uint32_t PackColor(SurfaceColorFormat format, uint32_t a, uint32_t r, uint32_t g, uint32_t b) {
+    switch (format) {
+    case SurfaceColorFormat::X1R5G5B5_Z1R5G5B5: return ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+    case SurfaceColorFormat::X1R5G5B5_O1R5G5B5: return 0x8000 | ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+    case SurfaceColorFormat::R5G6B5: return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+    case SurfaceColorFormat::X8R8G8B8_Z8R8G8B8: return (r << 16) | (g << 8) | b;
+    case SurfaceColorFormat::X8R8G8B8_O8R8G8B8: return 0xff000000 | (r << 16) | (g << 8) | b;
+    case SurfaceColorFormat::X1A7R8G8B8_Z1A7R8G8B8: return ((a >> 1) << 24) | (r << 16) | (g << 8) | b;
+    case SurfaceColorFormat::X1A7R8G8B8_O1A7R8G8B8: return 0x80000000 | ((a >> 1) << 24) | (r << 16) | (g << 8) | b;
+    case SurfaceColorFormat::A8R8G8B8: return (a << 24) | (r << 16) | (g << 8) | b;
+    case SurfaceColorFormat::B8: return b;
+    case SurfaceColorFormat::G8B8: return (g << 8) | b;
+    default: return 0;
+    }
+}
+
+// Converts an ARGB8888 channel mask into a mask of the bits written to the
+// surface format. Padding bits are always written.
+static inline uint32_t PackColorMask(SurfaceColorFormat format, uint32_t argbMask) {
+    uint32_t a = (argbMask >> 24) & 0xff;
+    uint32_t r = (argbMask >> 16) & 0xff;
+    uint32_t g = (argbMask >> 8) & 0xff;
+    uint32_t b = argbMask & 0xff;
+    uint32_t mask = PackColor(format, a, r, g, b);
+    switch (format) {
+    case SurfaceColorFormat::X1R5G5B5_Z1R5G5B5:
+    case SurfaceColorFormat::X1R5G5B5_O1R5G5B5: return mask | 0x8000;
+    case SurfaceColorFormat::X8R8G8B8_Z8R8G8B8:
+    case SurfaceColorFormat::X8R8G8B8_O8R8G8B8: return mask | 0xff000000;
+    case SurfaceColorFormat::X1A7R8G8B8_Z1A7R8G8B8:
+    case SurfaceColorFormat::X1A7R8G8B8_O1A7R8G8B8: return mask | 0x80000000;
+    default: return mask;
+    }
+}
+
+static inline uint32_t ReadPixel(const uint8_t* p, uint32_t size) {
+    switch (size) {
+    case 1: return *p;
+    case 2: { uint16_t v; std::memcpy(&v, p, 2); return v; }
+    default: { uint32_t v; std::memcpy(&v, p, 4); return v; }
+    }
+}
+
+static inline void WritePixel(uint8_t* p, uint32_t size, uint32_t value) {
+    switch (size) {
+    case 1: *p = static_cast<uint8_t>(value); break;
+    case 2: { uint16_t v = static_cast<uint16_t>(value); std::memcpy(p, &v, 2); break; }
+    default: std::memcpy(p, &value, 4); break;
+    }
+}
+
+static inline void WriteMaskedPixel(uint8_t* p, uint32_t size, uint32_t value, uint32_t mask) {
+    if (mask != 0xffffffff) {
+        value = (ReadPixel(p, size) & ~mask) | (value & mask);
+    }
+    WritePixel(p, size, value);
+}
+
+static inline bool CompareDepth(CompareFunc func, uint32_t value, uint32_t ref) {
+    switch (func) {
+    case CompareFunc::Never: return false;
+    case CompareFunc::Less: return value < ref;
+    case CompareFunc::Equal: return value == ref;
+    case CompareFunc::LessEqual: return value <= ref;
+    case CompareFunc::Greater: return value > ref;
+    case CompareFunc::NotEqual: return value != ref;
+    case CompareFunc::GreaterEqual: return value >= ref;
+    default: return true;
+    }
+}
+
+// Margin added to the depth range of triangles, covering rounding differences
+// between the evaluation at the corners of a rectangle and at each pixel
+static const float kDepthBoundsMargin = 2.0f;
+
+SoftwareRenderer::DepthBoundsTest SoftwareRenderer::TestDepthBounds(CompareFunc func, uint32_t zmin, uint32_t zmax, const DepthBounds& bounds) {
+    // Reject if no pixel can pass; accept if every pixel passes
+    bool reject, accept;
+    switch (func) {
+    case CompareFunc::Never: reject = true; accept = false; break;
+    case CompareFunc::Less: reject = zmin >= bounds.max; accept = zmax < bounds.min; break;
+    case CompareFunc::Equal:
+        reject = zmax < bounds.min || zmin > bounds.max;
+        accept = zmin == zmax && bounds.min == bounds.max && zmin == bounds.min;
+        break;
+    case CompareFunc::LessEqual: reject = zmin > bounds.max; accept = zmax <= bounds.min; break;
+    case CompareFunc::Greater: reject = zmax <= bounds.min; accept = zmin > bounds.max; break;
+    case CompareFunc::NotEqual:
+        reject = zmin == zmax && bounds.min == bounds.max && zmin == bounds.min;
+        accept = zmax < bounds.min || zmin > bounds.max;
+        break;
+    case CompareFunc::GreaterEqual: reject = zmax < bounds.min; accept = zmin >= bounds.max; break;
+    default: reject = false; accept = true; break;
+    }
+    return reject ? DepthBoundsTest::Reject : accept ? DepthBoundsTest::Accept : DepthBoundsTest::Test;
+}
+
+void SoftwareRenderer::UpdateDepthBounds(DepthBounds& bounds, CompareFunc func, uint32_t zmin, uint32_t zmax, bool covered) {
+    // Every pixel keeps the lesser (or greater) of the old and new values when
+    // the triangle covers the tile, so the range can also shrink
+    switch (func) {
+    case CompareFunc::Never:
+    case CompareFunc::Equal:
+        // Values never change
+        break;
+    case CompareFunc::Less:
+    case CompareFunc::LessEqual:
+        bounds.min = std::min(bounds.min, zmin);
+        bounds.max = covered ? std::min(bounds.max, zmax) : std::max(bounds.max, zmax);
+        break;
+    case CompareFunc::Greater:
+    case CompareFunc::GreaterEqual:
+        bounds.min = covered ? std::max(bounds.min, zmin) : std::min(bounds.min, zmin);
+        bounds.max = std::max(bounds.max, zmax);
+        break;
+    case CompareFunc::Always:
+        bounds.min = covered ? zmin : std::min(bounds.min, zmin);
+        bounds.max = covered ? zmax : std::max(bounds.max, zmax);
+        break;
+    default:
+        bounds.min = std::min(bounds.min, zmin);
+        bounds.max = std::max(bounds.max, zmax);
+        break;
+    }
+}
+
+// --- Setup and binning -----------
+
+SoftwareRenderer::SoftwareRenderer(uint32_t numWorkers) {
+    if (numWorkers == 0) {
+        uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+        numWorkers = cores - 1;
+    }
+    for (uint32_t i = 0; i < numWorkers; i++) {
+        m_workers.emplace_back([this]() { WorkerThread(); });
+    }
+}
+
+SoftwareRenderer::~SoftwareRenderer() {
+    Flush();
+    {
+        std::lock_guard<std::mutex> lk(m_poolMutex);
+        m_quit = true;
+    }
+    m_workCond.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void SoftwareRenderer::SetSurfaces(const SurfaceTarget& target) {
+    Flush();
+    m_target = target;
+
+    uint32_t right = target.clipX + target.clipWidth;
+    uint32_t bottom = target.clipY + target.clipHeight;
+    m_tilesX = (right + kSWRastTileSize - 1) >> kSWRastTileShift;
+    m_tilesY = (bottom + kSWRastTileSize - 1) >> kSWRastTileShift;
+    m_bins.resize(m_tilesX * m_tilesY);
+
+    // Depth ranges are computed on first use
+    m_depthBounds.clear();
+    if (target.zetaCompressed && m_target.zeta != nullptr && GetZetaFormatSize(m_target.zetaFormat) != 0) {
+        m_depthBounds.assign(m_tilesX * m_tilesY, DepthBounds{ 0, 0, false });
+    }
+}
+
+void SoftwareRenderer::InvalidateZeta(uint32_t offset, uint32_t size) {
+    if (m_depthBounds.empty() || size == 0) {
+        return;
+    }
+
+    if (m_target.zetaPitch == 0) {
+        for (DepthBounds& bounds : m_depthBounds) {
+            bounds.valid = false;
+        }
+        return;
+    }
+
+    uint32_t firstRow = offset / m_target.zetaPitch;
+    uint32_t lastRow = static_cast<uint32_t>((static_cast<uint64_t>(offset) + size - 1) / m_target.zetaPitch);
+    uint32_t ty1 = std::min(lastRow >> kSWRastTileShift, m_tilesY - 1);
+    for (uint32_t ty = firstRow >> kSWRastTileShift; ty <= ty1; ty++) {
+        for (uint32_t tx = 0; tx < m_tilesX; tx++) {
+            m_depthBounds[ty * m_tilesX + tx].valid = false;
+        }
+    }
+}
+
+void SoftwareRenderer::DrawTriangles(const RasterState& state, const RasterVertex* vertices, const uint32_t* indices, uint32_t indexCount) {
+    if (m_target.color == nullptr && m_target.zeta == nullptr) {
+        return;
+    }
+    if (m_triangles.size() + indexCount / 3 > kSWRastMaxTriangles) {
+        Flush();
+    }
+
+    uint32_t stateIndex = static_cast<uint32_t>(m_states.size());
+    m_states.push_back(state);
+    for (uint32_t i = 0; i + 2 < indexCount; i += 3) {
+        SetupTriangle(stateIndex, vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]]);
+    }
+}
+
+void SoftwareRenderer::Clear(const ClearParams& params) {
+    if (m_target.color == nullptr && m_target.zeta == nullptr) {
+        return;
+    }
+    int32_t minX = std::max<int32_t>(params.x1, m_target.clipX);
+    int32_t minY = std::max<int32_t>(params.y1, m_target.clipY);
+    int32_t maxX = std::min<int32_t>(params.x2, m_target.clipX + m_target.clipWidth - 1);
+    int32_t maxY = std::min<int32_t>(params.y2, m_target.clipY + m_target.clipHeight - 1);
+    if (minX > maxX || minY > maxY) {
+        return;
+    }
+
+    uint32_t index = static_cast<uint32_t>(m_clears.size());
+    m_clears.push_back(params);
+    uint32_t job = static_cast<uint32_t>(m_jobs.size());
+    m_jobs.push_back({ JobType::Clear, index });
+    BinJob(job, minX, minY, maxX, maxY);
+}
+
+void SoftwareRenderer::SetupTriangle(uint32_t state, const RasterVertex& v0, const RasterVertex& v1, const RasterVertex& v2) {
+    const RasterVertex* v[3] = { &v0, &v1, &v2 };
+
+    // Snap positions to 1/16 pixel
+    float x[3], y[3];
+    for (int i = 0; i < 3; i++) {
+        x[i] = std::round(v[i]->position[0] * 16.0f) * (1.0f / 16.0f);
+        y[i] = std::round(v[i]->position[1] * 16.0f) * (1.0f / 16.0f);
+        if (!std::isfinite(x[i]) || !std::isfinite(y[i])) {
+            return;
+        }
+    }
+
+    // Window coordinates have Y pointing down, so a positive area means the
+    // vertices are in clockwise order
+    float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0.0f) {
+        return;
+    }
+    bool cw = area > 0.0f;
+    const RasterState& rs = m_states[state];
+    if ((cw && rs.cullCW) || (!cw && rs.cullCCW)) {
+        return;
+    }
+    if (!cw) {
+        std::swap(v[1], v[2]);
+        std::swap(x[1], x[2]);
+        std::swap(y[1], y[2]);
+        area = -area;
+    }
+
+    Triangle tri;
+    tri.state = state;
+    tri.topLeftMask = 0;
+
+    // Edge N is opposite to vertex N and evaluates to the area of the
+    // sub-triangle formed with the point, which is positive inside
+    for (int i = 0; i < 3; i++) {
+        int a = (i + 1) % 3;
+        int b = (i + 2) % 3;
+        Plane& e = tri.edges[i];
+        e.a = y[a] - y[b];
+        e.b = x[b] - x[a];
+        e.c = -(e.a * x[a] + e.b * y[a]);
+        if (e.a > 0.0f || (e.a == 0.0f && e.b > 0.0f)) {
+            tri.topLeftMask |= 1 << i;
+        }
+    }
+
+    // Attribute planes are the barycentric weights (edge / area) applied to
+    // the vertex values
+    float invArea = 1.0f / area;
+    auto makePlane = [&](float a0, float a1, float a2) {
+        return Plane{
+            (a0 * tri.edges[0].a + a1 * tri.edges[1].a + a2 * tri.edges[2].a) * invArea,
+            (a0 * tri.edges[0].b + a1 * tri.edges[1].b + a2 * tri.edges[2].b) * invArea,
+            (a0 * tri.edges[0].c + a1 * tri.edges[1].c + a2 * tri.edges[2].c) * invArea,
+        };
+    };
+    tri.z = makePlane(v[0]->position[2], v[1]->position[2], v[2]->position[2]);
+
+    // Attributes are interpolated as value / w and divided by the
+    // interpolated 1 / w. Vertices without a usable w are interpolated
+    // linearly in screen space.
+    float invW[3];
+    for (int i = 0; i < 3; i++) {
+        float w = v[i]->position[3];
+        invW[i] = (std::isfinite(w) && w > 0.0f) ? 1.0f / w : 0.0f;
+    }
+    if (invW[0] == 0.0f || invW[1] == 0.0f || invW[2] == 0.0f || !std::isfinite(invW[0] + invW[1] + invW[2])) {
+        invW[0] = invW[1] = invW[2] = 1.0f;
+    }
+    tri.invW = makePlane(invW[0], invW[1], invW[2]);
+    auto makeAttribute = [&](const float* a0, const float* a1, const float* a2, uint32_t c) {
+        return makePlane(a0[c] * invW[0], a1[c] * invW[1], a2[c] * invW[2]);
+    };
+
+    tri.inputs = rs.combiner ? rs.combiner->GetInputMask() : CombinerInput_Diffuse;
+    if (tri.inputs & CombinerInput_Diffuse) {
+        for (uint32_t c = 0; c < 4; c++) {
+            tri.diffuse[c] = makeAttribute(v[0]->diffuse, v[1]->diffuse, v[2]->diffuse, c);
+        }
+    }
+    if (tri.inputs & CombinerInput_Specular) {
+        for (uint32_t c = 0; c < 4; c++) {
+            tri.specular[c] = makeAttribute(v[0]->specular, v[1]->specular, v[2]->specular, c);
+        }
+    }
+    if (tri.inputs & CombinerInput_Fog) {
+        tri.fog = makeAttribute(v[0]->fog, v[1]->fog, v[2]->fog, 0);
+    }
+    for (uint32_t stage = 0; stage < kKelvinTextureCount; stage++) {
+        if (tri.inputs & (CombinerInput_TexCoord0 << stage)) {
+            for (uint32_t c = 0; c < 4; c++) {
+                tri.texCoords[stage][c] = makeAttribute(v[0]->texCoords[stage], v[1]->texCoords[stage], v[2]->texCoords[stage], c);
+            }
+        }
+    }
+
+    // Pixels are covered if their centers are inside the triangle
+    float minX = std::min({ x[0], x[1], x[2] });
+    float minY = std::min({ y[0], y[1], y[2] });
+    float maxX = std::max({ x[0], x[1], x[2] });
+    float maxY = std::max({ y[0], y[1], y[2] });
+    int32_t clipRight = static_cast<int32_t>(m_target.clipX + m_target.clipWidth) - 1;
+    int32_t clipBottom = static_cast<int32_t>(m_target.clipY + m_target.clipHeight) - 1;
+    tri.minX = static_cast<int32_t>(std::max<float>(std::ceil(minX - 0.5f), static_cast<float>(m_target.clipX)));
+    tri.minY = static_cast<int32_t>(std::max<float>(std::ceil(minY - 0.5f), static_cast<float>(m_target.clipY)));
+    tri.maxX = static_cast<int32_t>(std::min<float>(std::floor(maxX - 0.5f), static_cast<float>(clipRight)));
+    tri.maxY = static_cast<int32_t>(std::min<float>(std::floor(maxY - 0.5f), static_cast<float>(clipBottom)));
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY) {
+        return;
+    }
+
+    uint32_t index = static_cast<uint32_t>(m_triangles.size());
+    m_triangles.push_back(tri);
+    uint32_t job = static_cast<uint32_t>(m_jobs.size());
+    m_jobs.push_back({ JobType::Triangle, index });
+    BinJob(job, tri.minX, tri.minY, tri.maxX, tri.maxY);
+}
+
+void SoftwareRenderer::BinJob(uint32_t job, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY) {
+    uint32_t tx0 = minX >> kSWRastTileShift;
+    uint32_t ty0 = minY >> kSWRastTileShift;
+    uint32_t tx1 = maxX >> kSWRastTileShift;
+    uint32_t ty1 = maxY >> kSWRastTileShift;
+    for (uint32_t ty = ty0; ty <= ty1; ty++) {
+        for (uint32_t tx = tx0; tx <= tx1; tx++) {
+            uint32_t tile = ty * m_tilesX + tx;
+            std::vector<uint32_t>& bin = m_bins[tile];
+            if (bin.empty()) {
+                m_activeTiles.push_back(tile);
+            }
+            bin.push_back(job);
+        }
+    }
+}
+
+// --- Tile rendering --------------
+
+void SoftwareRenderer::RenderTile(uint32_t tile) {
+    int32_t tx = tile % m_tilesX;
+    int32_t ty = tile / m_tilesX;
+    int32_t x0 = std::max<int32_t>(tx << kSWRastTileShift, m_target.clipX);
+    int32_t y0 = std::max<int32_t>(ty << kSWRastTileShift, m_target.clipY);
+    int32_t x1 = std::min<int32_t>(((tx + 1) << kSWRastTileShift) - 1, m_target.clipX + m_target.clipWidth - 1);
+    int32_t y1 = std::min<int32_t>(((ty + 1) << kSWRastTileShift) - 1, m_target.clipY + m_target.clipHeight - 1);
+
+    // Pixel centers at the corners of the tile
+    F4 cornerX = F4::Set(x0 + 0.5f, x1 + 0.5f, x0 + 0.5f, x1 + 0.5f);
+    F4 cornerY = F4::Set(y0 + 0.5f, y0 + 0.5f, y1 + 0.5f, y1 + 0.5f);
+    F4 zero = F4::Splat(0.0f);
+
+    DepthBounds* bounds = m_depthBounds.empty() ? nullptr : &m_depthBounds[tile];
+    bool z24 = m_target.zetaFormat == SurfaceZetaFormat::Z24S8;
+    float zMax = z24 ? 16777215.0f : 65535.0f;
+
+    for (uint32_t jobIndex : m_bins[tile]) {
+        const Job& job = m_jobs[jobIndex];
+        if (job.type == JobType::Clear) {
+            const ClearParams& params = m_clears[job.index];
+            int32_t cx0 = std::max<int32_t>(x0, params.x1);
+            int32_t cy0 = std::max<int32_t>(y0, params.y1);
+            int32_t cx1 = std::min<int32_t>(x1, params.x2);
+            int32_t cy1 = std::min<int32_t>(y1, params.y2);
+            ClearTile(params, cx0, cy0, cx1, cy1);
+
+            if (bounds != nullptr && (params.flags & Val_KELVIN_CLEAR_SURFACE_Z) && cx0 <= cx1 && cy0 <= cy1) {
+                uint32_t value = z24 ? (params.zstencil >> 8) : (params.zstencil & 0xffff);
+                if (cx0 == x0 && cy0 == y0 && cx1 == x1 && cy1 == y1) {
+                    *bounds = DepthBounds{ value, value, true };
+                }
+                else if (bounds->valid) {
+                    bounds->min = std::min(bounds->min, value);
+                    bounds->max = std::max(bounds->max, value);
+                }
+            }
+            continue;
+        }
+
+        const Triangle& tri = m_triangles[job.index];
+
+        // Skip the tile if it lies entirely outside of any edge. The triangle
+        // covers the tile if all corners are strictly inside every edge.
+        bool outside = false;
+        bool covered = true;
+        for (int i = 0; i < 3; i++) {
+            const Plane& e = tri.edges[i];
+            F4 value = simd::MulAdd(F4::Splat(e.a), cornerX, simd::MulAdd(F4::Splat(e.b), cornerY, F4::Splat(e.c)));
+            if ((value >= zero).Bits() == 0) {
+                outside = true;
+                break;
+            }
+            covered = covered && (value > zero).Bits() == 0xf;
+        }
+        if (outside) {
+            continue;
+        }
+
+        int32_t rx0 = std::max(x0, tri.minX);
+        int32_t ry0 = std::max(y0, tri.minY);
+        int32_t rx1 = std::min(x1, tri.maxX);
+        int32_t ry1 = std::min(y1, tri.maxY);
+        if (rx0 > rx1 || ry0 > ry1) {
+            continue;
+        }
+
+        // Test the depth range of the triangle against that of the tile. The
+        // depth plane reaches its extremes at the corners of the rectangle.
+        const RasterState& state = m_states[tri.state];
+        DepthBoundsTest depthBoundsTest = DepthBoundsTest::Test;
+        uint32_t zmin = 0;
+        uint32_t zmax = static_cast<uint32_t>(zMax);
+        if (bounds != nullptr && state.depthTest) {
+            if (!bounds->valid) {
+                ComputeDepthBounds(*bounds, x0, y0, x1, y1);
+            }
+            alignas(16) float z[4];
+            F4 rectX = F4::Set(rx0 + 0.5f, rx1 + 0.5f, rx0 + 0.5f, rx1 + 0.5f);
+            F4 rectY = F4::Set(ry0 + 0.5f, ry0 + 0.5f, ry1 + 0.5f, ry1 + 0.5f);
+            simd::MulAdd(F4::Splat(tri.z.a), rectX, simd::MulAdd(F4::Splat(tri.z.b), rectY, F4::Splat(tri.z.c))).Store(z);
+            float lo = std::min({ z[0], z[1], z[2], z[3] });
+            float hi = std::max({ z[0], z[1], z[2], z[3] });
+            if (std::isfinite(lo) && std::isfinite(hi)) {
+                zmin = static_cast<uint32_t>(std::clamp(std::floor(lo) - kDepthBoundsMargin, 0.0f, zMax));
+                zmax = static_cast<uint32_t>(std::clamp(std::ceil(hi) + kDepthBoundsMargin, 0.0f, zMax));
+            }
+            depthBoundsTest = TestDepthBounds(state.depthFunc, zmin, zmax, *bounds);
+            if (depthBoundsTest == DepthBoundsTest::Reject) {
+                continue;
+            }
+        }
+
+        RasterizeTriangle(tri, rx0, ry0, rx1, ry1, depthBoundsTest == DepthBoundsTest::Accept);
+
+        if (bounds != nullptr && state.depthTest && state.depthWrite) {
+            const CombinerKernel* kernel = state.combiner.get();
+            covered = covered && (kernel == nullptr || !kernel->CanDiscard());
+            UpdateDepthBounds(*bounds, state.depthFunc, zmin, zmax, covered);
+        }
+    }
+}
+
+void SoftwareRenderer::ComputeDepthBounds(DepthBounds& bounds, int32_t x0, int32_t y0, int32_t x1, int32_t y1) const {
+    bool z24 = m_target.zetaFormat == SurfaceZetaFormat::Z24S8;
+    uint32_t size = z24 ? 4 : 2;
+    uint32_t zmin = 0xffffffff;
+    uint32_t zmax = 0;
+    for (int32_t y = y0; y <= y1; y++) {
+        const uint8_t* row = &m_target.zeta[y * m_target.zetaPitch];
+        for (int32_t x = x0; x <= x1; x++) {
+            uint32_t stored = ReadPixel(&row[x * size], size);
+            uint32_t depth = z24 ? (stored >> 8) : stored;
+            zmin = std::min(zmin, depth);
+            zmax = std::max(zmax, depth);
+        }
+    }
+    bounds = DepthBounds{ zmin, zmax, true };
+}
+
+void SoftwareRenderer::RasterizeTriangle(const Triangle& tri, int32_t x0, int32_t y0, int32_t x1, int32_t y1, bool depthPass) {
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+
+    const RasterState& state = m_states[tri.state];
+    const SurfaceTarget& target = m_target;
+
+    uint32_t colorSize = GetColorFormatSize(target.colorFormat);
+    uint8_t* color = (colorSize != 0) ? target.color : nullptr;
+    uint32_t colorMask = (color != nullptr) ? PackColorMask(target.colorFormat, state.colorMask) : 0;
+    if (colorMask == 0) {
+        color = nullptr;
+    }
+
+    uint8_t* zeta = (target.zetaFormat != SurfaceZetaFormat::None) ? target.zeta : nullptr;
+    bool z24 = target.zetaFormat == SurfaceZetaFormat::Z24S8;
+    uint32_t zetaSize = z24 ? 4 : 2;
+    float zMax = z24 ? 16777215.0f : 65535.0f;
+    bool depthTest = state.depthTest && zeta != nullptr;
+    bool depthWrite = depthTest && state.depthWrite;
+    bool readDepth = depthTest && (!depthPass || (z24 && depthWrite));
+
+    // The kernel also runs for depth-only draws, since it may discard pixels
+    const CombinerKernel* kernel = state.combiner.get();
+    bool shade = color != nullptr || (kernel != nullptr && depthWrite);
+    const Texture* textures[kKelvinTextureCount];
+    for (uint32_t stage = 0; stage < kKelvinTextureCount; stage++) {
+        textures[stage] = state.textures[stage].get();
+    }
+
+    // Lanes of a 2x2 quad: (0,0) (1,0) (0,1) (1,1)
+    const F4 laneX = F4::Set(0.5f, 1.5f, 0.5f, 1.5f);
+    const F4 laneY = F4::Set(0.5f, 0.5f, 1.5f, 1.5f);
+    const F4 zero = F4::Splat(0.0f);
+    const F4 one = F4::Splat(1.0f);
+    const F4 scale255 = F4::Splat(255.0f);
+    const F4 zMaxV = F4::Splat(zMax);
+
+    F4 ea[3], eb[3], ec[3];
+    M4 topLeft[3];
+    for (int i = 0; i < 3; i++) {
+        ea[i] = F4::Splat(tri.edges[i].a);
+        eb[i] = F4::Splat(tri.edges[i].b);
+        ec[i] = F4::Splat(tri.edges[i].c);
+        topLeft[i] = M4::FromBits((tri.topLeftMask & (1 << i)) ? 0xf : 0);
+    }
+
+    int32_t qx0 = x0 & ~1;
+    int32_t qy0 = y0 & ~1;
+    for (int32_t y = qy0; y <= y1; y += 2) {
+        F4 py = F4::Splat(static_cast<float>(y)) + laneY;
+
+        // Lanes outside of the vertical bounds
+        uint32_t rowMask = 0xf;
+        if (y < y0) rowMask &= ~0x3;
+        if (y + 1 > y1) rowMask &= ~0xc;
+
+        for (int32_t x = qx0; x <= x1; x += 2) {
+            F4 px = F4::Splat(static_cast<float>(x)) + laneX;
+
+            uint32_t mask = rowMask;
+            if (x < x0) mask &= ~0x5;
+            if (x + 1 > x1) mask &= ~0xa;
+
+            for (int i = 0; i < 3 && mask != 0; i++) {
+                F4 e = simd::MulAdd(ea[i], px, simd::MulAdd(eb[i], py, ec[i]));
+                mask &= ((e > zero) | ((e == zero) & topLeft[i])).Bits();
+            }
+            if (mask == 0) {
+                continue;
+            }
+
+            int32_t z[4];
+            simd::Clamp(simd::MulAdd(F4::Splat(tri.z.a), px, simd::MulAdd(F4::Splat(tri.z.b), py, F4::Splat(tri.z.c))), zero, zMaxV).StoreInt(z);
+
+            // Test depth before shading, unless the tile range already
+            // determined that every pixel passes. Z24S8 values are still
+            // read to preserve the stencil bits.
+            uint32_t stored[4];
+            if (readDepth) {
+                for (uint32_t lane = 0; lane < 4; lane++) {
+                    if (!(mask & (1 << lane))) {
+                        continue;
+                    }
+                    uint32_t pxl = x + (lane & 1);
+                    uint32_t pyl = y + (lane >> 1);
+                    stored[lane] = ReadPixel(&zeta[pyl * target.zetaPitch + pxl * zetaSize], zetaSize);
+                    uint32_t depth = z24 ? (stored[lane] >> 8) : stored[lane];
+                    if (!depthPass && !CompareDepth(state.depthFunc, static_cast<uint32_t>(z[lane]), depth)) {
+                        mask &= ~(1 << lane);
+                    }
+                }
+                if (mask == 0) {
+                    continue;
+                }
+            }
+
+            int32_t rgba[4][4];
+            if (shade) {
+                F4 w = one / simd::MulAdd(F4::Splat(tri.invW.a), px, simd::MulAdd(F4::Splat(tri.invW.b), py, F4::Splat(tri.invW.c)));
+                auto interpolate = [&](const Plane& p) {
+                    return simd::MulAdd(F4::Splat(p.a), px, simd::MulAdd(F4::Splat(p.b), py, F4::Splat(p.c))) * w;
+                };
+
+                F4 out[4];
+                if (kernel != nullptr) {
+                    PixelQuad quad;
+                    for (uint32_t c = 0; c < 4; c++) {
+                        quad.diffuse[c] = (tri.inputs & CombinerInput_Diffuse) ? interpolate(tri.diffuse[c]) : zero;
+                        quad.specular[c] = (tri.inputs & CombinerInput_Specular) ? interpolate(tri.specular[c]) : zero;
+                    }
+                    quad.fog = (tri.inputs & CombinerInput_Fog) ? interpolate(tri.fog) : zero;
+                    for (uint32_t stage = 0; stage < kKelvinTextureCount; stage++) {
+                        bool used = (tri.inputs & (CombinerInput_TexCoord0 << stage)) != 0;
+                        for (uint32_t c = 0; c < 4; c++) {
+                            quad.texCoords[stage][c] = used ? interpolate(tri.texCoords[stage][c]) : zero;
+                        }
+                    }
+                    mask &= kernel->Shade(state.combinerConstants, textures, quad, out);
+                    if (mask == 0) {
+                        continue;
+                    }
+                }
+                else {
+                    for (uint32_t c = 0; c < 4; c++) {
+                        out[c] = interpolate(tri.diffuse[c]);
+                    }
+                }
+                if (color != nullptr) {
+                    for (uint32_t c = 0; c < 4; c++) {
+                        (simd::Clamp(out[c], zero, one) * scale255).StoreInt(rgba[c]);
+                    }
+                }
+            }
+
+            for (uint32_t lane = 0; lane < 4; lane++) {
+                if (!(mask & (1 << lane))) {
+                    continue;
+                }
+                uint32_t pxl = x + (lane & 1);
+                uint32_t pyl = y + (lane >> 1);
+
+                if (depthWrite) {
+                    uint8_t* zp = &zeta[pyl * target.zetaPitch + pxl * zetaSize];
+                    uint32_t depth = static_cast<uint32_t>(z[lane]);
+                    WritePixel(zp, zetaSize, z24 ? ((depth << 8) | (stored[lane] & 0xff)) : depth);
+                }
+
+                if (color != nullptr) {
+                    uint32_t value = PackColor(target.colorFormat, rgba[3][lane], rgba[0][lane], rgba[1][lane], rgba[2][lane]);
+                    WriteMaskedPixel(&color[pyl * target.colorPitch + pxl * colorSize], colorSize, value, colorMask);
+                }
+            }
+        }
+    }
+}
+
+void SoftwareRenderer::ClearTile(const ClearParams& params, int32_t x0, int32_t y0, int32_t x1, int32_t y1) {
+    if (x0 > x1 || y0 > y1) {
+        return;
+    }
+    const SurfaceTarget& target = m_target;
+
+    // CLEAR_SURFACE color flags select the R, G, B and A channels in bits 4..7
+    uint32_t colorSize = GetColorFormatSize(target.colorFormat);
+    if (target.color != nullptr && colorSize != 0 && (params.flags & Val_KELVIN_CLEAR_SURFACE_COLOR)) {
+        uint32_t argbMask =
+            ((params.flags & (1 << 4)) ? 0x00ff0000 : 0) |
+            ((params.flags & (1 << 5)) ? 0x0000ff00 : 0) |
+            ((params.flags & (1 << 6)) ? 0x000000ff : 0) |
+            ((params.flags & (1 << 7)) ? 0xff000000 : 0);
+        uint32_t mask = PackColorMask(target.colorFormat, argbMask);
+        uint32_t value = PackColor(target.colorFormat,
+            params.color >> 24, (params.color >> 16) & 0xff, (params.color >> 8) & 0xff, params.color & 0xff);
+        for (int32_t y = y0; y <= y1; y++) {
+            uint8_t* row = &target.color[y * target.colorPitch];
+            for (int32_t x = x0; x <= x1; x++) {
+                WriteMaskedPixel(&row[x * colorSize], colorSize, value, mask);
+            }
+        }
+    }
+
+    uint32_t zsFlags = params.flags & (Val_KELVIN_CLEAR_SURFACE_Z | Val_KELVIN_CLEAR_SURFACE_STENCIL);
+    if (target.zeta != nullptr && target.zetaFormat != SurfaceZetaFormat::None && zsFlags != 0) {
+        bool z24 = target.zetaFormat == SurfaceZetaFormat::Z24S8;
+        uint32_t size = z24 ? 4 : 2;
+        uint32_t mask;
+        if (z24) {
+            mask = ((zsFlags & Val_KELVIN_CLEAR_SURFACE_Z) ? 0xffffff00 : 0) | ((zsFlags & Val_KELVIN_CLEAR_SURFACE_STENCIL) ? 0xff : 0);
+        }
+        else {
+            mask = (zsFlags & Val_KELVIN_CLEAR_SURFACE_Z) ? 0xffff : 0;
+        }
+        if (mask != 0) {
+            for (int32_t y = y0; y <= y1; y++) {
+                uint8_t* row = &target.zeta[y * target.zetaPitch];
+                for (int32_t x = x0; x <= x1; x++) {
+                    WriteMaskedPixel(&row[x * size], size, params.zstencil, mask);
+                }
+            }
+        }
+    }
+}
+
+// --- Worker pool -----------------
+
+void SoftwareRenderer::Flush() {
+    if (m_activeTiles.empty()) {
+        m_jobs.clear();
+        m_triangles.clear();
+        m_clears.clear();
+        m_states.clear();
+        return;
+    }
+
+    m_nextTile.store(0, std::memory_order_relaxed);
+    if (!m_workers.empty()) {
+        {
+            std::lock_guard<std::mutex> lk(m_poolMutex);
+            m_busyWorkers = static_cast<uint32_t>(m_workers.size());
+            m_generation++;
+        }
+        m_workCond.notify_all();
+    }
+
+    // The calling thread takes part in the work
+    RunTiles();
+
+    if (!m_workers.empty()) {
+        std::unique_lock<std::mutex> lk(m_poolMutex);
+        m_doneCond.wait(lk, [this]() { return m_busyWorkers == 0; });
+    }
+
+    for (uint32_t tile : m_activeTiles) {
+        m_bins[tile].clear();
+    }
+    m_activeTiles.clear();
+    m_jobs.clear();
+    m_triangles.clear();
+    m_clears.clear();
+    m_states.clear();
+}
+
+void SoftwareRenderer::RunTiles() {
+    uint32_t count = static_cast<uint32_t>(m_activeTiles.size());
+    for (;;) {
+        uint32_t index = m_nextTile.fetch_add(1, std::memory_order_relaxed);
+        if (index >= count) {
+            break;
+        }
+        RenderTile(m_activeTiles[index]);
+    }
+}
+
+void SoftwareRenderer::WorkerThread() {
+    Thread_SetName("[HW] NV2A rasterizer");
+
+    uint64_t generation = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lk(m_poolMutex);
+            m_workCond.wait(lk, [&]() { return m_quit || m_generation != generation; });
+            if (m_quit) {
+                return;
+            }
+            generation = m_generation;
+        }
+
+        RunTiles();
+
+        {
+            std::lock_guard<std::mutex> lk(m_poolMutex);
+            if (--m_busyWorkers == 0) {
+                m_doneCond.notify_all();
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,373 @@
+// StrikeBox NV2A PGRAPH texture formats and decoding
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+#include "strikebox/hw/gpu/pgraph/texture.h"
+#include "strikebox/hw/gpu/pgraph/hash.h"
+#include "strikebox/hw/gpu/pgraph/s3tc.h"
+#include "strikebox/hw/gpu/pgraph/swizzle.h"
+#include "strikebox/hw/gpu/yuv.h"
+
+#include "strikebox/log.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace strikebox::nv2a {
+
+// Keeps textures in unsupported layouts, which are looked up on every draw,
+// from flooding the log
+static LogRateLimiter s_unsupportedLimiter(16, 1000);
+
+// --- Decoders ---------------
+
+// Applies a per-texel conversion to 32-bit texels
+template <uint32_t (*Convert)(uint32_t)>
+static void Decode32(const uint8_t* src, uint32_t srcPitch, uint32_t* dst, uint32_t width, uint32_t height, const uint32_t*) {
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* row = src + y * srcPitch;
+        for (uint32_t x = 0; x < width; x++) {
+            uint32_t texel;
+            std::memcpy(&texel, row + x * 4, 4);
+            *dst++ = Convert(texel);
+        }
+    }
+}
+
+// Applies a per-texel conversion to 16-bit texels
+template <uint32_t (*Convert)(uint32_t)>
+static void Decode16(const uint8_t* src, uint32_t srcPitch, uint32_t* dst, uint32_t width, uint32_t height, const uint32_t*) {
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* row = src + y * srcPitch;
+        for (uint32_t x = 0; x < width; x++) {
+            uint16_t texel;
+            std::memcpy(&texel, row + x * 2, 2);
+            *dst++ = Convert(texel);
+        }
+    }
+}
+
+// Applies a per-texel conversion to 8-bit texels
+template <uint32_t (*Convert)(uint32_t)>
+static void Decode8(const uint8_t* src, uint32_t srcPitch, uint32_t* dst, uint32_t width, uint32_t height, const uint32_t*) {
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* row = src + y * srcPitch;
+        for (uint32_t x = 0; x < width; x++) {
+            *dst++ = Convert(row[x]);
+        }
+    }
+}
+
+// Converts YUV 4:2:2 rows. Rows of odd width end with half a pair, whose
+// chroma is read from the padding required by GetTextureSourceSize.
+template <void (*ConvertRow)(const uint8_t*, uint32_t*, uint32_t)>
+static void DecodeYUV(const uint8_t* src, uint32_t srcPitch, uint32_t* dst, uint32_t width, uint32_t height, const uint32_t*) {
+    const uint32_t pairs = width & ~1u;
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* row = src + y * srcPitch;
+        ConvertRow(row, dst, pairs);
+        if (width & 1) {
+            uint32_t last[2];
+            ConvertRow(row + pairs * 2, last, 2);
+            dst[pairs] = last[0];
+        }
+        dst += width;
+    }
+}
+
+// Looks up 8-bit indices in the palette
+static void DecodeI8(const uint8_t* src, uint32_t srcPitch, uint32_t* dst, uint32_t width, uint32_t height, const uint32_t* palette) {
+    for (uint32_t y = 0; y < height; y++) {
+        const uint8_t* row = src + y * srcPitch;
+        for (uint32_t x = 0; x < width; x++) {
+            *dst++ = palette[row[x]];
+        }
+    }
+}
+
+// Replicate the high bits of narrow channels into the low bits of 8-bit channels
+static constexpr uint32_t Expand4(uint32_t value) { return value * 0x11; }
+static constexpr uint32_t Expand5(uint32_t value) { return (value << 3) | (value >> 2); }
+static constexpr uint32_t Expand6(uint32_t value) { return (value << 2) | (value >> 4); }
+
+static uint32_t ConvertA1R5G5B5(uint32_t texel) {
+    return ((texel & 0x8000) ? 0xff000000 : 0) | (Expand5((texel >> 10) & 0x1f) << 16) | (Expand5((texel >> 5) & 0x1f) << 8) | Expand5(texel & 0x1f);
+}
+
+static uint32_t ConvertX1R5G5B5(uint32_t texel) {
+    return ConvertA1R5G5B5(texel | 0x8000);
+}
+
+static uint32_t ConvertA4R4G4B4(uint32_t texel) {
+    return (Expand4(texel >> 12) << 24) | (Expand4((texel >> 8) & 0xf) << 16) | (Expand4((texel >> 4) & 0xf) << 8) | Expand4(texel & 0xf);
+}
+
+static uint32_t ConvertR5G6B5(uint32_t texel) {
+    return 0xff000000 | (Expand5(texel >> 11) << 16) | (Expand6((texel >> 5) & 0x3f) << 8) | Expand5(texel & 0x1f);
+}
+
+static uint32_t ConvertR6G5B5(uint32_t texel) {
+    return 0xff000000 | (Expand6(texel >> 10) << 16) | (Expand5((texel >> 5) & 0x1f) << 8) | Expand5(texel & 0x1f);
+}
+
+// Luminance in all color channels, opaque
+static uint32_t ConvertY8(uint32_t texel) {
+    return 0xff000000 | (texel * 0x010101);
+}
+
+// Luminance in all four channels
+static uint32_t ConvertAY8(uint32_t texel) {
+    return texel * 0x01010101;
+}
+
+// Alpha only; color channels read as white
+static uint32_t ConvertA8(uint32_t texel) {
+    return (texel << 24) | 0xffffff;
+}
+
+// Alpha in the high byte, luminance in the low byte
+static uint32_t ConvertA8Y8(uint32_t texel) {
+    return ((texel & 0xff00) << 16) | ((texel & 0xff) * 0x010101);
+}
+
+// Two-channel formats; the missing channel reads as zero
+static uint32_t ConvertG8B8(uint32_t texel) {
+    return 0xff000000 | texel;
+}
+
+static uint32_t ConvertR8B8(uint32_t texel) {
+    return 0xff000000 | ((texel & 0xff00) << 8) | (texel & 0xff);
+}
+
+static uint32_t ConvertX8R8G8B8(uint32_t texel) {
+    return texel | 0xff000000;
+}
+
+static uint32_t ConvertA8B8G8R8(uint32_t texel) {
+    return (texel & 0xff00ff00) | ((texel >> 16) & 0xff) | ((texel & 0xff) << 16);
+}
+
+static uint32_t ConvertB8G8R8A8(uint32_t texel) {
+    return (texel >> 24) | ((texel >> 8) & 0xff00) | ((texel << 8) & 0xff0000) | (texel << 24);
+}
+
+static uint32_t ConvertR8G8B8A8(uint32_t texel) {
+    return (texel >> 8) | (texel << 24);
+}
+
+// --- Format table ---------------
+
+static constexpr std::array<TextureFormatInfo, 0x100> BuildTextureFormatTable() {
+    std::array<TextureFormatInfo, 0x100> table{};
+    auto set = [&](TextureColorFormat format, uint8_t bytesPerTexel, bool swizzled, TextureDecoder decode) {
+        TextureFormatInfo& info = table[static_cast<uint8_t>(format)];
+        info.bytesPerTexel = bytesPerTexel;
+        info.swizzled = swizzled;
+        info.decode = decode;
+    };
+    auto setCompressed = [&](TextureColorFormat format, uint8_t bytesPerBlock, TextureDecoder decode) {
+        set(format, bytesPerBlock, false, decode);
+        table[static_cast<uint8_t>(format)].compressed = true;
+    };
+
+    set(TextureColorFormat::SZ_A1R5G5B5, 2, true, Decode16<ConvertA1R5G5B5>);
+    set(TextureColorFormat::SZ_X1R5G5B5, 2, true, Decode16<ConvertX1R5G5B5>);
+    set(TextureColorFormat::SZ_A4R4G4B4, 2, true, Decode16<ConvertA4R4G4B4>);
+    set(TextureColorFormat::SZ_R5G6B5, 2, true, Decode16<ConvertR5G6B5>);
+    set(TextureColorFormat::SZ_R6G5B5, 2, true, Decode16<ConvertR6G5B5>);
+    set(TextureColorFormat::SZ_A8Y8, 2, true, Decode16<ConvertA8Y8>);
+    set(TextureColorFormat::SZ_G8B8, 2, true, Decode16<ConvertG8B8>);
+    set(TextureColorFormat::SZ_R8B8, 2, true, Decode16<ConvertR8B8>);
+    set(TextureColorFormat::LU_IMAGE_A1R5G5B5, 2, false, Decode16<ConvertA1R5G5B5>);
+    set(TextureColorFormat::LU_IMAGE_X1R5G5B5, 2, false, Decode16<ConvertX1R5G5B5>);
+    set(TextureColorFormat::LU_IMAGE_A4R4G4B4, 2, false, Decode16<ConvertA4R4G4B4>);
+    set(TextureColorFormat::LU_IMAGE_R5G6B5, 2, false, Decode16<ConvertR5G6B5>);
+    set(TextureColorFormat::LU_IMAGE_A8Y8, 2, false, Decode16<ConvertA8Y8>);
+
+    set(TextureColorFormat::SZ_Y8, 1, true, Decode8<ConvertY8>);
+    set(TextureColorFormat::SZ_AY8, 1, true, Decode8<ConvertAY8>);
+    set(TextureColorFormat::SZ_A8, 1, true, Decode8<ConvertA8>);
+    set(TextureColorFormat::LU_IMAGE_Y8, 1, false, Decode8<ConvertY8>);
+    set(TextureColorFormat::LU_IMAGE_AY8, 1, false, Decode8<ConvertAY8>);
+    set(TextureColorFormat::LU_IMAGE_A8, 1, false, Decode8<ConvertA8>);
+
+    set(TextureColorFormat::LC_IMAGE_CR8YB8CB8YA8, 2, false, DecodeYUV<ConvertYUY2Row>);
+    set(TextureColorFormat::LC_IMAGE_YB8CR8YA8CB8, 2, false, DecodeYUV<ConvertUYVYRow>);
+    table[static_cast<uint8_t>(TextureColorFormat::LC_IMAGE_CR8YB8CB8YA8)].pairs = true;
+    table[static_cast<uint8_t>(TextureColorFormat::LC_IMAGE_YB8CR8YA8CB8)].pairs = true;
+
+    set(TextureColorFormat::SZ_I8_A8R8G8B8, 1, true, DecodeI8);
+    table[static_cast<uint8_t>(TextureColorFormat::SZ_I8_A8R8G8B8)].palettized = true;
+
+    setCompressed(TextureColorFormat::L_DXT1_A1R5G5B5, kDXT1BlockSize, DecodeDXT1);
+    setCompressed(TextureColorFormat::L_DXT23_A8R8G8B8, kDXT3BlockSize, DecodeDXT3);
+    setCompressed(TextureColorFormat::L_DXT45_A8R8G8B8, kDXT5BlockSize, DecodeDXT5);
+
+    set(TextureColorFormat::SZ_A8R8G8B8, 4, true, nullptr);
+    set(TextureColorFormat::SZ_X8R8G8B8, 4, true, Decode32<ConvertX8R8G8B8>);
+    set(TextureColorFormat::SZ_A8B8G8R8, 4, true, Decode32<ConvertA8B8G8R8>);
+    set(TextureColorFormat::SZ_B8G8R8A8, 4, true, Decode32<ConvertB8G8R8A8>);
+    set(TextureColorFormat::SZ_R8G8B8A8, 4, true, Decode32<ConvertR8G8B8A8>);
+    set(TextureColorFormat::LU_IMAGE_A8R8G8B8, 4, false, nullptr);
+    set(TextureColorFormat::LU_IMAGE_X8R8G8B8, 4, false, Decode32<ConvertX8R8G8B8>);
+    set(TextureColorFormat::LU_IMAGE_A8B8G8R8, 4, false, Decode32<ConvertA8B8G8R8>);
+    set(TextureColorFormat::LU_IMAGE_B8G8R8A8, 4, false, Decode32<ConvertB8G8R8A8>);
+    set(TextureColorFormat::LU_IMAGE_R8G8B8A8, 4, false, Decode32<ConvertR8G8B8A8>);
+
+    return table;
+}
+
+static constexpr std::array<TextureFormatInfo, 0x100> kTextureFormats = BuildTextureFormatTable();
+
+const TextureFormatInfo& GetTextureFormatInfo(uint32_t format) {
+    return kTextureFormats[format & 0xff];
+}
+
+// --- Keys ---------------
+
+size_t TextureKeyHash::operator()(const TextureKey& key) const {
+    const uint32_t words[] = {
+        key.address, key.format, key.width, key.height, key.depth, key.levels, key.pitch,
+        (key.swizzled ? 1u : 0u) | (key.cube ? 2u : 0u), key.paletteAddress, key.paletteLength,
+    };
+    return static_cast<size_t>(HashMemory(words, sizeof(words)));
+}
+
+// --- Decoding ---------------
+
+// Returns the number of bytes of guest memory occupied by a mipmap level
+static uint64_t GetLevelSize(const TextureFormatInfo& info, uint32_t width, uint32_t height, uint32_t depth) {
+    if (info.compressed) {
+        return static_cast<uint64_t>((width + 3) / 4) * ((height + 3) / 4) * depth * info.bytesPerTexel;
+    }
+    return static_cast<uint64_t>(width) * height * depth * info.bytesPerTexel;
+}
+
+// Returns the number of bytes of guest memory occupied by the mipmap chain of
+// a swizzled or compressed texture, padded to the face alignment for cube maps
+static uint64_t GetMipmapChainSize(const TextureFormatInfo& info, const TextureKey& key) {
+    uint64_t size = 0;
+    uint32_t w = key.width, h = key.height, d = key.depth;
+    for (uint32_t level = 0; level < key.levels; level++) {
+        size += GetLevelSize(info, w, h, d);
+        w = std::max(w >> 1, 1u);
+        h = std::max(h >> 1, 1u);
+        d = std::max(d >> 1, 1u);
+    }
+    if (key.cube) {
+        size = (size + kCubeFaceAlignment - 1) & ~static_cast<uint64_t>(kCubeFaceAlignment - 1);
+    }
+    return size;
+}
+
+uint32_t GetTextureSourceSize(const TextureKey& key) {
+    const TextureFormatInfo& info = GetTextureFormatInfo(key.format);
+    if (info.bytesPerTexel == 0 || key.width == 0 || key.height == 0) {
+        return 0;
+    }
+    if (!key.swizzled && !info.compressed) {
+        // Pairs of YUV texels are read whole
+        uint32_t width = info.pairs ? (key.width + 1) & ~1u : key.width;
+        if (key.pitch < width * info.bytesPerTexel) {
+            return 0;
+        }
+        return key.pitch * key.height;
+    }
+    if (info.compressed && key.depth > 1) {
+        // The arrangement of blocks across the slices of compressed volumes
+        // is not known
+        log_ratelimited(s_unsupportedLimiter, LOG_LEVEL_ERROR, "[NV2A] PGRAPH: Compressed volume textures are not supported (format 0x%x, %ux%ux%u)\n",
+            key.format, key.width, key.height, key.depth);
+        return 0;
+    }
+
+    uint64_t size = GetMipmapChainSize(info, key) * (key.cube ? 6 : 1);
+    return (size <= UINT32_MAX) ? static_cast<uint32_t>(size) : 0;
+}
+
+bool DecodeTexture(const TextureKey& key, const uint8_t* src, const uint32_t* palette, Texture& texture) {
+    const TextureFormatInfo& info = GetTextureFormatInfo(key.format);
+    if (info.bytesPerTexel == 0) {
+        return false;
+    }
+    const uint32_t bpp = info.bytesPerTexel;
+    const bool mipmapped = key.swizzled || info.compressed;
+
+    // Indices past the end of the palette read transparent black
+    std::array<uint32_t, 256> fullPalette{};
+    if (info.palettized) {
+        std::copy_n(palette, std::min<uint32_t>(key.paletteLength, 256), fullPalette.begin());
+        palette = fullPalette.data();
+    }
+
+    texture.width = key.width;
+    texture.height = key.height;
+    texture.depth = mipmapped ? key.depth : 1;
+    texture.levels = mipmapped ? key.levels : 1;
+    texture.faces = key.cube ? 6 : 1;
+
+    // Lay out the decoded levels
+    texture.levelOffsets.resize(texture.faces * texture.levels);
+    size_t total = 0;
+    for (uint32_t face = 0; face < texture.faces; face++) {
+        uint32_t w = texture.width, h = texture.height, d = texture.depth;
+        for (uint32_t level = 0; level < texture.levels; level++) {
+            texture.levelOffsets[face * texture.levels + level] = total;
+            total += static_cast<size_t>(w) * h * d;
+            w = std::max(w >> 1, 1u);
+            h = std::max(h >> 1, 1u);
+            d = std::max(d >> 1, 1u);
+        }
+    }
+    texture.texels.resize(total);
+
+    if (!mipmapped) {
+        uint32_t* dst = texture.texels.data();
+        if (info.decode != nullptr) {
+            info.decode(src, key.pitch, dst, key.width, key.height, palette);
+        }
+        else {
+            for (uint32_t y = 0; y < key.height; y++) {
+                std::memcpy(dst + y * key.width, src + y * key.pitch, key.width * sizeof(uint32_t));
+            }
+        }
+        return true;
+    }
+
+    static thread_local std::vector<uint8_t> scratch;
+    const uint64_t faceStride = key.cube ? GetMipmapChainSize(info, key) : 0;
+    for (uint32_t face = 0; face < texture.faces; face++) {
+        const uint8_t* levelSrc = src + face * faceStride;
+        uint32_t w = texture.width, h = texture.height, d = texture.depth;
+        for (uint32_t level = 0; level < texture.levels; level++) {
+            uint32_t* dst = &texture.texels[texture.levelOffsets[face * texture.levels + level]];
+            uint32_t rowPitch = w * bpp;
+            if (info.compressed) {
+                // Blocks are stored in rows without swizzling
+                info.decode(levelSrc, (w + 3) / 4 * bpp, dst, w, h, palette);
+            }
+            else if (info.decode != nullptr) {
+                scratch.resize(static_cast<size_t>(rowPitch) * h * d);
+                UnswizzleBox(levelSrc, scratch.data(), rowPitch, rowPitch * h, w, h, d, bpp);
+                info.decode(scratch.data(), rowPitch, dst, w, h * d, palette);
+            }
+            else {
+                // Texels are already in the host format
+                UnswizzleBox(levelSrc, reinterpret_cast<uint8_t*>(dst), rowPitch, rowPitch * h, w, h, d, bpp);
+            }
+            levelSrc += GetLevelSize(info, w, h, d);
+            w = std::max(w >> 1, 1u);
+            h = std::max(h >> 1, 1u);
+            d = std::max(d >> 1, 1u);
+        }
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,140 @@
+// StrikeBox NV2A PGRAPH texture cache
+// (C) Ivan "StrikerX3" Oliveira
+#include "strikebox/hw/gpu/pgraph/texture_cache.h"
+#include "strikebox/hw/gpu/pgraph/hash.h"
+
+#include "strikebox/log.h"
+
+#include <algorithm>
+
+namespace strikebox::nv2a {
+
+TextureCache::~TextureCache() {
+    SetGuestMemory(nullptr);
+}
+
+void TextureCache::SetGuestMemory(GuestMemory* memory) {
+    if (m_memory != nullptr) {
+        m_memory->Unsubscribe(m_memoryView);
+    }
+    m_memory = nullptr;
+    m_memoryView = -1;
+    if (memory != nullptr && memory->TracksCPUWrites()) {
+        m_memoryView = memory->Subscribe();
+        if (m_memoryView >= 0) {
+            m_memory = memory;
+        }
+    }
+    // Revalidate everything, since writes made until now were not tracked
+    for (auto& [key, entry] : m_entries) {
+        entry.written = true;
+    }
+}
+
+void TextureCache::CollectWrites() {
+    m_collectPending = false;
+    m_memory->CollectDirty(m_memoryView, m_dirtyPages);
+    for (auto& [key, entry] : m_entries) {
+        if (!entry.written) {
+            entry.written = GuestMemory::AnyPageDirty(m_dirtyPages, key.address, entry.size)
+                || GuestMemory::AnyPageDirty(m_dirtyPages, key.paletteAddress, key.paletteLength * sizeof(uint32_t));
+        }
+    }
+}
+
+std::shared_ptr<const Texture> TextureCache::Lookup(const TextureKey& key, const uint8_t* ram, uint32_t ramSize) {
+    if (m_memory != nullptr && m_collectPending) {
+        CollectWrites();
+    }
+
+    uint32_t size = GetTextureSourceSize(key);
+    if (size == 0) {
+        log_spew("[NV2A] PGRAPH: Unsupported texture format 0x%x, %ux%ux%u\n", key.format, key.width, key.height, key.depth);
+        return nullptr;
+    }
+    uint64_t paletteSize = static_cast<uint64_t>(key.paletteLength) * sizeof(uint32_t);
+    if (static_cast<uint64_t>(key.address) + size > ramSize || key.paletteAddress + paletteSize > ramSize) {
+        log_warning("[NV2A] PGRAPH: Texture at 0x%x (%u bytes) is outside system RAM\n", key.address, size);
+        return nullptr;
+    }
+
+    auto it = m_entries.find(key);
+    if (it != m_entries.end() && m_memory != nullptr && !it->second.written) {
+        m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+        m_stats.hits++;
+        return it->second.texture;
+    }
+
+    uint64_t hash = HashMemory(&ram[key.address], size);
+    if (paletteSize != 0) {
+        hash = HashMemory(&ram[key.paletteAddress], paletteSize, hash);
+    }
+
+    if (it != m_entries.end()) {
+        Entry& entry = it->second;
+        m_lru.splice(m_lru.begin(), m_lru, entry.lru);
+        if (entry.hash == hash) {
+            entry.written = false;
+            m_stats.hits++;
+            return entry.texture;
+        }
+    }
+    m_stats.misses++;
+
+    auto texture = std::make_shared<Texture>();
+    const uint32_t* palette = (paletteSize != 0) ? reinterpret_cast<const uint32_t*>(&ram[key.paletteAddress]) : nullptr;
+    if (!DecodeTexture(key, &ram[key.address], palette, *texture)) {
+        return nullptr;
+    }
+
+    if (it != m_entries.end()) {
+        m_stats.bytes -= it->second.texture->SizeInBytes();
+        it->second.texture = texture;
+        it->second.hash = hash;
+        it->second.size = size;
+        it->second.written = false;
+    }
+    else {
+        m_lru.push_front(key);
+        m_entries.emplace(key, Entry{ texture, hash, size, false, m_lru.begin() });
+        m_stats.entries++;
+    }
+    m_stats.bytes += texture->SizeInBytes();
+
+    // Keep the texture just decoded even if it exceeds the budget on its own
+    if (m_stats.bytes > m_budget) {
+        Evict(std::max(m_budget, texture->SizeInBytes()));
+    }
+    return texture;
+}
+
+void TextureCache::SetBudget(size_t budget) {
+    m_budget = budget;
+    Evict(budget);
+}
+
+void TextureCache::Clear() {
+    m_entries.clear();
+    m_lru.clear();
+    m_stats.bytes = 0;
+    m_stats.entries = 0;
+}
+
+void TextureCache::ResetStats() {
+    m_stats.hits = 0;
+    m_stats.misses = 0;
+    m_stats.evictions = 0;
+}
+
+void TextureCache::Evict(size_t budget) {
+    while (m_stats.bytes > budget && !m_lru.empty()) {
+        auto it = m_entries.find(m_lru.back());
+        m_stats.bytes -= it->second.texture->SizeInBytes();
+        m_stats.entries--;
+        m_stats.evictions++;
+        m_entries.erase(it);
+        m_lru.pop_back();
+    }
+}
+
+}
@@ -0,0 +1,229 @@
+// StrikeBox NV2A PGRAPH vertex fetch
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+#include "strikebox/hw/gpu/pgraph/vertex_fetch.h"
+#include "strikebox/hw/gpu/pgraph/simd.h"
+
+#include "strikebox/log.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace strikebox::nv2a {
+
+using simd::F4;
+
+uint32_t GetVertexArrayElementSize(const VertexArrayFormat& format) {
+    if (format.type == VertexArrayType::CMP) {
+        return (format.size == 1) ? 4 : 0;
+    }
+    if (format.size == 0 || format.size > 4) {
+        return 0;
+    }
+    switch (format.type) {
+    case VertexArrayType::UB_D3D:
+    case VertexArrayType::UB_OGL:
+        return format.size;
+    case VertexArrayType::S1:
+    case VertexArrayType::S32K:
+        return format.size * 2;
+    case VertexArrayType::F:
+        return format.size * 4;
+    default:
+        return 0;
+    }
+}
+
+void DecodeVertexArrayLayout(const KelvinState& state, VertexArrayLayout& layout) {
+    layout.enabledMask = 0;
+    layout.inlineStride = 0;
+    for (uint32_t attr = 0; attr < kKelvinAttributeCount; attr++) {
+        uint32_t value = state.Reg(Mthd_KELVIN_SET_VERTEX_DATA_ARRAY_FORMAT + attr * 4);
+        VertexArrayFormat& format = layout.formats[attr];
+        format.type = static_cast<VertexArrayType>(value & 0xf);
+        format.size = (value >> 4) & 0xf;
+        format.stride = value >> 8;
+        layout.offsets[attr] = state.Reg(Mthd_KELVIN_SET_VERTEX_DATA_ARRAY_OFFSET + attr * 4);
+        layout.inlineOffsets[attr] = 0;
+        if (format.size == 0) {
+            continue;
+        }
+
+        uint32_t elementSize = GetVertexArrayElementSize(format);
+        if (elementSize == 0) {
+            log_spew("[NV2A] PGRAPH: Unsupported vertex array format 0x%x on attribute %u\n", value & 0xff, attr);
+            format.size = 0;
+            continue;
+        }
+        layout.enabledMask |= 1 << attr;
+        layout.inlineOffsets[attr] = layout.inlineStride;
+        layout.inlineStride += (elementSize + 3) & ~3;
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+namespace {
+
+const uint32_t kVertexStride = kKelvinAttributeCount * 4;
+
+// Converts one element per lane into one vector per component
+template <VertexArrayType Type, uint32_t Size>
+inline void Decode(const uint8_t* const* elements, F4* out) {
+    if constexpr (Type == VertexArrayType::CMP) {
+        // x in bits 10..0, y in bits 21..11, z in bits 31..22
+        alignas(16) int32_t x[4], y[4], z[4];
+        for (uint32_t lane = 0; lane < 4; lane++) {
+            uint32_t packed;
+            std::memcpy(&packed, elements[lane], 4);
+            x[lane] = static_cast<int32_t>(packed << 21) >> 21;
+            y[lane] = static_cast<int32_t>(packed << 10) >> 21;
+            z[lane] = static_cast<int32_t>(packed) >> 22;
+        }
+        out[0] = F4::LoadInt(x) * F4::Splat(1.0f / 1023.0f);
+        out[1] = F4::LoadInt(y) * F4::Splat(1.0f / 1023.0f);
+        out[2] = F4::LoadInt(z) * F4::Splat(1.0f / 511.0f);
+        out[3] = F4::Splat(1.0f);
+        return;
+    }
+    else if constexpr (Type == VertexArrayType::F) {
+        alignas(16) float values[Size][4];
+        for (uint32_t lane = 0; lane < 4; lane++) {
+            for (uint32_t c = 0; c < Size; c++) {
+                std::memcpy(&values[c][lane], elements[lane] + c * 4, 4);
+            }
+        }
+        for (uint32_t c = 0; c < Size; c++) {
+            out[c] = F4::Load(values[c]);
+        }
+    }
+    else {
+        alignas(16) int32_t values[Size][4];
+        for (uint32_t lane = 0; lane < 4; lane++) {
+            for (uint32_t c = 0; c < Size; c++) {
+                if constexpr (Type == VertexArrayType::UB_D3D) {
+                    // D3DCOLOR stores blue in the first byte
+                    values[c][lane] = elements[lane][(Size >= 3 && c < 3) ? 2 - c : c];
+                }
+                else if constexpr (Type == VertexArrayType::UB_OGL) {
+                    values[c][lane] = elements[lane][c];
+                }
+                else {
+                    int16_t value;
+                    std::memcpy(&value, elements[lane] + c * 2, 2);
+                    values[c][lane] = value;
+                }
+            }
+        }
+        for (uint32_t c = 0; c < Size; c++) {
+            F4 value = F4::LoadInt(values[c]);
+            if constexpr (Type == VertexArrayType::UB_D3D || Type == VertexArrayType::UB_OGL) {
+                out[c] = value / F4::Splat(255.0f);
+            }
+            else if constexpr (Type == VertexArrayType::S1) {
+                // Maps [-32768, 32767] to [-1, 1]
+                out[c] = (value * F4::Splat(2.0f) + F4::Splat(1.0f)) * F4::Splat(1.0f / 65535.0f);
+            }
+            else {
+                out[c] = value;
+            }
+        }
+    }
+
+    // Missing components default to (0, 0, 0, 1)
+    for (uint32_t c = Size; c < 4; c++) {
+        out[c] = F4::Splat((c == 3) ? 1.0f : 0.0f);
+    }
+}
+
+// Number of vertices converted at a time; their outputs fit in the L1 cache
+const uint32_t kFetchChunkSize = 64;
+
+// Converts an attribute of count vertices reading indices[i], or first + i if
+// indices is null
+typedef void (*ConvertFn)(const VertexAttributeSource& source, uint32_t attr, const uint32_t* indices, uint32_t count, float* outputs, uint32_t first);
+
+// Converts four vertices at a time
+template <VertexArrayType Type, uint32_t Size>
+void Convert(const VertexAttributeSource& source, uint32_t attr, const uint32_t* indices, uint32_t count, float* outputs, uint32_t first) {
+    for (uint32_t base = 0; base < count; base += 4) {
+        uint32_t n = std::min(4u, count - base);
+
+        // Lanes beyond the end repeat the last vertex
+        const uint8_t* elements[4];
+        for (uint32_t lane = 0; lane < 4; lane++) {
+            uint32_t vertex = base + std::min(lane, n - 1);
+            uint32_t index = (indices != nullptr) ? indices[vertex] : first + vertex;
+            elements[lane] = source.data + static_cast<size_t>(index) * source.stride;
+        }
+
+        F4 c[4];
+        Decode<Type, Size>(elements, c);
+        simd::Transpose(c[0], c[1], c[2], c[3]);
+        for (uint32_t lane = 0; lane < n; lane++) {
+            c[lane].Store(&outputs[(base + lane) * kVertexStride + attr * 4]);
+        }
+    }
+}
+
+template <VertexArrayType Type>
+ConvertFn GetConvertFn(uint32_t size) {
+    switch (size) {
+    case 1: return &Convert<Type, 1>;
+    case 2: return &Convert<Type, 2>;
+    case 3: return &Convert<Type, 3>;
+    case 4: return &Convert<Type, 4>;
+    default: return nullptr;
+    }
+}
+
+ConvertFn GetConvertFn(const VertexArrayFormat& format) {
+    switch (format.type) {
+    case VertexArrayType::UB_D3D: return GetConvertFn<VertexArrayType::UB_D3D>(format.size);
+    case VertexArrayType::S1: return GetConvertFn<VertexArrayType::S1>(format.size);
+    case VertexArrayType::F: return GetConvertFn<VertexArrayType::F>(format.size);
+    case VertexArrayType::UB_OGL: return GetConvertFn<VertexArrayType::UB_OGL>(format.size);
+    case VertexArrayType::S32K: return GetConvertFn<VertexArrayType::S32K>(format.size);
+    case VertexArrayType::CMP: return &Convert<VertexArrayType::CMP, 3>;
+    default: return nullptr;
+    }
+}
+
+void FillConstant(const float* value, uint32_t attr, uint32_t count, float* outputs) {
+    F4 v = F4::Load(value);
+    for (uint32_t i = 0; i < count; i++) {
+        v.Store(&outputs[i * kVertexStride + attr * 4]);
+    }
+}
+
+}
+
+void FetchVertices(const VertexAttributeSource* sources, const uint32_t* indices, uint32_t count, float* outputs) {
+    ConvertFn converters[kKelvinAttributeCount];
+    for (uint32_t attr = 0; attr < kKelvinAttributeCount; attr++) {
+        converters[attr] = (sources[attr].data != nullptr) ? GetConvertFn(sources[attr].format) : nullptr;
+    }
+
+    // Convert every attribute of a chunk of vertices while it is in cache
+    for (uint32_t base = 0; base < count; base += kFetchChunkSize) {
+        uint32_t n = std::min(kFetchChunkSize, count - base);
+        const uint32_t* chunkIndices = (indices != nullptr) ? indices + base : nullptr;
+        float* chunkOutputs = &outputs[static_cast<size_t>(base) * kVertexStride];
+        for (uint32_t attr = 0; attr < kKelvinAttributeCount; attr++) {
+            if (converters[attr] != nullptr) {
+                converters[attr](sources[attr], attr, chunkIndices, n, chunkOutputs, base);
+            }
+            else {
+                FillConstant(sources[attr].constant, attr, n, chunkOutputs);
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,560 @@
+// StrikeBox NV2A PGRAPH vertex program engine
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+#include "strikebox/hw/gpu/pgraph/vertex_program.h"
+#include "strikebox/hw/gpu/pgraph/hash.h"
+#include "strikebox/hw/gpu/pgraph/simd.h"
+
+#include "strikebox/log.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+namespace strikebox::nv2a {
+
+// Register file layout. Output registers follow the temporaries so that R12
+// lands on oPos. Constant registers take up the end of the register file.
+const uint32_t kReg_Temp = 0;
+const uint32_t kReg_Output = 12;
+const uint32_t kReg_Scratch = kReg_Output + kVertexOutputCount;
+const uint32_t kReg_Zero = kReg_Scratch + 1;
+const uint32_t kReg_Input = kReg_Zero + 1;
+const uint32_t kReg_Constant = kReg_Input + kKelvinAttributeCount;
+
+// Returns the register holding a copy of the constant, allocating it if needed
+static uint16_t GetConstantRegister(VertexProgram& decoded, uint32_t index) {
+    auto& regs = decoded.constantRegisters;
+    auto it = std::find(regs.begin(), regs.end(), index);
+    if (it == regs.end()) {
+        it = regs.insert(regs.end(), static_cast<uint16_t>(index));
+    }
+    return static_cast<uint16_t>(kReg_Constant + (it - regs.begin()));
+}
+
+// ----------------------------------------------------------------------------
+// Instruction decoding
+
+// Instruction fields, given as word, shift and size
+//   word 1: 27..25 ILU op, 24..21 MAC op, 20..13 constant index, 12..9 input index,
+//           8 A negate, 7..0 A swizzle
+//   word 2: 31..28 A temp, 27..26 A mux, 25 B negate, 24..17 B swizzle, 16..13 B temp,
+//           12..11 B mux, 10 C negate, 9..2 C swizzle, 1..0 C temp (high bits)
+//   word 3: 31..30 C temp (low bits), 29..28 C mux, 27..24 MAC temp mask, 23..20 temp,
+//           19..16 ILU temp mask, 15..12 output mask, 11 output is register (vs. constant),
+//           10..3 output address, 2 output is ILU (vs. MAC), 1 constant index relative to A0,
+//           0 final
+// Swizzles have x in the two most significant bits; masks have x in bit 3.
+static inline uint32_t Field(const uint32_t* insn, uint32_t word, uint32_t shift, uint32_t size) {
+    return (insn[word] >> shift) & ((1u << size) - 1);
+}
+
+// Operand multiplexer values
+const uint32_t kMux_Temp = 1;
+const uint32_t kMux_Input = 2;
+const uint32_t kMux_Constant = 3;
+
+static inline bool IsFinal(const uint32_t* insn) {
+    return Field(insn, 3, 0, 1) != 0;
+}
+
+// Converts a hardware write mask into a mask with x in bit 0
+static inline uint8_t ConvertMask(uint32_t mask) {
+    return static_cast<uint8_t>(((mask >> 3) & 1) | ((mask >> 1) & 2) | ((mask << 1) & 4) | ((mask << 3) & 8));
+}
+
+static VertexOperand DecodeOperand(const uint32_t* insn, uint32_t mux, uint32_t temp, uint32_t swizzle, bool negate, VertexProgram& decoded) {
+    VertexOperand op;
+    op.negate = negate;
+    op.swizzle = static_cast<uint8_t>(((swizzle >> 6) & 3) | (((swizzle >> 4) & 3) << 2) | (((swizzle >> 2) & 3) << 4) | ((swizzle & 3) << 6));
+    switch (mux) {
+    case kMux_Temp:
+        if (temp <= kVertexTempCount) {
+            op.index = kReg_Temp + temp;
+        }
+        else {
+            log_spew("[NV2A] PGRAPH: Vertex program reads invalid temporary R%u\n", temp);
+            op.index = kReg_Zero;
+        }
+        break;
+    case kMux_Input: {
+        uint32_t input = Field(insn, 1, 9, 4);
+        op.index = kReg_Input + input;
+        decoded.inputMask |= 1 << input;
+        break;
+    }
+    case kMux_Constant: {
+        uint32_t index = Field(insn, 1, 13, 8);
+        if (Field(insn, 3, 1, 1)) {
+            op.file = VertexOperand::File::RelativeConstant;
+            op.index = index;
+        }
+        else if (index < kKelvinConstantCount) {
+            op.index = GetConstantRegister(decoded, index);
+        }
+        else {
+            op.index = kReg_Zero;
+        }
+        break;
+    }
+    default:
+        op.index = kReg_Zero;
+        break;
+    }
+    return op;
+}
+
+// Determines if the first micro-op writes anything read by the second
+static bool WritesSources(const VertexMicroOp& first, const VertexMicroOp& second, uint32_t sourceCount) {
+    for (uint32_t i = 0; i < sourceCount; i++) {
+        const VertexOperand& src = second.src[i];
+        if (src.file == VertexOperand::File::Register) {
+            if ((first.dstMask[0] && first.dst[0] == src.index) || (first.dstMask[1] && first.dst[1] == src.index)) {
+                return true;
+            }
+            if (first.constMask && src.index >= kReg_Constant) {
+                return true;
+            }
+        }
+        else if (first.constMask || first.op == VertexOp::Arl) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Sets the destinations of a micro-op: temporary register, and output
+// register or constant if the instruction routes this unit to the output
+static void SetDestinations(const uint32_t* insn, VertexMicroOp& op, uint32_t temp, uint32_t tempMask, bool toOutput, VertexProgram& decoded) {
+    op.dst[0] = op.dst[1] = kReg_Zero;
+    op.dstMask[0] = op.dstMask[1] = 0;
+    op.constMask = 0;
+    op.constIndex = 0;
+    op.constRegister = 0;
+
+    if (tempMask != 0) {
+        if (temp < kVertexTempCount) {
+            op.dst[0] = static_cast<uint8_t>(kReg_Temp + temp);
+            op.dstMask[0] = ConvertMask(tempMask);
+        }
+        else {
+            log_spew("[NV2A] PGRAPH: Vertex program writes invalid temporary R%u\n", temp);
+        }
+    }
+
+    uint32_t outMask = Field(insn, 3, 12, 4);
+    if (!toOutput || outMask == 0) {
+        return;
+    }
+    uint32_t address = Field(insn, 3, 3, 8);
+    if (Field(insn, 3, 11, 1)) {
+        if (address < kVertexOutputCount) {
+            op.dst[1] = static_cast<uint8_t>(kReg_Output + address);
+            op.dstMask[1] = ConvertMask(outMask);
+            decoded.outputMask |= 1 << address;
+        }
+        else {
+            log_spew("[NV2A] PGRAPH: Vertex program writes invalid output %u\n", address);
+        }
+    }
+    else if (address < kKelvinConstantCount) {
+        op.constIndex = static_cast<uint16_t>(address);
+        op.constMask = ConvertMask(outMask);
+        decoded.writesConstants = true;
+    }
+}
+
+void DecodeVertexProgram(const uint32_t (*program)[4], uint32_t start, VertexProgram& decoded) {
+    static const VertexOp kMacOps[] = {
+        VertexOp::Mov, VertexOp::Mov, VertexOp::Mul, VertexOp::Add, VertexOp::Mad, VertexOp::Dp3, VertexOp::Dph,
+        VertexOp::Dp4, VertexOp::Dst, VertexOp::Min, VertexOp::Max, VertexOp::Slt, VertexOp::Sge, VertexOp::Arl,
+    };
+    static const VertexOp kIluOps[] = {
+        VertexOp::Mov, VertexOp::Mov, VertexOp::Rcp, VertexOp::Rcc, VertexOp::Rsq, VertexOp::Exp, VertexOp::Log, VertexOp::Lit,
+    };
+
+    decoded = VertexProgram();
+    for (uint32_t slot = start; slot < kKelvinProgramSize; slot++) {
+        const uint32_t* insn = program[slot];
+        uint32_t mac = Field(insn, 1, 21, 4);
+        uint32_t ilu = Field(insn, 1, 25, 3);
+        if (mac >= std::size(kMacOps)) {
+            log_spew("[NV2A] PGRAPH: Invalid vertex program MAC operation %u at slot %u\n", mac, slot);
+            mac = 0;
+        }
+
+        VertexOperand a = DecodeOperand(insn, Field(insn, 2, 26, 2), Field(insn, 2, 28, 4), Field(insn, 1, 0, 8), Field(insn, 1, 8, 1) != 0, decoded);
+        VertexOperand b = DecodeOperand(insn, Field(insn, 2, 11, 2), Field(insn, 2, 13, 4), Field(insn, 2, 17, 8), Field(insn, 2, 25, 1) != 0, decoded);
+        uint32_t cTemp = (Field(insn, 2, 0, 2) << 2) | Field(insn, 3, 30, 2);
+        VertexOperand c = DecodeOperand(insn, Field(insn, 3, 28, 2), cTemp, Field(insn, 2, 2, 8), Field(insn, 2, 10, 1) != 0, decoded);
+
+        uint32_t temp = Field(insn, 3, 20, 4);
+        bool outputIsILU = Field(insn, 3, 2, 1) != 0;
+
+        VertexMicroOp macOp;
+        if (mac != 0) {
+            macOp.op = kMacOps[mac];
+            macOp.src[0] = a;
+            switch (macOp.op) {
+            case VertexOp::Add: macOp.src[1] = c; break;
+            case VertexOp::Mad: macOp.src[1] = b; macOp.src[2] = c; break;
+            default: macOp.src[1] = b; break;
+            }
+            SetDestinations(insn, macOp, temp, Field(insn, 3, 24, 4), !outputIsILU, decoded);
+            if (macOp.op == VertexOp::Arl) {
+                macOp.dstMask[0] = macOp.dstMask[1] = macOp.constMask = 0;
+            }
+        }
+
+        if (ilu != 0) {
+            // When paired with a MAC operation, the ILU writes its temporary to R1
+            VertexMicroOp iluOp;
+            iluOp.op = kIluOps[ilu];
+            iluOp.src[0] = c;
+            SetDestinations(insn, iluOp, (mac != 0) ? 1 : temp, Field(insn, 3, 16, 4), outputIsILU, decoded);
+
+            if (mac != 0) {
+                // Both units read their inputs before either writes. Keep the
+                // ILU input aside if the MAC operation overwrites it.
+                if (WritesSources(macOp, iluOp, 1)) {
+                    VertexMicroOp copy;
+                    copy.op = VertexOp::Mov;
+                    copy.src[0] = c;
+                    copy.dst[0] = copy.dst[1] = kReg_Scratch;
+                    copy.dstMask[0] = 0xf;
+                    copy.dstMask[1] = 0;
+                    copy.constMask = 0;
+                    copy.constIndex = 0;
+                    copy.constRegister = 0;
+                    decoded.ops.push_back(copy);
+                    iluOp.src[0] = VertexOperand();
+                    iluOp.src[0].index = kReg_Scratch;
+                }
+                decoded.ops.push_back(macOp);
+            }
+            decoded.ops.push_back(iluOp);
+        }
+        else if (mac != 0) {
+            decoded.ops.push_back(macOp);
+        }
+
+        if (IsFinal(insn)) {
+            break;
+        }
+    }
+
+    // Constant writes also update the copies read by later instructions
+    for (VertexMicroOp& op : decoded.ops) {
+        if (op.constMask) {
+            auto& regs = decoded.constantRegisters;
+            auto it = std::find(regs.begin(), regs.end(), op.constIndex);
+            if (it != regs.end()) {
+                op.constRegister = static_cast<uint16_t>(kReg_Constant + (it - regs.begin()));
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Execution
+
+namespace {
+
+typedef simd::FV Vec;
+
+const uint32_t kLanes = Vec::kLanes;
+
+typedef float Register[4][kLanes];
+
+// Registers of a batch of vertices in structure of arrays layout
+struct VertexBatch {
+    Register* regs;
+    int32_t a0[kLanes];
+};
+
+inline Vec Fetch(const VertexBatch& b, const VertexOperand& op, uint32_t c, const float (*constants)[4]) {
+    uint32_t comp = op.Component(c);
+    Vec value;
+    if (op.file == VertexOperand::File::Register) {
+        value = Vec::Load(b.regs[op.index][comp]);
+    }
+    else {
+        // Out of range relative reads return zero
+        alignas(32) float lanes[kLanes];
+        for (uint32_t lane = 0; lane < kLanes; lane++) {
+            int32_t index = static_cast<int32_t>(op.index) + b.a0[lane];
+            lanes[lane] = (index >= 0 && index < static_cast<int32_t>(kKelvinConstantCount)) ? constants[index][comp] : 0.0f;
+        }
+        value = Vec::Load(lanes);
+    }
+    return op.negate ? Negate(value) : value;
+}
+
+// Applies a scalar function to each lane
+template <typename Fn>
+inline Vec PerLane(Vec x, Fn&& fn) {
+    alignas(32) float lanes[kLanes];
+    x.Store(lanes);
+    for (uint32_t lane = 0; lane < kLanes; lane++) {
+        lanes[lane] = fn(lanes[lane]);
+    }
+    return Vec::Load(lanes);
+}
+
+void Execute(VertexBatch& b, const VertexMicroOp& op, float (*constants)[4], bool contextWrite) {
+    const Vec zero = Vec::Splat(0.0f);
+    const Vec one = Vec::Splat(1.0f);
+    const uint32_t mask = op.dstMask[0] | op.dstMask[1] | op.constMask;
+    auto src = [&](uint32_t i, uint32_t c) { return Fetch(b, op.src[i], c, constants); };
+
+    Vec r[4] = { zero, zero, zero, zero };
+    switch (op.op) {
+    case VertexOp::Mov:
+        for (uint32_t c = 0; c < 4; c++) if (mask & (1 << c)) r[c] = src(0, c);
+        break;
+    case VertexOp::Mul:
+        for (uint32_t c = 0; c < 4; c++) if (mask & (1 << c)) r[c] = src(0, c) * src(1, c);
+        break;
+    case VertexOp::Add:
+        for (uint32_t c = 0; c < 4; c++) if (mask & (1 << c)) r[c] = src(0, c) + src(1, c);
+        break;
+    case VertexOp::Mad:
+        for (uint32_t c = 0; c < 4; c++) if (mask & (1 << c)) r[c] = src(0, c) * src(1, c) + src(2, c);
+        break;
+    case VertexOp::Min:
+        for (uint32_t c = 0; c < 4; c++) if (mask & (1 << c)) r[c] = Min(src(0, c), src(1, c));
+        break;
+    case VertexOp::Max:
+        for (uint32_t c = 0; c < 4; c++) if (mask & (1 << c)) r[c] = Max(src(0, c), src(1, c));
+        break;
+    case VertexOp::Slt:
+        for (uint32_t c = 0; c < 4; c++) if (mask & (1 << c)) r[c] = Vec::Select(src(0, c) < src(1, c), one, zero);
+        break;
+    case VertexOp::Sge:
+        for (uint32_t c = 0; c < 4; c++) if (mask & (1 << c)) r[c] = Vec::Select(src(0, c) >= src(1, c), one, zero);
+        break;
+    case VertexOp::Dp3:
+    case VertexOp::Dph:
+    case VertexOp::Dp4: {
+        Vec dot = src(0, 0) * src(1, 0) + src(0, 1) * src(1, 1) + src(0, 2) * src(1, 2);
+        if (op.op == VertexOp::Dph) dot = dot + src(1, 3);
+        if (op.op == VertexOp::Dp4) dot = dot + src(0, 3) * src(1, 3);
+        r[0] = r[1] = r[2] = r[3] = dot;
+        break;
+    }
+    case VertexOp::Dst:
+        r[0] = one;
+        r[1] = src(0, 1) * src(1, 1);
+        r[2] = src(0, 2);
+        r[3] = src(1, 3);
+        break;
+    case VertexOp::Arl: {
+        alignas(32) float lanes[kLanes];
+        src(0, 0).Store(lanes);
+        for (uint32_t lane = 0; lane < kLanes; lane++) {
+            b.a0[lane] = static_cast<int32_t>(std::floor(lanes[lane]));
+        }
+        return;
+    }
+    case VertexOp::Rcp:
+        r[0] = r[1] = r[2] = r[3] = one / src(0, 0);
+        break;
+    case VertexOp::Rcc:
+        // Reciprocal clamped away from zero and infinity, keeping the sign
+        r[0] = r[1] = r[2] = r[3] = PerLane(src(0, 0), [](float x) {
+            float rcp = 1.0f / x;
+            float mag = std::min(std::max(std::fabs(rcp), 5.42101e-020f), 1.84467e+019f);
+            return std::signbit(x) ? -mag : mag;
+        });
+        break;
+    case VertexOp::Rsq:
+        r[0] = r[1] = r[2] = r[3] = one / Sqrt(Abs(src(0, 0)));
+        break;
+    case VertexOp::Exp: {
+        Vec x = src(0, 0);
+        Vec floor = PerLane(x, [](float v) { return std::floor(v); });
+        r[0] = PerLane(floor, [](float v) { return std::exp2(v); });
+        r[1] = x - floor;
+        r[2] = PerLane(x, [](float v) { return std::exp2(v); });
+        r[3] = one;
+        break;
+    }
+    case VertexOp::Log: {
+        Vec x = Abs(src(0, 0));
+        Vec exponent = PerLane(x, [](float v) { return (v == 0.0f) ? -INFINITY : std::floor(std::log2(v)); });
+        r[0] = exponent;
+        r[1] = PerLane(x, [](float v) { return (v == 0.0f) ? 1.0f : v / std::exp2(std::floor(std::log2(v))); });
+        r[2] = PerLane(x, [](float v) { return std::log2(v); });
+        r[3] = one;
+        break;
+    }
+    case VertexOp::Lit: {
+        alignas(32) float x[kLanes], y[kLanes], w[kLanes], z[kLanes];
+        src(0, 0).Store(x);
+        src(0, 1).Store(y);
+        src(0, 3).Store(w);
+        for (uint32_t lane = 0; lane < kLanes; lane++) {
+            float power = std::min(std::max(w[lane], -127.9961f), 127.9961f);
+            z[lane] = (x[lane] > 0.0f && y[lane] > 0.0f) ? std::pow(y[lane], power) : 0.0f;
+        }
+        r[0] = one;
+        r[1] = Max(Vec::Load(x), zero);
+        r[2] = Vec::Load(z);
+        r[3] = one;
+        break;
+    }
+    }
+
+    for (uint32_t d = 0; d < 2; d++) {
+        for (uint32_t c = 0; c < 4; c++) {
+            if (op.dstMask[d] & (1 << c)) {
+                r[c].Store(b.regs[op.dst[d]][c]);
+            }
+        }
+    }
+    if (op.constMask && contextWrite) {
+        alignas(32) float lanes[kLanes];
+        for (uint32_t c = 0; c < 4; c++) {
+            if (op.constMask & (1 << c)) {
+                r[c].Store(lanes);
+                constants[op.constIndex][c] = lanes[kLanes - 1];
+                if (op.constRegister != 0) {
+                    Vec::Splat(lanes[kLanes - 1]).Store(b.regs[op.constRegister][c]);
+                }
+            }
+        }
+    }
+}
+
+}
+
+void RunVertexProgram(const VertexProgram& program, const float* inputs, uint32_t count, float (*constants)[4], bool contextWrite, const VertexOutputLayout& layout, float* outputs) {
+    const uint32_t inputStride = kKelvinAttributeCount * 4;
+
+    thread_local std::vector<float> regs;
+    regs.resize((kReg_Constant + program.constantRegisters.size()) * 4 * kLanes);
+    VertexBatch b;
+    b.regs = reinterpret_cast<Register*>(regs.data());
+    std::fill(&b.regs[kReg_Zero][0][0], &b.regs[kReg_Zero][0][0] + 4 * kLanes, 0.0f);
+
+    // Temporaries are undefined at the start of a program. They are cleared
+    // once and then carry over between batches.
+    std::fill(&b.regs[kReg_Temp][0][0], &b.regs[kReg_Temp + kVertexTempCount][0][0], 0.0f);
+    for (size_t i = 0; i < program.constantRegisters.size(); i++) {
+        const float* constant = constants[program.constantRegisters[i]];
+        for (uint32_t c = 0; c < 4; c++) {
+            Vec::Splat(constant[c]).Store(b.regs[kReg_Constant + i][c]);
+        }
+    }
+
+    for (uint32_t base = 0; base < count; base += kLanes) {
+        // Lanes past the end repeat the last vertex, so that constant
+        // writes from the last lane hold the value of the last vertex
+        uint32_t n = std::min(kLanes, count - base);
+
+        // oPos is also reset if not written, since it can be read through R12
+        for (uint32_t reg = 0; reg < kVertexOutputCount; reg++) {
+            if (!(program.outputMask & (1 << reg)) && reg != kVertexOut_Position) {
+                continue;
+            }
+            std::fill(&b.regs[kReg_Output + reg][0][0], &b.regs[kReg_Output + reg][3][0], 0.0f);
+            std::fill(&b.regs[kReg_Output + reg][3][0], &b.regs[kReg_Output + reg][3][0] + kLanes, 1.0f);
+        }
+        std::fill(std::begin(b.a0), std::end(b.a0), 0);
+
+        for (uint32_t attr = 0; attr < kKelvinAttributeCount; attr++) {
+            if (!(program.inputMask & (1 << attr))) {
+                continue;
+            }
+            for (uint32_t lane = 0; lane < kLanes; lane++) {
+                const float* in = &inputs[(base + std::min(lane, n - 1)) * inputStride + attr * 4];
+                for (uint32_t c = 0; c < 4; c++) {
+                    b.regs[kReg_Input + attr][c][lane] = in[c];
+                }
+            }
+        }
+
+        for (const VertexMicroOp& op : program.ops) {
+            Execute(b, op, constants, contextWrite);
+        }
+
+        for (uint32_t lane = 0; lane < n; lane++) {
+            float* vertex = &outputs[(base + lane) * layout.stride];
+            for (uint32_t reg = 0; reg < kVertexOutputCount; reg++) {
+                if (layout.offsets[reg] < 0) {
+                    continue;
+                }
+                float* out = &vertex[layout.offsets[reg]];
+                if (program.outputMask & (1 << reg)) {
+                    for (uint32_t c = 0; c < 4; c++) {
+                        out[c] = b.regs[kReg_Output + reg][c][lane];
+                    }
+                }
+                else {
+                    out[0] = out[1] = out[2] = 0.0f;
+                    out[3] = 1.0f;
+                }
+            }
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Cache
+
+std::shared_ptr<const VertexProgram> VertexProgramCache::Lookup(const uint32_t (*program)[4], uint32_t start) {
+    uint32_t end = start;
+    while (end < kKelvinProgramSize && !IsFinal(program[end])) {
+        end++;
+    }
+    end = std::min(end + 1, kKelvinProgramSize);
+    const uint32_t* words = (start < end) ? program[start] : nullptr;
+    size_t wordCount = (start < end) ? (end - start) * 4 : 0;
+    uint64_t hash = HashMemory(words, wordCount * sizeof(uint32_t));
+
+    auto range = m_entries.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        Entry& entry = *it->second;
+        if (entry.words.size() == wordCount && std::equal(entry.words.begin(), entry.words.end(), words)) {
+            m_lru.splice(m_lru.begin(), m_lru, it->second);
+            m_stats.hits++;
+            return entry.program;
+        }
+    }
+    m_stats.misses++;
+
+    auto decoded = std::make_shared<VertexProgram>();
+    DecodeVertexProgram(program, start, *decoded);
+    m_lru.push_front(Entry{ hash, std::vector<uint32_t>(words, words + wordCount), decoded });
+    m_entries.emplace(hash, m_lru.begin());
+    m_stats.entries++;
+
+    while (m_stats.entries > m_capacity) {
+        auto last = std::prev(m_lru.end());
+        auto victims = m_entries.equal_range(last->hash);
+        for (auto it = victims.first; it != victims.second; ++it) {
+            if (it->second == last) {
+                m_entries.erase(it);
+                break;
+            }
+        }
+        m_lru.pop_back();
+        m_stats.entries--;
+    }
+    return decoded;
+}
+
+void VertexProgramCache::Clear() {
+    m_entries.clear();
+    m_lru.clear();
+    m_stats.entries = 0;
+}
+
+}
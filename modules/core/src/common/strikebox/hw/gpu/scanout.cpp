@@ -0,0 +1,219 @@
+// StrikeBox NV2A display scan-out
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Based on envytools and nouveau:
+// https://envytools.readthedocs.io/en/latest/index.html
+// https://github.com/torvalds/linux/tree/master/drivers/gpu/drm/nouveau
+//
+// References to particular items in the documentation are denoted between
+// brackets optionally followed by a quote from the documentation.
+#include "strikebox/hw/gpu/scanout.h"
+#include "strikebox/hw/gpu/pgraph/simd.h"
+#include "strikebox/hw/gpu/state.h"
+
+#include "strikebox/log.h"
+
+namespace strikebox::nv2a {
+
+// --- Kernels ---------------
+
+namespace {
+
+inline uint32_t Expand5(uint32_t c) { return (c << 3) | (c >> 2); }
+inline uint32_t Expand6(uint32_t c) { return (c << 2) | (c >> 4); }
+
+template <ScanOutFormat format>
+inline uint32_t ExpandPixel(uint32_t pixel) {
+    if constexpr (format == ScanOutFormat::R5G6B5) {
+        return 0xff000000 | (Expand5((pixel >> 11) & 0x1f) << 16) | (Expand6((pixel >> 5) & 0x3f) << 8) | Expand5(pixel & 0x1f);
+    }
+    else if constexpr (format == ScanOutFormat::X1R5G5B5) {
+        return 0xff000000 | (Expand5((pixel >> 10) & 0x1f) << 16) | (Expand5((pixel >> 5) & 0x1f) << 8) | Expand5(pixel & 0x1f);
+    }
+    else {
+        return 0xff000000 | pixel;
+    }
+}
+
+#ifdef STRIKEBOX_SIMD_SSE2
+// Expands a channel of four 16-bit pixels held in 32-bit lanes
+template <int shift, int bits>
+inline __m128i ExpandChannel(__m128i pixels) {
+    __m128i c = _mm_and_si128(_mm_srli_epi32(pixels, shift), _mm_set1_epi32((1 << bits) - 1));
+    return _mm_or_si128(_mm_slli_epi32(c, 8 - bits), _mm_srli_epi32(c, 2 * bits - 8));
+}
+
+template <ScanOutFormat format>
+inline __m128i ExpandPixels(__m128i pixels) {
+    const int rShift = (format == ScanOutFormat::R5G6B5) ? 11 : 10;
+    const int gBits = (format == ScanOutFormat::R5G6B5) ? 6 : 5;
+    __m128i r = ExpandChannel<rShift, 5>(pixels);
+    __m128i g = ExpandChannel<5, gBits>(pixels);
+    __m128i b = ExpandChannel<0, 5>(pixels);
+    __m128i rgb = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(g, 8)), b);
+    return _mm_or_si128(rgb, _mm_set1_epi32(0xff000000));
+}
+#endif
+
+// Converts a row of framebuffer pixels into opaque X8R8G8B8
+template <ScanOutFormat format>
+void ExpandRow(const uint8_t* src, uint32_t* dst, uint32_t count) {
+    uint32_t x = 0;
+    if constexpr (format == ScanOutFormat::X8R8G8B8) {
+        const uint32_t* src32 = reinterpret_cast<const uint32_t*>(src);
+#ifdef STRIKEBOX_SIMD_SSE2
+        const __m128i alpha = _mm_set1_epi32(0xff000000);
+        for (; x + 4 <= count; x += 4) {
+            __m128i p = _mm_loadu_si128((const __m128i*)(src32 + x));
+            _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(p, alpha));
+        }
+#endif
+        for (; x < count; x++) {
+            dst[x] = ExpandPixel<format>(src32[x]);
+        }
+    }
+    else {
+        const uint16_t* src16 = reinterpret_cast<const uint16_t*>(src);
+#ifdef STRIKEBOX_SIMD_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 8 <= count; x += 8) {
+            __m128i p = _mm_loadu_si128((const __m128i*)(src16 + x));
+            _mm_storeu_si128((__m128i*)(dst + x), ExpandPixels<format>(_mm_unpacklo_epi16(p, zero)));
+            _mm_storeu_si128((__m128i*)(dst + x + 4), ExpandPixels<format>(_mm_unpackhi_epi16(p, zero)));
+        }
+#endif
+        for (; x < count; x++) {
+            dst[x] = ExpandPixel<format>(src16[x]);
+        }
+    }
+}
+
+void ExpandRow(ScanOutFormat format, const uint8_t* src, uint32_t* dst, uint32_t count) {
+    switch (format) {
+    case ScanOutFormat::X8R8G8B8: ExpandRow<ScanOutFormat::X8R8G8B8>(src, dst, count); break;
+    case ScanOutFormat::R5G6B5: ExpandRow<ScanOutFormat::R5G6B5>(src, dst, count); break;
+    case ScanOutFormat::X1R5G5B5: ExpandRow<ScanOutFormat::X1R5G5B5>(src, dst, count); break;
+    }
+}
+
+uint32_t ExpandPixel(ScanOutFormat format, uint32_t pixel) {
+    switch (format) {
+    case ScanOutFormat::R5G6B5: return ExpandPixel<ScanOutFormat::R5G6B5>(pixel & 0xffff);
+    case ScanOutFormat::X1R5G5B5: return ExpandPixel<ScanOutFormat::X1R5G5B5>(pixel & 0xffff);
+    default: return ExpandPixel<ScanOutFormat::X8R8G8B8>(pixel & 0xffffff);
+    }
+}
+
+// Converts X8R8G8B8 pixels into opaque RGBA bytes by swapping red and blue
+void ConvertToRGBA(const uint32_t* src, uint8_t* dst, uint32_t count) {
+    uint32_t* dst32 = reinterpret_cast<uint32_t*>(dst);
+    uint32_t x = 0;
+#ifdef STRIKEBOX_SIMD_SSE2
+    const __m128i alphaGreen = _mm_set1_epi32(0x0000ff00);
+    const __m128i redBlue = _mm_set1_epi32(0x00ff00ff);
+    const __m128i alpha = _mm_set1_epi32(0xff000000);
+    for (; x + 4 <= count; x += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i*)(src + x));
+        // Red and blue sit in the low bytes of the 16-bit halves of each pixel
+        __m128i rb = _mm_and_si128(p, redBlue);
+        rb = _mm_shufflelo_epi16(rb, _MM_SHUFFLE(2, 3, 0, 1));
+        rb = _mm_shufflehi_epi16(rb, _MM_SHUFFLE(2, 3, 0, 1));
+        __m128i ag = _mm_or_si128(_mm_and_si128(p, alphaGreen), alpha);
+        _mm_storeu_si128((__m128i*)(dst32 + x), _mm_or_si128(ag, rb));
+    }
+#endif
+    for (; x < count; x++) {
+        uint32_t p = src[x];
+        dst32[x] = 0xff000000 | (p & 0x0000ff00) | ((p >> 16) & 0xff) | ((p & 0xff) << 16);
+    }
+}
+
+}
+
+// --- Scan-out --------------
+
+void ScanOut::Run() {
+    if (m_sink == nullptr) {
+        return;
+    }
+
+    // [https://envytools.readthedocs.io/en/latest/hw/display/nv3/vga.html]
+    // Only the direct color modes are supported
+    auto& prmcio = m_nv2a.prmcio;
+    const uint8_t depth = prmcio.GetPixelDepth();
+    ScanOutFormat format;
+    uint32_t bytesPerPixel;
+    switch (depth) {
+    case Val_CR_PIXEL_DEPTH_32:
+        format = ScanOutFormat::X8R8G8B8;
+        bytesPerPixel = 4;
+        break;
+    case Val_CR_PIXEL_DEPTH_16:
+        format = (m_nv2a.pramdac.GetGeneralControl() & Val_RAMDAC_GENERAL_CONTROL_ALT_MODE_SEL)
+            ? ScanOutFormat::R5G6B5
+            : ScanOutFormat::X1R5G5B5;
+        bytesPerPixel = 2;
+        break;
+    default:
+        if (depth != m_lastUnsupportedDepth) {
+            log_spew("[NV2A] Scan-out: Unsupported pixel depth %u\n", depth);
+            m_lastUnsupportedDepth = depth;
+        }
+        return;
+    }
+    m_lastUnsupportedDepth = -1;
+
+    const uint32_t width = prmcio.GetDisplayWidth();
+    const uint32_t height = prmcio.GetDisplayHeight();
+    const uint32_t pitch = prmcio.GetFramebufferPitch();
+    const uint32_t start = m_nv2a.pcrtc.GetStart();
+    if (pitch < width * bytesPerPixel) {
+        return;
+    }
+    const uint64_t end = start + static_cast<uint64_t>(height - 1) * pitch + width * bytesPerPixel;
+    if (end > m_nv2a.systemRAMSize) {
+        log_spew("[NV2A] Scan-out: %ux%u framebuffer at 0x%x exceeds system memory\n", width, height, start);
+        return;
+    }
+    const uint8_t* src = &m_nv2a.systemRAM[start];
+
+    const uint64_t framePeriod = m_nv2a.pcrtc.GetFramePeriod();
+    if (framePeriod != m_framePeriod) {
+        m_sink->SetFramePeriod(framePeriod);
+        m_framePeriod = framePeriod;
+    }
+
+    uint32_t dstPitch;
+    uint8_t* dst = m_sink->BeginFrame(width, height, dstPitch);
+    if (dst == nullptr) {
+        return;
+    }
+
+    auto& pvideo = m_nv2a.pvideo;
+    if (pvideo.IsDisplaying()) {
+        m_frame.resize(static_cast<size_t>(width) * height);
+        for (uint32_t y = 0; y < height; y++) {
+            ExpandRow(format, src + y * pitch, &m_frame[y * width], width);
+        }
+        pvideo.Compose(m_frame.data(), width, width, height, ExpandPixel(format, pvideo.GetColorKey()));
+        for (uint32_t y = 0; y < height; y++) {
+            ConvertToRGBA(&m_frame[y * width], dst + y * dstPitch, width);
+        }
+    }
+    else if (format == ScanOutFormat::X8R8G8B8) {
+        for (uint32_t y = 0; y < height; y++) {
+            ConvertToRGBA(reinterpret_cast<const uint32_t*>(src + y * pitch), dst + y * dstPitch, width);
+        }
+    }
+    else {
+        m_row.resize(width);
+        for (uint32_t y = 0; y < height; y++) {
+            ExpandRow(format, src + y * pitch, m_row.data(), width);
+            ConvertToRGBA(m_row.data(), dst + y * dstPitch, width);
+        }
+    }
+
+    m_sink->EndFrame();
+}
+
+}
@@ -2,15 +2,23 @@
 
 #include "strikebox/log.h"
 
+#include <cassert>
+
 namespace strikebox::nv2a {
 
-NV2A::NV2A(uint8_t* systemRAM, uint32_t systemRAMSize, PCIConfigReader readPCIConfig, PCIConfigWriter writePCIConfig, IRQHandlerFunc handleIRQ)
-    : systemRAM(systemRAM)
-    , systemRAMSize(systemRAMSize)
-    , readPCIConfig(readPCIConfig)
+NV2A::NV2A(uint8_t* systemRAM, uint32_t systemRAMSize, PCIConfigReader readPCIConfig, PCIConfigWriter writePCIConfig, IRQHandlerFunc handleIRQ,
+    VirtualClock& clock, GuestMemory* guestMemory, Scheduler* scheduler)
+    : readPCIConfig(readPCIConfig)
     , writePCIConfig(writePCIConfig)
     , handleIRQ(handleIRQ)
+    , systemRAM(systemRAM)
+    , systemRAMSize(systemRAMSize)
+    , guestMemory(guestMemory)
+    , clock(clock)
+    , scheduler(scheduler)
 {
+    enginePages.fill(&unmapped);
+
     RegisterEngine(pmc);
     RegisterEngine(pbus);
     RegisterEngine(pfifo);
@@ -32,60 +40,50 @@ NV2A::NV2A(uint8_t* systemRAM, uint32_t systemRAMSize, PCIConfigReader readPCICo
 }
 
 void NV2A::Reset() {
-    for (auto& eng : engines) {
-        eng.second.Reset();
+    for (auto eng : engines) {
+        eng->Reset();
     }
 }
 
 uint32_t NV2A::Read(const uint32_t addr, const uint8_t size) {
-    auto opt_eng = FindEngine(addr);
-    if (opt_eng) {
-        auto& eng = opt_eng->get();
-        // Aligned 32-bit read as expected
-        if ((addr & 3) == 0 && size == 4) {
-            return eng.Read(addr - eng.GetOffset());
-        }
+    assert(addr < kMMIOSize);
+    auto& eng = *enginePages[addr >> kEnginePageShift];
 
-        // Unaligned or non 32-bit read
-        return eng.ReadUnaligned(addr - eng.GetOffset(), size);
+    // Aligned 32-bit read as expected
+    if ((addr & 3) == 0 && size == 4) {
+        return eng.Read(addr - eng.GetOffset());
     }
 
-    log_spew("NV2A::Read:   Unmapped read!   address = 0x%x,  size = %u\n", addr, size);
-    return 0;
+    // Unaligned or non 32-bit read
+    return eng.ReadUnaligned(addr - eng.GetOffset(), size);
 }
 
 void NV2A::Write(const uint32_t addr, const uint32_t value, const uint8_t size) {
-    auto opt_eng = FindEngine(addr);
-    if (opt_eng) {
-        auto& eng = opt_eng->get();
-        // Aligned 32-bit wrute as expected
-        if ((addr & 3) == 0 && size == 4) {
-            eng.Write(addr - eng.GetOffset(), value);
-        }
-        else {
-            // Unaligned or non 32-bit write
-            eng.WriteUnaligned(addr - eng.GetOffset(), value, size);
-        }
+    assert(addr < kMMIOSize);
+    auto& eng = *enginePages[addr >> kEnginePageShift];
+
+    // Aligned 32-bit write as expected
+    if ((addr & 3) == 0 && size == 4) {
+        eng.Write(addr - eng.GetOffset(), value);
     }
     else {
-        log_spew("NV2A::Write:  Unmapped write!  address = 0x%x,  value = 0x%x,  size = %u\n", addr, value, size);
+        // Unaligned or non 32-bit write
+        eng.WriteUnaligned(addr - eng.GetOffset(), value, size);
     }
 }
 
 void NV2A::RegisterEngine(nv2a::NV2AEngine& engine) {
-    engines.insert({ engine.GetOffset() + engine.GetLength() - 1, engine });
-    engine.Reset();
-}
+    assert((engine.GetOffset() & ((1 << kEnginePageShift) - 1)) == 0);
+    assert((engine.GetLength() & ((1 << kEnginePageShift) - 1)) == 0);
+    assert(engine.GetOffset() + engine.GetLength() <= kMMIOSize);
 
-std::optional<std::reference_wrapper<nv2a::NV2AEngine>> NV2A::FindEngine(const uint32_t address) {
-    auto entry = engines.lower_bound(address);
-    if (entry != engines.end()) {
-        auto& engine = entry->second;
-        if (engine.Contains(address)) {
-            return engine;
-        }
+    engines.push_back(&engine);
+    uint32_t firstPage = engine.GetOffset() >> kEnginePageShift;
+    uint32_t lastPage = (engine.GetOffset() + engine.GetLength() - 1) >> kEnginePageShift;
+    for (uint32_t page = firstPage; page <= lastPage; page++) {
+        enginePages[page] = &engine;
     }
-    return std::nullopt;
+    engine.Reset();
 }
 
 }
@@ -0,0 +1,95 @@
+// StrikeBox NV2A YUV 4:2:2 conversion
+// (C) Ivan "StrikerX3" Oliveira
+#include "strikebox/hw/gpu/yuv.h"
+#include "strikebox/hw/gpu/pgraph/simd.h"
+
+#include <algorithm>
+
+namespace strikebox::nv2a {
+
+namespace {
+
+// ITU-R BT.601 conversion from studio range YUV with coefficients scaled by 64:
+//   R = 1.164 (Y - 16) + 1.596 (V - 128)
+//   G = 1.164 (Y - 16) - 0.391 (U - 128) - 0.813 (V - 128)
+//   B = 1.164 (Y - 16) + 2.018 (U - 128)
+const int kYScale = 75;
+const int kVToR = 102;
+const int kUToG = 25;
+const int kVToG = 52;
+const int kUToB = 129;
+
+inline uint32_t ClampChannel(int value) {
+    return static_cast<uint32_t>(std::clamp(value, 0, 255));
+}
+
+inline uint32_t ConvertYUV(int y, int u, int v) {
+    int luma = kYScale * (y - 16) + 32;
+    u -= 128;
+    v -= 128;
+    uint32_t r = ClampChannel((luma + kVToR * v) >> 6);
+    uint32_t g = ClampChannel((luma - kUToG * u - kVToG * v) >> 6);
+    uint32_t b = ClampChannel((luma + kUToB * u) >> 6);
+    return 0xff000000 | (r << 16) | (g << 8) | b;
+}
+
+// Converts a pair of pixels sharing their chroma
+template <bool UYVY>
+inline void ConvertPair(const uint8_t* src, uint32_t* dst) {
+    if constexpr (UYVY) {
+        dst[0] = ConvertYUV(src[1], src[0], src[2]);
+        dst[1] = ConvertYUV(src[3], src[0], src[2]);
+    }
+    else {
+        dst[0] = ConvertYUV(src[0], src[1], src[3]);
+        dst[1] = ConvertYUV(src[2], src[1], src[3]);
+    }
+}
+
+template <bool UYVY>
+void ConvertRow(const uint8_t* src, uint32_t* dst, uint32_t width) {
+    uint32_t x = 0;
+#ifdef STRIKEBOX_SIMD_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i byteMask = _mm_set1_epi16(0xff);
+    const __m128i wordMask = _mm_set1_epi32(0xffff);
+    const __m128i alpha = _mm_set1_epi8(-1);
+    for (; x + 8 <= width; x += 8) {
+        // Eight pixels, one per 16-bit lane
+        __m128i in = _mm_loadu_si128((const __m128i*)(src + x * 2));
+        __m128i luma = UYVY ? _mm_srli_epi16(in, 8) : _mm_and_si128(in, byteMask);
+        __m128i chroma = UYVY ? _mm_and_si128(in, byteMask) : _mm_srli_epi16(in, 8);
+        __m128i u = _mm_and_si128(chroma, wordMask);
+        __m128i v = _mm_srli_epi32(chroma, 16);
+        u = _mm_sub_epi16(_mm_or_si128(u, _mm_slli_epi32(u, 16)), _mm_set1_epi16(128));
+        v = _mm_sub_epi16(_mm_or_si128(v, _mm_slli_epi32(v, 16)), _mm_set1_epi16(128));
+
+        // Sums that saturate exceed 255 once scaled down, so the clamped
+        // results are exact
+        luma = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(luma, _mm_set1_epi16(16)), _mm_set1_epi16(kYScale)), _mm_set1_epi16(32));
+        __m128i r = _mm_srai_epi16(_mm_adds_epi16(luma, _mm_mullo_epi16(v, _mm_set1_epi16(kVToR))), 6);
+        __m128i g = _mm_srai_epi16(_mm_subs_epi16(_mm_subs_epi16(luma, _mm_mullo_epi16(u, _mm_set1_epi16(kUToG))), _mm_mullo_epi16(v, _mm_set1_epi16(kVToG))), 6);
+        __m128i b = _mm_srai_epi16(_mm_adds_epi16(luma, _mm_mullo_epi16(u, _mm_set1_epi16(kUToB))), 6);
+
+        __m128i bg = _mm_unpacklo_epi8(_mm_packus_epi16(b, zero), _mm_packus_epi16(g, zero));
+        __m128i ra = _mm_unpacklo_epi8(_mm_packus_epi16(r, zero), alpha);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_unpacklo_epi16(bg, ra));
+        _mm_storeu_si128((__m128i*)(dst + x + 4), _mm_unpackhi_epi16(bg, ra));
+    }
+#endif
+    for (; x < width; x += 2) {
+        ConvertPair<UYVY>(src + x * 2, dst + x);
+    }
+}
+
+}
+
+void ConvertUYVYRow(const uint8_t* src, uint32_t* dst, uint32_t width) {
+    ConvertRow<true>(src, dst, width);
+}
+
+void ConvertYUY2Row(const uint8_t* src, uint32_t* dst, uint32_t width) {
+    ConvertRow<false>(src, dst, width);
+}
+
+}
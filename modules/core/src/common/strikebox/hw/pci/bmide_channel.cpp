@@ -18,11 +18,12 @@ using namespace hw;
 using namespace hw::bmide;
 using namespace hw::ata;
 
-BMIDEChannel::BMIDEChannel(Channel channel, ATAChannel& ataChannel, uint8_t *ram, uint32_t ramSize)
+BMIDEChannel::BMIDEChannel(Channel channel, ATAChannel& ataChannel, GuestMemory& memory)
     : m_channel(channel)
     , m_ataChannel(ataChannel)
-    , m_ram(ram)
-    , m_ramSize(ramSize) 
+    , m_memory(memory)
+    , m_ram(memory.Data())
+    , m_ramSize(memory.Size())
     , m_intrHook(IntrHook(*this))
 {
     ataChannel.RegisterInterruptHook(&m_intrHook);
@@ -244,6 +245,7 @@ void BMIDEChannel::RunWorker() {
                 }
                 else {
                     result = m_ataChannel.ReadDMA(helper.bufPtr, helper.bufLen);
+                    m_memory.MarkDirty(helper.physAddr, helper.bufLen);
                 }
 
                 // Set Interrupt flag if the ATA device triggered an interrupt
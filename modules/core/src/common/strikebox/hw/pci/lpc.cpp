@@ -29,11 +29,13 @@
 
 namespace strikebox {
 
-LPCDevice::LPCDevice(IRQ *irqs, uint8_t *rom, uint8_t *bios, uint32_t biosSize, uint8_t *mcpxROM, bool initMcpxROM)
+LPCDevice::LPCDevice(IRQ *irqs, VirtualClock& clock, uint8_t *rom, uint8_t *bios, uint32_t biosSize, uint8_t *mcpxROM, bool initMcpxROM)
     : PCIDevice(PCI_HEADER_TYPE_MULTIFUNCTION, PCI_VENDOR_ID_NVIDIA, 0x01B2, 0xB2,
         0x06, 0x01, 0x00, // ISA bridge
         /*TODO: subsystemVendorID*/0x00, /*TODO: subsystemID*/0x00)
     , m_irqs(irqs)
+    , m_clock(clock)
+    , m_acpiTimerRate(3375000) // This timer counts at 3375000 Hz
     , m_rom(rom)
     , m_bios(bios)
     , m_biosSize(biosSize)
@@ -127,9 +129,7 @@ void LPCDevice::PCIIORead(int barIndex, uint32_t port, uint32_t *value, uint8_t
     switch (port) {
     case 0x8008: { // TODO: Move 0x8008 TIMER to a device
         if (size == sizeof(uint32_t)) {
-            // This timer counts at 3375000 Hz
-            auto t = std::chrono::high_resolution_clock::now();
-            *value = static_cast<uint32_t>(t.time_since_epoch().count() * 0.003375000);
+            *value = static_cast<uint32_t>(m_acpiTimerRate.ToTicks(m_clock.Now()));
             return;
         }
         break;
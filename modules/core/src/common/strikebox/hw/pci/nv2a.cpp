@@ -4,7 +4,7 @@
 
 namespace strikebox {
 
-NV2ADevice::NV2ADevice(uint8_t *pSystemRAM, uint32_t systemRAMSize, IRQHandler& irqHandler)
+NV2ADevice::NV2ADevice(GuestMemory& memory, IRQHandler& irqHandler, Scheduler& scheduler)
     : PCIDevice(PCI_HEADER_TYPE_NORMAL, PCI_VENDOR_ID_NVIDIA, 0x02A0, 0xA2,
         0x03, 0x00, 0x00) // VGA-compatible controller
     , m_irqHandler(irqHandler)
@@ -12,7 +12,7 @@ NV2ADevice::NV2ADevice(uint8_t *pSystemRAM, uint32_t systemRAMSize, IRQHandler&
     nv2a::PCIConfigReader readPCIConfig = [&](uint8_t addr) -> uint32_t { return Read32(m_configSpace, addr); };
     nv2a::PCIConfigWriter writePCIConfig = [&](uint8_t addr, uint32_t value) { Write32(m_configSpace, addr, value); };
     nv2a::IRQHandlerFunc handleIRQ = [&](bool level) { irqHandler.HandleIRQ(Read8(m_configSpace, PCI_INTERRUPT_LINE), level); };
-    m_nv2a = std::make_unique<nv2a::NV2A>(pSystemRAM, systemRAMSize, readPCIConfig, writePCIConfig, handleIRQ);
+    m_nv2a = std::make_unique<nv2a::NV2A>(memory.Data(), memory.Size(), readPCIConfig, writePCIConfig, handleIRQ, scheduler.GetClock(), &memory, &scheduler);
 }
 
 NV2ADevice::~NV2ADevice() {
@@ -56,6 +56,10 @@ void NV2ADevice::Init() {
 void NV2ADevice::Reset() {
 }
 
+void NV2ADevice::SetFrameSink(nv2a::FrameSink* sink) {
+    m_nv2a->scanOut.SetSink(sink);
+}
+
 void NV2ADevice::PCIIORead(int barIndex, uint32_t port, uint32_t *value, uint8_t size) {
     log_warning("NV2ADevice::PCIIORead:  Unexpected I/O read!   bar = %d,  port = 0x%x,  size = %u\n", barIndex, port, size);
     *value = 0;
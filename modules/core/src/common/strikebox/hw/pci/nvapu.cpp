@@ -4,15 +4,11 @@
 
 namespace strikebox {
 
-uint32_t GetAPUTime() {
-    // This timer counts at 48000 Hz
-    auto t = std::chrono::high_resolution_clock::now();
-    return static_cast<uint32_t>(t.time_since_epoch().count() * 0.000048000);
-}
-
-NVAPUDevice::NVAPUDevice()
+NVAPUDevice::NVAPUDevice(VirtualClock& clock)
     : PCIDevice(PCI_HEADER_TYPE_NORMAL, PCI_VENDOR_ID_NVIDIA, 0x01B0, 0xB1,
         0x04, 0x01, 0x00) // Multimedia Audio Controller
+    , m_clock(clock)
+    , m_apuTimerRate(48000) // This timer counts at 48000 Hz
 {
 }
 
@@ -75,4 +71,8 @@ void NVAPUDevice::PCIMMIOWrite(int barIndex, uint32_t addr, uint32_t value, uint
     log_spew("NVAPUDevice::PCIMMIOWrite:  Unimplemented write!  bar = %d,  address = 0x%x,  value = 0x%x,  size = %u\n", barIndex, addr, value, size);
 }
 
+uint32_t NVAPUDevice::GetAPUTime() {
+    return static_cast<uint32_t>(m_apuTimerRate.ToTicks(m_clock.Now()));
+}
+
 }
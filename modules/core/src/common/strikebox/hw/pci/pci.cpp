@@ -28,6 +28,7 @@
 #include "strikebox/hw/pci/pci.h"
 
 #include "strikebox/hw/bus/pcibus.h"
+#include "strikebox/hw/utils.h"
 #include "strikebox/log.h"
 
 #include <cassert>
@@ -216,6 +217,50 @@ bool PCIDevice::GetMMIOBar(uint32_t addr, uint8_t* barIndex, uint32_t *baseAddre
     return false;
 }
 
+uint8_t PCIDevice::GetNumBARs() {
+    switch (m_configSpace[PCI_HEADER_TYPE]) {
+    case PCI_HEADER_TYPE_NORMAL:
+    case PCI_HEADER_TYPE_MULTIFUNCTION:
+        return PCI_NUM_BARS_DEVICE;
+    case PCI_HEADER_TYPE_BRIDGE:
+        return PCI_NUM_BARS_PCI_BRIDGE;
+    default:
+        return 0;
+    }
+}
+
+bool PCIDevice::GetIOBarRange(uint8_t barIndex, uint32_t *baseAddress, uint32_t *size) {
+    if (barIndex >= GetNumBARs() || m_BARSizes[barIndex] == 0) {
+        return false;
+    }
+
+    uint32_t barValue = Read32(m_configSpace, PCI_BASE_ADDRESS_0 + barIndex * sizeof(PCIBarRegister));
+    PCIBarRegister *bar = reinterpret_cast<PCIBarRegister *>(&barValue);
+    if ((bar->Raw.type & PCI_BAR_TYPE_MASK) != PCI_BAR_TYPE_IO) {
+        return false;
+    }
+
+    *baseAddress = bar->IO.address << 2;
+    *size = m_BARSizes[barIndex];
+    return true;
+}
+
+bool PCIDevice::GetMMIOBarRange(uint8_t barIndex, uint32_t *baseAddress, uint32_t *size) {
+    if (barIndex >= GetNumBARs() || m_BARSizes[barIndex] == 0) {
+        return false;
+    }
+
+    uint32_t barValue = Read32(m_configSpace, PCI_BASE_ADDRESS_0 + barIndex * sizeof(PCIBarRegister));
+    PCIBarRegister *bar = reinterpret_cast<PCIBarRegister *>(&barValue);
+    if ((bar->Raw.type & PCI_BAR_TYPE_MASK) != PCI_BAR_TYPE_MEMORY) {
+        return false;
+    }
+
+    *baseAddress = bar->Memory.address << 4;
+    *size = m_BARSizes[barIndex];
+    return true;
+}
+
 bool PCIDevice::RegisterBAR(int index, uint32_t size, uint32_t type) {
     uint8_t headerType = Read8(m_configSpace, PCI_HEADER_TYPE);
     uint8_t numBARs;
@@ -256,6 +301,10 @@ bool PCIDevice::RegisterBAR(int index, uint32_t size, uint32_t type) {
     Write32(m_writeMask, addr, ~(size - 1));
     Write32(m_checkMask, addr, 0xFFFFFFFF);
 
+    if (m_bus != nullptr) {
+        m_bus->UpdateMappings(this);
+    }
+
     return true;
 }
 
@@ -272,7 +321,11 @@ void PCIDevice::WriteConfig(uint32_t reg, uint32_t value, uint8_t size) {
         m_configSpace[reg + i] &= ~(value & w1cmask); // W1C: Write 1 to Clear
     }
 
-    // TODO: handle memory mapping changes
+    // Refresh I/O and MMIO mappings when BARs are relocated
+    if (m_bus != nullptr && RangesOverlap(reg, size, PCI_BASE_ADDRESS_0, GetNumBARs() * sizeof(PCIBarRegister))) {
+        m_bus->UpdateMappings(this);
+    }
+
     // TODO: handle Message Signalled Interrupts
 }
 
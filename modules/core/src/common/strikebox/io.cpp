@@ -1,8 +1,13 @@
 #include "strikebox/io.h"
 #include "strikebox/log.h"
 
+#include <algorithm>
+
 namespace strikebox {
 
+// Keeps guests polling unmapped ports or addresses from flooding the log
+static LogRateLimiter s_unhandledIOLimiter(16, 1000);
+
 // ----- Default I/O device implementation ------------------------------------
 
 bool IODevice::IORead(uint32_t addr, uint32_t *value, uint8_t size) {
@@ -23,14 +28,49 @@ bool IODevice::MMIOWrite(uint32_t addr, uint32_t value, uint8_t size) {
     return false;
 }
 
+// ----- Static device handlers -----------------------------------------------
+
+static bool StaticDeviceIORead(void *context, uint8_t, uint32_t port, uint32_t *value, uint8_t size) {
+    return reinterpret_cast<IODevice *>(context)->IORead(port, value, size);
+}
+
+static bool StaticDeviceIOWrite(void *context, uint8_t, uint32_t port, uint32_t value, uint8_t size) {
+    return reinterpret_cast<IODevice *>(context)->IOWrite(port, value, size);
+}
+
+static bool StaticDeviceMMIORead(void *context, uint8_t, uint32_t addr, uint32_t *value, uint8_t size) {
+    return reinterpret_cast<IODevice *>(context)->MMIORead(addr, value, size);
+}
+
+static bool StaticDeviceMMIOWrite(void *context, uint8_t, uint32_t addr, uint32_t value, uint8_t size) {
+    return reinterpret_cast<IODevice *>(context)->MMIOWrite(addr, value, size);
+}
+
 // ----- I/O mapper -----------------------------------------------------------
 
+IOMapper::IOMapper()
+    : m_ioPortTable(new IOHandler[kIOPortCount]())
+{
+}
+
 bool IOMapper::MapIODevice(uint32_t basePort, uint32_t numPorts, IODevice *device) {
-    return MapDevice(m_mappedIODevices, basePort, numPorts, device);
+    if (!MapDevice(m_mappedIODevices, basePort, numPorts, device)) {
+        return false;
+    }
+
+    UpdateIOPortTable(basePort, basePort + numPorts - 1);
+    IOSTATS_DESCRIBE(m_stats, IOStatsSpace_IO, device, 0, basePort, basePort + numPorts - 1, IOStatsKind_Device);
+    return true;
 }
 
 bool IOMapper::MapMMIODevice(uint32_t baseAddress, uint32_t numAddresses, IODevice *device) {
-    return MapDevice(m_mappedMMIODevices, baseAddress, numAddresses, device);
+    if (!MapDevice(m_mappedMMIODevices, baseAddress, numAddresses, device)) {
+        return false;
+    }
+
+    UpdateMMIOPageTable(baseAddress, baseAddress + numAddresses - 1);
+    IOSTATS_DESCRIBE(m_stats, IOStatsSpace_MMIO, device, 0, baseAddress, baseAddress + numAddresses - 1, IOStatsKind_Device);
+    return true;
 }
 
 bool IOMapper::MapDevice(std::map<uint32_t, MappedDevice>& iomap, uint32_t base, uint32_t size, IODevice *device) {
@@ -67,64 +107,225 @@ bool IOMapper::MapDevice(std::map<uint32_t, MappedDevice>& iomap, uint32_t base,
 }
 
 bool IOMapper::AddDevice(IODevice *device) {
+    IOSTATS_DESCRIBE(m_stats, IOStatsSpace_IO, device, kIOStatsDynamicIndex, 0, kIOPortCount - 1, IOStatsKind_Dynamic);
+    IOSTATS_DESCRIBE(m_stats, IOStatsSpace_MMIO, device, kIOStatsDynamicIndex, 0, 0xFFFFFFFF, IOStatsKind_Dynamic);
     return m_dynamicDevices.emplace(device).second;
 }
 
-bool IOMapper::LookupDevice(std::map<uint32_t, MappedDevice>& iomap, uint32_t addr, IODevice **device) {
-    auto p = iomap.upper_bound(addr);
+void IOMapper::MapIOHandler(uint32_t basePort, uint32_t numPorts, void *owner, const IOHandler& handler) {
+    if (numPorts == 0) {
+        return;
+    }
 
-    // p->first > addr
-    if (p == iomap.begin()) {
-        return false;
+    uint32_t lastPort = basePort + numPorts - 1;
+    m_ioHandlers.push_back(MappedHandler{ basePort, lastPort, owner, handler });
+    UpdateIOPortTable(basePort, lastPort);
+    IOSTATS_DESCRIBE(m_stats, IOStatsSpace_IO, handler.context, handler.index, basePort, lastPort, IOStatsKind_Handler);
+}
+
+// Removes the handlers mapped on behalf of the owner, returning their ranges
+static std::vector<MappedHandler> RemoveHandlers(std::vector<MappedHandler>& handlers, void *owner) {
+    std::vector<MappedHandler> removed;
+    for (auto it = handlers.begin(); it != handlers.end(); ) {
+        if (it->owner == owner) {
+            removed.push_back(*it);
+            it = handlers.erase(it);
+        }
+        else {
+            ++it;
+        }
     }
+    return removed;
+}
 
-    // p->first <= addr
-    --p;
+void IOMapper::UnmapIOHandlers(void *owner) {
+    for (auto& mapping : RemoveHandlers(m_ioHandlers, owner)) {
+        UpdateIOPortTable(mapping.baseAddress, mapping.lastAddress);
+    }
+}
 
-    if (addr >= p->first && addr <= p->second.lastAddress) {
-        *device = p->second.device;
-        return true;
+void IOMapper::MapMMIOHandler(uint32_t baseAddress, uint32_t numAddresses, void *owner, const IOHandler& handler) {
+    if (numAddresses == 0) {
+        return;
     }
 
-    return false;
+    uint32_t lastAddress = baseAddress + numAddresses - 1;
+    m_mmioHandlers.push_back(MappedHandler{ baseAddress, lastAddress, owner, handler });
+    UpdateMMIOPageTable(baseAddress, lastAddress);
+    IOSTATS_DESCRIBE(m_stats, IOStatsSpace_MMIO, handler.context, handler.index, baseAddress, lastAddress, IOStatsKind_Handler);
+}
+
+void IOMapper::UnmapMMIOHandlers(void *owner) {
+    for (auto& mapping : RemoveHandlers(m_mmioHandlers, owner)) {
+        UpdateMMIOPageTable(mapping.baseAddress, mapping.lastAddress);
+    }
+}
+
+void IOMapper::UpdateIOPortTable(uint32_t basePort, uint32_t lastPort) {
+    if (basePort >= kIOPortCount) {
+        return;
+    }
+    lastPort = std::min(lastPort, kIOPortCount - 1);
+
+    IOHandler *table = m_ioPortTable.get();
+    std::fill(&table[basePort], &table[lastPort + 1], IOHandler{});
+
+    // Handlers mapped earlier take precedence over those mapped later
+    for (auto& mapping : m_ioHandlers) {
+        uint32_t first = std::max(basePort, mapping.baseAddress);
+        uint32_t last = std::min(lastPort, mapping.lastAddress);
+        for (uint32_t port = first; port <= last; port++) {
+            if (table[port].read == nullptr) {
+                table[port] = mapping.handler;
+            }
+        }
+    }
+
+    // Statically mapped devices override everything else
+    for (auto& entry : m_mappedIODevices) {
+        auto& mapped = entry.second;
+        uint32_t first = std::max(basePort, mapped.baseAddress);
+        uint32_t last = std::min(lastPort, mapped.lastAddress);
+        for (uint32_t port = first; port <= last; port++) {
+            table[port] = IOHandler{ mapped.device, StaticDeviceIORead, StaticDeviceIOWrite, 0, 0 };
+        }
+    }
+}
+
+void IOMapper::UpdateMMIOPageTable(uint32_t baseAddress, uint32_t lastAddress) {
+    uint32_t firstPage = baseAddress >> kMMIOPageShift;
+    uint32_t lastPage = lastAddress >> kMMIOPageShift;
+
+    for (uint32_t page = firstPage; page <= lastPage; page++) {
+        uint32_t pageBase = page << kMMIOPageShift;
+        uint32_t pageLast = pageBase + (kMMIOPageSize - 1);
+
+        // Collect the mappings that overlap the page in order of precedence:
+        // statically mapped devices override everything else, and handlers
+        // mapped earlier take precedence over those mapped later
+        std::vector<MappedHandler> overlapping;
+        for (auto& entry : m_mappedMMIODevices) {
+            auto& mapped = entry.second;
+            if (mapped.baseAddress <= pageLast && mapped.lastAddress >= pageBase) {
+                IOHandler handler{ mapped.device, StaticDeviceMMIORead, StaticDeviceMMIOWrite, 0, 0 };
+                overlapping.push_back(MappedHandler{ mapped.baseAddress, mapped.lastAddress, mapped.device, handler });
+            }
+        }
+        for (auto& mapping : m_mmioHandlers) {
+            if (mapping.baseAddress <= pageLast && mapping.lastAddress >= pageBase) {
+                overlapping.push_back(mapping);
+            }
+        }
+
+        auto& table = m_mmioPageDirectory[page / kMMIOPagesPerTable];
+        if (table == nullptr) {
+            if (overlapping.empty()) {
+                continue;
+            }
+            table.reset(new MMIOPage[kMMIOPagesPerTable]());
+        }
+
+        MMIOPage& entry = table[page % kMMIOPagesPerTable];
+        entry.mapping = MappedHandler{};
+        entry.subPage.reset();
+        if (overlapping.empty()) {
+            continue;
+        }
+
+        // The mapping with the highest precedence wins the whole page if it
+        // covers it; otherwise resolve the page byte by byte
+        auto& top = overlapping.front();
+        if (top.baseAddress <= pageBase && top.lastAddress >= pageLast) {
+            entry.mapping = top;
+            continue;
+        }
+
+        if (overlapping.size() > 0xFF) {
+            log_warning("IOMapper::UpdateMMIOPageTable: Too many handlers mapped to page 0x%x; ignoring %u of them\n",
+                pageBase, static_cast<uint32_t>(overlapping.size() - 0xFF));
+            overlapping.resize(0xFF);
+        }
+
+        auto subPage = std::make_unique<MMIOSubPage>();
+        std::fill(std::begin(subPage->index), std::end(subPage->index), 0);
+        for (size_t i = 0; i < overlapping.size(); i++) {
+            auto& mapping = overlapping[i];
+            uint32_t first = std::max(pageBase, mapping.baseAddress) - pageBase;
+            uint32_t last = std::min(pageLast, mapping.lastAddress) - pageBase;
+            for (uint32_t offset = first; offset <= last; offset++) {
+                if (subPage->index[offset] == 0) {
+                    subPage->index[offset] = static_cast<uint8_t>(i + 1);
+                }
+            }
+        }
+        subPage->handlers = std::move(overlapping);
+        entry.subPage = std::move(subPage);
+    }
+}
+
+const MappedHandler *IOMapper::LookupMMIOHandler(uint32_t addr) {
+    auto& table = m_mmioPageDirectory[addr >> kMMIODirectoryShift];
+    if (table == nullptr) {
+        return nullptr;
+    }
+
+    const MMIOPage& entry = table[(addr >> kMMIOPageShift) % kMMIOPagesPerTable];
+    if (entry.subPage == nullptr) {
+        return (entry.mapping.handler.read != nullptr) ? &entry.mapping : nullptr;
+    }
+
+    uint8_t index = entry.subPage->index[addr & (kMMIOPageSize - 1)];
+    return (index != 0) ? &entry.subPage->handlers[index - 1] : nullptr;
 }
 
 bool IOMapper::IORead(uint32_t addr, uint32_t *value, uint8_t size) {
-    // Try looking up a device mapped to the specified port first
-    IODevice *dev;
-    if (LookupDevice(m_mappedIODevices, addr, &dev)) {
-        return dev->IORead(addr, value, size);
+    IOSTATS_SCOPE(m_stats, IOStatsSpace_IO, false, size);
+
+    // Try the port dispatch table first
+    if (addr < kIOPortCount) {
+        const IOHandler& handler = m_ioPortTable[addr];
+        if (handler.read != nullptr) {
+            IOSTATS_REGION(handler.context, handler.index);
+            return handler.read(handler.context, handler.index, addr - handler.baseAddress, value, size);
+        }
     }
 
     // Otherwise search for one of the dynamically mapped devices
     for (auto it = m_dynamicDevices.begin(); it != m_dynamicDevices.end(); it++) {
         auto dev = *it;
         if (dev->IORead(addr, value, size)) {
+            IOSTATS_REGION(dev, kIOStatsDynamicIndex);
             return true;
         }
     }
 
-    log_warning("IOMapper::IORead:   Unhandled I/O!  address = 0x%x,  size = %u,  read\n", addr, size);
+    log_ratelimited(s_unhandledIOLimiter, LOG_LEVEL_WARNING, "IOMapper::IORead:   Unhandled I/O!  address = 0x%x,  size = %u,  read\n", addr, size);
     *value = 0;
     return false;
 }
 
 bool IOMapper::IOWrite(uint32_t addr, uint32_t value, uint8_t size) {
-    // Try looking up a device mapped to the specified port first
-    IODevice *dev;
-    if (LookupDevice(m_mappedIODevices, addr, &dev)) {
-        return dev->IOWrite(addr, value, size);
+    IOSTATS_SCOPE(m_stats, IOStatsSpace_IO, true, size);
+
+    // Try the port dispatch table first
+    if (addr < kIOPortCount) {
+        const IOHandler& handler = m_ioPortTable[addr];
+        if (handler.write != nullptr) {
+            IOSTATS_REGION(handler.context, handler.index);
+            return handler.write(handler.context, handler.index, addr - handler.baseAddress, value, size);
+        }
     }
 
     // Otherwise search for one of the dynamically mapped devices
     for (auto it = m_dynamicDevices.begin(); it != m_dynamicDevices.end(); it++) {
         auto dev = *it;
         if (dev->IOWrite(addr, value, size)) {
+            IOSTATS_REGION(dev, kIOStatsDynamicIndex);
             return true;
         }
     }
 
-    log_warning("IOMapper::IOWrite:  Unhandled I/O!  address = 0x%x,  size = %u,  write 0x%x\n", addr, size, value);
+    log_ratelimited(s_unhandledIOLimiter, LOG_LEVEL_WARNING, "IOMapper::IOWrite:  Unhandled I/O!  address = 0x%x,  size = %u,  write 0x%x\n", addr, size, value);
     return false;
 }
 
@@ -134,21 +335,26 @@ bool IOMapper::MMIORead(uint32_t addr, uint32_t *value, uint8_t size) {
         return false;
     }
 
-    // Try looking up a device mapped to the specified port first
-    IODevice *dev;
-    if (LookupDevice(m_mappedMMIODevices, addr, &dev)) {
-        return dev->MMIORead(addr, value, size);
+    IOSTATS_SCOPE(m_stats, IOStatsSpace_MMIO, false, size);
+
+    // Look up the device or handler mapped to the address
+    const MappedHandler *mapping = LookupMMIOHandler(addr);
+    if (mapping != nullptr) {
+        const IOHandler& handler = mapping->handler;
+        IOSTATS_REGION(handler.context, handler.index);
+        return handler.read(handler.context, handler.index, addr - handler.baseAddress, value, size);
     }
 
     // Otherwise search for one of the dynamically mapped devices
     for (auto it = m_dynamicDevices.begin(); it != m_dynamicDevices.end(); it++) {
         auto dev = *it;
         if (dev->MMIORead(addr, value, size)) {
+            IOSTATS_REGION(dev, kIOStatsDynamicIndex);
             return true;
         }
     }
 
-    log_warning("IOMapper::MMIORead:   Unhandled MMIO!  address = 0x%x,  size = %u,  read\n", addr, size);
+    log_ratelimited(s_unhandledIOLimiter, LOG_LEVEL_WARNING, "IOMapper::MMIORead:   Unhandled MMIO!  address = 0x%x,  size = %u,  read\n", addr, size);
     *value = 0;
     return false;
 }
@@ -159,21 +365,26 @@ bool IOMapper::MMIOWrite(uint32_t addr, uint32_t value, uint8_t size) {
         return false;
     }
 
-    // Try looking up a device mapped to the specified port first
-    IODevice *dev;
-    if (LookupDevice(m_mappedMMIODevices, addr, &dev)) {
-        return dev->MMIOWrite(addr, value, size);
+    IOSTATS_SCOPE(m_stats, IOStatsSpace_MMIO, true, size);
+
+    // Look up the device or handler mapped to the address
+    const MappedHandler *mapping = LookupMMIOHandler(addr);
+    if (mapping != nullptr) {
+        const IOHandler& handler = mapping->handler;
+        IOSTATS_REGION(handler.context, handler.index);
+        return handler.write(handler.context, handler.index, addr - handler.baseAddress, value, size);
     }
 
     // Otherwise search for one of the dynamically mapped devices
     for (auto it = m_dynamicDevices.begin(); it != m_dynamicDevices.end(); it++) {
         auto dev = *it;
         if (dev->MMIOWrite(addr, value, size)) {
+            IOSTATS_REGION(dev, kIOStatsDynamicIndex);
             return true;
         }
     }
 
-    log_warning("IOMapper::MMIOWrite:  Unhandled MMIO!  address = 0x%x,  size = %u,  write 0x%x\n", addr, size, value);
+    log_ratelimited(s_unhandledIOLimiter, LOG_LEVEL_WARNING, "IOMapper::MMIOWrite:  Unhandled MMIO!  address = 0x%x,  size = %u,  write 0x%x\n", addr, size, value);
     return false;
 }
 
@@ -0,0 +1,117 @@
+#include "strikebox/io_stats.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace strikebox {
+
+static const char *kIOStatsKindNames[] = { "unhandled", "device", "handler", "dynamic" };
+
+void IOStats::DescribeRegion(IOStatsSpace space, const void *context, uint8_t index, uint32_t baseAddress, uint32_t lastAddress, IOStatsKind kind) {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    IOStatsRegion& region = GetRegion(space, context, index);
+    if (kind == IOStatsKind_Device && region.kind == IOStatsKind_Device) {
+        region.baseAddress = std::min(region.baseAddress, baseAddress);
+        region.lastAddress = std::max(region.lastAddress, lastAddress);
+    }
+    else {
+        region.baseAddress = baseAddress;
+        region.lastAddress = lastAddress;
+        region.kind = kind;
+    }
+}
+
+void IOStats::Record(IOStatsSpace space, const void *context, uint8_t index, bool write, uint8_t size, uint64_t nanos) {
+    // Find the log2 bucket for the latency
+    uint32_t bucket = 0;
+    for (uint64_t n = nanos >> 1; n != 0 && bucket < kIOStatsLatencyBuckets - 1; n >>= 1) {
+        bucket++;
+    }
+
+    std::lock_guard<std::mutex> lk(m_mutex);
+    IOStatsRegion& region = GetRegion(space, context, index);
+    if (write) {
+        region.writes++;
+    }
+    else {
+        region.reads++;
+    }
+    switch (size) {
+    case 1: region.sizes[0]++; break;
+    case 2: region.sizes[1]++; break;
+    case 4: region.sizes[2]++; break;
+    default: region.sizes[3]++; break;
+    }
+    region.totalNanos += nanos;
+    region.maxNanos = std::max(region.maxNanos, nanos);
+    region.latencyHistogram[bucket]++;
+}
+
+void IOStats::Reset() {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    for (auto& entry : m_regions) {
+        IOStatsRegion& region = entry.second;
+        IOStatsRegion cleared;
+        cleared.space = region.space;
+        cleared.baseAddress = region.baseAddress;
+        cleared.lastAddress = region.lastAddress;
+        cleared.index = region.index;
+        cleared.kind = region.kind;
+        region = cleared;
+    }
+}
+
+void IOStats::DumpJSON(FILE *fp) {
+    std::lock_guard<std::mutex> lk(m_mutex);
+
+    std::vector<const IOStatsRegion *> regions;
+    for (auto& entry : m_regions) {
+        if (entry.second.reads + entry.second.writes > 0) {
+            regions.push_back(&entry.second);
+        }
+    }
+    std::sort(regions.begin(), regions.end(), [](const IOStatsRegion *lhs, const IOStatsRegion *rhs) {
+        return lhs->totalNanos > rhs->totalNanos;
+    });
+
+    fprintf(fp, "{\n  \"latency_buckets\": \"log2_ns\",\n  \"regions\": [");
+    for (size_t i = 0; i < regions.size(); i++) {
+        const IOStatsRegion& region = *regions[i];
+        fprintf(fp, "%s\n    {\n", (i > 0) ? "," : "");
+        fprintf(fp, "      \"space\": \"%s\",\n", (region.space == IOStatsSpace_IO) ? "io" : "mmio");
+        fprintf(fp, "      \"kind\": \"%s\",\n", kIOStatsKindNames[region.kind]);
+        fprintf(fp, "      \"base\": \"0x%x\",\n", region.baseAddress);
+        fprintf(fp, "      \"last\": \"0x%x\",\n", region.lastAddress);
+        fprintf(fp, "      \"index\": %u,\n", region.index);
+        fprintf(fp, "      \"reads\": %llu,\n", (unsigned long long)region.reads);
+        fprintf(fp, "      \"writes\": %llu,\n", (unsigned long long)region.writes);
+        fprintf(fp, "      \"sizes\": { \"1\": %llu, \"2\": %llu, \"4\": %llu, \"other\": %llu },\n",
+            (unsigned long long)region.sizes[0], (unsigned long long)region.sizes[1],
+            (unsigned long long)region.sizes[2], (unsigned long long)region.sizes[3]);
+        fprintf(fp, "      \"total_ns\": %llu,\n", (unsigned long long)region.totalNanos);
+        fprintf(fp, "      \"max_ns\": %llu,\n", (unsigned long long)region.maxNanos);
+        fprintf(fp, "      \"latency\": [");
+        for (uint32_t bucket = 0; bucket < kIOStatsLatencyBuckets; bucket++) {
+            fprintf(fp, "%s%llu", (bucket > 0) ? ", " : "", (unsigned long long)region.latencyHistogram[bucket]);
+        }
+        fprintf(fp, "]\n    }");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+IOStatsRegion& IOStats::GetRegion(IOStatsSpace space, const void *context, uint8_t index) {
+    auto it = m_regions.find(Key(space, context, index));
+    if (it != m_regions.end()) {
+        return it->second;
+    }
+
+    IOStatsRegion& region = m_regions[Key(space, context, index)];
+    region.space = space;
+    region.baseAddress = 0;
+    region.lastAddress = 0;
+    region.index = index;
+    region.kind = (context == nullptr) ? IOStatsKind_Unhandled : IOStatsKind_Dynamic;
+    return region;
+}
+
+}
@@ -1,28 +1,414 @@
 #include "strikebox/log.h"
 
-#include <stdarg.h>
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace strikebox {
 
+namespace detail {
+
+std::atomic<int> g_logLevels[LogCategory_Count] = {
+    { LOG_LEVEL }, { LOG_LEVEL }, { LOG_LEVEL }, { LOG_LEVEL }, { LOG_LEVEL },
+    { LOG_LEVEL }, { LOG_LEVEL }, { LOG_LEVEL }, { LOG_LEVEL }, { LOG_LEVEL },
+};
+static_assert(LogCategory_Count == 10, "g_logLevels initializer must cover all categories");
+
+// Orders records across the threads' ring buffers
+static std::atomic<uint64_t> s_logSequence{ 0 };
+
+// Size of each thread's ring buffer
+static const size_t kLogRingSize = 256 * 1024;
+
+static inline size_t AlignRecordSize(size_t size) {
+    return (size + alignof(LogRecordHeader) - 1) & ~(alignof(LogRecordHeader) - 1);
+}
+
 /*!
- * Print a message to the log
+ * Single-producer, single-consumer ring buffer of variable-sized log records.
+ *
+ * Records never wrap around the end of the buffer. If a record does not fit
+ * in the remaining space, the producer skips to the start of the buffer,
+ * leaving a padding record behind if there is room for a header.
  */
-int log_print(int level, char const *fmt, ...)
-{
-	if (level > LOG_LEVEL) {
-		return 0;
-	}
+class LogRing {
+public:
+    LogRing() : m_dropped(0), m_abandoned(false), m_head(0), m_tail(0), m_pendingSize(0) {}
+
+    // ----- Producer ---------------------------------------------------------
+
+    uint8_t *Reserve(size_t size, bool wait, uint64_t *sequence) {
+        size = AlignRecordSize(size);
+        if (size > kLogRingSize / 2) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t pos = head % kLogRingSize;
+        size_t skip = (kLogRingSize - pos < size) ? kLogRingSize - pos : 0;
+
+        while (kLogRingSize - (head - m_tail.load(std::memory_order_acquire)) < skip + size) {
+            if (!wait) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            std::this_thread::yield();
+        }
+
+        if (skip >= sizeof(LogRecordHeader)) {
+            new (&m_buffer[pos]) LogRecordHeader{ 0, nullptr, nullptr, (uint32_t)skip };
+        }
+
+        m_pendingSize = skip + size;
+        *sequence = s_logSequence.fetch_add(1, std::memory_order_relaxed);
+        return &m_buffer[(head + skip) % kLogRingSize];
+    }
+
+    void Commit() {
+        m_head.store(m_head.load(std::memory_order_relaxed) + m_pendingSize, std::memory_order_release);
+    }
+
+    // ----- Consumer ---------------------------------------------------------
+
+    // Returns the next record or nullptr if the ring is empty
+    const LogRecordHeader *Peek() {
+        size_t head = m_head.load(std::memory_order_acquire);
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        while (tail != head) {
+            size_t pos = tail % kLogRingSize;
+            size_t remaining = kLogRingSize - pos;
+            if (remaining < sizeof(LogRecordHeader)) {
+                // Not enough room for a header; the producer skipped ahead
+                tail += remaining;
+                continue;
+            }
+
+            auto header = reinterpret_cast<const LogRecordHeader *>(&m_buffer[pos]);
+            if (header->format == nullptr) {
+                tail += header->size;
+                continue;
+            }
+
+            m_tail.store(tail, std::memory_order_release);
+            return header;
+        }
+        m_tail.store(tail, std::memory_order_release);
+        return nullptr;
+    }
+
+    // Releases the record returned by Peek
+    void Pop(const LogRecordHeader *header) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        m_tail.store(tail + AlignRecordSize(header->size), std::memory_order_release);
+    }
+
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<bool> m_abandoned;
+
+private:
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+
+    // Producer-only state
+    size_t m_pendingSize;
+
+    alignas(LogRecordHeader) uint8_t m_buffer[kLogRingSize];
+};
+
+/*!
+ * Owns the ring buffers of all threads and the thread that writes them out.
+ */
+class LogBackend {
+public:
+    static LogBackend& Instance() {
+        // Intentionally leaked so that messages logged during static
+        // destruction are still accepted; pending messages are written out
+        // by the exit handler
+        static LogBackend *instance = new LogBackend();
+        return *instance;
+    }
+
+    void Register(const std::shared_ptr<LogRing>& ring) {
+        std::lock_guard<std::mutex> lk(m_ringsMutex);
+        m_rings.push_back(ring);
+    }
+
+    void Flush() {
+        Drain();
+    }
+
+private:
+    LogBackend() {
+        std::thread([this]() { ThreadFunc(); }).detach();
+        std::atexit([]() { LogBackend::Instance().Flush(); });
+    }
+
+    void ThreadFunc() {
+        for (;;) {
+            if (!Drain()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    // Writes out all pending messages in order. Returns true if any message
+    // was written.
+    bool Drain() {
+        std::lock_guard<std::mutex> drainLock(m_drainMutex);
+
+        std::vector<std::shared_ptr<LogRing>> rings;
+        {
+            std::lock_guard<std::mutex> lk(m_ringsMutex);
+            rings = m_rings;
+        }
+
+        bool wrote = false;
+        for (;;) {
+            // Pick the oldest message across all threads
+            LogRing *oldestRing = nullptr;
+            const LogRecordHeader *oldest = nullptr;
+            for (auto& ring : rings) {
+                const LogRecordHeader *header = ring->Peek();
+                if (header != nullptr && (oldest == nullptr || header->sequence < oldest->sequence)) {
+                    oldest = header;
+                    oldestRing = ring.get();
+                }
+            }
+            if (oldest == nullptr) {
+                break;
+            }
+
+            oldest->format(stdout, oldest->fmt, reinterpret_cast<const uint8_t *>(oldest) + sizeof(LogRecordHeader));
+            oldestRing->Pop(oldest);
+            wrote = true;
+        }
+
+        for (auto& ring : rings) {
+            uint64_t dropped = ring->m_dropped.exchange(0, std::memory_order_relaxed);
+            if (dropped > 0) {
+                fprintf(stdout, "(%llu log messages dropped)\n", (unsigned long long)dropped);
+                wrote = true;
+            }
+        }
+
+        if (wrote) {
+            fflush(stdout);
+        }
+
+        // Forget rings of threads that have exited once they are drained
+        {
+            std::lock_guard<std::mutex> lk(m_ringsMutex);
+            for (auto it = m_rings.begin(); it != m_rings.end(); ) {
+                if ((*it)->m_abandoned.load(std::memory_order_acquire) && (*it)->Peek() == nullptr) {
+                    it = m_rings.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+
+        return wrote;
+    }
+
+    std::mutex m_ringsMutex;
+    std::vector<std::shared_ptr<LogRing>> m_rings;
+
+    // Serializes consumers (the backend thread and log_flush callers)
+    std::mutex m_drainMutex;
+};
 
-	int status;
-	va_list args;
+/*!
+ * Holds the calling thread's ring buffer.
+ */
+struct ThreadLogRing {
+    ThreadLogRing()
+        : ring(std::make_shared<LogRing>())
+    {
+        LogBackend::Instance().Register(ring);
+    }
+
+    ~ThreadLogRing() {
+        ring->m_abandoned.store(true, std::memory_order_release);
+    }
+
+    std::shared_ptr<LogRing> ring;
+};
+
+static LogRing& GetThreadRing() {
+    thread_local ThreadLogRing threadRing;
+    return *threadRing.ring;
+}
+
+uint8_t *LogReserve(size_t size, bool wait, uint64_t *sequence) {
+    return GetThreadRing().Reserve(size, wait, sequence);
+}
+
+uint64_t LogStringArgs(const char *fmt) {
+    uint64_t mask = 0;
+    uint32_t arg = 0;
+    for (const char *p = fmt; *p != '\0'; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        p++;
+        if (*p == '\0') {
+            break;
+        }
+        if (*p == '%') {
+            continue;
+        }
+
+        // Flags, width and precision; '*' consumes an argument
+        while (*p != '\0' && strchr("-+ #0123456789.*", *p) != nullptr) {
+            if (*p == '*') {
+                arg++;
+            }
+            p++;
+        }
+        // Length modifiers
+        while (*p != '\0' && strchr("hlLqjzt", *p) != nullptr) {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        if (*p == 's' && arg < 64) {
+            mask |= 1ull << arg;
+        }
+        arg++;
+    }
+    return mask;
+}
+
+void LogCommit() {
+    GetThreadRing().Commit();
+}
+
+}
+
+// ----- Log levels -----------------------------------------------------------
+
+static const char *kLogCategoryNames[LogCategory_Count] = {
+    "general", "io", "pci", "basic", "smbus", "ata", "usb", "audio", "net", "nv2a",
+};
+
+static const char *kLogLevelNames[] = {
+    nullptr, "fatal", "error", "warning", "info", "debug", "spew",
+};
+
+const char *log_category_name(LogCategory category) {
+    return kLogCategoryNames[category];
+}
+
+void log_set_level(LogCategory category, int level) {
+    detail::g_logLevels[category].store(level, std::memory_order_relaxed);
+}
+
+void log_set_level(int level) {
+    for (int i = 0; i < LogCategory_Count; i++) {
+        log_set_level((LogCategory)i, level);
+    }
+}
+
+int log_get_level(LogCategory category) {
+    return detail::g_logLevels[category].load(std::memory_order_relaxed);
+}
+
+static bool ParseLogLevel(const std::string& name, int *level) {
+    for (int i = LOG_LEVEL_FATAL; i <= LOG_LEVEL_SPEW; i++) {
+        if (name == kLogLevelNames[i]) {
+            *level = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool log_configure(const char *spec) {
+    std::string str(spec);
+    size_t start = 0;
+    while (start <= str.size()) {
+        size_t end = str.find(',', start);
+        if (end == std::string::npos) {
+            end = str.size();
+        }
+        std::string item = str.substr(start, end - start);
+        start = end + 1;
+        if (item.empty()) {
+            continue;
+        }
+
+        int level;
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            if (!ParseLogLevel(item, &level)) {
+                return false;
+            }
+            log_set_level(level);
+            continue;
+        }
+
+        std::string categoryName = item.substr(0, eq);
+        if (!ParseLogLevel(item.substr(eq + 1), &level)) {
+            return false;
+        }
+
+        bool found = false;
+        for (int i = 0; i < LogCategory_Count; i++) {
+            if (categoryName == kLogCategoryNames[i]) {
+                log_set_level((LogCategory)i, level);
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void log_flush() {
+    detail::LogBackend::Instance().Flush();
+}
+
+// ----- Rate limiter ---------------------------------------------------------
+
+LogRateLimiter::LogRateLimiter(uint32_t burst, uint32_t intervalMillis)
+    : m_burst(burst)
+    , m_interval(std::chrono::milliseconds(intervalMillis))
+    , m_tokens(burst)
+    , m_suppressed(0)
+    , m_lastRefill(std::chrono::steady_clock::now())
+{
+}
 
-	va_start(args, fmt);
+bool LogRateLimiter::Allow(uint64_t *suppressed) {
+    std::lock_guard<std::mutex> lk(m_mutex);
 
-	status = vfprintf(stdout, fmt, args);
+    // Refill one token per elapsed interval, up to the burst size
+    auto now = std::chrono::steady_clock::now();
+    auto refills = (now - m_lastRefill) / m_interval;
+    if (refills > 0) {
+        m_tokens = (uint32_t)std::min<decltype(refills)>(m_burst, m_tokens + refills);
+        m_lastRefill += refills * m_interval;
+    }
 
-	va_end(args);
+    if (m_tokens == 0) {
+        m_suppressed++;
+        return false;
+    }
 
-	return status;
+    m_tokens--;
+    *suppressed = m_suppressed;
+    m_suppressed = 0;
+    return true;
 }
 
 }
@@ -0,0 +1,110 @@
+#include "strikebox/scheduler.h"
+
+#include "strikebox/thread.h"
+
+#include <algorithm>
+
+namespace strikebox {
+
+// Longest time to sleep between checks of the clock, which may be paused,
+// resumed, scaled or stepped while the scheduler waits
+static const auto kMaxWait = std::chrono::milliseconds(10);
+
+Scheduler::Scheduler(VirtualClock& clock, SchedulerMode mode)
+    : m_clock(clock)
+    , m_mode(mode)
+{
+}
+
+Scheduler::~Scheduler() {
+    Stop();
+}
+
+void Scheduler::Start() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_running) {
+        m_running = true;
+        m_thread = std::thread([this]() { Run(); });
+    }
+}
+
+void Scheduler::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_cond.notify_one();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+Scheduler::EventID Scheduler::RegisterEvent(Callback callback) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.push_back(std::make_unique<Event>(Event{ std::move(callback), 0, false }));
+    return static_cast<EventID>(m_events.size() - 1);
+}
+
+void Scheduler::Schedule(EventID event, uint64_t time) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_events[event]->time = time;
+        m_events[event]->pending = true;
+    }
+    m_cond.notify_one();
+}
+
+void Scheduler::Cancel(EventID event) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events[event]->pending = false;
+}
+
+void Scheduler::NotifyGuestWaiting() {
+    if (m_mode != SchedulerMode::Unthrottled) {
+        return;
+    }
+    // Only wake up the thread on the first report; polling loops call this
+    // repeatedly
+    if (!m_guestWaiting.exchange(true)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cond.notify_one();
+    }
+}
+
+void Scheduler::Run() {
+    Thread_SetName("[HW] Scheduler");
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running) {
+        Event* next = nullptr;
+        for (auto& event : m_events) {
+            if (event->pending && (next == nullptr || event->time < next->time)) {
+                next = event.get();
+            }
+        }
+        if (next == nullptr) {
+            m_cond.wait(lock);
+            continue;
+        }
+
+        uint64_t now = Now();
+        if (next->time <= now) {
+            next->pending = false;
+            m_guestWaiting = false;
+            lock.unlock();
+            next->callback();
+            lock.lock();
+            continue;
+        }
+
+        if (m_guestWaiting) {
+            m_clock.Advance(next->time - now);
+            continue;
+        }
+
+        // Sleep until the event is due
+        m_cond.wait_for(lock, std::min<std::chrono::nanoseconds>(m_clock.ToHostDuration(next->time - now), kMaxWait));
+    }
+}
+
+}
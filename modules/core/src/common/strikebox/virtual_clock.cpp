@@ -0,0 +1,195 @@
+#include "strikebox/virtual_clock.h"
+
+#include "strikebox/log.h"
+
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define STRIKEBOX_HAS_TSC 1
+#include <cpuid.h>
+#include <x86intrin.h>
+#elif defined(_M_X64) || defined(_M_IX86)
+#define STRIKEBOX_HAS_TSC 1
+#include <intrin.h>
+#endif
+
+namespace strikebox {
+
+// How long to measure the timestamp counter against the steady clock
+static const auto kCalibrationTime = std::chrono::milliseconds(20);
+
+static bool HasInvariantTSC() {
+#if defined(__x86_64__) || defined(__i386__)
+    // CPUID.80000007h:EDX[8]: the TSC runs at a constant rate in all power states
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (edx >> 8) & 1;
+#elif defined(_M_X64) || defined(_M_IX86)
+    int regs[4];
+    __cpuid(regs, 0x80000000);
+    if (static_cast<unsigned int>(regs[0]) < 0x80000007) {
+        return false;
+    }
+    __cpuid(regs, 0x80000007);
+    return (regs[3] >> 8) & 1;
+#else
+    return false;
+#endif
+}
+
+static inline uint64_t SteadyNanos() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+#ifdef STRIKEBOX_HAS_TSC
+// Samples the steady clock and the timestamp counter at the same instant.
+// The steady clock read is bracketed by two counter reads; the tightest of a
+// few attempts is kept so that preemption does not skew the calibration.
+static void SampleTSC(uint64_t& nanos, uint64_t& ticks) {
+    uint64_t bestGap = ~0ull;
+    nanos = SteadyNanos();
+    ticks = __rdtsc();
+    for (int i = 0; i < 8; i++) {
+        uint64_t before = __rdtsc();
+        uint64_t now = SteadyNanos();
+        uint64_t after = __rdtsc();
+        if (after - before < bestGap) {
+            bestGap = after - before;
+            nanos = now;
+            ticks = before + (after - before) / 2;
+        }
+    }
+}
+#endif
+
+VirtualClock::VirtualClock() {
+    m_useTSC = HasInvariantTSC();
+    if (m_useTSC) {
+        Calibrate();
+    }
+    else {
+        // Host ticks are steady clock nanoseconds
+        m_hostFactor = 1ull << 32;
+        log_info("Virtual clock: No invariant TSC; using the host steady clock\n");
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_baseTicks.store(ReadHostTicks(), std::memory_order_relaxed);
+    m_factor.store(m_hostFactor, std::memory_order_relaxed);
+}
+
+void VirtualClock::Calibrate() {
+#ifdef STRIKEBOX_HAS_TSC
+    uint64_t startNanos, startTicks, endNanos, endTicks;
+    SampleTSC(startNanos, startTicks);
+    std::this_thread::sleep_for(kCalibrationTime);
+    SampleTSC(endNanos, endTicks);
+
+    uint64_t elapsedNanos = endNanos - startNanos;
+    uint64_t elapsedTicks = endTicks - startTicks;
+    if (elapsedNanos == 0 || elapsedTicks < elapsedNanos / 1000) {
+        log_warning("Virtual clock: TSC calibration failed; using the host steady clock\n");
+        m_useTSC = false;
+        m_hostFactor = 1ull << 32;
+        return;
+    }
+
+    m_tscFrequency = static_cast<uint64_t>(static_cast<double>(elapsedTicks) * 1e9 / elapsedNanos);
+    m_hostFactor = (1000000000ull << 32) / m_tscFrequency;
+    log_info("Virtual clock: Using invariant TSC at %.3f MHz\n", m_tscFrequency / 1e6);
+#endif
+}
+
+uint64_t VirtualClock::ReadHostTicks() const {
+#ifdef STRIKEBOX_HAS_TSC
+    if (m_useTSC) {
+        return __rdtsc();
+    }
+#endif
+    return SteadyNanos();
+}
+
+uint64_t VirtualClock::Now() const {
+    uint32_t sequence;
+    uint64_t ticks, baseTicks, baseTime, factor;
+    do {
+        sequence = m_sequence.load(std::memory_order_acquire);
+        baseTicks = m_baseTicks.load(std::memory_order_relaxed);
+        baseTime = m_baseTime.load(std::memory_order_relaxed);
+        factor = m_factor.load(std::memory_order_relaxed);
+        ticks = ReadHostTicks();
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((sequence & 1) || sequence != m_sequence.load(std::memory_order_relaxed));
+
+    // Counters on different cores may be slightly out of sync
+    if (ticks <= baseTicks) {
+        return baseTime;
+    }
+    return baseTime + MulShift32(ticks - baseTicks, factor);
+}
+
+void VirtualClock::Pause() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_paused) {
+        m_paused = true;
+        Rebase();
+    }
+}
+
+void VirtualClock::Resume() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_paused) {
+        m_paused = false;
+        Rebase();
+    }
+}
+
+void VirtualClock::SetScale(double scale) {
+    if (!(scale > 0.0)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_scale = scale;
+    Rebase();
+}
+
+void VirtualClock::Advance(uint64_t nanos) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Rebase(nanos);
+}
+
+std::chrono::nanoseconds VirtualClock::ToHostDuration(uint64_t nanos) const {
+    if (m_paused) {
+        return std::chrono::nanoseconds::max();
+    }
+    double hostNanos = static_cast<double>(nanos) / m_scale;
+    if (hostNanos >= static_cast<double>(std::chrono::nanoseconds::max().count())) {
+        return std::chrono::nanoseconds::max();
+    }
+    return std::chrono::nanoseconds(static_cast<int64_t>(hostNanos));
+}
+
+void VirtualClock::Rebase(uint64_t advance) {
+    // Mark the timeline as being updated before sampling the host ticks, so
+    // that no reader computes a time past the new base with the old factor
+    uint32_t sequence = m_sequence.load(std::memory_order_relaxed);
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint64_t ticks = ReadHostTicks();
+    uint64_t baseTicks = m_baseTicks.load(std::memory_order_relaxed);
+    uint64_t time = m_baseTime.load(std::memory_order_relaxed);
+    if (ticks > baseTicks) {
+        time += MulShift32(ticks - baseTicks, m_factor.load(std::memory_order_relaxed));
+    }
+
+    m_baseTicks.store(ticks, std::memory_order_relaxed);
+    m_baseTime.store(time + advance, std::memory_order_relaxed);
+    m_factor.store(m_paused ? 0 : static_cast<uint64_t>(m_hostFactor * m_scale), std::memory_order_relaxed);
+    m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+}
@@ -116,15 +116,10 @@ Xbox::Xbox(Platform& platform)
  * Destructor
  */
 Xbox::~Xbox() {
+    // Stop timed events before the devices they drive go away
+    if (m_scheduler != nullptr) delete m_scheduler;
+
     if (m_vm) m_virt86Platform.FreeVM(m_vm->get());
-    if (m_ram) {
-#ifdef _WIN32
-        vfree(m_ram);
-#endif
-#ifdef __linux__
-        munmap(m_ram, m_ramSize);
-#endif
-    }
     if (m_rom) {
 #ifdef _WIN32
         vfree(m_rom);
@@ -152,6 +147,7 @@ Xbox::~Xbox() {
     if (m_AC97 != nullptr) delete m_AC97;
     if (m_BMIDE != nullptr) delete m_BMIDE;
     if (m_NV2A != nullptr) delete m_NV2A;
+    if (m_frameSink != nullptr) delete m_frameSink;
     
     if (m_PCIBus != nullptr) delete m_PCIBus;
     
@@ -172,6 +168,7 @@ Xbox::~Xbox() {
     if (m_acpiIRQs != nullptr) delete[] m_acpiIRQs;
     if (m_IRQs != nullptr) delete[] m_IRQs;
     if (m_GSI != nullptr) delete m_GSI;
+    if (m_clock != nullptr) delete m_clock;
 }
 
 void Xbox::CopySettings(StrikeBoxSettings *settings) {
@@ -185,6 +182,7 @@ EmulatorStatus Xbox::Run() {
     }
 
     m_should_run = true;
+    m_scheduler->Start();
 
     // Start CPU emulation on a new thread
     uint32_t result;
@@ -192,6 +190,7 @@ EmulatorStatus Xbox::Run() {
 
     // Wait for the thread to exit
     cpuIdleThread.join();
+    m_scheduler->Stop();
 
     Cleanup();
 
@@ -268,19 +267,10 @@ EmulatorStatus Xbox::InitRAM() {
     m_ramSize = m_settings.ram_expanded ? XBOX_RAM_SIZE_DEBUG : XBOX_RAM_SIZE_RETAIL;
     log_debug("Allocating RAM (%d MiB)\n", m_ramSize >> 20);
 
-#ifdef _WIN32
-    m_ram = (uint8_t *)valloc(m_ramSize);
-#endif
-
-#ifdef __linux__
-    m_ram = (uint8_t *)mmap(nullptr, m_ramSize, PROT_READ | PROT_WRITE,
-        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
-#endif
-
-    if (m_ram == NULL) {
+    if (!m_guestMemory.Allocate(m_ramSize)) {
         return EMUS_INIT_ALLOC_RAM_FAILED;
     }
-    memset(m_ram, 0, m_ramSize);
+    m_ram = m_guestMemory.Data();
 
     // Map RAM at address 0x00000000
     auto result = m_vm->get().MapGuestMemory(0x00000000, m_ramSize, MemoryFlags::Read | MemoryFlags::Write | MemoryFlags::Execute, m_ram);
@@ -377,6 +367,11 @@ EmulatorStatus Xbox::InitHardware() {
     m_GSI = new GSI();
     m_IRQs = AllocateIRQs(m_GSI, GSI_NUM_PINS);
 
+    // Create the virtual clock shared by all device timers and the scheduler
+    // of timed device events
+    m_clock = new VirtualClock();
+    m_scheduler = new Scheduler(*m_clock, m_settings.emu_unthrottled ? SchedulerMode::Unthrottled : SchedulerMode::RealTime);
+
     // Create basic system devices
     m_i8259 = new i8259(vp);
     m_i8254 = new i8254(*m_i8259, m_settings.hw_sysclock_tickRate);
@@ -451,7 +446,7 @@ EmulatorStatus Xbox::InitHardware() {
             }
             m_CharDrivers[i]->Init();
         }
-        m_SuperIO = new SuperIO(*m_i8259, m_CharDrivers);
+        m_SuperIO = new SuperIO(*m_i8259, *m_clock, m_CharDrivers);
         m_SuperIO->Init();
     }
     else {
@@ -474,16 +469,48 @@ EmulatorStatus Xbox::InitHardware() {
     m_ADM1032 = new ADM1032Device();
     m_HostBridge = new HostBridgeDevice();
     m_MCPXRAM = new MCPXRAMDevice(mcpxRevision);
-    m_LPC = new LPCDevice(m_IRQs, m_rom, m_bios, m_biosSize, m_mcpxROM, m_settings.hw_revision != DebugKit);
+    m_LPC = new LPCDevice(m_IRQs, *m_clock, m_rom, m_bios, m_biosSize, m_mcpxROM, m_settings.hw_revision != DebugKit);
     m_USB1 = new USBPCIDevice(1, vp);
     m_USB2 = new USBPCIDevice(9, vp);
     m_NVNet = new NVNetDevice();
-    m_NVAPU = new NVAPUDevice();
+    m_NVAPU = new NVAPUDevice(*m_clock);
     m_AC97 = new AC97Device();
     m_PCIBridge = new PCIBridgeDevice();
-    m_BMIDE = new hw::bmide::BMIDEDevice(m_ram, m_ramSize, *m_ATA);
+    m_BMIDE = new hw::bmide::BMIDEDevice(m_guestMemory, *m_ATA);
     m_AGPBridge = new AGPBridgeDevice();
-    m_NV2A = new NV2ADevice(m_ram, m_ramSize, *m_i8259);
+    m_NV2A = new NV2ADevice(m_guestMemory, *m_i8259, *m_scheduler);
+
+    // Create the frame export sink
+    switch (m_settings.video_exportType) {
+    case VEX_None:
+        break;
+    case VEX_Null:
+        m_frameSink = new nv2a::NullFrameSink();
+        break;
+    case VEX_SharedMemory:
+    {
+        auto sharedMemorySink = new nv2a::SharedMemoryFrameSink();
+        m_frameSink = sharedMemorySink;
+        if (!sharedMemorySink->Create()) {
+            log_fatal("Failed to create the shared memory frame ring\n");
+            return EMUS_INIT_VIDEO_EXPORT_FAILED;
+        }
+        break;
+    }
+    case VEX_PPM:
+    case VEX_Y4M:
+    {
+        auto format = (m_settings.video_exportType == VEX_PPM) ? nv2a::FrameFileFormat::PPM : nv2a::FrameFileFormat::Y4M;
+        auto fileSink = new nv2a::FileFrameSink(format, m_settings.video_exportPath, m_settings.video_exportInterval);
+        m_frameSink = fileSink;
+        if (!fileSink->Start()) {
+            log_fatal("Failed to open the frame export file\n");
+            return EMUS_INIT_VIDEO_EXPORT_FAILED;
+        }
+        break;
+    }
+    }
+    m_NV2A->SetFrameSink(m_frameSink);
 
     // Configure IRQs
     m_acpiIRQs = AllocateIRQs(m_LPC, 2);
@@ -683,7 +710,7 @@ int Xbox::RunCpu() {
         // Handle result
         if (result != VPExecutionStatus::OK) {
             log_error("Error occurred!\n");
-            if (LOG_LEVEL >= LOG_LEVEL_DEBUG) {
+            if (LOG_LEVEL >= LOG_LEVEL_DEBUG && log_get_level(LogCategory_General) >= LOG_LEVEL_DEBUG) {
                 RegValue eip;
                 vp.RegRead(Reg::EIP, eip);
                 DumpCPURegisters(vp);
@@ -799,7 +826,7 @@ int Xbox::RunCpu() {
 }
 
 void Xbox::Cleanup() {
-    if (LOG_LEVEL >= LOG_LEVEL_DEBUG) {
+    if (LOG_LEVEL >= LOG_LEVEL_DEBUG && log_get_level(LogCategory_General) >= LOG_LEVEL_DEBUG) {
         log_debug("CPU state at the end of execution:\n");
         auto& vp = m_vm->get().GetVirtualProcessor(0)->get();
         RegValue eip;
@@ -903,11 +930,35 @@ void Xbox::Cleanup() {
         }
     }
 
+#ifdef STRIKEBOX_IO_STATS
+    if (m_settings.debug_ioStatsPath != nullptr) {
+        DumpIOStats(m_settings.debug_ioStatsPath);
+    }
+#endif
+
     if (m_settings.gdb_enable) {
         // TODO: Stop GDB server
     }
 }
 
+bool Xbox::DumpIOStats(const char *path) {
+#ifdef STRIKEBOX_IO_STATS
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        log_warning("Could not open %s to write I/O statistics\n", path);
+        return false;
+    }
+    m_ioMapper.GetStats().DumpJSON(fp);
+    fclose(fp);
+    log_info("I/O statistics written to %s\n", path);
+    return true;
+#else
+    (void)path;
+    log_warning("I/O statistics are not available; rebuild with STRIKEBOX_IO_STATS enabled\n");
+    return false;
+#endif
+}
+
 // CPU emulation thread function
 uint32_t Xbox::EmuCpuThreadFunc(void *data) {
     Thread_SetName("[HW] CPU");
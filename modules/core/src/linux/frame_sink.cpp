@@ -0,0 +1,50 @@
+#include "strikebox/hw/gpu/frame_sink.h"
+
+#include "strikebox/log.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace strikebox::nv2a {
+
+// The ring is an anonymous memfd. Viewers open it through the /proc link of
+// the file descriptor, or receive the descriptor from an embedding process.
+
+bool SharedMemoryFrameSink::MapSharedMemory(size_t size) {
+    int fd = memfd_create("strikebox-frames", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        log_warning("[NV2A] Scan-out: Could not create the shared memory object\n");
+        return false;
+    }
+
+    // Viewers rely on the size not changing under them
+    if (ftruncate(fd, size) != 0 || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+        log_warning("[NV2A] Scan-out: Could not allocate %zu bytes of shared memory\n", size);
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        log_warning("[NV2A] Scan-out: Could not map the shared memory object\n");
+        close(fd);
+        return false;
+    }
+
+    m_handle = fd;
+    m_data = static_cast<uint8_t*>(data);
+    m_size = size;
+    log_info("[NV2A] Scan-out: Frames are published to shared memory at /proc/%d/fd/%d\n", static_cast<int>(getpid()), fd);
+    return true;
+}
+
+void SharedMemoryFrameSink::UnmapSharedMemory() {
+    munmap(m_data, m_size);
+    close(static_cast<int>(m_handle));
+    m_data = nullptr;
+    m_size = 0;
+    m_handle = -1;
+}
+
+}
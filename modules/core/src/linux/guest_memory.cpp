@@ -0,0 +1,176 @@
+#include "strikebox/guest_memory.h"
+
+#include "strikebox/log.h"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <linux/userfaultfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Definitions from Linux 6.7 headers, for building against older ones
+// See https://docs.kernel.org/admin-guide/mm/pagemap.html
+#ifndef PAGEMAP_SCAN
+struct page_region {
+    __u64 start;
+    __u64 end;
+    __u64 categories;
+};
+
+struct pm_scan_arg {
+    __u64 size;
+    __u64 flags;
+    __u64 start;
+    __u64 end;
+    __u64 walk_end;
+    __u64 vec;
+    __u64 vec_len;
+    __u64 max_pages;
+    __u64 category_inverted;
+    __u64 category_mask;
+    __u64 category_anyof_mask;
+    __u64 return_mask;
+};
+
+#define PAGEMAP_SCAN _IOWR('f', 16, struct pm_scan_arg)
+#define PAGE_IS_WRITTEN (1 << 1)
+#define PM_SCAN_WP_MATCHING (1 << 0)
+#define PM_SCAN_CHECK_WPASYNC (1 << 1)
+#endif
+
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED (1 << 13)
+#endif
+#ifndef UFFD_FEATURE_WP_ASYNC
+#define UFFD_FEATURE_WP_ASYNC (1 << 15)
+#endif
+
+namespace strikebox {
+
+// Guest RAM is registered with userfaultfd for asynchronous write-protection:
+// the first write to a protected page, from user mode or from the kernel on
+// behalf of the hypervisor, unprotects it and marks it as written without
+// stopping the writer. PAGEMAP_SCAN then reports the written pages and
+// protects them again in one atomic step, so no write is lost between the two.
+struct GuestMemory::WriteTracker {
+    int userfault = -1;
+    int pagemap = -1;
+    std::vector<page_region> regions = std::vector<page_region>(256);
+
+    ~WriteTracker() {
+        if (userfault >= 0) close(userfault);
+        if (pagemap >= 0) close(pagemap);
+    }
+
+    bool Register(uint8_t *data, uint32_t size) {
+        userfault = static_cast<int>(syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY));
+        if (userfault < 0) {
+            return false;
+        }
+
+        uffdio_api api = {};
+        api.api = UFFD_API;
+        api.features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+        if (ioctl(userfault, UFFDIO_API, &api) < 0) {
+            return false;
+        }
+
+        uffdio_register registration = {};
+        registration.range.start = reinterpret_cast<uintptr_t>(data);
+        registration.range.len = size;
+        registration.mode = UFFDIO_REGISTER_MODE_WP;
+        if (ioctl(userfault, UFFDIO_REGISTER, &registration) < 0) {
+            return false;
+        }
+
+        uffdio_writeprotect protect = {};
+        protect.range = registration.range;
+        protect.mode = UFFDIO_WRITEPROTECT_MODE_WP;
+        return ioctl(userfault, UFFDIO_WRITEPROTECT, &protect) == 0;
+    }
+
+    // Sets the bits of the pages in the given range written since the last
+    // scan and write-protects them again
+    bool Scan(uintptr_t start, uintptr_t end, std::vector<uint64_t>& bitmap) {
+        pm_scan_arg scan = {};
+        scan.size = sizeof(scan);
+        scan.flags = PM_SCAN_WP_MATCHING | PM_SCAN_CHECK_WPASYNC;
+        scan.start = start;
+        scan.end = end;
+        scan.vec = reinterpret_cast<uintptr_t>(regions.data());
+        scan.vec_len = regions.size();
+        scan.category_mask = PAGE_IS_WRITTEN;
+        scan.return_mask = PAGE_IS_WRITTEN;
+
+        // The walk stops early when the region buffer fills up
+        while (scan.start < end) {
+            int count = ioctl(pagemap, PAGEMAP_SCAN, &scan);
+            if (count < 0) {
+                return false;
+            }
+            for (int i = 0; i < count; i++) {
+                uint32_t first = static_cast<uint32_t>((regions[i].start - start) >> kPageShift);
+                uint32_t last = static_cast<uint32_t>((regions[i].end - start - 1) >> kPageShift);
+                for (uint32_t page = first; page <= last; page++) {
+                    bitmap[page / 64] |= 1ull << (page & 63);
+                }
+            }
+            scan.start = scan.walk_end;
+        }
+        return true;
+    }
+};
+
+uint8_t *GuestMemory::AllocatePages(uint32_t size) {
+    void *data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (data == MAP_FAILED) {
+        return nullptr;
+    }
+    return static_cast<uint8_t *>(data);
+}
+
+void GuestMemory::FreePages(uint8_t *data, uint32_t size) {
+    munmap(data, size);
+}
+
+GuestMemory::WriteTracker *GuestMemory::CreateWriteTracker() {
+    if (sysconf(_SC_PAGESIZE) != kPageSize) {
+        return nullptr;
+    }
+
+    auto tracker = std::make_unique<WriteTracker>();
+    tracker->pagemap = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (tracker->pagemap < 0 || !tracker->Register(m_data, m_pageCount << kPageShift)) {
+        return nullptr;
+    }
+
+    // Check that a write is actually reported, then start from a clean state
+    uintptr_t start = reinterpret_cast<uintptr_t>(m_data);
+    std::vector<uint64_t> bitmap(m_bitmapWords);
+    volatile uint8_t *probe = m_data;
+    *probe = *probe;
+    if (!tracker->Scan(start, start + kPageSize, bitmap) || !(bitmap[0] & 1)) {
+        return nullptr;
+    }
+    return tracker.release();
+}
+
+void GuestMemory::DestroyWriteTracker() {
+    delete m_tracker;
+    m_tracker = nullptr;
+}
+
+void GuestMemory::ScanCPUWrites(std::vector<uint64_t>& bitmap) {
+    uintptr_t start = reinterpret_cast<uintptr_t>(m_data);
+    if (!m_tracker->Scan(start, start + (static_cast<uintptr_t>(m_pageCount) << kPageShift), bitmap)) {
+        // Report everything rather than miss writes
+        log_warning("GuestMemory: Failed to scan written pages\n");
+        std::fill(bitmap.begin(), bitmap.end(), ~0ull);
+    }
+}
+
+}
@@ -0,0 +1,16 @@
+#include "strikebox/hw/gpu/frame_sink.h"
+
+#include "strikebox/log.h"
+
+namespace strikebox::nv2a {
+
+// Shared memory export is only implemented on Linux
+bool SharedMemoryFrameSink::MapSharedMemory(size_t size) {
+    log_warning("[NV2A] Scan-out: Shared memory frame export is not supported on this platform\n");
+    return false;
+}
+
+void SharedMemoryFrameSink::UnmapSharedMemory() {
+}
+
+}
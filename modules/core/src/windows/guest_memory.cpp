@@ -0,0 +1,37 @@
+#include "strikebox/guest_memory.h"
+#include "strikebox/alloc.h"
+
+#include <cstring>
+
+namespace strikebox {
+
+// Guest CPU writes are made by the hypervisor, which the host write-watch
+// facilities cannot be relied upon to observe, so only explicitly marked
+// writes are tracked on Windows
+struct GuestMemory::WriteTracker {};
+
+uint8_t *GuestMemory::AllocatePages(uint32_t size) {
+    uint8_t *data = static_cast<uint8_t *>(valloc(size));
+    if (data != nullptr) {
+        memset(data, 0, size);
+    }
+    return data;
+}
+
+void GuestMemory::FreePages(uint8_t *data, uint32_t size) {
+    vfree(data);
+}
+
+GuestMemory::WriteTracker *GuestMemory::CreateWriteTracker() {
+    return nullptr;
+}
+
+void GuestMemory::DestroyWriteTracker() {
+    delete m_tracker;
+    m_tracker = nullptr;
+}
+
+void GuestMemory::ScanCPUWrites(std::vector<uint64_t>& bitmap) {
+}
+
+}
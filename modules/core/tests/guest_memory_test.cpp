@@ -0,0 +1,162 @@
+// Checks the dirty page views of guest memory
+#include "strikebox/guest_memory.h"
+
+#include "test.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+using namespace strikebox;
+
+static const uint32_t kRAMSize = 64 * GuestMemory::kPageSize;
+
+static bool IsClean(const std::vector<uint64_t>& bitmap) {
+    for (uint64_t word : bitmap) {
+        if (word != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool PageDirty(const std::vector<uint64_t>& bitmap, uint32_t page) {
+    return GuestMemory::AnyPageDirty(bitmap, page << GuestMemory::kPageShift, 1);
+}
+
+static void CheckExplicitWrites(GuestMemory& memory) {
+    std::vector<uint64_t> bitmap;
+    int a = memory.Subscribe();
+    int b = memory.Subscribe();
+    CHECK(a >= 0 && b >= 0 && a != b);
+
+    // New views start with every page dirty
+    memory.CollectDirty(a, bitmap);
+    CHECK(PageDirty(bitmap, 0) && PageDirty(bitmap, 63));
+    memory.CollectDirty(a, bitmap);
+    CHECK(IsClean(bitmap));
+    memory.CollectDirty(b, bitmap);
+
+    // Marks reach every view and cover partial pages
+    memory.MarkDirty(3 * GuestMemory::kPageSize + 100, GuestMemory::kPageSize);
+    memory.CollectDirty(a, bitmap);
+    CHECK(!PageDirty(bitmap, 2) && PageDirty(bitmap, 3) && PageDirty(bitmap, 4) && !PageDirty(bitmap, 5));
+    memory.CollectDirty(b, bitmap);
+    CHECK(PageDirty(bitmap, 3) && PageDirty(bitmap, 4));
+
+    // Writers are not notified of their own writes
+    memory.MarkDirty(7 * GuestMemory::kPageSize, 1, a);
+    memory.CollectDirty(a, bitmap);
+    CHECK(IsClean(bitmap));
+    memory.CollectDirty(b, bitmap);
+    CHECK(PageDirty(bitmap, 7));
+
+    // Marks past the end of RAM are clipped
+    memory.MarkDirty(kRAMSize - 1, 100);
+    memory.MarkDirty(kRAMSize, 100);
+    memory.CollectDirty(a, bitmap);
+    CHECK(PageDirty(bitmap, 63));
+    CHECK(bitmap.size() == 1);
+
+    memory.Unsubscribe(a);
+    memory.Unsubscribe(b);
+}
+
+static void CheckCPUWrites(GuestMemory& memory) {
+    if (!memory.TracksCPUWrites()) {
+        printf("Guest CPU writes are not tracked on this host; skipping\n");
+        return;
+    }
+
+    std::vector<uint64_t> bitmap;
+    int a = memory.Subscribe();
+    int b = memory.Subscribe();
+    memory.Synchronize();
+    memory.CollectDirty(a, bitmap);
+    memory.CollectDirty(b, bitmap);
+
+    memory.Data()[10 * GuestMemory::kPageSize + 5] = 1;
+
+    // Writes are only seen after synchronizing
+    memory.CollectDirty(a, bitmap);
+    CHECK(!PageDirty(bitmap, 10));
+
+    // A single synchronization hands the write to every view
+    memory.Synchronize();
+    memory.CollectDirty(a, bitmap);
+    CHECK(PageDirty(bitmap, 10));
+    memory.CollectDirty(b, bitmap);
+    CHECK(PageDirty(bitmap, 10));
+
+    // The host record is cleared by the scan
+    memory.Synchronize();
+    memory.CollectDirty(a, bitmap);
+    CHECK(!PageDirty(bitmap, 10));
+
+    memory.Unsubscribe(a);
+    memory.Unsubscribe(b);
+}
+
+static void CheckConcurrentCPUWrites(GuestMemory& memory) {
+    if (!memory.TracksCPUWrites()) {
+        return;
+    }
+
+    // A write that lands while the pages are being scanned must be reported by
+    // that synchronization or the next one. Any page whose contents changed
+    // between two snapshots taken before consecutive scans was written before
+    // the second scan, so one of the two must report it.
+    std::atomic<bool> stop{ false };
+    std::thread writer([&]() {
+        uint32_t value = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            uint32_t page = (value * 7) & 63;
+            uint32_t *word = reinterpret_cast<uint32_t *>(memory.Data() + (page << GuestMemory::kPageShift));
+            __atomic_store_n(word, ++value, __ATOMIC_RELAXED);
+        }
+    });
+
+    int view = memory.Subscribe();
+    std::vector<uint64_t> previous, current;
+    std::vector<uint32_t> before(64), after(64);
+    auto snapshot = [&](std::vector<uint32_t>& values) {
+        for (uint32_t page = 0; page < 64; page++) {
+            const uint32_t *word = reinterpret_cast<const uint32_t *>(memory.Data() + (page << GuestMemory::kPageShift));
+            values[page] = __atomic_load_n(word, __ATOMIC_RELAXED);
+        }
+    };
+
+    snapshot(before);
+    memory.Synchronize();
+    memory.CollectDirty(view, previous);
+    uint32_t lost = 0;
+    for (int i = 0; i < 2000; i++) {
+        snapshot(after);
+        memory.Synchronize();
+        memory.CollectDirty(view, current);
+        for (uint32_t page = 0; page < 64; page++) {
+            if (before[page] != after[page] && !PageDirty(previous, page) && !PageDirty(current, page)) {
+                lost++;
+            }
+        }
+        before.swap(after);
+        previous.swap(current);
+    }
+    stop = true;
+    writer.join();
+    CHECK_MSG(lost == 0, "%u writes were not reported", lost);
+
+    memory.Unsubscribe(view);
+}
+
+int main() {
+    GuestMemory memory;
+    CHECK(memory.Allocate(kRAMSize));
+    CHECK(memory.PageCount() == 64);
+
+    CheckExplicitWrites(memory);
+    CheckCPUWrites(memory);
+    CheckConcurrentCPUWrites(memory);
+
+    return strikebox::test::Result();
+}
@@ -0,0 +1,128 @@
+// Checks the PTIMER counter as seen by the CPU and by the GPU timestamps
+#include "strikebox/hw/gpu/state.h"
+#include "strikebox/virtual_clock.h"
+
+#include "test.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace strikebox;
+using namespace strikebox::nv2a;
+
+static const uint32_t kRAMSize = 1 << 20;
+
+// MMIO offsets of the engines programmed by the tests
+static const uint32_t kPTIMERBase = 0x009000;
+static const uint32_t kPRAMDACBase = 0x680000;
+
+struct TestSystem {
+    std::vector<uint8_t> ram = std::vector<uint8_t>(kRAMSize);
+    VirtualClock clock;
+    NV2A nv2a{ ram.data(), kRAMSize, [](uint8_t) -> uint32_t { return 0; }, [](uint8_t, uint32_t) {}, [](bool) {}, clock };
+
+    TestSystem(bool paused) {
+        if (paused) {
+            clock.Pause();
+        }
+        nv2a.Reset();
+    }
+
+    uint64_t CoreClock() { return nv2a.pramdac.GetCoreClockCoefficients().CalcClock(); }
+
+    // Reads the counter through TIME_HIGH:TIME_LOW
+    uint64_t ReadTicks() {
+        uint64_t low = nv2a.Read(kPTIMERBase + Reg_PTIMER_TIME_LOW, 4);
+        uint64_t high = nv2a.Read(kPTIMERBase + Reg_PTIMER_TIME_HIGH, 4);
+        return (high << 27) | (low >> 5);
+    }
+
+    void Write(uint32_t reg, uint32_t value) { nv2a.Write(kPTIMERBase + reg, value, 4); }
+};
+
+static void CheckRate() {
+    TestSystem system(true);
+    TickRate fullRate(system.CoreClock());
+    TickRate halfRate(system.CoreClock() / 2);
+
+    CHECK(system.ReadTicks() == 0);
+    system.clock.Advance(1000000);
+    CHECK(system.ReadTicks() == fullRate.ToTicks(1000000));
+    CHECK(system.nv2a.ptimer.GetTime() == system.ReadTicks() << 5);
+
+    // Changing the ratio keeps the ticks counted so far
+    system.Write(Reg_PTIMER_TIME_HIGH, 0);
+    system.Write(Reg_PTIMER_TIME_LOW, 0);
+    CHECK(system.ReadTicks() == 0);
+    system.clock.Advance(1000000);
+    system.Write(Reg_PTIMER_CLOCK_DIV, 2);
+    CHECK(system.ReadTicks() == fullRate.ToTicks(1000000));
+    system.clock.Advance(1000000);
+    CHECK(system.ReadTicks() == fullRate.ToTicks(1000000) + halfRate.ToTicks(1000000));
+
+    // A zero divider stops the counter
+    uint64_t stopped = system.ReadTicks();
+    system.Write(Reg_PTIMER_CLOCK_DIV, 0);
+    system.clock.Advance(1000000);
+    CHECK(system.ReadTicks() == stopped);
+}
+
+static void CheckCoreClockChange() {
+    TestSystem system(true);
+    TickRate oldRate(system.CoreClock());
+    system.clock.Advance(1000000);
+
+    // The counter follows NVPLL from the moment it is reprogrammed
+    auto coeff = system.nv2a.pramdac.GetCoreClockCoefficients();
+    coeff.N *= 2;
+    system.nv2a.Write(kPRAMDACBase + Reg_RAMDAC_NVPLL, coeff.u32, 4);
+    CHECK(system.ReadTicks() == oldRate.ToTicks(1000000));
+
+    TickRate newRate(system.CoreClock());
+    CHECK(newRate.GetFrequency() > oldRate.GetFrequency());
+    system.clock.Advance(1000000);
+    CHECK(system.ReadTicks() == oldRate.ToTicks(1000000) + newRate.ToTicks(1000000));
+}
+
+static void CheckConcurrentReads() {
+    // GPU timestamps never go backwards or jump ahead while the CPU keeps
+    // reprogramming the counter
+    TestSystem system(false);
+    std::atomic<bool> stop{ false };
+    std::atomic<uint32_t> backwards{ 0 };
+    std::atomic<uint64_t> maxTime{ 0 };
+    std::thread reader([&]() {
+        uint64_t last = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            uint64_t time = system.nv2a.ptimer.GetTime();
+            if (time < last) {
+                backwards++;
+            }
+            last = time;
+        }
+        maxTime = last;
+    });
+
+    uint64_t start = system.clock.Now();
+    uint64_t startTicks = system.ReadTicks();
+    for (uint32_t i = 0; i < 20000; i++) {
+        system.Write(Reg_PTIMER_CLOCK_MUL, 1 + (i & 1));
+        system.Write(Reg_PTIMER_CLOCK_DIV, 2);
+    }
+    stop = true;
+    reader.join();
+
+    // The counter ran at half or full speed the whole time
+    uint64_t limit = startTicks + TickRate(system.CoreClock()).ToTicks(system.clock.Now() - start);
+    CHECK_MSG(backwards == 0, "%u timestamps went backwards", backwards.load());
+    CHECK((maxTime >> 5) <= limit);
+}
+
+int main() {
+    CheckRate();
+    CheckCoreClockChange();
+    CheckConcurrentReads();
+
+    return strikebox::test::Result();
+}
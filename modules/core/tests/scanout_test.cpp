@@ -0,0 +1,247 @@
+// Checks the conversion of framebuffers into RGBA frames by the scan-out
+#include "strikebox/hw/gpu/state.h"
+#include "strikebox/virtual_clock.h"
+
+#include "test.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <vector>
+
+using namespace strikebox;
+using namespace strikebox::nv2a;
+
+static const uint32_t kRAMSize = 1 << 20;
+static const uint32_t kFramebuffer = 0x1000;
+
+// MMIO offsets of the engines programmed by the tests
+static const uint32_t kPCRTCBase = 0x600000;
+static const uint32_t kPRMCIOBase = 0x601000;
+static const uint32_t kPRAMDACBase = 0x680000;
+
+// Keeps frames in a buffer with padded rows
+class TestFrameSink : public FrameSink {
+public:
+    uint8_t* BeginFrame(uint32_t width, uint32_t height, uint32_t& pitch) override {
+        began++;
+        if (skip) {
+            return nullptr;
+        }
+        this->width = width;
+        this->height = height;
+        this->pitch = pitch = width * 4 + 16;
+        pixels.assign(static_cast<size_t>(pitch) * height, 0xcd);
+        return pixels.data();
+    }
+
+    void EndFrame() override { ended++; }
+    void SetFramePeriod(uint64_t period) override { framePeriod = period; }
+
+    // Returns the R, G, B, A bytes of a pixel
+    uint32_t Pixel(uint32_t x, uint32_t y) const {
+        const uint8_t* p = &pixels[y * pitch + x * 4];
+        return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    }
+
+    bool skip = false;
+    uint32_t began = 0;
+    uint32_t ended = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t pitch = 0;
+    uint64_t framePeriod = 0;
+    std::vector<uint8_t> pixels;
+};
+
+struct TestSystem {
+    std::vector<uint8_t> ram = std::vector<uint8_t>(kRAMSize);
+    VirtualClock clock;
+    NV2A nv2a{ ram.data(), kRAMSize, [](uint8_t) -> uint32_t { return 0; }, [](uint8_t, uint32_t) {}, [](bool) {}, clock };
+    TestFrameSink sink;
+
+    TestSystem() {
+        nv2a.Reset();
+        nv2a.scanOut.SetSink(&sink);
+    }
+
+    void WriteCRTC(uint8_t index, uint8_t value) {
+        nv2a.Write(kPRMCIOBase + Reg_PRMCIO_CRX_COLOR, index, 1);
+        nv2a.Write(kPRMCIOBase + Reg_PRMCIO_CR_COLOR, value, 1);
+    }
+
+    // Programs a display mode; width must be a multiple of 8 and pitch of 8
+    void SetMode(uint32_t width, uint32_t height, uint32_t pitch, uint8_t depth, bool r5g6b5 = false) {
+        WriteCRTC(Reg_CR_HDE, static_cast<uint8_t>(width / 8 - 1));
+        WriteCRTC(Reg_CR_VDE, static_cast<uint8_t>(height - 1));
+        WriteCRTC(Reg_CR_OVL, static_cast<uint8_t>(((height - 1) >> 7) & 0x02));
+        WriteCRTC(Reg_CR_OFFSET, static_cast<uint8_t>(pitch / 8));
+        WriteCRTC(Reg_CR_RPC0, static_cast<uint8_t>(((pitch / 8) >> 3) & 0xe0));
+        WriteCRTC(Reg_CR_PIXEL, depth);
+        nv2a.Write(kPRAMDACBase + Reg_RAMDAC_GENERAL_CONTROL, r5g6b5 ? Val_RAMDAC_GENERAL_CONTROL_ALT_MODE_SEL : 0, 4);
+        nv2a.Write(kPCRTCBase + Reg_PCRTC_START, kFramebuffer, 4);
+    }
+
+    void Write32(uint32_t address, uint32_t value) { memcpy(&ram[address], &value, 4); }
+    void Write16(uint32_t address, uint16_t value) { memcpy(&ram[address], &value, 2); }
+};
+
+static void Check32Bit() {
+    TestSystem system;
+    const uint32_t width = 24, height = 3, pitch = 128;
+    system.SetMode(width, height, pitch, Val_CR_PIXEL_DEPTH_32);
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            // The unused top byte must not leak into alpha
+            system.Write32(kFramebuffer + y * pitch + x * 4, 0x5a000000 | (y << 16) | (x << 8) | (x ^ y));
+        }
+    }
+    system.nv2a.scanOut.Run();
+
+    auto& sink = system.sink;
+    CHECK(sink.began == 1 && sink.ended == 1);
+    CHECK(sink.width == width && sink.height == height);
+    uint32_t mismatches = 0;
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            mismatches += sink.Pixel(x, y) != ((y << 24) | (x << 16) | ((x ^ y) << 8) | 0xff);
+        }
+        // Row padding is left alone
+        mismatches += sink.pixels[y * sink.pitch + width * 4] != 0xcd;
+    }
+    CHECK_MSG(mismatches == 0, "%u pixels differ", mismatches);
+}
+
+static void Check16Bit(bool r5g6b5) {
+    TestSystem system;
+    const uint32_t width = 16, height = 2, pitch = 64;
+    system.SetMode(width, height, pitch, Val_CR_PIXEL_DEPTH_16, r5g6b5);
+
+    // Pure red, green, blue and white, repeated across both rows
+    const uint16_t colors[] = {
+        static_cast<uint16_t>(r5g6b5 ? 0xf800 : 0x7c00),
+        static_cast<uint16_t>(r5g6b5 ? 0x07e0 : 0x03e0),
+        0x001f,
+        static_cast<uint16_t>(r5g6b5 ? 0xffff : 0x7fff),
+    };
+    const uint32_t expected[] = { 0xff0000ff, 0x00ff00ff, 0x0000ffff, 0xffffffff };
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            system.Write16(kFramebuffer + y * pitch + x * 2, colors[x & 3]);
+        }
+    }
+    system.nv2a.scanOut.Run();
+
+    auto& sink = system.sink;
+    CHECK(sink.ended == 1);
+    uint32_t mismatches = 0;
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            mismatches += sink.Pixel(x, y) != expected[x & 3];
+        }
+    }
+    CHECK_MSG(mismatches == 0, "%s: %u pixels differ", r5g6b5 ? "R5G6B5" : "X1R5G5B5", mismatches);
+
+    // Channels are widened by replicating their high bits
+    system.Write16(kFramebuffer, r5g6b5 ? (0x10 << 11) | (0x20 << 5) | 0x01 : (0x10 << 10) | (0x10 << 5) | 0x01);
+    system.nv2a.scanOut.Run();
+    CHECK(sink.Pixel(0, 0) == (r5g6b5 ? 0x848208ff : 0x848408ff));
+}
+
+static void CheckSkippedFrames() {
+    TestSystem system;
+    auto& sink = system.sink;
+
+    // Unsupported depths produce no frames
+    system.SetMode(16, 2, 64, Val_CR_PIXEL_DEPTH_8);
+    system.nv2a.scanOut.Run();
+    CHECK(sink.began == 0);
+
+    // Nor do framebuffers that do not fit in RAM
+    system.SetMode(16, 2, 64, Val_CR_PIXEL_DEPTH_32);
+    system.nv2a.Write(kPCRTCBase + Reg_PCRTC_START, kRAMSize - 64, 4);
+    system.nv2a.scanOut.Run();
+    CHECK(sink.began == 0);
+
+    // Nor pitches narrower than the display
+    system.SetMode(16, 2, 32, Val_CR_PIXEL_DEPTH_32);
+    system.nv2a.scanOut.Run();
+    CHECK(sink.began == 0);
+
+    // The sink may skip frames
+    system.SetMode(16, 2, 64, Val_CR_PIXEL_DEPTH_32);
+    sink.skip = true;
+    system.nv2a.scanOut.Run();
+    CHECK(sink.began == 1 && sink.ended == 0);
+
+    // Without a sink, nothing happens
+    sink.skip = false;
+    system.nv2a.scanOut.SetSink(nullptr);
+    system.nv2a.scanOut.Run();
+    CHECK(sink.began == 1);
+}
+
+// Returns the first line of a file
+static std::string ReadHeader(const std::string& path) {
+    std::string header;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file != nullptr) {
+        int c;
+        while ((c = fgetc(file)) != EOF && c != '\n') {
+            header.push_back(static_cast<char>(c));
+        }
+        fclose(file);
+    }
+    return header;
+}
+
+static void CheckFrameRate() {
+    // The sink learns the display's frame period with the first frame
+    TestSystem system;
+    system.SetMode(16, 2, 64, Val_CR_PIXEL_DEPTH_32);
+    system.nv2a.scanOut.Run();
+    CHECK(system.sink.framePeriod == system.nv2a.pcrtc.GetFramePeriod());
+
+    // Y4M streams play back at the display's rate, reduced, with one out of
+    // every interval frames
+    const std::string path = "scanout_test.y4m";
+    {
+        FileFrameSink sink(FrameFileFormat::Y4M, path, 2);
+        CHECK(sink.Start());
+        system.nv2a.scanOut.SetSink(&sink);
+        system.nv2a.scanOut.Run();
+        system.nv2a.scanOut.SetSink(nullptr);
+    }
+    const uint64_t second = 1000000000;
+    uint64_t period = system.nv2a.pcrtc.GetFramePeriod() * 2;
+    uint64_t divisor = std::gcd(second, period);
+    char expected[64];
+    snprintf(expected, sizeof(expected), " F%" PRIu64 ":%" PRIu64 " ", second / divisor, period / divisor);
+    std::string header = ReadHeader(path);
+    CHECK_MSG(header.find(expected) != std::string::npos, "header: %s", header.c_str());
+
+    // 50 Hz displays are not recorded as 60 Hz
+    {
+        FileFrameSink sink(FrameFileFormat::Y4M, path);
+        CHECK(sink.Start());
+        sink.SetFramePeriod(20000000);
+        uint32_t pitch;
+        CHECK(sink.BeginFrame(8, 2, pitch) != nullptr);
+        sink.EndFrame();
+    }
+    header = ReadHeader(path);
+    CHECK_MSG(header.find(" F50:1 ") != std::string::npos, "header: %s", header.c_str());
+    remove(path.c_str());
+}
+
+int main() {
+    Check32Bit();
+    Check16Bit(false);
+    Check16Bit(true);
+    CheckSkippedFrames();
+    CheckFrameRate();
+
+    return strikebox::test::Result();
+}
@@ -0,0 +1,146 @@
+// Checks the ordering and timing of scheduled events. The clock is paused so
+// that virtual time only moves when the tests advance it.
+#include "strikebox/scheduler.h"
+
+#include "test.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace strikebox;
+
+// Waits up to two seconds for the condition to become true
+template <typename Condition>
+static bool WaitFor(Condition condition) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!condition()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Gives the event thread time to fire events that should not fire
+static void Settle() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+}
+
+static void CheckOrder(VirtualClock& clock) {
+    Scheduler scheduler(clock);
+    std::mutex mutex;
+    std::vector<int> fired;
+    auto record = [&](int id) {
+        return [&, id]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            fired.push_back(id);
+        };
+    };
+    auto count = [&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return fired.size();
+    };
+
+    const uint64_t base = clock.Now();
+    auto a = scheduler.RegisterEvent(record(0));
+    auto b = scheduler.RegisterEvent(record(1));
+    auto c = scheduler.RegisterEvent(record(2));
+    auto d = scheduler.RegisterEvent(record(3));
+    scheduler.Schedule(a, base + 3000);
+    scheduler.Schedule(b, base + 1000);
+    scheduler.Schedule(c, base + 2000);
+    scheduler.Schedule(d, base + 500);
+
+    // Rescheduling replaces the previous time, and canceled events never fire
+    scheduler.Schedule(c, base + 4000);
+    scheduler.Cancel(d);
+
+    // Events scheduled while stopped fire once started, when they are due
+    scheduler.Start();
+    Settle();
+    CHECK(count() == 0);
+
+    clock.Advance(1500);
+    CHECK(WaitFor([&]() { return count() == 1; }));
+    Settle();
+    CHECK(count() == 1);
+
+    clock.Advance(5000);
+    CHECK(WaitFor([&]() { return count() == 3; }));
+    Settle();
+    std::lock_guard<std::mutex> lock(mutex);
+    CHECK(fired == std::vector<int>({ 1, 0, 2 }));
+}
+
+static void CheckPeriodic(VirtualClock& clock) {
+    Scheduler scheduler(clock);
+    std::atomic<uint32_t> count{ 0 };
+    std::atomic<uint64_t> lastTime{ 0 };
+    Scheduler::EventID event = Scheduler::kInvalidEvent;
+    uint64_t next = clock.Now() + 100;
+
+    // Callbacks may schedule their own event
+    event = scheduler.RegisterEvent([&]() {
+        lastTime = next;
+        if (++count < 5) {
+            next += 100;
+            scheduler.Schedule(event, next);
+        }
+    });
+    scheduler.Schedule(event, next);
+    scheduler.Start();
+
+    clock.Advance(10000);
+    CHECK(WaitFor([&]() { return count == 5; }));
+    Settle();
+    CHECK(count == 5);
+    CHECK(lastTime == next);
+}
+
+static void CheckGuestWaiting(VirtualClock& clock) {
+    // Real-time schedulers never move the clock
+    {
+        Scheduler scheduler(clock, SchedulerMode::RealTime);
+        std::atomic<bool> fired{ false };
+        auto event = scheduler.RegisterEvent([&]() { fired = true; });
+        const uint64_t before = clock.Now();
+        scheduler.Schedule(event, before + 1000000000);
+        scheduler.Start();
+        scheduler.NotifyGuestWaiting();
+        Settle();
+        CHECK(!fired);
+        CHECK(clock.Now() == before);
+    }
+
+    // Unthrottled schedulers skip ahead to the next event while the guest waits
+    {
+        Scheduler scheduler(clock, SchedulerMode::Unthrottled);
+        std::atomic<bool> fired{ false };
+        auto event = scheduler.RegisterEvent([&]() { fired = true; });
+        const uint64_t due = clock.Now() + 1000000000;
+        scheduler.Schedule(event, due);
+        scheduler.Start();
+        Settle();
+        CHECK(!fired);
+
+        scheduler.NotifyGuestWaiting();
+        CHECK(WaitFor([&]() { return fired.load(); }));
+        CHECK(clock.Now() >= due);
+        CHECK(clock.Now() < due + 1000000);
+    }
+}
+
+int main() {
+    VirtualClock clock;
+    clock.Pause();
+
+    CheckOrder(clock);
+    CheckPeriodic(clock);
+    CheckGuestWaiting(clock);
+
+    return strikebox::test::Result();
+}
@@ -0,0 +1,162 @@
+// Checks the swizzle kernels against a bit-by-bit reference implementation
+// for every power-of-two size at every supported texel size.
+#include "strikebox/hw/gpu/pgraph/swizzle.h"
+
+#include "test.h"
+
+#include <cstring>
+#include <vector>
+
+using namespace strikebox::nv2a;
+
+static const uint32_t kTexelSizes[] = { 1, 2, 4, 8 };
+static const uint32_t kMaxRectSize = 512;
+static const uint32_t kMaxBoxSize = 64;
+
+// Extra bytes at the end of each linear row and slice, which must be left
+// untouched by unswizzling
+static const uint32_t kPadding = 12;
+static const uint8_t kFill = 0xCD;
+
+// Computes the swizzled texel index by interleaving coordinate bits one at a
+// time in X, Y, Z order while each axis has bits left
+static uint32_t ReferenceOffset(uint32_t x, uint32_t y, uint32_t z, uint32_t width, uint32_t height, uint32_t depth) {
+    uint32_t offset = 0;
+    uint32_t outBit = 0;
+    for (uint32_t bit = 0; (1u << bit) < width || (1u << bit) < height || (1u << bit) < depth; bit++) {
+        if ((1u << bit) < width) {
+            offset |= ((x >> bit) & 1) << outBit++;
+        }
+        if ((1u << bit) < height) {
+            offset |= ((y >> bit) & 1) << outBit++;
+        }
+        if ((1u << bit) < depth) {
+            offset |= ((z >> bit) & 1) << outBit++;
+        }
+    }
+    return offset;
+}
+
+static void FillPattern(std::vector<uint8_t>& buffer, uint32_t seed) {
+    uint32_t state = seed * 2654435761u + 1;
+    for (auto& byte : buffer) {
+        state = state * 1664525u + 1013904223u;
+        byte = static_cast<uint8_t>(state >> 24);
+    }
+}
+
+static void CheckBox(uint32_t width, uint32_t height, uint32_t depth, uint32_t bpp) {
+    const uint32_t rowPitch = width * bpp + kPadding;
+    const uint32_t slicePitch = rowPitch * height + kPadding;
+    const uint32_t size = width * height * depth * bpp;
+
+    std::vector<uint8_t> linear(slicePitch * depth);
+    FillPattern(linear, width ^ (height << 8) ^ (depth << 16) ^ (bpp << 24));
+
+    // Linear to swizzled
+    std::vector<uint8_t> swizzled(size + kPadding, kFill);
+    if (depth == 1) {
+        SwizzleRect(linear.data(), rowPitch, swizzled.data(), width, height, bpp);
+    }
+    else {
+        SwizzleBox(linear.data(), rowPitch, slicePitch, swizzled.data(), width, height, depth, bpp);
+    }
+
+    uint32_t mismatches = 0;
+    for (uint32_t z = 0; z < depth; z++) {
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                const uint8_t* expected = &linear[z * slicePitch + y * rowPitch + x * bpp];
+                const uint8_t* actual = &swizzled[ReferenceOffset(x, y, z, width, height, depth) * bpp];
+                if (memcmp(expected, actual, bpp) != 0) {
+                    mismatches++;
+                }
+            }
+        }
+    }
+    CHECK_MSG(mismatches == 0, "swizzle %ux%ux%u, %u bytes per texel: %u texels differ", width, height, depth, bpp, mismatches);
+    for (uint32_t i = size; i < size + kPadding; i++) {
+        CHECK_MSG(swizzled[i] == kFill, "swizzle %ux%ux%u, %u bytes per texel: wrote past the end", width, height, depth, bpp);
+    }
+
+    // Swizzled to linear
+    std::vector<uint8_t> unswizzled(linear.size(), kFill);
+    if (depth == 1) {
+        UnswizzleRect(swizzled.data(), unswizzled.data(), rowPitch, width, height, bpp);
+    }
+    else {
+        UnswizzleBox(swizzled.data(), unswizzled.data(), rowPitch, slicePitch, width, height, depth, bpp);
+    }
+
+    mismatches = 0;
+    uint32_t padding = 0;
+    for (uint32_t z = 0; z < depth; z++) {
+        for (uint32_t y = 0; y < height; y++) {
+            const uint8_t* row = &unswizzled[z * slicePitch + y * rowPitch];
+            if (memcmp(row, &linear[z * slicePitch + y * rowPitch], width * bpp) != 0) {
+                mismatches++;
+            }
+            for (uint32_t i = width * bpp; i < rowPitch; i++) {
+                padding += row[i] != kFill;
+            }
+        }
+    }
+    CHECK_MSG(mismatches == 0, "unswizzle %ux%ux%u, %u bytes per texel: %u rows differ", width, height, depth, bpp, mismatches);
+    CHECK_MSG(padding == 0, "unswizzle %ux%ux%u, %u bytes per texel: wrote into the row padding", width, height, depth, bpp);
+}
+
+static void CheckTableCache() {
+    const SwizzleTables& a = SwizzleTables::Get(64, 32);
+    const SwizzleTables& b = SwizzleTables::Get(32, 64);
+    CHECK(&a != &b);
+    CHECK(&SwizzleTables::Get(64, 32) == &a);
+    CHECK(&SwizzleTables::Get(32, 64) == &b);
+    CHECK(&SwizzleTables::Get(64, 32, 2) != &a);
+    CHECK(a.x.size() == 64 && a.y.size() == 32 && a.z.size() == 1);
+}
+
+static void CheckCubeFaces() {
+    // 16x16 at 4 bytes per texel with 5 levels is 1364 bytes, rounded up to
+    // the face alignment
+    CHECK(GetCubeFaceStride(16, 16, 4, 5) == 1408);
+    CHECK(GetCubeFaceStride(16, 16, 4, 1) == 1024);
+    CHECK(GetCubeFaceStride(1, 1, 1, 1) == kCubeFaceAlignment);
+
+    const uint32_t size = 8;
+    const uint32_t faceStride = GetCubeFaceStride(size, size, 4, 1);
+    std::vector<uint8_t> linear(size * size * 4);
+    FillPattern(linear, 1234);
+    std::vector<uint8_t> cube(faceStride * 6, kFill);
+    SwizzleCubeFace(linear.data(), size * 4, cube.data(), 3, faceStride, 0, size, size, 4);
+    for (uint32_t i = 0; i < cube.size(); i++) {
+        if (i < faceStride * 3 || i >= faceStride * 3 + size * size * 4) {
+            CHECK_MSG(cube[i] == kFill, "cube face 3 wrote outside its face at byte %u", i);
+        }
+    }
+
+    std::vector<uint8_t> unswizzled(linear.size());
+    UnswizzleCubeFace(cube.data(), 3, faceStride, 0, unswizzled.data(), size * 4, size, size, 4);
+    CHECK(unswizzled == linear);
+}
+
+int main() {
+    for (uint32_t bpp : kTexelSizes) {
+        for (uint32_t height = 1; height <= kMaxRectSize; height <<= 1) {
+            for (uint32_t width = 1; width <= kMaxRectSize; width <<= 1) {
+                CheckBox(width, height, 1, bpp);
+            }
+        }
+        for (uint32_t depth = 2; depth <= kMaxBoxSize; depth <<= 1) {
+            for (uint32_t height = 1; height <= kMaxBoxSize; height <<= 1) {
+                for (uint32_t width = 1; width <= kMaxBoxSize; width <<= 1) {
+                    CheckBox(width, height, depth, bpp);
+                }
+            }
+        }
+    }
+
+    CheckTableCache();
+    CheckCubeFaces();
+
+    return strikebox::test::Result();
+}
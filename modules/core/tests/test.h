@@ -0,0 +1,44 @@
+// StrikeBox core unit test helpers
+// (C) Ivan "StrikerX3" Oliveira
+//
+// Tests are plain executables that exit with a non-zero status if any check
+// fails. Checks report the failing expression and keep going, so that one run
+// shows every failure.
+#pragma once
+
+#include <cstdio>
+
+namespace strikebox::test {
+
+inline int g_failures = 0;
+
+// Returns the process exit status for the checks run so far
+inline int Result() {
+    if (g_failures != 0) {
+        printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
+
+}
+
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+            ::strikebox::test::g_failures++; \
+        } \
+    } while (0)
+
+// Like CHECK, with a printf-style description of the case being checked
+#define CHECK_MSG(expr, ...) \
+    do { \
+        if (!(expr)) { \
+            printf("%s:%d: check failed: %s: ", __FILE__, __LINE__, #expr); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            ::strikebox::test::g_failures++; \
+        } \
+    } while (0)
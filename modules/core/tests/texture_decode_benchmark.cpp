@@ -0,0 +1,71 @@
+// Measures the throughput of the texture decoders in megatexels per second.
+//
+// Usage: texture-decode-benchmark [size] [milliseconds]
+// Each decoder converts a size x size image (1024 by default) repeatedly for
+// the given time (250 ms by default).
+#include "strikebox/hw/gpu/pgraph/texture.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace strikebox::nv2a;
+
+struct Benchmark {
+    const char* name;
+    TextureColorFormat format;
+};
+
+static const Benchmark kBenchmarks[] = {
+    { "DXT1", TextureColorFormat::L_DXT1_A1R5G5B5 },
+    { "DXT3", TextureColorFormat::L_DXT23_A8R8G8B8 },
+    { "DXT5", TextureColorFormat::L_DXT45_A8R8G8B8 },
+    { "I8 (paletted)", TextureColorFormat::SZ_I8_A8R8G8B8 },
+    { "A1R5G5B5", TextureColorFormat::LU_IMAGE_A1R5G5B5 },
+    { "X1R5G5B5", TextureColorFormat::LU_IMAGE_X1R5G5B5 },
+    { "A4R4G4B4", TextureColorFormat::LU_IMAGE_A4R4G4B4 },
+    { "R5G6B5", TextureColorFormat::LU_IMAGE_R5G6B5 },
+};
+
+int main(int argc, char* argv[]) {
+    const uint32_t size = (argc > 1) ? static_cast<uint32_t>(strtoul(argv[1], nullptr, 0)) : 1024;
+    const auto duration = std::chrono::milliseconds((argc > 2) ? strtoul(argv[2], nullptr, 0) : 250);
+    if (size < 4 || (size & 3) != 0) {
+        fprintf(stderr, "Size must be a multiple of 4\n");
+        return 1;
+    }
+
+    // Random texels exercise every DXT block mode
+    std::vector<uint8_t> src(static_cast<size_t>(size) * size * 4);
+    uint32_t state = 12345;
+    for (auto& byte : src) {
+        state = state * 1664525u + 1013904223u;
+        byte = static_cast<uint8_t>(state >> 24);
+    }
+    std::vector<uint32_t> palette(256);
+    for (uint32_t i = 0; i < 256; i++) {
+        palette[i] = 0xff000000 | (i * 0x010101);
+    }
+    std::vector<uint32_t> dst(static_cast<size_t>(size) * size);
+
+    printf("%ux%u texels, %lld ms per decoder\n", size, size, static_cast<long long>(duration.count()));
+    for (const Benchmark& benchmark : kBenchmarks) {
+        const TextureFormatInfo& info = GetTextureFormatInfo(static_cast<uint32_t>(benchmark.format));
+        const uint32_t pitch = info.compressed ? (size / 4) * info.bytesPerTexel : size * info.bytesPerTexel;
+
+        uint64_t iterations = 0;
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::steady_clock::duration::zero();
+        do {
+            info.decode(src.data(), pitch, dst.data(), size, size, palette.data());
+            iterations++;
+            elapsed = std::chrono::steady_clock::now() - start;
+        } while (elapsed < duration);
+
+        double seconds = std::chrono::duration<double>(elapsed).count();
+        double megatexels = static_cast<double>(iterations) * size * size / 1e6;
+        printf("%-16s %10.1f Mtexels/s\n", benchmark.name, megatexels / seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Checks the decoding of 8-bit and YUV texture formats and the rejection of
+// unsupported layouts
+#include "strikebox/hw/gpu/pgraph/texture.h"
+
+#include "test.h"
+
+#include <vector>
+
+using namespace strikebox::nv2a;
+
+static uint32_t Decode(TextureColorFormat format, const std::vector<uint8_t>& src, uint32_t width, uint32_t pitch, std::vector<uint32_t>& texels) {
+    TextureKey key;
+    key.format = static_cast<uint32_t>(format);
+    key.width = width;
+    key.height = 1;
+    key.depth = 1;
+    key.levels = 1;
+    key.pitch = pitch;
+    uint32_t size = GetTextureSourceSize(key);
+    Texture texture;
+    if (size != 0 && size <= src.size() && DecodeTexture(key, src.data(), nullptr, texture)) {
+        texels = texture.texels;
+    }
+    else {
+        texels.clear();
+    }
+    return size;
+}
+
+static void CheckLuminanceAndAlpha() {
+    const std::vector<uint8_t> src = { 0x00, 0x80, 0xff, 0x12 };
+    std::vector<uint32_t> texels;
+
+    Decode(TextureColorFormat::LU_IMAGE_Y8, src, 4, 4, texels);
+    CHECK(texels == std::vector<uint32_t>({ 0xff000000, 0xff808080, 0xffffffff, 0xff121212 }));
+
+    Decode(TextureColorFormat::LU_IMAGE_AY8, src, 4, 4, texels);
+    CHECK(texels == std::vector<uint32_t>({ 0x00000000, 0x80808080, 0xffffffff, 0x12121212 }));
+
+    Decode(TextureColorFormat::LU_IMAGE_A8, src, 4, 4, texels);
+    CHECK(texels == std::vector<uint32_t>({ 0x00ffffff, 0x80ffffff, 0xffffffff, 0x12ffffff }));
+
+    // Swizzled 2x2: texels are stored in the order (0,0), (1,0), (0,1), (1,1)
+    TextureKey key;
+    key.format = static_cast<uint32_t>(TextureColorFormat::SZ_Y8);
+    key.width = 2;
+    key.height = 2;
+    key.depth = 1;
+    key.levels = 1;
+    key.swizzled = true;
+    CHECK(GetTextureSourceSize(key) == 4);
+    Texture texture;
+    CHECK(DecodeTexture(key, src.data(), nullptr, texture));
+    CHECK(texture.texels == std::vector<uint32_t>({ 0xff000000, 0xff808080, 0xffffffff, 0xff121212 }));
+}
+
+static void CheckYUV() {
+    std::vector<uint32_t> texels;
+
+    // Studio range white and black, with neutral chroma
+    const std::vector<uint8_t> yuy2 = { 235, 128, 16, 128 };
+    CHECK(Decode(TextureColorFormat::LC_IMAGE_CR8YB8CB8YA8, yuy2, 2, 4, texels) == 4);
+    CHECK(texels == std::vector<uint32_t>({ 0xffffffff, 0xff000000 }));
+
+    const std::vector<uint8_t> uyvy = { 128, 235, 128, 16 };
+    CHECK(Decode(TextureColorFormat::LC_IMAGE_YB8CR8YA8CB8, uyvy, 2, 4, texels) == 4);
+    CHECK(texels == std::vector<uint32_t>({ 0xffffffff, 0xff000000 }));
+
+    // Saturated chroma clamps to pure colors
+    const std::vector<uint8_t> blue = { 41, 240, 41, 110 };
+    Decode(TextureColorFormat::LC_IMAGE_CR8YB8CB8YA8, blue, 2, 4, texels);
+    CHECK(texels.size() == 2 && (texels[0] & 0xff) >= 0xfe && ((texels[0] >> 16) & 0xff) <= 1);
+
+    // Odd widths need the whole last pair
+    const std::vector<uint8_t> odd = { 235, 128, 16, 128, 235, 128, 16, 128 };
+    CHECK(Decode(TextureColorFormat::LC_IMAGE_CR8YB8CB8YA8, odd, 3, 6, texels) == 0);
+    CHECK(Decode(TextureColorFormat::LC_IMAGE_CR8YB8CB8YA8, odd, 3, 8, texels) == 8);
+    CHECK(texels == std::vector<uint32_t>({ 0xffffffff, 0xff000000, 0xffffffff }));
+}
+
+static void CheckUnsupported() {
+    TextureKey key;
+    key.format = static_cast<uint32_t>(TextureColorFormat::L_DXT1_A1R5G5B5);
+    key.width = 16;
+    key.height = 16;
+    key.depth = 1;
+    key.levels = 1;
+    CHECK(GetTextureSourceSize(key) == 16 / 4 * 16 / 4 * 8);
+
+    key.depth = 4;
+    CHECK(GetTextureSourceSize(key) == 0);
+
+    key.format = 0xff;
+    key.depth = 1;
+    CHECK(GetTextureSourceSize(key) == 0);
+}
+
+int main() {
+    CheckLuminanceAndAlpha();
+    CheckYUV();
+    CheckUnsupported();
+
+    return strikebox::test::Result();
+}
@@ -0,0 +1,145 @@
+// Checks the fixed-point helpers and the pause, advance and scaling behavior
+// of the virtual clock.
+#include "strikebox/virtual_clock.h"
+
+#include "test.h"
+
+#include <random>
+#include <thread>
+
+using namespace strikebox;
+
+static uint64_t ReferenceMulShift32(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 32);
+#else
+    uint64_t high;
+    uint64_t low = _umul128(a, b, &high);
+    return __shiftright128(low, high, 32);
+#endif
+}
+
+static void CheckMulShift32() {
+    const uint64_t values[] = {
+        0, 1, 2, 0xFFFFFFFFull, 0x100000000ull, 0x100000001ull, 0x1FFFFFFFFull,
+        0x80000000ull, 0x8000000080000000ull, 0xFFFFFFFF00000000ull, 0x00000000FFFFFFFFull,
+        0xFFFFFFFFFFFFFFFFull, 0x7FFFFFFFFFFFFFFFull, 0x123456789ABCDEF0ull, 3375000ull << 20,
+    };
+    for (uint64_t a : values) {
+        for (uint64_t b : values) {
+            CHECK_MSG(MulShift32Portable(a, b) == ReferenceMulShift32(a, b), "a=%#llx b=%#llx",
+                (unsigned long long)a, (unsigned long long)b);
+            CHECK(MulShift32(a, b) == ReferenceMulShift32(a, b));
+        }
+    }
+
+    // Products whose middle partial sums carry into the upper word
+    std::mt19937_64 random(1234);
+    for (int i = 0; i < 100000; i++) {
+        uint64_t a = random();
+        uint64_t b = random();
+        if (i & 1) {
+            a |= 0xFFFFFFFFull;
+            b |= 0xFFFFFFFFull;
+        }
+        CHECK_MSG(MulShift32Portable(a, b) == ReferenceMulShift32(a, b), "a=%#llx b=%#llx",
+            (unsigned long long)a, (unsigned long long)b);
+    }
+}
+
+static void CheckTickRate() {
+    const uint64_t frequencies[] = { 3375000, 13500000, 233333333, 733333333, 1000000000, 2500000000ull };
+    for (uint64_t frequency : frequencies) {
+        TickRate rate(frequency);
+        CHECK(rate.GetFrequency() == frequency);
+        CHECK(rate.ToTicks(0) == 0);
+
+        // One second of virtual time is off by at most one tick
+        uint64_t ticks = rate.ToTicks(1000000000);
+        CHECK_MSG(ticks + 1 >= frequency && ticks <= frequency + 1, "%llu Hz: %llu ticks",
+            (unsigned long long)frequency, (unsigned long long)ticks);
+
+        // Conversions are monotonic
+        uint64_t last = 0;
+        for (uint64_t nanos = 0; nanos < 100000; nanos += 7) {
+            uint64_t current = rate.ToTicks(nanos);
+            CHECK(current >= last);
+            last = current;
+        }
+    }
+}
+
+static void CheckPauseAndAdvance() {
+    VirtualClock clock;
+
+    uint64_t last = clock.Now();
+    for (int i = 0; i < 1000; i++) {
+        uint64_t now = clock.Now();
+        CHECK(now >= last);
+        last = now;
+    }
+
+    clock.Pause();
+    CHECK(clock.IsPaused());
+    uint64_t paused = clock.Now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    CHECK(clock.Now() == paused);
+
+    // Advancing a paused clock moves it by exactly the given amount
+    clock.Advance(12345);
+    CHECK(clock.Now() == paused + 12345);
+    clock.Advance(1000000000);
+    CHECK(clock.Now() == paused + 12345 + 1000000000);
+
+    CHECK(clock.ToHostDuration(1000) == std::chrono::nanoseconds::max());
+
+    // Time resumes from where it was paused
+    uint64_t resumedFrom = clock.Now();
+    clock.Resume();
+    CHECK(!clock.IsPaused());
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    uint64_t resumed = clock.Now();
+    CHECK(resumed > resumedFrom);
+    CHECK(resumed < resumedFrom + 1000000000);
+
+    // Advancing a running clock never moves it backwards
+    clock.Advance(500000000);
+    CHECK(clock.Now() >= resumed + 500000000);
+}
+
+static void CheckScale() {
+    VirtualClock clock;
+    CHECK(clock.GetScale() == 1.0);
+    CHECK(clock.ToHostDuration(1000) == std::chrono::nanoseconds(1000));
+
+    clock.SetScale(2.0);
+    CHECK(clock.GetScale() == 2.0);
+    CHECK(clock.ToHostDuration(1000) == std::chrono::nanoseconds(500));
+
+    clock.SetScale(0.0);
+    CHECK(clock.GetScale() == 2.0);
+    clock.SetScale(-1.0);
+    CHECK(clock.GetScale() == 2.0);
+
+    clock.SetScale(0.5);
+    CHECK(clock.ToHostDuration(1000) == std::chrono::nanoseconds(2000));
+    CHECK(clock.ToHostDuration(~0ull) == std::chrono::nanoseconds::max());
+
+    // Half-speed time passes no faster than the host
+    uint64_t start = clock.Now();
+    auto hostStart = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    uint64_t elapsed = clock.Now() - start;
+    auto hostElapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - hostStart);
+    CHECK(elapsed > 0);
+    CHECK(elapsed <= static_cast<uint64_t>(hostElapsed.count()));
+}
+
+int main() {
+    CheckMulShift32();
+    CheckTickRate();
+    CheckPauseAndAdvance();
+    CheckScale();
+
+    return strikebox::test::Result();
+}